@@ -2,11 +2,11 @@
 
 #include "source/VulkanApp.h"
 
-int main()
+int main(int argc, char* argv[])
 {
     try
     {
-        VulkanApp app;
+        VulkanApp app(AppSettings::ParseCommandLine(argc, argv));
         app.Run();
     } catch (const std::exception& e)
     {
@@ -0,0 +1,31 @@
+#version 450
+
+// Depth prepass. Only the position stream is bound and there is no fragment shader, the pass just lays down the depth
+// the forward pass then tests against with EQUAL, so every pixel is shaded once
+#ifdef MULTIVIEW
+#extension GL_EXT_multiview : require
+#endif
+
+#ifndef VIEW_COUNT
+#define VIEW_COUNT 1
+#endif
+
+layout(binding = 0) uniform UniformBufferObject {
+    mat4 model;
+    mat4 proj;
+    mat4 view[VIEW_COUNT];
+} ubo;
+
+layout(location = 0) in vec3 inPosition;
+
+// Must come out bit for bit the same as in shader.vert, or the EQUAL test in the forward pass drops pixels
+invariant gl_Position;
+
+void main() {
+#ifdef MULTIVIEW
+    mat4 view = ubo.view[gl_ViewIndex];
+#else
+    mat4 view = ubo.view[0];
+#endif
+    gl_Position = ubo.proj * view * ubo.model * vec4(inPosition, 1.0);
+}
@@ -0,0 +1,57 @@
+#version 450
+
+// Fast approximate anti-aliasing over the resolved scene. Edges are found from the luma of the four diagonal
+// neighbours, and the pixel is blurred along the edge with two or four taps, keeping the wider blur only when it
+// stays inside the local luma range
+layout(set = 0, binding = 0) uniform sampler2D sceneColor;
+
+layout(push_constant) uniform PushConstants
+{
+    // One over the image size
+    vec2 texelSize;
+    // Half a texel inside the rendered area, so with dynamic resolution no tap reaches pixels of older frames
+    vec2 uvMax;
+} pc;
+
+layout(location = 0) out vec4 outColor;
+
+const float REDUCE_MIN = 1.0 / 128.0;
+const float REDUCE_MUL = 1.0 / 8.0;
+// Longest blur along an edge, in texels
+const float SPAN_MAX = 8.0;
+
+vec3 Sample(vec2 uv) {
+    return texture(sceneColor, min(uv, pc.uvMax)).rgb;
+}
+
+// The scene image is sRGB, so samples come back linear. Edges are judged on perceived brightness
+float Luma(vec3 color) {
+    return sqrt(dot(color, vec3(0.299, 0.587, 0.114)));
+}
+
+void main() {
+    // Pixels of the output line up with pixels of the scene image, whatever area the pass is recorded over
+    vec2 uv = gl_FragCoord.xy * pc.texelSize;
+
+    vec3 colorM = Sample(uv);
+    float lumaNW = Luma(Sample(uv + vec2(-1.0, -1.0) * pc.texelSize));
+    float lumaNE = Luma(Sample(uv + vec2(1.0, -1.0) * pc.texelSize));
+    float lumaSW = Luma(Sample(uv + vec2(-1.0, 1.0) * pc.texelSize));
+    float lumaSE = Luma(Sample(uv + vec2(1.0, 1.0) * pc.texelSize));
+    float lumaM = Luma(colorM);
+
+    float lumaMin = min(lumaM, min(min(lumaNW, lumaNE), min(lumaSW, lumaSE)));
+    float lumaMax = max(lumaM, max(max(lumaNW, lumaNE), max(lumaSW, lumaSE)));
+
+    // Perpendicular to the luma gradient, so along the edge
+    vec2 direction = vec2(-((lumaNW + lumaNE) - (lumaSW + lumaSE)), (lumaNW + lumaSW) - (lumaNE + lumaSE));
+    float directionReduce = max((lumaNW + lumaNE + lumaSW + lumaSE) * 0.25 * REDUCE_MUL, REDUCE_MIN);
+    float scale = 1.0 / (min(abs(direction.x), abs(direction.y)) + directionReduce);
+    direction = clamp(direction * scale, vec2(-SPAN_MAX), vec2(SPAN_MAX)) * pc.texelSize;
+
+    vec3 colorA = 0.5 * (Sample(uv + direction * (1.0 / 3.0 - 0.5)) + Sample(uv + direction * (2.0 / 3.0 - 0.5)));
+    vec3 colorB = colorA * 0.5 + 0.25 * (Sample(uv - direction * 0.5) + Sample(uv + direction * 0.5));
+    float lumaB = Luma(colorB);
+
+    outColor = vec4((lumaB < lumaMin || lumaB > lumaMax) ? colorA : colorB, 1.0);
+}
@@ -2,12 +2,103 @@
 
 layout(binding = 1) uniform sampler2D texSampler;
 
+// Permutation switches, set per pipeline through VkSpecializationInfo (see PipelineKey)
+layout(constant_id = 0) const bool USE_TEXTURE = true;
+layout(constant_id = 1) const bool USE_VERTEX_COLOR = false;
+layout(constant_id = 2) const bool ALPHA_TEST = false;
+layout(constant_id = 3) const float ALPHA_CUTOFF = 0.5;
+
 layout(location = 0) in vec3 fragColor;
 layout(location = 1) in vec2 fragTexCoord;
 
 layout(location = 0) out vec4 outColor;
 
+#ifdef CLUSTERED_LIGHTING
+// Written by ClusteredLighting and lightcull.comp, see there for the layout
+struct PointLight
+{
+    vec4 positionRadius;
+    vec4 colorIntensity;
+};
+
+layout(std430, binding = 2) readonly buffer Lights
+{
+    mat4 view;
+    vec4 projection;
+    uvec4 grid;
+    vec4 screen;
+    PointLight lights[];
+};
+
+layout(std430, binding = 3) readonly buffer LightGrid
+{
+    uvec2 cells[];
+};
+
+layout(std430, binding = 4) readonly buffer LightIndices
+{
+    uint lightIndexCount;
+    uint lightIndices[];
+};
+
+layout(location = 2) in vec3 fragWorldPos;
+
+// Keeps the parts no light reaches from going black
+const float AMBIENT = 0.1;
+
+// Only the lights of the fragment's cluster are visited, and a cluster never holds more than the cap lightcull.comp
+// was built with, however many lights there are
+vec3 ShadeLights(vec3 albedo)
+{
+    // The model has no normals, the face normal comes out of the position derivatives. Screen y points down, so this
+    // order faces the camera
+    const vec3 normal = normalize(cross(dFdy(fragWorldPos), dFdx(fragWorldPos)));
+
+    // Back from the [0, 1] depth of a perspective projection to the distance from the camera
+    const float near = projection.z;
+    const float far = projection.w;
+    const float depth = near * far / (far - gl_FragCoord.z * (far - near));
+    const uint slice = min(uint(max(log(depth / near) / log(far / near), 0.0) * float(grid.z)), grid.z - 1u);
+    const uvec2 tile = min(uvec2(gl_FragCoord.xy / screen.xy), grid.xy - 1u);
+    const uvec2 cell = cells[tile.x + (tile.y + slice * grid.y) * grid.x];
+
+    vec3 radiance = vec3(AMBIENT);
+    for (uint i = 0; i < cell.y; i++)
+    {
+        const PointLight light = lights[lightIndices[cell.x + i]];
+        const vec3 toLight = light.positionRadius.xyz - fragWorldPos;
+        const float distanceSquared = dot(toLight, toLight);
+
+        // Inverse square, windowed to reach zero at the radius the light was culled with
+        const float ratio = distanceSquared / (light.positionRadius.w * light.positionRadius.w);
+        const float window = clamp(1.0 - ratio * ratio, 0.0, 1.0);
+        const float attenuation = window * window / max(distanceSquared, 0.01);
+
+        const float lambert = max(dot(normal, toLight * inversesqrt(max(distanceSquared, 1.0e-8))), 0.0);
+        radiance += light.colorIntensity.rgb * light.colorIntensity.a * lambert * attenuation;
+    }
+    return albedo * radiance;
+}
+#endif
 
 void main() {
-    outColor = texture(texSampler, fragTexCoord);
-}
\ No newline at end of file
+    vec4 color = vec4(1.0);
+
+    if (USE_TEXTURE) {
+        color = texture(texSampler, fragTexCoord);
+    }
+
+    if (USE_VERTEX_COLOR) {
+        color.rgb *= fragColor;
+    }
+
+    if (ALPHA_TEST && color.a < ALPHA_CUTOFF) {
+        discard;
+    }
+
+#ifdef CLUSTERED_LIGHTING
+    color.rgb = ShadeLights(color.rgb);
+#endif
+
+    outColor = color;
+}
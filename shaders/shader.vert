@@ -1,9 +1,19 @@
 #version 450
 
+// Built with MULTIVIEW and VIEW_COUNT defined, one draw renders every view of the render pass and gl_ViewIndex
+// picks the camera
+#ifdef MULTIVIEW
+#extension GL_EXT_multiview : require
+#endif
+
+#ifndef VIEW_COUNT
+#define VIEW_COUNT 1
+#endif
+
 layout(binding = 0) uniform UniformBufferObject {
     mat4 model;
-    mat4 view;
     mat4 proj;
+    mat4 view[VIEW_COUNT];
 } ubo;
 
 layout(location = 0) in vec3 inPosition;
@@ -12,9 +22,19 @@ layout(location = 2) in vec2 inTexCoord;
 
 layout(location = 0) out vec3 fragColor;
 layout(location = 1) out vec2 fragTexCoord;
+layout(location = 2) out vec3 fragWorldPos;
+
+// The depth prepass (depth.vert) computes the same position, and the forward pass tests against it with EQUAL
+invariant gl_Position;
 
 void main() {
-    gl_Position = ubo.proj * ubo.view * ubo.model * vec4(inPosition, 1.0);
+#ifdef MULTIVIEW
+    mat4 view = ubo.view[gl_ViewIndex];
+#else
+    mat4 view = ubo.view[0];
+#endif
+    gl_Position = ubo.proj * view * ubo.model * vec4(inPosition, 1.0);
     fragColor = inColor;
     fragTexCoord = inTexCoord;
-}
\ No newline at end of file
+    fragWorldPos = (ubo.model * vec4(inPosition, 1.0)).xyz;
+}
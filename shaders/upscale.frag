@@ -0,0 +1,20 @@
+#version 450
+
+// Stretches the part of the scene image rendered this frame over the whole backbuffer, with bilinear filtering
+layout(set = 0, binding = 0) uniform sampler2D sceneColor;
+
+layout(push_constant) uniform PushConstants
+{
+    // Rendered size over image size
+    vec2 uvScale;
+    // Half a texel inside the rendered area, past it the filter would blend in pixels of older frames
+    vec2 uvMax;
+} pc;
+
+layout(location = 0) in vec2 fragTexCoord;
+
+layout(location = 0) out vec4 outColor;
+
+void main() {
+    outColor = texture(sceneColor, min(fragTexCoord * pc.uvScale, pc.uvMax));
+}
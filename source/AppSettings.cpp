@@ -0,0 +1,346 @@
+#include "AppSettings.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+
+namespace
+{
+    uint32_t ParseUnsigned(const std::string& flag, const char* value)
+    {
+        // stoul takes "-1" as a huge count and stops at the first non digit, both are typos rather than values
+        size_t pos = 0;
+        unsigned long parsed = 0;
+        try
+        {
+            parsed = std::stoul(value, &pos);
+        }
+        catch (const std::exception&)
+        {
+            pos = 0;
+        }
+        if (pos == 0 || pos != std::strlen(value) || std::strchr(value, '-') != nullptr || parsed > std::numeric_limits<uint32_t>::max())
+        {
+            throw std::runtime_error("invalid value '" + std::string(value) + "' for " + flag);
+        }
+        return static_cast<uint32_t>(parsed);
+    }
+
+    float ParseFloat(const std::string& flag, const char* value)
+    {
+        size_t pos = 0;
+        float parsed = 0.0f;
+        try
+        {
+            parsed = std::stof(value, &pos);
+        }
+        catch (const std::exception&)
+        {
+            pos = 0;
+        }
+        if (pos == 0 || pos != std::strlen(value))
+        {
+            throw std::runtime_error("invalid value '" + std::string(value) + "' for " + flag);
+        }
+        return parsed;
+    }
+}
+
+const char* GetAntiAliasingName(const AntiAliasing antiAliasing)
+{
+    switch (antiAliasing)
+    {
+    case AntiAliasing::None: return "none";
+    case AntiAliasing::Fxaa: return "fxaa";
+    case AntiAliasing::Msaa2: return "msaa2";
+    case AntiAliasing::Msaa4: return "msaa4";
+    case AntiAliasing::Msaa8: return "msaa8";
+    }
+    return "unknown";
+}
+
+AppSettings AppSettings::ParseCommandLine(const int argc, char* argv[])
+{
+    AppSettings settings;
+
+    for (int i = 1; i < argc; i++)
+    {
+        const std::string arg = argv[i];
+
+        // Every flag except the switches takes exactly one value
+        const auto nextValue = [&]() -> const char*
+        {
+            if (i + 1 >= argc)
+            {
+                throw std::runtime_error("missing value for " + arg);
+            }
+            return argv[++i];
+        };
+
+        if (arg == "--headless")
+        {
+            settings.headless = true;
+        }
+        else if (arg == "--width")
+        {
+            settings.width = ParseUnsigned(arg, nextValue());
+        }
+        else if (arg == "--height")
+        {
+            settings.height = ParseUnsigned(arg, nextValue());
+        }
+        else if (arg == "--frames")
+        {
+            settings.frameCount = ParseUnsigned(arg, nextValue());
+        }
+        else if (arg == "--views")
+        {
+            settings.views = ParseUnsigned(arg, nextValue());
+        }
+        else if (arg == "--camera-path")
+        {
+            settings.cameraPath = nextValue();
+        }
+        else if (arg == "--model")
+        {
+            settings.modelPath = nextValue();
+        }
+        else if (arg == "--readback")
+        {
+            settings.readback = true;
+        }
+        else if (arg == "--readback-dump")
+        {
+            settings.readback = true;
+            settings.readbackDumpDirectory = nextValue();
+        }
+        else if (arg == "--benchmark")
+        {
+            settings.benchmark = true;
+        }
+        else if (arg == "--duration")
+        {
+            settings.benchmark = true;
+            settings.benchmarkDuration = ParseFloat(arg, nextValue());
+        }
+        else if (arg == "--warmup")
+        {
+            settings.warmupFrames = ParseUnsigned(arg, nextValue());
+        }
+        else if (arg == "--report")
+        {
+            settings.benchmark = true;
+            settings.benchmarkReport = nextValue();
+        }
+        else if (arg == "--depth-prepass")
+        {
+            settings.depthPrepass = true;
+        }
+        else if (arg == "--occlusion-culling")
+        {
+            settings.depthPrepass = true;
+            settings.occlusionCulling = true;
+        }
+        else if (arg == "--dynamic-resolution")
+        {
+            settings.dynamicResolution = true;
+            settings.targetFrameTime = ParseFloat(arg, nextValue());
+        }
+        else if (arg == "--aa")
+        {
+            const std::string value = nextValue();
+            bool found = false;
+            for (const AntiAliasing antiAliasing : {AntiAliasing::None, AntiAliasing::Fxaa, AntiAliasing::Msaa2, AntiAliasing::Msaa4, AntiAliasing::Msaa8})
+            {
+                if (value == GetAntiAliasingName(antiAliasing))
+                {
+                    settings.antiAliasing = antiAliasing;
+                    found = true;
+                }
+            }
+            if (!found)
+            {
+                throw std::runtime_error("invalid value '" + value + "' for " + arg);
+            }
+        }
+        else if (arg == "--aa-sweep")
+        {
+            settings.benchmark = true;
+            settings.antiAliasingSweep = true;
+        }
+        else if (arg == "--lights")
+        {
+            settings.lightCount = ParseUnsigned(arg, nextValue());
+        }
+        else if (arg == "--draws")
+        {
+            settings.drawCount = ParseUnsigned(arg, nextValue());
+        }
+        else if (arg == "--reuse-command-buffers")
+        {
+            settings.reuseCommandBuffers = true;
+        }
+        else if (arg == "--command-buffer-benchmark")
+        {
+            settings.commandBufferBenchmark = true;
+        }
+        else if (arg == "--draw-sort-benchmark")
+        {
+            settings.drawSortBenchmark = true;
+        }
+        else if (arg == "--blit-mipmaps")
+        {
+            settings.blitMipmaps = true;
+        }
+        else if (arg == "--mip-benchmark")
+        {
+            settings.mipBenchmark = true;
+        }
+        else if (arg == "--threads")
+        {
+            settings.threadCount = ParseUnsigned(arg, nextValue());
+        }
+        else if (arg == "--job-benchmark")
+        {
+            settings.jobBenchmark = true;
+        }
+        else if (arg == "--capture")
+        {
+            settings.captureFile = nextValue();
+        }
+        else if (arg == "--replay")
+        {
+            settings.headless = true;
+            settings.replayFile = nextValue();
+        }
+        else if (arg == "--startup-report")
+        {
+            settings.startupReport = nextValue();
+        }
+        else if (arg == "--startup-memory")
+        {
+            settings.startupMemory = true;
+        }
+        else if (arg == "--trace")
+        {
+            settings.traceFile = nextValue();
+        }
+        else if (arg == "--help" || arg == "-h")
+        {
+            PrintUsage();
+            std::exit(EXIT_SUCCESS);
+        }
+        else
+        {
+            PrintUsage();
+            throw std::runtime_error("unknown argument " + arg);
+        }
+    }
+
+    if (settings.width == 0 || settings.height == 0)
+    {
+        throw std::runtime_error("--width and --height must be greater than zero");
+    }
+
+    if (settings.views == 0 || settings.views > MAX_VIEWS)
+    {
+        throw std::runtime_error("--views must be between 1 and " + std::to_string(MAX_VIEWS));
+    }
+
+    // The views end up in an image array, which a swap chain can't present
+    if (settings.views > 1 && !settings.headless)
+    {
+        throw std::runtime_error("--views needs --headless");
+    }
+
+    // Clusters are culled against a single camera
+    if (settings.occlusionCulling && settings.views > 1)
+    {
+        throw std::runtime_error("--occlusion-culling needs a single view");
+    }
+
+    // The upscale pass draws into a single layer
+    if (settings.dynamicResolution && settings.views > 1)
+    {
+        throw std::runtime_error("--dynamic-resolution needs a single view");
+    }
+
+    if (settings.dynamicResolution && settings.targetFrameTime <= 0.0f)
+    {
+        throw std::runtime_error("--dynamic-resolution needs a target frame time above zero");
+    }
+
+    if (settings.lightCount > MAX_LIGHTS)
+    {
+        throw std::runtime_error("--lights must be at most " + std::to_string(MAX_LIGHTS));
+    }
+
+    // Likewise the light clusters are built for one camera
+    if (settings.lightCount > 0 && settings.views > 1)
+    {
+        throw std::runtime_error("--lights needs a single view");
+    }
+
+    if (settings.drawCount == 0)
+    {
+        throw std::runtime_error("--draws must be greater than zero");
+    }
+
+    // A replay's inputs come from the capture, there is nothing live to record
+    if (!settings.captureFile.empty() && !settings.replayFile.empty())
+    {
+        throw std::runtime_error("--capture and --replay can't be used together");
+    }
+
+    // The FXAA pass draws into a single layer
+    if (settings.antiAliasing == AntiAliasing::Fxaa && settings.views > 1)
+    {
+        throw std::runtime_error("--aa fxaa needs a single view");
+    }
+
+    return settings;
+}
+
+void AppSettings::PrintUsage()
+{
+    std::cout <<
+        "Usage: NycsiRenderer [options]\n"
+        "  --headless            Render offscreen without a window or swap chain\n"
+        "  --width <pixels>      Render width (default 800)\n"
+        "  --height <pixels>     Render height (default 600)\n"
+        "  --frames <count>      Exit after this many frames (headless default: 1000)\n"
+        "  --views <count>       Render this many cameras around the model per frame, in one pass (headless, max 6)\n"
+        "  --camera-path <file>  Drive the camera from a file, one 'eye target' pair per line\n"
+        "  --model <file>        OBJ file to render (default models/viking_room.obj)\n"
+        "  --readback            Copy every frame back to the CPU and report the throughput\n"
+        "  --readback-dump <dir> Like --readback, and write each frame to <dir> as a .ppm\n"
+        "  --benchmark           Measure CPU, wait and GPU frame times and write a JSON report\n"
+        "  --duration <seconds>  Benchmark for this long instead of a frame count (implies --benchmark)\n"
+        "  --warmup <frames>     Frames rendered before measuring starts (default 60)\n"
+        "  --report <file>       Where the benchmark report goes (default benchmark.json, implies --benchmark)\n"
+        "  --depth-prepass       Render depth in a position only pass before shading\n"
+        "  --occlusion-culling   Cull clusters against a Hi-Z pyramid of the prepass depth (implies --depth-prepass)\n"
+        "  --dynamic-resolution <ms>\n"
+        "                        Lower the render resolution to keep the GPU frame time under <ms>, and upscale\n"
+        "  --aa <tier>           Anti-aliasing: none, fxaa, msaa2, msaa4 or msaa8 (default msaa4). Keys 1-5 switch it\n"
+        "  --aa-sweep            Benchmark every supported anti-aliasing tier in turn (implies --benchmark)\n"
+        "  --lights <count>      Shade with this many point lights through clustered lighting (max 4096)\n"
+        "  --draws <count>       Split the model into this many draws, at least one per material (default 1)\n"
+        "  --reuse-command-buffers\n"
+        "                        Record command buffers once and submit them again until the frame changes\n"
+        "  --command-buffer-benchmark\n"
+        "                        Time re-recording against reusing command buffers at 1k-100k draws, then exit\n"
+        "  --draw-sort-benchmark Time sorting 100k draws and count the binds the sorted order saves, then exit\n"
+        "  --blit-mipmaps        Generate texture mips with blits instead of the compute downsampler\n"
+        "  --mip-benchmark       Time blit and compute mip generation on 4K and 8K textures, then exit\n"
+        "  --threads <count>     Job system threads, counting the main thread (default: one per hardware thread)\n"
+        "  --job-benchmark       Time job spawning and the scaling of a fixed workload up to 64 threads, then exit\n"
+        "  --capture <file>      Record every frame's camera, time, draws and startup resources into <file>\n"
+        "  --replay <file>       Render the frames of a capture headless, with the capture's settings\n"
+        "  --startup-report <file>\n"
+        "                        Where the startup timings go as JSON (default startup.json)\n"
+        "  --startup-memory      Record the peak memory use after every startup step\n"
+        "  --trace <file>        Write a Chrome trace of the profiler zones (builds with NYCSI_PROFILE=1)\n";
+}
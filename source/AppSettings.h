@@ -0,0 +1,118 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+// Vulkan guarantees at least this many views in a multiview render pass (maxMultiviewViewCount)
+constexpr uint32_t MAX_VIEWS = 6;
+
+// Upper bound of --lights, the light buffers are sized for the count asked for
+constexpr uint32_t MAX_LIGHTS = 4096;
+
+// Anti-aliasing quality tiers, switchable at runtime. FXAA is a post-process over the single sampled scene, the MSAA
+// tiers multisample color and depth and resolve at the end of the forward pass
+enum class AntiAliasing
+{
+    None,
+    Fxaa,
+    Msaa2,
+    Msaa4,
+    Msaa8,
+};
+
+// The name --aa takes, also used in the benchmark report
+const char* GetAntiAliasingName(AntiAliasing antiAliasing);
+
+// Everything that can be changed from the command line. The defaults reproduce the interactive 800x600 window
+struct AppSettings
+{
+    // Render into offscreen images instead of a window. No GLFW, surface or swap chain is created
+    bool headless = false;
+    uint32_t width = 800;
+    uint32_t height = 600;
+
+    // Number of frames to render before exiting. 0 means until the window is closed, or the length of the camera path
+    uint32_t frameCount = 0;
+
+    // Cameras rendered per frame. Above 1 every view is drawn in the same multiview render pass into one layer of an
+    // image array, with the cameras spread evenly around the model. Headless only
+    uint32_t views = 1;
+
+    // Optional text file with one "eyeX eyeY eyeZ targetX targetY targetZ" camera per line, one line per frame
+    std::string cameraPath;
+
+    // OBJ file to render. Its material library and textures are looked up relative to it
+    std::string modelPath = "models/viking_room.obj";
+
+    // Copy every rendered frame back to the CPU and report the readback throughput
+    bool readback = false;
+    // When set, every read back frame is also written there as a .ppm image. Implies readback
+    std::string readbackDumpDirectory;
+
+    // Measure frame times instead of just rendering. The animation is driven by the frame number, so every run
+    // renders the same frames. Runs for benchmarkDuration seconds if set, frameCount frames otherwise
+    bool benchmark = false;
+    float benchmarkDuration = 0.0f;
+    // Rendered before measuring starts, so pipeline creation, shader compilation and first-use costs are excluded
+    uint32_t warmupFrames = 60;
+    std::string benchmarkReport = "benchmark.json";
+
+    // Lay down depth in a position only pass first, so the forward pass shades every pixel once
+    bool depthPrepass = false;
+    // Build a Hi-Z pyramid from the prepass depth and skip the clusters of the model it hides. Implies depthPrepass
+    bool occlusionCulling = false;
+
+    // Render the scene below the swap chain's resolution whenever the GPU takes longer than targetFrameTime
+    // milliseconds per frame, and upscale it. Single view only
+    bool dynamicResolution = false;
+    float targetFrameTime = 16.6f;
+
+    // Starting tier. MSAA tiers above what the device supports fall back to its highest sample count
+    AntiAliasing antiAliasing = AntiAliasing::Msaa4;
+    // Benchmark every tier the device supports in turn, each after its own warm-up, and report their GPU times side by side
+    bool antiAliasingSweep = false;
+
+    // Point lights orbiting the model, shaded with clustered forward lighting. 0 keeps the unlit texture
+    uint32_t lightCount = 0;
+
+    // Draws the model is split into, standing in for a scene of that many objects. Never fewer than one per material,
+    // and past one draw per triangle the draws start over at the first triangle
+    uint32_t drawCount = 1;
+    // Record one command buffer per frame in flight and swap chain image once, and submit it again every frame until
+    // the graph, a pipeline, the draws or the render area change
+    bool reuseCommandBuffers = false;
+    // Time recording every frame against reusing recorded command buffers at 1k, 10k and 100k draws, print the
+    // results and exit
+    bool commandBufferBenchmark = false;
+    // Time sorting 100k draws by state and depth, print the sort times and the binds saved and exit without rendering
+    bool drawSortBenchmark = false;
+
+    // Build texture mip chains with blits even where the compute downsampler could
+    bool blitMipmaps = false;
+    // Time the blit and compute mip chains of 4K and 8K textures, print the results and exit without rendering
+    bool mipBenchmark = false;
+
+    // Threads the job system runs on, counting the main thread. 0 means one per hardware thread
+    uint32_t threadCount = 0;
+    // Time spawning empty jobs and the speedup of a fixed workload from 1 to 64 threads, print the results and exit
+    // without rendering
+    bool jobBenchmark = false;
+
+    // Record the inputs of every frame, the camera, animation time, anti-aliasing tier, resolution and draws, along
+    // with the resources created at startup, into this file
+    std::string captureFile;
+    // Render a capture again instead of the live inputs, headless, so two builds render exactly the same frames. The
+    // capture decides the model, resolution and every setting that changes the workload
+    std::string replayFile;
+
+    // Where the startup timings are written as JSON once the first frame is submitted. Empty to only print them
+    std::string startupReport = "startup.json";
+    // Also record the process's peak memory use after every startup step
+    bool startupMemory = false;
+
+    // Write a Chrome trace of the CPU and GPU profiler zones here. Only available in builds with NYCSI_PROFILE=1
+    std::string traceFile;
+
+    static AppSettings ParseCommandLine(int argc, char* argv[]);
+    static void PrintUsage();
+};
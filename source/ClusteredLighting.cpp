@@ -0,0 +1,230 @@
+#include "ClusteredLighting.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <glm/common.hpp>
+#include <glm/gtc/constants.hpp>
+
+#include "LayoutCache.h"
+#include "ShaderCompiler.h"
+#include "ShaderReflection.h"
+
+void ClusteredLighting::Init(const VkDevice device, const VkPhysicalDevice physicalDevice, const uint32_t framesInFlight, const uint32_t lightCount,
+                             const ShaderCompiler& shaderCompiler, LayoutCache& layoutCache)
+{
+    vkDevice = device;
+    deviceMemory.Init(device, physicalDevice);
+
+    CreatePipeline(shaderCompiler, layoutCache);
+
+    // A fixed seed, so every run lights the scene the same way. The more lights, the smaller each one gets, which
+    // keeps the number of lights overlapping any point roughly the same
+    std::mt19937 random(1234);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    const float lightRadius = std::clamp(1.5f / std::cbrt(static_cast<float>(lightCount)), 0.15f, 1.5f);
+
+    orbits.resize(lightCount);
+    lights.resize(lightCount);
+    for (uint32_t i = 0; i < lightCount; i++)
+    {
+        orbits[i].radius = 0.1f + 1.1f * unit(random);
+        orbits[i].height = 0.05f + 0.75f * unit(random);
+        orbits[i].phase = 2.0f * glm::pi<float>() * unit(random);
+        orbits[i].speed = 2.0f * unit(random) - 1.0f;
+
+        glm::vec3 color(unit(random), unit(random), unit(random));
+        color /= std::max(std::max(color.r, color.g), std::max(color.b, 0.01f));
+        lights[i].positionRadius = glm::vec4(0.0f, 0.0f, 0.0f, lightRadius);
+        lights[i].colorIntensity = glm::vec4(color, 0.25f * lightRadius * lightRadius);
+    }
+
+    // The index list can hold a full cluster everywhere, so lightcull.comp never has to check for room
+    const VkDeviceSize lightBufferSize = sizeof(Header) + sizeof(PointLight) * std::max(lightCount, 1u);
+    const VkDeviceSize gridBufferSize = sizeof(uint32_t) * 2 * CLUSTER_COUNT;
+    const VkDeviceSize indexBufferSize = sizeof(uint32_t) * (1 + CLUSTER_COUNT * MAX_LIGHTS_PER_CLUSTER);
+
+    lightBuffers.resize(framesInFlight);
+    lightBuffersMemory.resize(framesInFlight);
+    lightBuffersMapped.resize(framesInFlight);
+    gridBuffers.resize(framesInFlight);
+    gridBuffersMemory.resize(framesInFlight);
+    indexBuffers.resize(framesInFlight);
+    indexBuffersMemory.resize(framesInFlight);
+    for (uint32_t frame = 0; frame < framesInFlight; frame++)
+    {
+        deviceMemory.CreateBuffer(lightBufferSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                                  lightBuffers[frame], lightBuffersMemory[frame], "light buffer");
+        vkMapMemory(vkDevice, lightBuffersMemory[frame], 0, lightBufferSize, 0, &lightBuffersMapped[frame]);
+        deviceMemory.CreateBuffer(gridBufferSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, gridBuffers[frame], gridBuffersMemory[frame], "light buffer");
+        deviceMemory.CreateBuffer(indexBufferSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                                  indexBuffers[frame], indexBuffersMemory[frame], "light buffer");
+    }
+
+    // The buffers never change, so the sets are written once
+    VkDescriptorPoolSize poolSize{VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, framesInFlight * 3};
+
+    VkDescriptorPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.poolSizeCount = 1;
+    poolInfo.pPoolSizes = &poolSize;
+    poolInfo.maxSets = framesInFlight;
+
+    if (vkCreateDescriptorPool(vkDevice, &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create descriptor pool!");
+    }
+
+    std::vector<VkDescriptorSetLayout> layouts(framesInFlight, setLayout);
+    VkDescriptorSetAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = descriptorPool;
+    allocInfo.descriptorSetCount = framesInFlight;
+    allocInfo.pSetLayouts = layouts.data();
+
+    descriptorSets.resize(framesInFlight);
+    if (vkAllocateDescriptorSets(vkDevice, &allocInfo, descriptorSets.data()) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to allocate descriptor sets!");
+    }
+
+    for (uint32_t frame = 0; frame < framesInFlight; frame++)
+    {
+        const std::array<VkDescriptorBufferInfo, 3> bufferInfos = GetFragmentBuffers(frame);
+
+        std::array<VkWriteDescriptorSet, 3> descriptorWrites{};
+        for (uint32_t binding = 0; binding < descriptorWrites.size(); binding++)
+        {
+            descriptorWrites[binding].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            descriptorWrites[binding].dstSet = descriptorSets[frame];
+            descriptorWrites[binding].dstBinding = binding;
+            descriptorWrites[binding].descriptorCount = 1;
+            descriptorWrites[binding].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            descriptorWrites[binding].pBufferInfo = &bufferInfos[binding];
+        }
+        vkUpdateDescriptorSets(vkDevice, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+    }
+}
+
+void ClusteredLighting::Cleanup()
+{
+    for (size_t frame = 0; frame < lightBuffers.size(); frame++)
+    {
+        vkDestroyBuffer(vkDevice, lightBuffers[frame], nullptr);
+        vkFreeMemory(vkDevice, lightBuffersMemory[frame], nullptr);
+        vkDestroyBuffer(vkDevice, gridBuffers[frame], nullptr);
+        vkFreeMemory(vkDevice, gridBuffersMemory[frame], nullptr);
+        vkDestroyBuffer(vkDevice, indexBuffers[frame], nullptr);
+        vkFreeMemory(vkDevice, indexBuffersMemory[frame], nullptr);
+    }
+    vkDestroyDescriptorPool(vkDevice, descriptorPool, nullptr);
+    vkDestroyPipeline(vkDevice, pipeline, nullptr);
+}
+
+void ClusteredLighting::Update(const uint32_t frame, const glm::mat4& view, const glm::mat4& proj, const VkExtent2D extent, const float time) const
+{
+    // Near and far come back out of the projection: proj[2][2] is far / (near - far) and proj[3][2] is
+    // -far * near / (far - near)
+    Header header{};
+    header.view = view;
+    header.projection = glm::vec4(proj[0][0], proj[1][1], proj[3][2] / proj[2][2], proj[3][2] / (proj[2][2] + 1.0f));
+    header.grid = glm::uvec4(GRID_X, GRID_Y, GRID_Z, GetLightCount());
+    header.screen = glm::vec4(static_cast<float>((extent.width + GRID_X - 1) / GRID_X), static_cast<float>((extent.height + GRID_Y - 1) / GRID_Y),
+                              static_cast<float>(extent.width), static_cast<float>(extent.height));
+
+    auto* data = static_cast<char*>(lightBuffersMapped[frame]);
+    memcpy(data, &header, sizeof(header));
+
+    auto* mappedLights = reinterpret_cast<PointLight*>(data + sizeof(header));
+    for (size_t i = 0; i < orbits.size(); i++)
+    {
+        const Orbit& orbit = orbits[i];
+        const float angle = orbit.phase + orbit.speed * time;
+        mappedLights[i].positionRadius = glm::vec4(orbit.radius * std::cos(angle), orbit.radius * std::sin(angle), orbit.height, lights[i].positionRadius.w);
+        mappedLights[i].colorIntensity = lights[i].colorIntensity;
+    }
+}
+
+void ClusteredLighting::Record(const VkCommandBuffer commandBuffer, const uint32_t frame) const
+{
+    // The index list is handed out from zero every frame
+    vkCmdFillBuffer(commandBuffer, indexBuffers[frame], 0, sizeof(uint32_t), 0);
+
+    VkMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+    vkCmdPipelineBarrier(commandBuffer,
+        VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+        1, &barrier,
+        0, nullptr,
+        0, nullptr);
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &descriptorSets[frame], 0, nullptr);
+    vkCmdDispatch(commandBuffer, GRID_X, GRID_Y, GRID_Z);
+
+    // The render graph only tracks images, so handing the lists to the forward pass is ours
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+    vkCmdPipelineBarrier(commandBuffer,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
+        1, &barrier,
+        0, nullptr,
+        0, nullptr);
+}
+
+std::array<VkDescriptorBufferInfo, 3> ClusteredLighting::GetFragmentBuffers(const uint32_t frame) const
+{
+    return
+    {{
+        {lightBuffers[frame], 0, VK_WHOLE_SIZE},
+        {gridBuffers[frame], 0, VK_WHOLE_SIZE},
+        {indexBuffers[frame], 0, VK_WHOLE_SIZE},
+    }};
+}
+
+void ClusteredLighting::CreatePipeline(const ShaderCompiler& shaderCompiler, LayoutCache& layoutCache)
+{
+    // The cap sizes a shared memory array, so it has to be known when the shader is compiled
+    const std::vector<uint32_t> code = shaderCompiler.Compile("shaders/lightcull.comp", shaderc_glsl_compute_shader,
+                                                              {{"MAX_LIGHTS_PER_CLUSTER", std::to_string(MAX_LIGHTS_PER_CLUSTER) + "u"}});
+
+    ShaderLayout shaderLayout;
+    ShaderReflection::Reflect(code, VK_SHADER_STAGE_COMPUTE_BIT, shaderLayout);
+    std::vector<VkDescriptorSetLayout> setLayouts;
+    pipelineLayout = layoutCache.GetPipelineLayout(shaderLayout, &setLayouts);
+    setLayout = setLayouts[0];
+
+    VkShaderModuleCreateInfo moduleInfo{};
+    moduleInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    moduleInfo.codeSize = code.size() * sizeof(uint32_t);
+    moduleInfo.pCode = code.data();
+
+    VkShaderModule shaderModule;
+    if (vkCreateShaderModule(vkDevice, &moduleInfo, nullptr, &shaderModule) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create shader module!");
+    }
+
+    VkComputePipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipelineInfo.stage.module = shaderModule;
+    pipelineInfo.stage.pName = "main";
+    pipelineInfo.layout = pipelineLayout;
+
+    const VkResult result = vkCreateComputePipelines(vkDevice, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &pipeline);
+    vkDestroyShaderModule(vkDevice, shaderModule, nullptr);
+
+    if (result != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create light culling pipeline!");
+    }
+}
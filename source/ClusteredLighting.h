@@ -0,0 +1,92 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <vector>
+#include <glm/mat4x4.hpp>
+#include <glm/vec4.hpp>
+#include <vulkan/vulkan.h>
+
+#include "DeviceMemory.h"
+
+class LayoutCache;
+class ShaderCompiler;
+
+// Clustered forward shading for many point lights. The view frustum is split into GRID_X x GRID_Y screen tiles by
+// GRID_Z depth slices, and every frame a compute pass (shaders/lightcull.comp) lists the lights touching each cluster
+// in one compact index list. shader.frag, built with CLUSTERED_LIGHTING, then only visits the lights of its own cluster,
+// at most MAX_LIGHTS_PER_CLUSTER of them, so its cost depends on how many lights overlap rather than on the total.
+class ClusteredLighting
+{
+public:
+    static constexpr uint32_t GRID_X = 16;
+    static constexpr uint32_t GRID_Y = 9;
+    static constexpr uint32_t GRID_Z = 24;
+    static constexpr uint32_t CLUSTER_COUNT = GRID_X * GRID_Y * GRID_Z;
+    static constexpr uint32_t MAX_LIGHTS_PER_CLUSTER = 128;
+
+    // Matches the PointLight struct of lightcull.comp and shader.frag, std430
+    struct PointLight
+    {
+        glm::vec4 positionRadius;
+        glm::vec4 colorIntensity;
+    };
+
+    // Scatters lightCount lights around the model, each on its own orbit
+    void Init(VkDevice device, VkPhysicalDevice physicalDevice, uint32_t framesInFlight, uint32_t lightCount,
+              const ShaderCompiler& shaderCompiler, LayoutCache& layoutCache);
+    void Cleanup();
+
+    // Moves the lights to where they are at this time and writes them, with the camera the clusters are built for,
+    // into the frame's light buffer. The frame's fence must have signaled
+    void Update(uint32_t frame, const glm::mat4& view, const glm::mat4& proj, VkExtent2D extent, float time) const;
+    // Recorded in the "LightCulling" pass. Leaves the cluster lists ready for the fragment shader
+    void Record(VkCommandBuffer commandBuffer, uint32_t frame) const;
+
+    // The light, grid and index buffers, for bindings 2, 3 and 4 of shader.frag
+    [[nodiscard]] std::array<VkDescriptorBufferInfo, 3> GetFragmentBuffers(uint32_t frame) const;
+    [[nodiscard]] uint32_t GetLightCount() const { return static_cast<uint32_t>(orbits.size()); }
+
+private:
+    // Matches the start of the Lights buffer, the lights follow
+    struct Header
+    {
+        glm::mat4 view;
+        glm::vec4 projection;
+        glm::uvec4 grid;
+        glm::vec4 screen;
+    };
+
+    struct Orbit
+    {
+        float radius;
+        float height;
+        float phase;
+        float speed;
+    };
+
+    VkDevice vkDevice = VK_NULL_HANDLE;
+    DeviceMemory deviceMemory;
+
+    // Owned by the layout cache
+    VkDescriptorSetLayout setLayout = VK_NULL_HANDLE;
+    VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+    VkPipeline pipeline = VK_NULL_HANDLE;
+
+    // Positions are animated from these, everything else about a light stays the same
+    std::vector<Orbit> orbits;
+    std::vector<PointLight> lights;
+
+    // One of each per frame in flight. The light buffers stay mapped and are rewritten by Update
+    std::vector<VkBuffer> lightBuffers;
+    std::vector<VkDeviceMemory> lightBuffersMemory;
+    std::vector<void*> lightBuffersMapped;
+    std::vector<VkBuffer> gridBuffers;
+    std::vector<VkDeviceMemory> gridBuffersMemory;
+    std::vector<VkBuffer> indexBuffers;
+    std::vector<VkDeviceMemory> indexBuffersMemory;
+    VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+    std::vector<VkDescriptorSet> descriptorSets;
+
+    void CreatePipeline(const ShaderCompiler& shaderCompiler, LayoutCache& layoutCache);
+};
@@ -0,0 +1,72 @@
+#include "DeletionQueue.h"
+
+void DeletionQueue::Init(const VkDevice device)
+{
+    vkDevice = device;
+}
+
+void DeletionQueue::Push(const uint64_t lastUsedFrame, const VkBuffer buffer)
+{
+    Push(lastUsedFrame, [buffer](const VkDevice device) { vkDestroyBuffer(device, buffer, nullptr); });
+}
+
+void DeletionQueue::Push(const uint64_t lastUsedFrame, const VkImage image)
+{
+    Push(lastUsedFrame, [image](const VkDevice device) { vkDestroyImage(device, image, nullptr); });
+}
+
+void DeletionQueue::Push(const uint64_t lastUsedFrame, const VkImageView imageView)
+{
+    Push(lastUsedFrame, [imageView](const VkDevice device) { vkDestroyImageView(device, imageView, nullptr); });
+}
+
+void DeletionQueue::Push(const uint64_t lastUsedFrame, const VkFramebuffer framebuffer)
+{
+    Push(lastUsedFrame, [framebuffer](const VkDevice device) { vkDestroyFramebuffer(device, framebuffer, nullptr); });
+}
+
+void DeletionQueue::Push(const uint64_t lastUsedFrame, const VkPipeline pipeline)
+{
+    Push(lastUsedFrame, [pipeline](const VkDevice device) { vkDestroyPipeline(device, pipeline, nullptr); });
+}
+
+void DeletionQueue::Push(const uint64_t lastUsedFrame, const VkSampler sampler)
+{
+    Push(lastUsedFrame, [sampler](const VkDevice device) { vkDestroySampler(device, sampler, nullptr); });
+}
+
+void DeletionQueue::Push(const uint64_t lastUsedFrame, const VkDeviceMemory memory)
+{
+    Push(lastUsedFrame, [memory](const VkDevice device) { vkFreeMemory(device, memory, nullptr); });
+}
+
+void DeletionQueue::Push(const uint64_t lastUsedFrame, const VkSwapchainKHR swapChain)
+{
+    Push(lastUsedFrame, [swapChain](const VkDevice device) { vkDestroySwapchainKHR(device, swapChain, nullptr); });
+}
+
+void DeletionQueue::Push(uint64_t lastUsedFrame, std::function<void(VkDevice)> deleter)
+{
+    // Frames only move forward, but if someone pushes for an older frame we simply keep it as long as the newest
+    // entry. Destroying a little late is always safe, destroying early never is
+    if (!entries.empty() && lastUsedFrame < entries.back().lastUsedFrame)
+    {
+        lastUsedFrame = entries.back().lastUsedFrame;
+    }
+
+    entries.push_back({lastUsedFrame, std::move(deleter)});
+}
+
+void DeletionQueue::Collect(const uint64_t completedFrame)
+{
+    while (!entries.empty() && entries.front().lastUsedFrame <= completedFrame)
+    {
+        entries.front().deleter(vkDevice);
+        entries.pop_front();
+    }
+}
+
+void DeletionQueue::Flush()
+{
+    Collect(UINT64_MAX);
+}
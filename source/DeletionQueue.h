@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <vulkan/vulkan.h>
+
+// Destroys Vulkan objects once the GPU can no longer be using them, without waiting for the device to go idle.
+// Every object is pushed with the number of the last frame that may reference it. Once the fence of that frame has
+// signaled, Collect() destroys it. Swapping an asset or evicting a streamed resource is then just a Push.
+class DeletionQueue
+{
+public:
+    void Init(VkDevice device);
+
+    void Push(uint64_t lastUsedFrame, VkBuffer buffer);
+    void Push(uint64_t lastUsedFrame, VkImage image);
+    void Push(uint64_t lastUsedFrame, VkImageView imageView);
+    void Push(uint64_t lastUsedFrame, VkFramebuffer framebuffer);
+    void Push(uint64_t lastUsedFrame, VkPipeline pipeline);
+    void Push(uint64_t lastUsedFrame, VkSampler sampler);
+    void Push(uint64_t lastUsedFrame, VkDeviceMemory memory);
+    void Push(uint64_t lastUsedFrame, VkSwapchainKHR swapChain);
+    // For anything else, e.g. objects owned by another module
+    void Push(uint64_t lastUsedFrame, std::function<void(VkDevice)> deleter);
+
+    // Destroys everything whose last frame is at or before completedFrame
+    void Collect(uint64_t completedFrame);
+    // Destroys everything. The device must be idle
+    void Flush();
+
+    [[nodiscard]] size_t GetPendingCount() const { return entries.size(); }
+
+private:
+    struct Entry
+    {
+        uint64_t lastUsedFrame;
+        std::function<void(VkDevice)> deleter;
+    };
+
+    VkDevice vkDevice = VK_NULL_HANDLE;
+    // Kept sorted by lastUsedFrame, so Collect only ever looks at the front
+    std::deque<Entry> entries;
+};
@@ -0,0 +1,68 @@
+#include "DeviceMemory.h"
+
+#include <stdexcept>
+#include <string>
+
+void DeviceMemory::Init(const VkDevice device, const VkPhysicalDevice physicalDevice)
+{
+    vkDevice = device;
+    vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+}
+
+std::optional<uint32_t> DeviceMemory::TryFindMemoryType(const uint32_t typeFilter, const VkMemoryPropertyFlags properties) const
+{
+    for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++)
+    {
+        if ((typeFilter & (1 << i)) && (memoryProperties.memoryTypes[i].propertyFlags & properties) == properties)
+        {
+            return i;
+        }
+    }
+
+    return std::nullopt;
+}
+
+uint32_t DeviceMemory::FindMemoryType(const uint32_t typeFilter, const VkMemoryPropertyFlags properties) const
+{
+    if (const std::optional<uint32_t> memoryType = TryFindMemoryType(typeFilter, properties))
+    {
+        return *memoryType;
+    }
+
+    throw std::runtime_error("failed to find suitable memory type!");
+}
+
+VkMemoryPropertyFlags DeviceMemory::GetPropertyFlags(const uint32_t memoryType) const
+{
+    return memoryProperties.memoryTypes[memoryType].propertyFlags;
+}
+
+void DeviceMemory::CreateBuffer(const VkDeviceSize size, const VkBufferUsageFlags usage, const VkMemoryPropertyFlags properties, VkBuffer& buffer,
+                                VkDeviceMemory& memory, const char* name) const
+{
+    VkBufferCreateInfo bufferInfo{};
+    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size = size;
+    bufferInfo.usage = usage;
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    if (vkCreateBuffer(vkDevice, &bufferInfo, nullptr, &buffer) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create " + std::string(name) + "!");
+    }
+
+    VkMemoryRequirements memRequirements;
+    vkGetBufferMemoryRequirements(vkDevice, buffer, &memRequirements);
+
+    VkMemoryAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocInfo.allocationSize = memRequirements.size;
+    allocInfo.memoryTypeIndex = FindMemoryType(memRequirements.memoryTypeBits, properties);
+
+    if (vkAllocateMemory(vkDevice, &allocInfo, nullptr, &memory) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to allocate " + std::string(name) + " memory!");
+    }
+
+    vkBindBufferMemory(vkDevice, buffer, memory, 0);
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <vulkan/vulkan.h>
+
+// The memory types of the physical device, and buffers with memory of their own. Every module creating buffers or
+// picking memory for its images goes through one of these, so there is a single search for a memory type
+class DeviceMemory
+{
+public:
+    void Init(VkDevice device, VkPhysicalDevice physicalDevice);
+
+    // The first type allowed by typeFilter that has all of properties
+    [[nodiscard]] std::optional<uint32_t> TryFindMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) const;
+    // Same, but throws if there is none
+    [[nodiscard]] uint32_t FindMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) const;
+    [[nodiscard]] VkMemoryPropertyFlags GetPropertyFlags(uint32_t memoryType) const;
+
+    // Allocates memory just for the buffer and binds it. name is what the errors call the buffer
+    void CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& memory,
+                      const char* name = "buffer") const;
+
+private:
+    VkDevice vkDevice = VK_NULL_HANDLE;
+    VkPhysicalDeviceMemoryProperties memoryProperties = {};
+};
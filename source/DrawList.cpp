@@ -0,0 +1,82 @@
+#include "DrawList.h"
+
+#include <algorithm>
+#include <array>
+
+namespace
+{
+    constexpr uint32_t RADIX_BITS = 8;
+    constexpr uint32_t BUCKET_COUNT = 1u << RADIX_BITS;
+    constexpr uint32_t PASS_COUNT = 64 / RADIX_BITS;
+
+    constexpr uint64_t FieldMask(const uint32_t bits)
+    {
+        return (1ull << bits) - 1;
+    }
+}
+
+static_assert(DrawList::PIPELINE_BITS + DrawList::MATERIAL_BITS + DrawList::MESH_BITS + DrawList::DEPTH_BITS == 64, "the sort key fields must fill 64 bits");
+
+uint64_t DrawList::MakeSortKey(const uint32_t pipeline, const uint32_t material, const uint32_t mesh, const float depth)
+{
+    const uint64_t quantizedDepth = static_cast<uint64_t>(std::clamp(depth, 0.0f, 1.0f) * static_cast<float>(FieldMask(DEPTH_BITS)));
+
+    return (pipeline & FieldMask(PIPELINE_BITS)) << (MATERIAL_BITS + MESH_BITS + DEPTH_BITS) |
+           (material & FieldMask(MATERIAL_BITS)) << (MESH_BITS + DEPTH_BITS) |
+           (mesh & FieldMask(MESH_BITS)) << DEPTH_BITS |
+           quantizedDepth;
+}
+
+void DrawList::Sort()
+{
+    if (items.size() < 2)
+        return;
+
+    // Every histogram in one pass over the keys
+    std::array<std::array<uint32_t, BUCKET_COUNT>, PASS_COUNT> histograms{};
+    for (const DrawItem& item : items)
+    {
+        for (uint32_t pass = 0; pass < PASS_COUNT; pass++)
+        {
+            histograms[pass][(item.sortKey >> (pass * RADIX_BITS)) & (BUCKET_COUNT - 1)]++;
+        }
+    }
+
+    scratch.resize(items.size());
+    for (uint32_t pass = 0; pass < PASS_COUNT; pass++)
+    {
+        const uint32_t shift = pass * RADIX_BITS;
+        std::array<uint32_t, BUCKET_COUNT>& histogram = histograms[pass];
+
+        // Most bytes are the same for every draw, e.g. the pipeline bits of a scene with a single pipeline. Such a
+        // pass wouldn't move anything
+        if (histogram[(items[0].sortKey >> shift) & (BUCKET_COUNT - 1)] == items.size())
+            continue;
+
+        uint32_t offset = 0;
+        for (uint32_t& count : histogram)
+        {
+            const uint32_t bucketSize = count;
+            count = offset;
+            offset += bucketSize;
+        }
+
+        for (const DrawItem& item : items)
+        {
+            scratch[histogram[(item.sortKey >> shift) & (BUCKET_COUNT - 1)]++] = item;
+        }
+        items.swap(scratch);
+    }
+}
+
+DrawList::BindCounts DrawList::CountBinds() const
+{
+    BindCounts counts;
+    for (size_t i = 0; i < items.size(); i++)
+    {
+        counts.pipelines += i == 0 || items[i].pipeline != items[i - 1].pipeline;
+        counts.materials += i == 0 || items[i].material != items[i - 1].material;
+        counts.meshes += i == 0 || items[i].mesh != items[i - 1].mesh;
+    }
+    return counts;
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// One draw of the frame. pipeline, material and mesh index the renderer's own state tables, and equal indices mean
+// equal state, which is all the recorder needs to tell which binds it can skip
+struct DrawItem
+{
+    uint64_t sortKey = 0;
+    uint32_t pipeline = 0;
+    uint32_t material = 0;
+    uint32_t mesh = 0;
+    uint32_t firstIndex = 0;
+    uint32_t indexCount = 0;
+    int32_t vertexOffset = 0;
+
+    bool operator==(const DrawItem& other) const = default;
+};
+
+// The draws of a frame, sorted so draws sharing state end up next to each other. The key packs, from the top bit
+// down, pipeline, material, mesh and quantized view depth, so pipeline changes are the rarest and draws with the same
+// state go front to back. Sorting is an LSD radix sort on the key, linear in the number of draws.
+class DrawList
+{
+public:
+    static constexpr uint32_t PIPELINE_BITS = 8;
+    static constexpr uint32_t MATERIAL_BITS = 16;
+    static constexpr uint32_t MESH_BITS = 16;
+    static constexpr uint32_t DEPTH_BITS = 24;
+
+    // Binds a recorder skipping redundant ones issues for the list in its current order
+    struct BindCounts
+    {
+        uint64_t pipelines = 0;
+        uint64_t materials = 0;
+        uint64_t meshes = 0;
+    };
+
+    // depth is the view depth over the far plane distance, clamped to [0, 1]. Ids wider than their field wrap around
+    [[nodiscard]] static uint64_t MakeSortKey(uint32_t pipeline, uint32_t material, uint32_t mesh, float depth);
+
+    void Clear() { items.clear(); }
+    void Add(const DrawItem& item) { items.push_back(item); }
+    // Adds count default draws and returns the first, so separate threads can fill in separate ranges of them
+    DrawItem* Append(size_t count)
+    {
+        items.resize(items.size() + count);
+        return items.data() + items.size() - count;
+    }
+    // Stable, so draws with equal keys keep the order they were added in
+    void Sort();
+
+    [[nodiscard]] const std::vector<DrawItem>& GetItems() const { return items; }
+    [[nodiscard]] BindCounts CountBinds() const;
+
+private:
+    std::vector<DrawItem> items;
+    // The other half of every radix pass, kept so sorting every frame doesn't allocate
+    std::vector<DrawItem> scratch;
+};
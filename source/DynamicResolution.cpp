@@ -0,0 +1,56 @@
+#include "DynamicResolution.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+    // Weight of the newest frame in the averaged full resolution time
+    constexpr double SMOOTHING = 0.1;
+    // Scale changes smaller than this are ignored, so the resolution doesn't flicker around the target
+    constexpr float DEAD_BAND = 0.02f;
+    // Largest change per frame, a sudden spike only drags the resolution down gradually
+    constexpr float MAX_STEP = 0.05f;
+}
+
+void DynamicResolution::Init(const VkDevice device, const VkRenderPass upscaleRenderPass, const double targetTime,
+                             const ShaderCompiler& shaderCompiler, LayoutCache& layoutCache)
+{
+    targetFrameTime = targetTime;
+    upscale.Init(device, upscaleRenderPass, "shaders/upscale.frag", VK_FILTER_LINEAR, shaderCompiler, layoutCache);
+}
+
+void DynamicResolution::Cleanup()
+{
+    upscale.Cleanup();
+}
+
+void DynamicResolution::AddGpuTime(const double milliseconds, const float frameScale)
+{
+    // GPU time roughly follows the pixel count, so every frame tells what full resolution would cost whatever scale
+    // it was rendered at. That keeps the frames still in flight at an older scale from pulling the controller around
+    const double fullTime = milliseconds / (static_cast<double>(frameScale) * frameScale);
+    fullResolutionTime = fullResolutionTime == 0.0 ? fullTime : fullResolutionTime + SMOOTHING * (fullTime - fullResolutionTime);
+
+    const float wanted = std::clamp(static_cast<float>(std::sqrt(targetFrameTime / fullResolutionTime)), MIN_SCALE, MAX_SCALE);
+    if (std::abs(wanted - scale) < DEAD_BAND && wanted != MIN_SCALE && wanted != MAX_SCALE)
+        return;
+
+    scale = std::clamp(wanted, scale - MAX_STEP, scale + MAX_STEP);
+}
+
+VkExtent2D DynamicResolution::GetRenderExtent(const VkExtent2D fullExtent) const
+{
+    return {std::max(static_cast<uint32_t>(std::lround(static_cast<float>(fullExtent.width) * scale)), 1u),
+            std::max(static_cast<uint32_t>(std::lround(static_cast<float>(fullExtent.height) * scale)), 1u)};
+}
+
+void DynamicResolution::RecordUpscale(const VkCommandBuffer commandBuffer, const VkExtent2D fullExtent, const VkExtent2D renderExtent) const
+{
+    const float width = static_cast<float>(fullExtent.width);
+    const float height = static_cast<float>(fullExtent.height);
+    const PushConstants pushConstants{static_cast<float>(renderExtent.width) / width, static_cast<float>(renderExtent.height) / height,
+                                      (static_cast<float>(renderExtent.width) - 0.5f) / width, (static_cast<float>(renderExtent.height) - 0.5f) / height};
+
+    upscale.Record(commandBuffer, fullExtent, &pushConstants, sizeof(pushConstants));
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstdint>
+#include <vulkan/vulkan.h>
+
+#include "FullscreenPass.h"
+
+// Trades resolution for frame time. The scene renders into the top left corner of images the size of the swap chain,
+// and a final pass (shaders/upscale.frag) stretches that corner over the backbuffer. A feedback loop on the GPU time
+// of completed frames picks the scale, so only the render area changes from frame to frame, never the images.
+class DynamicResolution
+{
+public:
+    static constexpr float MIN_SCALE = 0.5f;
+    static constexpr float MAX_SCALE = 1.0f;
+
+    // upscaleRenderPass is the render pass of the graph's "Upscale" pass, which the graph keeps across rebuilds
+    void Init(VkDevice device, VkRenderPass upscaleRenderPass, double targetFrameTime, const ShaderCompiler& shaderCompiler, LayoutCache& layoutCache);
+    void Cleanup();
+    [[nodiscard]] bool IsInitialized() const { return upscale.IsInitialized(); }
+
+    // Once the graph is compiled: the image the scene renders into. Retire hands it back before the next rebuild
+    void SetSceneView(VkImageView sceneView) { upscale.SetSource(sceneView); }
+    void Retire(DeletionQueue& deletionQueue, const uint64_t lastUsedFrame) { upscale.Retire(deletionQueue, lastUsedFrame); }
+
+    // Feeds the GPU time of a completed frame, rendered at frameScale, to the controller
+    void AddGpuTime(double milliseconds, float frameScale);
+    [[nodiscard]] float GetScale() const { return scale; }
+    // The part of a full size target the scene renders into at the current scale
+    [[nodiscard]] VkExtent2D GetRenderExtent(VkExtent2D fullExtent) const;
+
+    // Recorded in the "Upscale" pass, with the scene image in SHADER_READ_ONLY_OPTIMAL
+    void RecordUpscale(VkCommandBuffer commandBuffer, VkExtent2D fullExtent, VkExtent2D renderExtent) const;
+
+private:
+    struct PushConstants
+    {
+        float uvScaleX;
+        float uvScaleY;
+        float uvMaxX;
+        float uvMaxY;
+    };
+
+    FullscreenPass upscale;
+
+    double targetFrameTime = 16.6;
+    // What a frame would take at full resolution, averaged over the last frames
+    double fullResolutionTime = 0.0;
+    float scale = MAX_SCALE;
+};
@@ -0,0 +1,216 @@
+#include "FrameCapture.h"
+
+#include <cstring>
+#include <stdexcept>
+#include <type_traits>
+
+namespace
+{
+    constexpr char MAGIC[8] = {'N', 'Y', 'C', 'S', 'I', 'C', 'A', 'P'};
+    // Bump whenever the layout of anything below changes, old captures are refused rather than misread
+    constexpr uint32_t VERSION = 1;
+
+    enum class Record : uint8_t
+    {
+        Resource = 1,
+        Frame = 2,
+    };
+
+    template <typename T>
+    void Write(std::ofstream& file, const T& value)
+    {
+        static_assert(std::is_trivially_copyable_v<T>, "only plain data is written as is");
+        file.write(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    void WriteString(std::ofstream& file, const std::string& text)
+    {
+        Write(file, static_cast<uint32_t>(text.size()));
+        file.write(text.data(), static_cast<std::streamsize>(text.size()));
+    }
+
+    // false at the end of the file, an exception if a value is cut off halfway
+    template <typename T>
+    bool TryRead(std::ifstream& file, T& value)
+    {
+        static_assert(std::is_trivially_copyable_v<T>, "only plain data is read as is");
+        file.read(reinterpret_cast<char*>(&value), sizeof(T));
+        if (file.gcount() == 0)
+            return false;
+        if (file.gcount() != sizeof(T))
+        {
+            throw std::runtime_error("capture is truncated!");
+        }
+        return true;
+    }
+
+    template <typename T>
+    void Read(std::ifstream& file, T& value)
+    {
+        if (!TryRead(file, value))
+        {
+            throw std::runtime_error("capture is truncated!");
+        }
+    }
+
+    void ReadString(std::ifstream& file, std::string& text)
+    {
+        uint32_t size;
+        Read(file, size);
+        text.resize(size);
+        file.read(text.data(), size);
+        if (file.gcount() != size)
+        {
+            throw std::runtime_error("capture is truncated!");
+        }
+    }
+}
+
+void CaptureWriter::Open(const std::string& path, const CaptureSettings& settings)
+{
+    file.open(path, std::ios::binary | std::ios::trunc);
+    if (!file.is_open())
+    {
+        throw std::runtime_error("failed to write capture " + path + "!");
+    }
+
+    file.write(MAGIC, sizeof(MAGIC));
+    Write(file, VERSION);
+    WriteString(file, settings.modelPath);
+    Write(file, settings.views);
+    Write(file, settings.drawCount);
+    Write(file, settings.lightCount);
+    Write(file, settings.antiAliasing);
+    Write(file, settings.depthPrepass);
+    Write(file, settings.occlusionCulling);
+    Write(file, settings.dynamicResolution);
+    Write(file, settings.targetFrameTime);
+    Write(file, settings.reuseCommandBuffers);
+    Write(file, settings.blitMipmaps);
+}
+
+void CaptureWriter::Close()
+{
+    file.close();
+}
+
+void CaptureWriter::AddResource(const std::string& description)
+{
+    Write(file, Record::Resource);
+    WriteString(file, description);
+}
+
+void CaptureWriter::AddFrame(const CapturedFrame& frame, const std::vector<DrawItem>& draws)
+{
+    Write(file, Record::Frame);
+    Write(file, frame.animationTime);
+    Write(file, frame.model);
+    Write(file, static_cast<uint32_t>(frame.views.size()));
+    file.write(reinterpret_cast<const char*>(frame.views.data()), static_cast<std::streamsize>(sizeof(glm::mat4) * frame.views.size()));
+    Write(file, frame.proj);
+    Write(file, frame.width);
+    Write(file, frame.height);
+    Write(file, frame.renderWidth);
+    Write(file, frame.renderHeight);
+    Write(file, frame.antiAliasing);
+
+    const bool sameDraws = hasFrames && draws.size() == lastDraws.size() &&
+                           std::memcmp(draws.data(), lastDraws.data(), sizeof(DrawItem) * draws.size()) == 0;
+    Write(file, static_cast<uint8_t>(sameDraws ? 0 : 1));
+    if (!sameDraws)
+    {
+        Write(file, static_cast<uint32_t>(draws.size()));
+        file.write(reinterpret_cast<const char*>(draws.data()), static_cast<std::streamsize>(sizeof(DrawItem) * draws.size()));
+        lastDraws = draws;
+    }
+    hasFrames = true;
+}
+
+void CaptureReader::Load(const std::string& path)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open())
+    {
+        throw std::runtime_error("failed to open capture " + path + "!");
+    }
+
+    char magic[sizeof(MAGIC)] = {};
+    file.read(magic, sizeof(magic));
+    uint32_t version = 0;
+    if (file.gcount() != sizeof(magic) || std::memcmp(magic, MAGIC, sizeof(MAGIC)) != 0 || !TryRead(file, version) || version != VERSION)
+    {
+        throw std::runtime_error(path + " is not a capture of this version!");
+    }
+
+    ReadString(file, settings.modelPath);
+    Read(file, settings.views);
+    Read(file, settings.drawCount);
+    Read(file, settings.lightCount);
+    Read(file, settings.antiAliasing);
+    Read(file, settings.depthPrepass);
+    Read(file, settings.occlusionCulling);
+    Read(file, settings.dynamicResolution);
+    Read(file, settings.targetFrameTime);
+    Read(file, settings.reuseCommandBuffers);
+    Read(file, settings.blitMipmaps);
+
+    Record record;
+    while (TryRead(file, record))
+    {
+        if (record == Record::Resource)
+        {
+            std::string description;
+            ReadString(file, description);
+            resources.push_back(description);
+            continue;
+        }
+        if (record != Record::Frame)
+        {
+            throw std::runtime_error("capture " + path + " is corrupt!");
+        }
+
+        CapturedFrame frame;
+        Read(file, frame.animationTime);
+        Read(file, frame.model);
+        uint32_t viewCount;
+        Read(file, viewCount);
+        frame.views.resize(viewCount);
+        for (glm::mat4& view : frame.views)
+        {
+            Read(file, view);
+        }
+        Read(file, frame.proj);
+        Read(file, frame.width);
+        Read(file, frame.height);
+        Read(file, frame.renderWidth);
+        Read(file, frame.renderHeight);
+        Read(file, frame.antiAliasing);
+
+        // The first frame always has its draws, later ones only when they changed
+        uint8_t newDraws;
+        Read(file, newDraws);
+        if (newDraws == 0 && drawLists.empty())
+        {
+            throw std::runtime_error("capture " + path + " is corrupt!");
+        }
+        if (newDraws != 0)
+        {
+            uint32_t drawCount;
+            Read(file, drawCount);
+            std::vector<DrawItem>& draws = drawLists.emplace_back(drawCount);
+            const std::streamsize size = static_cast<std::streamsize>(sizeof(DrawItem) * drawCount);
+            file.read(reinterpret_cast<char*>(draws.data()), size);
+            if (file.gcount() != size)
+            {
+                throw std::runtime_error("capture is truncated!");
+            }
+        }
+        frame.drawList = static_cast<uint32_t>(drawLists.size() - 1);
+        frames.push_back(frame);
+    }
+
+    if (frames.empty())
+    {
+        throw std::runtime_error("capture " + path + " has no frames!");
+    }
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <glm/mat4x4.hpp>
+
+#include "AppSettings.h"
+#include "DrawList.h"
+
+// The settings a capture was made with that decide what gets created at startup and what every frame draws. A
+// replay runs with these instead of its own
+struct CaptureSettings
+{
+    std::string modelPath;
+    uint32_t views = 1;
+    uint32_t drawCount = 1;
+    uint32_t lightCount = 0;
+    AntiAliasing antiAliasing = AntiAliasing::None;
+    bool depthPrepass = false;
+    bool occlusionCulling = false;
+    bool dynamicResolution = false;
+    float targetFrameTime = 0.0f;
+    bool reuseCommandBuffers = false;
+    bool blitMipmaps = false;
+};
+
+// Everything a frame took from outside the renderer: the time and camera that drove the animation, the window size
+// and resolution scale, the anti-aliasing tier the keys picked, and the draws that went into the command buffer
+struct CapturedFrame
+{
+    float animationTime = 0.0f;
+    glm::mat4 model = glm::mat4(1.0f);
+    // One per view
+    std::vector<glm::mat4> views;
+    glm::mat4 proj = glm::mat4(1.0f);
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint32_t renderWidth = 0;
+    uint32_t renderHeight = 0;
+    AntiAliasing antiAliasing = AntiAliasing::None;
+    // Index for CaptureReader::GetDrawList. Consecutive frames with the same draws share one
+    uint32_t drawList = 0;
+};
+
+// Writes a capture as the app runs. The file is a header with the settings followed by one record per resource
+// created and per frame submitted, appended as they happen, so a run that ends early still leaves a usable capture.
+// A frame's draws are only written when they differ from the frame before, which is all a fixed camera needs, but a
+// moving camera reorders them every frame: at 100k draws that is over 3 MB a frame.
+class CaptureWriter
+{
+public:
+    void Open(const std::string& path, const CaptureSettings& settings);
+    void Close();
+    [[nodiscard]] bool IsOpen() const { return file.is_open(); }
+
+    // A line describing a texture, mesh or other resource, which a replay compares against what it creates
+    void AddResource(const std::string& description);
+    // frame.drawList is ignored, the writer works it out
+    void AddFrame(const CapturedFrame& frame, const std::vector<DrawItem>& draws);
+
+private:
+    std::ofstream file;
+    std::vector<DrawItem> lastDraws;
+    bool hasFrames = false;
+};
+
+// Reads a whole capture back into memory before the replay starts, so replaying never waits on the disk
+class CaptureReader
+{
+public:
+    void Load(const std::string& path);
+    [[nodiscard]] bool IsLoaded() const { return !frames.empty(); }
+
+    [[nodiscard]] const CaptureSettings& GetSettings() const { return settings; }
+    [[nodiscard]] const std::vector<std::string>& GetResources() const { return resources; }
+    [[nodiscard]] const std::vector<CapturedFrame>& GetFrames() const { return frames; }
+    [[nodiscard]] const std::vector<DrawItem>& GetDrawList(const uint32_t drawList) const { return drawLists[drawList]; }
+
+private:
+    CaptureSettings settings;
+    std::vector<std::string> resources;
+    std::vector<CapturedFrame> frames;
+    std::vector<std::vector<DrawItem>> drawLists;
+};
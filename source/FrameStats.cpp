@@ -0,0 +1,221 @@
+#include "FrameStats.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <numeric>
+#include <stdexcept>
+
+namespace
+{
+    // Nearest-rank percentile of an already sorted list
+    double Percentile(const std::vector<double>& sorted, const double percentile)
+    {
+        const size_t rank = static_cast<size_t>(std::ceil(percentile / 100.0 * static_cast<double>(sorted.size())));
+        return sorted[std::clamp<size_t>(rank, 1, sorted.size()) - 1];
+    }
+
+    void WriteSummary(std::ofstream& file, const char* name, const FrameStats::Summary& summary, const bool last)
+    {
+        file << "    \"" << name << "\": { "
+             << "\"count\": " << summary.count << ", "
+             << "\"mean\": " << summary.mean << ", "
+             << "\"p50\": " << summary.p50 << ", "
+             << "\"p95\": " << summary.p95 << ", "
+             << "\"p99\": " << summary.p99 << ", "
+             << "\"max\": " << summary.max << " }" << (last ? "\n" : ",\n");
+    }
+
+    void PrintSummary(const char* name, const FrameStats::Summary& summary)
+    {
+        std::cout << "  " << name << ": mean " << summary.mean << " ms, p50 " << summary.p50 << ", p95 " << summary.p95
+                  << ", p99 " << summary.p99 << ", max " << summary.max << '\n';
+    }
+}
+
+void FrameStats::AddFrame(const FrameTiming& timing)
+{
+    cpuFrameTimes.push_back(timing.cpuFrameTime);
+    fenceWaitTimes.push_back(timing.fenceWaitTime);
+    acquireWaitTimes.push_back(timing.acquireWaitTime);
+    recordTimes.push_back(timing.recordTime);
+}
+
+void FrameStats::AddGpuTime(const double milliseconds)
+{
+    gpuTimes.push_back(milliseconds);
+}
+
+void FrameStats::AddGpuTime(const double milliseconds, const std::string& variant)
+{
+    AddGpuTime(milliseconds);
+
+    auto it = std::find_if(variantGpuTimes.begin(), variantGpuTimes.end(), [&variant](const auto& entry) { return entry.first == variant; });
+    if (it == variantGpuTimes.end())
+    {
+        it = variantGpuTimes.emplace(variantGpuTimes.end(), variant, std::vector<double>());
+    }
+    it->second.push_back(milliseconds);
+}
+
+void FrameStats::AddCounters(const FrameCounters& frame)
+{
+    std::vector<std::pair<const char*, double>> values = {
+        {"draws", static_cast<double>(frame.draws)},
+        {"pipelineBinds", static_cast<double>(frame.pipelineBinds)},
+        {"descriptorSetBinds", static_cast<double>(frame.descriptorSetBinds)},
+        {"vertexBufferBinds", static_cast<double>(frame.vertexBufferBinds)},
+        {"skippedBinds", static_cast<double>(frame.skippedBinds)},
+        {"submittedTriangles", static_cast<double>(frame.submittedTriangles)},
+    };
+
+    if (frame.hasPipelineStatistics)
+    {
+        values.insert(values.end(), {
+            {"inputAssemblyVertices", static_cast<double>(frame.inputAssemblyVertices)},
+            {"inputAssemblyPrimitives", static_cast<double>(frame.inputAssemblyPrimitives)},
+            {"vertexShaderInvocations", static_cast<double>(frame.vertexShaderInvocations)},
+            {"clippingInvocations", static_cast<double>(frame.clippingInvocations)},
+            {"clippingPrimitives", static_cast<double>(frame.clippingPrimitives)},
+            {"fragmentShaderInvocations", static_cast<double>(frame.fragmentShaderInvocations)},
+        });
+    }
+
+    if (frame.hasCulling)
+    {
+        values.insert(values.end(), {
+            {"clusters", static_cast<double>(frame.clusters)},
+            {"frustumCulledClusters", static_cast<double>(frame.frustumCulledClusters)},
+            {"occlusionCulledClusters", static_cast<double>(frame.occlusionCulledClusters)},
+        });
+    }
+
+    if (frame.hasRenderScale)
+    {
+        values.push_back({"renderScale", frame.renderScale});
+    }
+
+    for (const auto& [name, value] : values)
+    {
+        auto it = std::find_if(counters.begin(), counters.end(), [name](const auto& counter)
+        {
+            return std::string(counter.first) == name;
+        });
+        if (it == counters.end())
+        {
+            counters.emplace_back(name, std::vector<double>{});
+            it = counters.end() - 1;
+        }
+        it->second.push_back(value);
+    }
+}
+
+void FrameStats::SetInfo(const std::string& key, const std::string& value)
+{
+    info.emplace_back(key, value);
+}
+
+FrameStats::Summary FrameStats::Summarize(std::vector<double> samples)
+{
+    Summary summary;
+    if (samples.empty())
+        return summary;
+
+    std::sort(samples.begin(), samples.end());
+
+    summary.count = samples.size();
+    summary.mean = std::accumulate(samples.begin(), samples.end(), 0.0) / static_cast<double>(samples.size());
+    summary.p50 = Percentile(samples, 50.0);
+    summary.p95 = Percentile(samples, 95.0);
+    summary.p99 = Percentile(samples, 99.0);
+    summary.max = samples.back();
+    return summary;
+}
+
+void FrameStats::WriteJson(const std::string& path, const double totalSeconds) const
+{
+    std::ofstream file(path);
+    if (!file.is_open())
+    {
+        throw std::runtime_error("failed to write benchmark report " + path + "!");
+    }
+
+    file << "{\n";
+    for (const auto& [key, value] : info)
+    {
+        file << "  \"" << EscapeJson(key) << "\": \"" << EscapeJson(value) << "\",\n";
+    }
+    file << "  \"frames\": " << cpuFrameTimes.size() << ",\n";
+    file << "  \"seconds\": " << totalSeconds << ",\n";
+    file << "  \"fps\": " << (totalSeconds > 0.0 ? static_cast<double>(cpuFrameTimes.size()) / totalSeconds : 0.0) << ",\n";
+
+    // Every metric is in milliseconds
+    file << "  \"metrics\": {\n";
+    WriteSummary(file, "cpuFrameTime", Summarize(cpuFrameTimes), false);
+    WriteSummary(file, "fenceWaitTime", Summarize(fenceWaitTimes), false);
+    WriteSummary(file, "acquireWaitTime", Summarize(acquireWaitTimes), false);
+    WriteSummary(file, "recordTime", Summarize(recordTimes), false);
+    WriteSummary(file, "gpuTime", Summarize(gpuTimes), true);
+    file << "  },\n";
+
+    // The GPU time again, split by variant
+    file << "  \"gpuTimeByVariant\": {\n";
+    for (size_t i = 0; i < variantGpuTimes.size(); i++)
+    {
+        WriteSummary(file, EscapeJson(variantGpuTimes[i].first).c_str(), Summarize(variantGpuTimes[i].second), i + 1 == variantGpuTimes.size());
+    }
+    file << "  },\n";
+
+    // Work per frame, as plain counts
+    file << "  \"counters\": {\n";
+    for (size_t i = 0; i < counters.size(); i++)
+    {
+        WriteSummary(file, counters[i].first, Summarize(counters[i].second), i + 1 == counters.size());
+    }
+    file << "  }\n";
+    file << "}\n";
+}
+
+void FrameStats::Print(const double totalSeconds) const
+{
+    std::cout << "Benchmark: " << cpuFrameTimes.size() << " frames in " << totalSeconds << " s ("
+              << (totalSeconds > 0.0 ? static_cast<double>(cpuFrameTimes.size()) / totalSeconds : 0.0) << " frames/s)" << '\n';
+    PrintSummary("CPU frame", Summarize(cpuFrameTimes));
+    PrintSummary("Fence wait", Summarize(fenceWaitTimes));
+    PrintSummary("Acquire wait", Summarize(acquireWaitTimes));
+    PrintSummary("Record", Summarize(recordTimes));
+    if (!gpuTimes.empty())
+    {
+        PrintSummary("GPU", Summarize(gpuTimes));
+    }
+    // One variant is just the GPU line again
+    if (variantGpuTimes.size() > 1)
+    {
+        for (const auto& [variant, samples] : variantGpuTimes)
+        {
+            PrintSummary(("GPU " + variant).c_str(), Summarize(samples));
+        }
+    }
+
+    for (const auto& [name, samples] : counters)
+    {
+        const Summary summary = Summarize(samples);
+        std::cout << "  " << name << ": mean " << summary.mean << ", max " << summary.max << '\n';
+    }
+}
+
+std::string FrameStats::EscapeJson(const std::string& text)
+{
+    std::string escaped;
+    escaped.reserve(text.size());
+    for (const char c : text)
+    {
+        if (c == '"' || c == '\\')
+        {
+            escaped += '\\';
+        }
+        escaped += c;
+    }
+    return escaped;
+}
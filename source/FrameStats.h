@@ -0,0 +1,100 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Timings of a single frame, in milliseconds
+struct FrameTiming
+{
+    // Whole loop iteration on the CPU, blocking included
+    double cpuFrameTime = 0.0;
+    // Time spent blocked in vkWaitForFences and vkAcquireNextImageKHR
+    double fenceWaitTime = 0.0;
+    double acquireWaitTime = 0.0;
+    // Recording the frame's command buffer, or picking the one recorded earlier when command buffers are reused
+    double recordTime = 0.0;
+};
+
+// How much work a frame did. The CPU side is counted while recording, the GPU side comes from a pipeline statistics
+// query around the frame's render passes and is only valid when hasPipelineStatistics is set
+struct FrameCounters
+{
+    uint64_t frameNumber = 0;
+
+    // Recorded commands
+    uint64_t draws = 0;
+    uint64_t pipelineBinds = 0;
+    uint64_t descriptorSetBinds = 0;
+    uint64_t vertexBufferBinds = 0;
+    // Binds the sorted draw list made unnecessary, against binding everything for every draw
+    uint64_t skippedBinds = 0;
+    uint64_t submittedTriangles = 0;
+
+    bool hasPipelineStatistics = false;
+    uint64_t inputAssemblyVertices = 0;
+    uint64_t inputAssemblyPrimitives = 0;
+    uint64_t vertexShaderInvocations = 0;
+    uint64_t clippingInvocations = 0;
+    uint64_t clippingPrimitives = 0;
+    uint64_t fragmentShaderInvocations = 0;
+
+    // GPU occlusion culling, read back with the pipeline statistics
+    bool hasCulling = false;
+    uint64_t clusters = 0;
+    uint64_t frustumCulledClusters = 0;
+    uint64_t occlusionCulledClusters = 0;
+
+    // Dynamic resolution: the fraction of the backbuffer's width and height the scene was rendered at
+    bool hasRenderScale = false;
+    double renderScale = 1.0;
+};
+
+// Collects frame timings during a benchmark and turns them into a JSON report. GPU times arrive separately, because
+// the timestamps of a frame can only be read a few frames after it was submitted
+class FrameStats
+{
+public:
+    struct Summary
+    {
+        size_t count = 0;
+        double mean = 0.0;
+        double p50 = 0.0;
+        double p95 = 0.0;
+        double p99 = 0.0;
+        double max = 0.0;
+    };
+
+    void AddFrame(const FrameTiming& timing);
+    void AddGpuTime(double milliseconds);
+    // Also files the GPU time under a variant of the renderer, e.g. the anti-aliasing tier the frame was rendered with,
+    // so runs that switch between variants report each one separately
+    void AddGpuTime(double milliseconds, const std::string& variant);
+    void AddCounters(const FrameCounters& counters);
+
+    // Free form "key": "value" pairs written at the top of the report (device, resolution, ...)
+    void SetInfo(const std::string& key, const std::string& value);
+
+    void WriteJson(const std::string& path, double totalSeconds) const;
+    void Print(double totalSeconds) const;
+
+    [[nodiscard]] size_t GetFrameCount() const { return cpuFrameTimes.size(); }
+
+    static Summary Summarize(std::vector<double> samples);
+
+private:
+    std::vector<std::pair<std::string, std::string>> info;
+    std::vector<double> cpuFrameTimes;
+    std::vector<double> fenceWaitTimes;
+    std::vector<double> acquireWaitTimes;
+    std::vector<double> recordTimes;
+    std::vector<double> gpuTimes;
+    // In the order the variants were first seen
+    std::vector<std::pair<std::string, std::vector<double>>> variantGpuTimes;
+
+    // One list of samples per FrameCounters field, in the order they are reported
+    std::vector<std::pair<const char*, std::vector<double>>> counters;
+
+    static std::string EscapeJson(const std::string& text);
+};
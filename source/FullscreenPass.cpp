@@ -0,0 +1,201 @@
+#include "FullscreenPass.h"
+
+#include <array>
+#include <stdexcept>
+#include <vector>
+
+#include "DeletionQueue.h"
+#include "LayoutCache.h"
+#include "ShaderCompiler.h"
+#include "ShaderReflection.h"
+
+void FullscreenPass::Init(const VkDevice device, const VkRenderPass renderPass, const char* fragmentShader, const VkFilter filter,
+                          const ShaderCompiler& shaderCompiler, LayoutCache& layoutCache)
+{
+    vkDevice = device;
+
+    CreatePipeline(renderPass, fragmentShader, shaderCompiler, layoutCache);
+
+    VkSamplerCreateInfo samplerInfo{};
+    samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    samplerInfo.magFilter = filter;
+    samplerInfo.minFilter = filter;
+    samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+
+    if (vkCreateSampler(vkDevice, &samplerInfo, nullptr, &sampler) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create post-processing sampler!");
+    }
+}
+
+void FullscreenPass::Cleanup()
+{
+    vkDestroySampler(vkDevice, sampler, nullptr);
+    vkDestroyPipeline(vkDevice, pipeline, nullptr);
+}
+
+void FullscreenPass::SetSource(const VkImageView source)
+{
+    VkDescriptorPoolSize poolSize{VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1};
+
+    VkDescriptorPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.poolSizeCount = 1;
+    poolInfo.pPoolSizes = &poolSize;
+    poolInfo.maxSets = 1;
+
+    if (vkCreateDescriptorPool(vkDevice, &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create descriptor pool!");
+    }
+
+    VkDescriptorSetAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = descriptorPool;
+    allocInfo.descriptorSetCount = 1;
+    allocInfo.pSetLayouts = &setLayout;
+
+    if (vkAllocateDescriptorSets(vkDevice, &allocInfo, &descriptorSet) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to allocate descriptor sets!");
+    }
+
+    const VkDescriptorImageInfo imageInfo{sampler, source, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+
+    VkWriteDescriptorSet descriptorWrite{};
+    descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptorWrite.dstSet = descriptorSet;
+    descriptorWrite.dstBinding = 0;
+    descriptorWrite.descriptorCount = 1;
+    descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    descriptorWrite.pImageInfo = &imageInfo;
+    vkUpdateDescriptorSets(vkDevice, 1, &descriptorWrite, 0, nullptr);
+}
+
+void FullscreenPass::Retire(DeletionQueue& deletionQueue, const uint64_t lastUsedFrame)
+{
+    // Destroying the pool frees its set
+    deletionQueue.Push(lastUsedFrame, [pool = descriptorPool](const VkDevice device)
+    {
+        vkDestroyDescriptorPool(device, pool, nullptr);
+    });
+
+    descriptorPool = VK_NULL_HANDLE;
+    descriptorSet = VK_NULL_HANDLE;
+}
+
+void FullscreenPass::Record(const VkCommandBuffer commandBuffer, const VkExtent2D extent, const void* pushConstants, const uint32_t pushConstantsSize) const
+{
+    const VkViewport viewport{0.0f, 0.0f, static_cast<float>(extent.width), static_cast<float>(extent.height), 0.0f, 1.0f};
+    vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+    const VkRect2D scissor{{0, 0}, extent};
+    vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSet, 0, nullptr);
+    if (pushConstantsSize > 0)
+    {
+        vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, pushConstantsSize, pushConstants);
+    }
+    vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+}
+
+void FullscreenPass::CreatePipeline(const VkRenderPass renderPass, const char* fragmentShader, const ShaderCompiler& shaderCompiler, LayoutCache& layoutCache)
+{
+    const std::vector<uint32_t> vertCode = shaderCompiler.Compile("shaders/fullscreen.vert", shaderc_glsl_vertex_shader);
+    const std::vector<uint32_t> fragCode = shaderCompiler.Compile(fragmentShader, shaderc_glsl_fragment_shader);
+
+    ShaderLayout shaderLayout;
+    ShaderReflection::Reflect(vertCode, VK_SHADER_STAGE_VERTEX_BIT, shaderLayout);
+    ShaderReflection::Reflect(fragCode, VK_SHADER_STAGE_FRAGMENT_BIT, shaderLayout);
+    std::vector<VkDescriptorSetLayout> setLayouts;
+    pipelineLayout = layoutCache.GetPipelineLayout(shaderLayout, &setLayouts);
+    setLayout = setLayouts[0];
+
+    std::array<VkShaderModule, 2> shaderModules{};
+    std::array<VkPipelineShaderStageCreateInfo, 2> shaderStages{};
+    const std::array<const std::vector<uint32_t>*, 2> codes = {&vertCode, &fragCode};
+    for (size_t i = 0; i < shaderStages.size(); i++)
+    {
+        VkShaderModuleCreateInfo moduleInfo{};
+        moduleInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+        moduleInfo.codeSize = codes[i]->size() * sizeof(uint32_t);
+        moduleInfo.pCode = codes[i]->data();
+
+        if (vkCreateShaderModule(vkDevice, &moduleInfo, nullptr, &shaderModules[i]) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create shader module!");
+        }
+
+        shaderStages[i].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        shaderStages[i].stage = i == 0 ? VK_SHADER_STAGE_VERTEX_BIT : VK_SHADER_STAGE_FRAGMENT_BIT;
+        shaderStages[i].module = shaderModules[i];
+        shaderStages[i].pName = "main";
+    }
+
+    // The triangle comes from the vertex index, there are no vertex buffers
+    VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
+    vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+
+    VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
+    inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+    inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+
+    VkPipelineViewportStateCreateInfo viewportState{};
+    viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+    viewportState.viewportCount = 1;
+    viewportState.scissorCount = 1;
+
+    VkPipelineRasterizationStateCreateInfo rasterizer{};
+    rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+    rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
+    rasterizer.lineWidth = 1.0f;
+    rasterizer.cullMode = VK_CULL_MODE_NONE;
+
+    VkPipelineMultisampleStateCreateInfo multisampling{};
+    multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+    multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+    VkPipelineColorBlendAttachmentState colorBlendAttachment{};
+    colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+
+    VkPipelineColorBlendStateCreateInfo colorBlending{};
+    colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+    colorBlending.attachmentCount = 1;
+    colorBlending.pAttachments = &colorBlendAttachment;
+
+    const std::array<VkDynamicState, 2> dynamicStates = {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
+    VkPipelineDynamicStateCreateInfo dynamicState{};
+    dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+    dynamicState.dynamicStateCount = static_cast<uint32_t>(dynamicStates.size());
+    dynamicState.pDynamicStates = dynamicStates.data();
+
+    VkGraphicsPipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    pipelineInfo.stageCount = static_cast<uint32_t>(shaderStages.size());
+    pipelineInfo.pStages = shaderStages.data();
+    pipelineInfo.pVertexInputState = &vertexInputInfo;
+    pipelineInfo.pInputAssemblyState = &inputAssembly;
+    pipelineInfo.pViewportState = &viewportState;
+    pipelineInfo.pRasterizationState = &rasterizer;
+    pipelineInfo.pMultisampleState = &multisampling;
+    pipelineInfo.pColorBlendState = &colorBlending;
+    pipelineInfo.pDynamicState = &dynamicState;
+    pipelineInfo.layout = pipelineLayout;
+    pipelineInfo.renderPass = renderPass;
+    pipelineInfo.subpass = 0;
+
+    const VkResult result = vkCreateGraphicsPipelines(vkDevice, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &pipeline);
+    for (const VkShaderModule shaderModule : shaderModules)
+    {
+        vkDestroyShaderModule(vkDevice, shaderModule, nullptr);
+    }
+
+    if (result != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create post-processing pipeline!");
+    }
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+#include <vulkan/vulkan.h>
+
+class DeletionQueue;
+class LayoutCache;
+class ShaderCompiler;
+
+// A post-processing pass: one triangle over the area it is recorded with (shaders/fullscreen.vert) and a fragment
+// shader that samples a single image at binding 0, with an optional push constant block. The upscale and FXAA passes
+// are both one of these.
+class FullscreenPass
+{
+public:
+    // renderPass is the render pass of the graph pass it is recorded in, which the graph keeps across rebuilds
+    void Init(VkDevice device, VkRenderPass renderPass, const char* fragmentShader, VkFilter filter,
+              const ShaderCompiler& shaderCompiler, LayoutCache& layoutCache);
+    // The source must have been retired already
+    void Cleanup();
+    [[nodiscard]] bool IsInitialized() const { return pipeline != VK_NULL_HANDLE; }
+
+    // Once the graph is compiled: points binding 0 at the image the pass reads. The set stays the same until the next
+    // rebuild, so command buffers recorded in between can be submitted again
+    void SetSource(VkImageView source);
+    // Hands the source's descriptor pool to the deletion queue, ready for the next SetSource
+    void Retire(DeletionQueue& deletionQueue, uint64_t lastUsedFrame);
+
+    // Draws over extent with the source in SHADER_READ_ONLY_OPTIMAL
+    void Record(VkCommandBuffer commandBuffer, VkExtent2D extent, const void* pushConstants, uint32_t pushConstantsSize) const;
+
+private:
+    VkDevice vkDevice = VK_NULL_HANDLE;
+    VkSampler sampler = VK_NULL_HANDLE;
+    // Layouts owned by the layout cache
+    VkDescriptorSetLayout setLayout = VK_NULL_HANDLE;
+    VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+    VkPipeline pipeline = VK_NULL_HANDLE;
+    // Replaced by SetSource
+    VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+    VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+
+    void CreatePipeline(VkRenderPass renderPass, const char* fragmentShader, const ShaderCompiler& shaderCompiler, LayoutCache& layoutCache);
+};
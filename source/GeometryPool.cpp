@@ -0,0 +1,203 @@
+#include "GeometryPool.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <stdexcept>
+
+void GeometryPool::Init(const VkDevice device, const VkPhysicalDevice physicalDevice, const VkDeviceSize stride, const uint32_t vertices,
+                        const uint32_t indices, const bool positions)
+{
+    vkDevice = device;
+    deviceMemory.Init(device, physicalDevice);
+    vertexStride = stride;
+    vertexCapacity = vertices;
+    indexCapacity = indices;
+
+    // Storage usage too, so compute passes can read the geometry the indirect draws point at
+    deviceMemory.CreateBuffer(vertexStride * vertexCapacity, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                              VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, vertexBuffer, vertexBufferMemory, "geometry buffer");
+    deviceMemory.CreateBuffer(sizeof(uint32_t) * indexCapacity, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                              VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, indexBuffer, indexBufferMemory, "geometry buffer");
+    if (positions)
+    {
+        deviceMemory.CreateBuffer(sizeof(glm::vec3) * vertexCapacity, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+                                  VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, positionBuffer, positionBufferMemory, "geometry buffer");
+    }
+
+    vertexSpace.Reset(vertexCapacity);
+    indexSpace.Reset(indexCapacity);
+}
+
+void GeometryPool::Cleanup()
+{
+    ReleaseStaging();
+
+    vkDestroyBuffer(vkDevice, vertexBuffer, nullptr);
+    vkFreeMemory(vkDevice, vertexBufferMemory, nullptr);
+    vkDestroyBuffer(vkDevice, indexBuffer, nullptr);
+    vkFreeMemory(vkDevice, indexBufferMemory, nullptr);
+    vkDestroyBuffer(vkDevice, positionBuffer, nullptr);
+    vkFreeMemory(vkDevice, positionBufferMemory, nullptr);
+}
+
+uint32_t GeometryPool::AddMesh(const VkCommandBuffer commandBuffer, const void* vertexData, const glm::vec3* positions, const uint32_t vertexCount,
+                               const uint32_t* indexData, const uint32_t indexCount)
+{
+    const std::optional<uint32_t> firstVertex = vertexSpace.Allocate(vertexCount);
+    if (!firstVertex)
+    {
+        throw std::runtime_error("geometry pool is out of vertex space!");
+    }
+    const std::optional<uint32_t> firstIndex = indexSpace.Allocate(indexCount);
+    if (!firstIndex)
+    {
+        vertexSpace.Free(*firstVertex, vertexCount);
+        throw std::runtime_error("geometry pool is out of index space!");
+    }
+
+    // One staging buffer for every stream, back to back
+    const VkDeviceSize vertexSize = vertexStride * vertexCount;
+    const VkDeviceSize indexSize = sizeof(uint32_t) * indexCount;
+    const VkDeviceSize positionSize = positionBuffer != VK_NULL_HANDLE ? sizeof(glm::vec3) * vertexCount : 0;
+
+    VkBuffer stagingBuffer;
+    VkDeviceMemory stagingBufferMemory;
+    deviceMemory.CreateBuffer(vertexSize + indexSize + positionSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                              stagingBuffer, stagingBufferMemory, "geometry buffer");
+    stagingBuffers.push_back(stagingBuffer);
+    stagingBuffersMemory.push_back(stagingBufferMemory);
+
+    void* data;
+    vkMapMemory(vkDevice, stagingBufferMemory, 0, vertexSize + indexSize + positionSize, 0, &data);
+    memcpy(data, vertexData, static_cast<size_t>(vertexSize));
+    memcpy(static_cast<char*>(data) + vertexSize, indexData, static_cast<size_t>(indexSize));
+    if (positionSize > 0)
+    {
+        memcpy(static_cast<char*>(data) + vertexSize + indexSize, positions, static_cast<size_t>(positionSize));
+    }
+    vkUnmapMemory(vkDevice, stagingBufferMemory);
+
+    const VkBufferCopy vertexCopy{0, vertexStride * *firstVertex, vertexSize};
+    vkCmdCopyBuffer(commandBuffer, stagingBuffer, vertexBuffer, 1, &vertexCopy);
+    const VkBufferCopy indexCopy{vertexSize, sizeof(uint32_t) * *firstIndex, indexSize};
+    vkCmdCopyBuffer(commandBuffer, stagingBuffer, indexBuffer, 1, &indexCopy);
+    if (positionSize > 0)
+    {
+        const VkBufferCopy positionCopy{vertexSize + indexSize, sizeof(glm::vec3) * *firstVertex, positionSize};
+        vkCmdCopyBuffer(commandBuffer, stagingBuffer, positionBuffer, 1, &positionCopy);
+    }
+
+    // Covers every buffer of the pool, later draws may read any of them
+    VkMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer,
+        VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+        1, &barrier,
+        0, nullptr,
+        0, nullptr);
+
+    Mesh mesh;
+    mesh.firstIndex = *firstIndex;
+    mesh.indexCount = indexCount;
+    mesh.vertexOffset = static_cast<int32_t>(*firstVertex);
+    mesh.vertexCount = vertexCount;
+
+    if (freeMeshIds.empty())
+    {
+        meshes.push_back(mesh);
+        return static_cast<uint32_t>(meshes.size() - 1);
+    }
+    const uint32_t id = freeMeshIds.back();
+    freeMeshIds.pop_back();
+    meshes[id] = mesh;
+    return id;
+}
+
+void GeometryPool::RemoveMesh(const uint32_t id)
+{
+    Mesh& mesh = meshes[id];
+    vertexSpace.Free(static_cast<uint32_t>(mesh.vertexOffset), mesh.vertexCount);
+    indexSpace.Free(mesh.firstIndex, mesh.indexCount);
+    mesh = {};
+    freeMeshIds.push_back(id);
+}
+
+void GeometryPool::ReleaseStaging()
+{
+    for (size_t i = 0; i < stagingBuffers.size(); i++)
+    {
+        vkDestroyBuffer(vkDevice, stagingBuffers[i], nullptr);
+        vkFreeMemory(vkDevice, stagingBuffersMemory[i], nullptr);
+    }
+    stagingBuffers.clear();
+    stagingBuffersMemory.clear();
+}
+
+void GeometryPool::Bind(const VkCommandBuffer commandBuffer, const bool positionsOnly) const
+{
+    constexpr VkDeviceSize offset = 0;
+    vkCmdBindVertexBuffers(commandBuffer, 0, 1, positionsOnly ? &positionBuffer : &vertexBuffer, &offset);
+    vkCmdBindIndexBuffer(commandBuffer, indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+}
+
+void GeometryPool::FreeList::Reset(const uint32_t capacity)
+{
+    ranges.clear();
+    ranges.push_back({0, capacity});
+}
+
+std::optional<uint32_t> GeometryPool::FreeList::Allocate(const uint32_t count)
+{
+    const auto it = std::find_if(ranges.begin(), ranges.end(), [count](const Range& range) { return range.count >= count; });
+    if (it == ranges.end())
+        return std::nullopt;
+
+    const uint32_t first = it->first;
+    it->first += count;
+    it->count -= count;
+    if (it->count == 0)
+    {
+        ranges.erase(it);
+    }
+    return first;
+}
+
+void GeometryPool::FreeList::Free(const uint32_t first, const uint32_t count)
+{
+    if (count == 0)
+        return;
+
+    // The range goes back in order, merged with the free ranges right before and after it
+    auto next = std::lower_bound(ranges.begin(), ranges.end(), first, [](const Range& range, const uint32_t value) { return range.first < value; });
+    if (next != ranges.begin() && std::prev(next)->first + std::prev(next)->count == first)
+    {
+        const auto previous = std::prev(next);
+        previous->count += count;
+        if (next != ranges.end() && previous->first + previous->count == next->first)
+        {
+            previous->count += next->count;
+            ranges.erase(next);
+        }
+        return;
+    }
+    if (next != ranges.end() && first + count == next->first)
+    {
+        next->first = first;
+        next->count += count;
+        return;
+    }
+    ranges.insert(next, {first, count});
+}
+
+uint32_t GeometryPool::FreeList::GetFreeCount() const
+{
+    uint32_t count = 0;
+    for (const Range& range : ranges)
+    {
+        count += range.count;
+    }
+    return count;
+}
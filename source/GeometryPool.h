@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <vector>
+#include <glm/vec3.hpp>
+#include <vulkan/vulkan.h>
+
+#include "DeviceMemory.h"
+
+// Every mesh's vertices and indices, suballocated from one large vertex buffer and one large index buffer. A mesh is
+// addressed by its firstIndex and vertexOffset, the same fields as VkDrawIndexedIndirectCommand, so the buffers are
+// bound once per pass and any mix of meshes can go into a single multi-draw indirect. Space is handed out by a
+// first-fit free list per buffer, and freed ranges merge with their neighbours.
+class GeometryPool
+{
+public:
+    struct Mesh
+    {
+        uint32_t firstIndex = 0;
+        uint32_t indexCount = 0;
+        int32_t vertexOffset = 0;
+        uint32_t vertexCount = 0;
+    };
+
+    // vertexStride is the size of one vertex. With positions, a tightly packed copy of every vertex position is kept
+    // in a third buffer at the same offsets, for passes that read nothing else
+    void Init(VkDevice device, VkPhysicalDevice physicalDevice, VkDeviceSize vertexStride, uint32_t vertexCapacity, uint32_t indexCapacity, bool positions);
+    // No command buffer drawing from the pool may still be pending
+    void Cleanup();
+
+    // Records the copy of a mesh into the pool, ready for VERTEX_INPUT once commandBuffer has executed. positions must
+    // be given when the pool keeps them, and is ignored otherwise. Indices are relative to the mesh's first vertex.
+    // Returns the mesh id
+    uint32_t AddMesh(VkCommandBuffer commandBuffer, const void* vertexData, const glm::vec3* positions, uint32_t vertexCount,
+                     const uint32_t* indexData, uint32_t indexCount);
+    // Gives the mesh's ranges back to the free lists. No command buffer drawing it may still be pending
+    void RemoveMesh(uint32_t mesh);
+    // Frees the staging buffers of every AddMesh so far. Their command buffers must have completed
+    void ReleaseStaging();
+
+    [[nodiscard]] const Mesh& GetMesh(uint32_t mesh) const { return meshes[mesh]; }
+    // Binds the index buffer and either the vertex buffer or the position buffer at binding 0
+    void Bind(VkCommandBuffer commandBuffer, bool positionsOnly) const;
+
+    [[nodiscard]] uint32_t GetUsedVertices() const { return vertexCapacity - vertexSpace.GetFreeCount(); }
+    [[nodiscard]] uint32_t GetUsedIndices() const { return indexCapacity - indexSpace.GetFreeCount(); }
+
+private:
+    // Free ranges of one buffer, in elements, sorted by their first element
+    class FreeList
+    {
+    public:
+        void Reset(uint32_t capacity);
+        // First fit. Empty when no free range is large enough
+        [[nodiscard]] std::optional<uint32_t> Allocate(uint32_t count);
+        void Free(uint32_t first, uint32_t count);
+        [[nodiscard]] uint32_t GetFreeCount() const;
+
+    private:
+        struct Range
+        {
+            uint32_t first;
+            uint32_t count;
+        };
+        std::vector<Range> ranges;
+    };
+
+    VkDevice vkDevice = VK_NULL_HANDLE;
+    DeviceMemory deviceMemory;
+    VkDeviceSize vertexStride = 0;
+    uint32_t vertexCapacity = 0;
+    uint32_t indexCapacity = 0;
+
+    VkBuffer vertexBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory vertexBufferMemory = VK_NULL_HANDLE;
+    VkBuffer indexBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory indexBufferMemory = VK_NULL_HANDLE;
+    // Only with positions
+    VkBuffer positionBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory positionBufferMemory = VK_NULL_HANDLE;
+
+    FreeList vertexSpace;
+    FreeList indexSpace;
+    // Indexed by mesh id. Removed meshes leave a hole whose id the next AddMesh reuses
+    std::vector<Mesh> meshes;
+    std::vector<uint32_t> freeMeshIds;
+
+    // Per AddMesh, until ReleaseStaging
+    std::vector<VkBuffer> stagingBuffers;
+    std::vector<VkDeviceMemory> stagingBuffersMemory;
+};
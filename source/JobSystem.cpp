@@ -0,0 +1,228 @@
+#include "JobSystem.h"
+
+#include <algorithm>
+
+namespace
+{
+    // Which queue the current thread owns, for the job system it works for
+    thread_local const JobSystem* currentSystem = nullptr;
+    thread_local uint32_t currentQueue = 0;
+}
+
+void JobSystem::Init(uint32_t threadCount)
+{
+    if (threadCount == 0)
+    {
+        threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+    }
+
+    stopping = false;
+    for (uint32_t i = 0; i < threadCount; i++)
+    {
+        queues.push_back(std::make_unique<Queue>());
+    }
+    for (uint32_t i = 1; i < threadCount; i++)
+    {
+        workers.emplace_back(&JobSystem::WorkerLoop, this, i);
+    }
+}
+
+void JobSystem::Shutdown()
+{
+    if (queues.empty())
+        return;
+
+    {
+        std::lock_guard lock(sleepMutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread& worker : workers)
+    {
+        worker.join();
+    }
+    workers.clear();
+
+    // Without workers nobody else would run what is left
+    while (TryRunJob(0))
+    {
+    }
+    queues.clear();
+}
+
+void JobSystem::Run(Job job, Counter* counter)
+{
+    if (counter != nullptr)
+    {
+        counter->pending.fetch_add(1, std::memory_order_relaxed);
+    }
+    Push(GetQueueIndex(), std::move(job), counter);
+}
+
+void JobSystem::RunAfter(Counter& dependency, Job job, Counter* counter)
+{
+    if (counter != nullptr)
+    {
+        counter->pending.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    {
+        // The last job of the dependency takes the continuations under this lock, so the job is either seen by it or
+        // the dependency is already done here
+        std::lock_guard lock(dependency.mutex);
+        if (dependency.pending.load(std::memory_order_acquire) != 0)
+        {
+            dependency.continuations.emplace_back(std::move(job), counter);
+            return;
+        }
+    }
+    Push(GetQueueIndex(), std::move(job), counter);
+}
+
+void JobSystem::Wait(Counter& counter)
+{
+    const uint32_t queue = GetQueueIndex();
+    while (!counter.IsDone())
+    {
+        if (!TryRunJob(queue))
+        {
+            std::this_thread::yield();
+        }
+    }
+
+    // The job that finished the counter may still be holding its mutex, and the counter may be gone right after this
+    std::lock_guard lock(counter.mutex);
+}
+
+void JobSystem::ParallelFor(const uint32_t count, uint32_t batchSize, const std::function<void(uint32_t begin, uint32_t end)>& body)
+{
+    if (count == 0)
+        return;
+
+    batchSize = std::max(batchSize, 1u);
+    const uint32_t batches = (count + batchSize - 1) / batchSize;
+    if (workers.empty() || batches == 1)
+    {
+        body(0, count);
+        return;
+    }
+
+    Counter counter;
+    for (uint32_t batch = 0; batch < batches; batch++)
+    {
+        const uint32_t begin = batch * batchSize;
+        const uint32_t end = std::min(begin + batchSize, count);
+        Run([&body, begin, end]() { body(begin, end); }, &counter);
+    }
+    Wait(counter);
+}
+
+void JobSystem::WorkerLoop(const uint32_t queue)
+{
+    currentSystem = this;
+    currentQueue = queue;
+
+    while (true)
+    {
+        if (TryRunJob(queue))
+            continue;
+
+        // Counted as asleep before looking at queuedJobs one last time, so a Push either sees the sleeper and wakes
+        // it, or comes early enough for the check below to see its job
+        std::unique_lock lock(sleepMutex);
+        sleepingWorkers.fetch_add(1);
+        while (!stopping && queuedJobs.load() == 0)
+        {
+            wake.wait(lock);
+        }
+        sleepingWorkers.fetch_sub(1);
+
+        if (stopping && queuedJobs.load() == 0)
+            return;
+    }
+}
+
+void JobSystem::Push(const uint32_t queue, Job job, Counter* counter)
+{
+    {
+        std::lock_guard lock(queues[queue]->mutex);
+        queues[queue]->jobs.emplace_back(std::move(job), counter);
+    }
+    queuedJobs.fetch_add(1);
+
+    if (sleepingWorkers.load() > 0)
+    {
+        {
+            std::lock_guard lock(sleepMutex);
+        }
+        wake.notify_one();
+    }
+}
+
+bool JobSystem::TryRunJob(const uint32_t queue)
+{
+    if (queuedJobs.load(std::memory_order_relaxed) == 0)
+        return false;
+
+    std::pair<Job, Counter*> job;
+    bool found = false;
+    {
+        // Newest first from our own deque, it is the most likely to still be in cache
+        Queue& own = *queues[queue];
+        std::lock_guard lock(own.mutex);
+        if (!own.jobs.empty())
+        {
+            job = std::move(own.jobs.back());
+            own.jobs.pop_back();
+            found = true;
+        }
+    }
+
+    // Oldest first from the others, those tend to be the largest pieces of work left
+    const uint32_t queueCount = static_cast<uint32_t>(queues.size());
+    for (uint32_t offset = 1; offset < queueCount && !found; offset++)
+    {
+        Queue& victim = *queues[(queue + offset) % queueCount];
+        std::lock_guard lock(victim.mutex);
+        if (!victim.jobs.empty())
+        {
+            job = std::move(victim.jobs.front());
+            victim.jobs.pop_front();
+            found = true;
+        }
+    }
+
+    if (!found)
+        return false;
+
+    queuedJobs.fetch_sub(1);
+    job.first();
+    Finish(job.second);
+    return true;
+}
+
+void JobSystem::Finish(Counter* counter)
+{
+    if (counter == nullptr)
+        return;
+
+    std::vector<std::pair<Job, Counter*>> ready;
+    {
+        std::lock_guard lock(counter->mutex);
+        if (counter->pending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        {
+            ready.swap(counter->continuations);
+        }
+    }
+
+    const uint32_t queue = GetQueueIndex();
+    for (auto& [job, next] : ready)
+    {
+        Push(queue, std::move(job), next);
+    }
+}
+
+uint32_t JobSystem::GetQueueIndex() const
+{
+    return currentSystem == this ? currentQueue : 0;
+}
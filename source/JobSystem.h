@@ -0,0 +1,86 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// A work-stealing job scheduler. Every worker thread, and the thread that called Init, has its own deque: jobs spawned
+// on a thread go to the back of its deque and it takes them back from there, newest first, which keeps the data they
+// touch in its cache. A thread that runs out steals the oldest job of another deque. Jobs are grouped by Counters:
+// Wait blocks until every job of a counter has finished, running queued jobs in the meantime rather than sleeping, and
+// RunAfter holds a job back until another counter is done.
+class JobSystem
+{
+public:
+    using Job = std::function<void()>;
+
+    // Jobs still pending in a group. A counter must outlive every job and continuation it was given to
+    class Counter
+    {
+    public:
+        [[nodiscard]] bool IsDone() const { return pending.load(std::memory_order_acquire) == 0; }
+
+    private:
+        friend class JobSystem;
+        std::atomic<uint32_t> pending = 0;
+        // Jobs waiting for this counter, scheduled by whichever job finishes last
+        std::mutex mutex;
+        std::vector<std::pair<Job, Counter*>> continuations;
+    };
+
+    JobSystem() = default;
+    JobSystem(const JobSystem&) = delete;
+    JobSystem& operator=(const JobSystem&) = delete;
+    ~JobSystem() { Shutdown(); }
+
+    // Runs jobs on threadCount threads counting the calling thread, which only takes part while it waits. Zero means
+    // one per hardware thread
+    void Init(uint32_t threadCount = 0);
+    // Finishes the jobs already queued and joins the workers
+    void Shutdown();
+    [[nodiscard]] uint32_t GetWorkerCount() const { return static_cast<uint32_t>(workers.size()); }
+
+    // Queues a job. With a counter, the counter isn't done until the job has returned
+    void Run(Job job, Counter* counter = nullptr);
+    // Queues a job once dependency is done, right away if it already is
+    void RunAfter(Counter& dependency, Job job, Counter* counter = nullptr);
+    // Runs queued jobs, this thread's first, until the counter is done. Only after Wait may the counter be destroyed
+    void Wait(Counter& counter);
+
+    // Calls body(begin, end) over [0, count) in ranges of up to batchSize, spread over every thread, and returns once
+    // all of them have. With no workers, or a single range, it all runs on the calling thread
+    void ParallelFor(uint32_t count, uint32_t batchSize, const std::function<void(uint32_t begin, uint32_t end)>& body);
+
+private:
+    struct Queue
+    {
+        std::mutex mutex;
+        std::deque<std::pair<Job, Counter*>> jobs;
+    };
+
+    std::vector<std::thread> workers;
+    // Index 0 belongs to the thread that called Init, and to any other thread that isn't a worker
+    std::vector<std::unique_ptr<Queue>> queues;
+    // Jobs queued and not taken yet, so idle workers know whether to look again or sleep
+    std::atomic<uint32_t> queuedJobs = 0;
+    // Workers asleep on wake. Push only takes sleepMutex to wake one when there are any
+    std::atomic<uint32_t> sleepingWorkers = 0;
+    std::mutex sleepMutex;
+    std::condition_variable wake;
+    bool stopping = false;
+
+    void WorkerLoop(uint32_t queue);
+    void Push(uint32_t queue, Job job, Counter* counter);
+    // This thread's own deque first, then every other one in turn
+    bool TryRunJob(uint32_t queue);
+    void Finish(Counter* counter);
+    // The queue of the calling thread
+    [[nodiscard]] uint32_t GetQueueIndex() const;
+};
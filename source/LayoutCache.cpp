@@ -0,0 +1,171 @@
+#include "LayoutCache.h"
+
+#include <functional>
+#include <stdexcept>
+
+namespace
+{
+    void HashCombine(size_t& seed, const size_t value)
+    {
+        seed ^= value + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+    }
+}
+
+bool LayoutCache::SetLayoutKey::operator==(const SetLayoutKey& other) const
+{
+    if (bindings.size() != other.bindings.size())
+        return false;
+
+    for (size_t i = 0; i < bindings.size(); i++)
+    {
+        const VkDescriptorSetLayoutBinding& a = bindings[i];
+        const VkDescriptorSetLayoutBinding& b = other.bindings[i];
+        if (a.binding != b.binding || a.descriptorType != b.descriptorType || a.descriptorCount != b.descriptorCount ||
+            a.stageFlags != b.stageFlags || a.pImmutableSamplers != b.pImmutableSamplers)
+            return false;
+    }
+
+    return true;
+}
+
+bool LayoutCache::PipelineLayoutKey::operator==(const PipelineLayoutKey& other) const
+{
+    if (setLayouts != other.setLayouts || pushConstantRanges.size() != other.pushConstantRanges.size())
+        return false;
+
+    for (size_t i = 0; i < pushConstantRanges.size(); i++)
+    {
+        const VkPushConstantRange& a = pushConstantRanges[i];
+        const VkPushConstantRange& b = other.pushConstantRanges[i];
+        if (a.stageFlags != b.stageFlags || a.offset != b.offset || a.size != b.size)
+            return false;
+    }
+
+    return true;
+}
+
+size_t LayoutCache::SetLayoutKeyHash::operator()(const SetLayoutKey& key) const
+{
+    size_t seed = key.bindings.size();
+    for (const VkDescriptorSetLayoutBinding& binding : key.bindings)
+    {
+        HashCombine(seed, binding.binding);
+        HashCombine(seed, binding.descriptorType);
+        HashCombine(seed, binding.descriptorCount);
+        HashCombine(seed, binding.stageFlags);
+    }
+    return seed;
+}
+
+size_t LayoutCache::PipelineLayoutKeyHash::operator()(const PipelineLayoutKey& key) const
+{
+    size_t seed = key.setLayouts.size();
+    for (const VkDescriptorSetLayout setLayout : key.setLayouts)
+    {
+        HashCombine(seed, std::hash<VkDescriptorSetLayout>()(setLayout));
+    }
+    for (const VkPushConstantRange& range : key.pushConstantRanges)
+    {
+        HashCombine(seed, range.stageFlags);
+        HashCombine(seed, range.offset);
+        HashCombine(seed, range.size);
+    }
+    return seed;
+}
+
+void LayoutCache::Init(const VkDevice device)
+{
+    vkDevice = device;
+}
+
+void LayoutCache::Cleanup()
+{
+    // Pipeline layouts reference the set layouts, so they go first
+    for (const auto& [key, pipelineLayout] : pipelineLayouts)
+    {
+        vkDestroyPipelineLayout(vkDevice, pipelineLayout, nullptr);
+    }
+    pipelineLayouts.clear();
+
+    for (const auto& [key, setLayout] : setLayouts)
+    {
+        vkDestroyDescriptorSetLayout(vkDevice, setLayout, nullptr);
+    }
+    setLayouts.clear();
+}
+
+VkDescriptorSetLayout LayoutCache::GetSetLayout(const std::vector<VkDescriptorSetLayoutBinding>& bindings)
+{
+    SetLayoutKey key{bindings};
+
+    const auto it = setLayouts.find(key);
+    if (it != setLayouts.end())
+    {
+        return it->second;
+    }
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+    layoutInfo.pBindings = bindings.data();
+
+    VkDescriptorSetLayout setLayout;
+    if (vkCreateDescriptorSetLayout(vkDevice, &layoutInfo, nullptr, &setLayout) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create descriptor set layout!");
+    }
+
+    setLayouts.emplace(std::move(key), setLayout);
+    return setLayout;
+}
+
+VkPipelineLayout LayoutCache::GetPipelineLayout(const std::vector<VkDescriptorSetLayout>& setLayouts, const std::vector<VkPushConstantRange>& pushConstantRanges)
+{
+    PipelineLayoutKey key{setLayouts, pushConstantRanges};
+
+    const auto it = pipelineLayouts.find(key);
+    if (it != pipelineLayouts.end())
+    {
+        return it->second;
+    }
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(setLayouts.size());
+    pipelineLayoutInfo.pSetLayouts = setLayouts.data();
+    pipelineLayoutInfo.pushConstantRangeCount = static_cast<uint32_t>(pushConstantRanges.size());
+    pipelineLayoutInfo.pPushConstantRanges = pushConstantRanges.data();
+
+    VkPipelineLayout pipelineLayout;
+    if (vkCreatePipelineLayout(vkDevice, &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create pipeline layout!");
+    }
+
+    pipelineLayouts.emplace(std::move(key), pipelineLayout);
+    return pipelineLayout;
+}
+
+VkPipelineLayout LayoutCache::GetPipelineLayout(const ShaderLayout& layout, std::vector<VkDescriptorSetLayout>* outSetLayouts)
+{
+    std::vector<VkDescriptorSetLayout> layouts;
+    if (!layout.sets.empty())
+    {
+        // Set numbers are indices into pSetLayouts, so gaps must be filled with an empty layout
+        const uint32_t setCount = layout.sets.rbegin()->first + 1;
+        layouts.reserve(setCount);
+
+        for (uint32_t set = 0; set < setCount; set++)
+        {
+            const auto it = layout.sets.find(set);
+            layouts.push_back(GetSetLayout(it != layout.sets.end() ? it->second : std::vector<VkDescriptorSetLayoutBinding>{}));
+        }
+    }
+
+    if (outSetLayouts != nullptr)
+    {
+        *outSetLayouts = layouts;
+    }
+
+    return GetPipelineLayout(layouts, layout.pushConstantRanges);
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+#include <unordered_map>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+#include "ShaderReflection.h"
+
+// Hands out descriptor set layouts and pipeline layouts, creating each distinct one only once.
+// Pipelines built from shaders that declare the same bindings end up with the very same VkDescriptorSetLayout and
+// VkPipelineLayout handles, so descriptor sets stay bound when we switch between them.
+class LayoutCache
+{
+public:
+    void Init(VkDevice device);
+    void Cleanup();
+
+    VkDescriptorSetLayout GetSetLayout(const std::vector<VkDescriptorSetLayoutBinding>& bindings);
+    VkPipelineLayout GetPipelineLayout(const std::vector<VkDescriptorSetLayout>& setLayouts, const std::vector<VkPushConstantRange>& pushConstantRanges);
+
+    // Builds the full pipeline layout for a reflected shader set. Unused set indices below the highest one get an empty layout
+    VkPipelineLayout GetPipelineLayout(const ShaderLayout& layout, std::vector<VkDescriptorSetLayout>* outSetLayouts = nullptr);
+
+private:
+    struct SetLayoutKey
+    {
+        std::vector<VkDescriptorSetLayoutBinding> bindings;
+        bool operator==(const SetLayoutKey& other) const;
+    };
+
+    struct PipelineLayoutKey
+    {
+        std::vector<VkDescriptorSetLayout> setLayouts;
+        std::vector<VkPushConstantRange> pushConstantRanges;
+        bool operator==(const PipelineLayoutKey& other) const;
+    };
+
+    struct SetLayoutKeyHash { size_t operator()(const SetLayoutKey& key) const; };
+    struct PipelineLayoutKeyHash { size_t operator()(const PipelineLayoutKey& key) const; };
+
+    VkDevice vkDevice = VK_NULL_HANDLE;
+    std::unordered_map<SetLayoutKey, VkDescriptorSetLayout, SetLayoutKeyHash> setLayouts;
+    std::unordered_map<PipelineLayoutKey, VkPipelineLayout, PipelineLayoutKeyHash> pipelineLayouts;
+};
@@ -0,0 +1,283 @@
+#include "MipGenerator.h"
+
+#include <algorithm>
+#include <array>
+#include <stdexcept>
+
+#include "LayoutCache.h"
+#include "ShaderCompiler.h"
+#include "ShaderReflection.h"
+
+namespace
+{
+    // Threads per workgroup side in downsample.comp. Each one covers a 2x2 quad of the source level
+    constexpr uint32_t GROUP_SIZE = 16;
+}
+
+void MipGenerator::Init(const VkDevice device, const VkPhysicalDevice physicalDevice, const uint32_t queueFamily, const bool restrictViewUsage,
+                        const ShaderCompiler& shaderCompiler, LayoutCache& layoutCache)
+{
+    vkDevice = device;
+    vkPhysicalDevice = physicalDevice;
+    viewUsage = restrictViewUsage;
+
+    // Graphics queues almost always do compute as well, but Vulkan doesn't promise it
+    uint32_t queueFamilyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(vkPhysicalDevice, &queueFamilyCount, nullptr);
+    std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(vkPhysicalDevice, &queueFamilyCount, queueFamilies.data());
+    computeQueue = (queueFamilies[queueFamily].queueFlags & VK_QUEUE_COMPUTE_BIT) != 0;
+
+    const std::vector<uint32_t> code = shaderCompiler.Compile("shaders/downsample.comp", shaderc_glsl_compute_shader);
+
+    ShaderLayout shaderLayout;
+    ShaderReflection::Reflect(code, VK_SHADER_STAGE_COMPUTE_BIT, shaderLayout);
+    std::vector<VkDescriptorSetLayout> setLayouts;
+    pipelineLayout = layoutCache.GetPipelineLayout(shaderLayout, &setLayouts);
+    descriptorSetLayout = setLayouts[0];
+
+    VkShaderModuleCreateInfo moduleInfo{};
+    moduleInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    moduleInfo.codeSize = code.size() * sizeof(uint32_t);
+    moduleInfo.pCode = code.data();
+
+    VkShaderModule shaderModule;
+    if (vkCreateShaderModule(vkDevice, &moduleInfo, nullptr, &shaderModule) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create shader module!");
+    }
+
+    VkComputePipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipelineInfo.stage.module = shaderModule;
+    pipelineInfo.stage.pName = "main";
+    pipelineInfo.layout = pipelineLayout;
+
+    const VkResult result = vkCreateComputePipelines(vkDevice, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &pipeline);
+    vkDestroyShaderModule(vkDevice, shaderModule, nullptr);
+
+    if (result != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create downsample pipeline!");
+    }
+}
+
+void MipGenerator::Cleanup()
+{
+    ReleaseResources();
+    vkDestroyPipeline(vkDevice, pipeline, nullptr);
+    pipeline = VK_NULL_HANDLE;
+}
+
+bool MipGenerator::Supports(const VkFormat format) const
+{
+    // The shader declares its images as rgba8
+    const VkFormat storageFormat = GetStorageFormat(format);
+    if (!computeQueue || storageFormat != VK_FORMAT_R8G8B8A8_UNORM)
+        return false;
+    // A view of an sRGB alias would inherit STORAGE, which the sRGB format itself doesn't support
+    if (storageFormat != format && !viewUsage)
+        return false;
+
+    VkFormatProperties formatProperties;
+    vkGetPhysicalDeviceFormatProperties(vkPhysicalDevice, storageFormat, &formatProperties);
+    return (formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT) != 0;
+}
+
+VkFormat MipGenerator::GetStorageFormat(const VkFormat format)
+{
+    switch (format)
+    {
+    case VK_FORMAT_R8G8B8A8_SRGB: return VK_FORMAT_R8G8B8A8_UNORM;
+    case VK_FORMAT_B8G8R8A8_SRGB: return VK_FORMAT_B8G8R8A8_UNORM;
+    default: return format;
+    }
+}
+
+VkImageCreateFlags MipGenerator::GetImageCreateFlags(const VkFormat format)
+{
+    // Lets the sRGB view used for sampling and the UNORM views used for storage share the image
+    return GetStorageFormat(format) != format ? VK_IMAGE_CREATE_MUTABLE_FORMAT_BIT : 0;
+}
+
+uint32_t MipGenerator::Record(const VkCommandBuffer commandBuffer, const VkImage image, const VkFormat format, const VkExtent2D extent, const uint32_t mipLevels)
+{
+    VkImageMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = image;
+    barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, mipLevels, 0, 1};
+
+    // Nothing to generate, but the image still has to end up ready for sampling
+    if (mipLevels <= 1)
+    {
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+        vkCmdPipelineBarrier(commandBuffer,
+            VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
+            0, nullptr,
+            0, nullptr,
+            1, &barrier);
+        return 0;
+    }
+
+    const VkFormat storageFormat = GetStorageFormat(format);
+
+    // One single level view per mip, which is all a storage image descriptor can address
+    std::vector<VkImageView> levelViews(mipLevels);
+    for (uint32_t level = 0; level < mipLevels; level++)
+    {
+        VkImageViewCreateInfo viewInfo{};
+        viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        viewInfo.image = image;
+        viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        viewInfo.format = storageFormat;
+        viewInfo.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, level, 1, 0, 1};
+
+        if (vkCreateImageView(vkDevice, &viewInfo, nullptr, &levelViews[level]) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create mip level view!");
+        }
+        views.push_back(levelViews[level]);
+    }
+
+    const uint32_t dispatchCount = (mipLevels - 1 + MIPS_PER_DISPATCH - 1) / MIPS_PER_DISPATCH;
+
+    std::array<VkDescriptorPoolSize, 1> poolSizes{};
+    poolSizes[0].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    poolSizes[0].descriptorCount = dispatchCount * (1 + MIPS_PER_DISPATCH);
+
+    VkDescriptorPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+    poolInfo.pPoolSizes = poolSizes.data();
+    poolInfo.maxSets = dispatchCount;
+
+    VkDescriptorPool descriptorPool;
+    if (vkCreateDescriptorPool(vkDevice, &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create descriptor pool!");
+    }
+    descriptorPools.push_back(descriptorPool);
+
+    std::vector<VkDescriptorSetLayout> layouts(dispatchCount, descriptorSetLayout);
+    std::vector<VkDescriptorSet> descriptorSets(dispatchCount);
+
+    VkDescriptorSetAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = descriptorPool;
+    allocInfo.descriptorSetCount = dispatchCount;
+    allocInfo.pSetLayouts = layouts.data();
+
+    if (vkAllocateDescriptorSets(vkDevice, &allocInfo, descriptorSets.data()) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to allocate descriptor sets!");
+    }
+
+    // Everything goes to GENERAL, the only layout storage images can be written in. Level 0 is waited on, the
+    // others are overwritten anyway
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+    vkCmdPipelineBarrier(commandBuffer,
+        VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+        0, nullptr,
+        0, nullptr,
+        1, &barrier);
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+
+    const bool srgb = storageFormat != format;
+    for (uint32_t dispatch = 0; dispatch < dispatchCount; dispatch++)
+    {
+        const uint32_t baseLevel = dispatch * MIPS_PER_DISPATCH;
+        const uint32_t mipCount = std::min(MIPS_PER_DISPATCH, mipLevels - 1 - baseLevel);
+
+        // Every slot of the array needs a valid view. The ones past mipCount repeat the last level and are never written
+        VkDescriptorImageInfo srcInfo{VK_NULL_HANDLE, levelViews[baseLevel], VK_IMAGE_LAYOUT_GENERAL};
+        std::array<VkDescriptorImageInfo, MIPS_PER_DISPATCH> dstInfos{};
+        for (uint32_t i = 0; i < MIPS_PER_DISPATCH; i++)
+        {
+            dstInfos[i] = {VK_NULL_HANDLE, levelViews[baseLevel + 1 + std::min(i, mipCount - 1)], VK_IMAGE_LAYOUT_GENERAL};
+        }
+
+        std::array<VkWriteDescriptorSet, 2> descriptorWrites{};
+        descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrites[0].dstSet = descriptorSets[dispatch];
+        descriptorWrites[0].dstBinding = 0;
+        descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        descriptorWrites[0].descriptorCount = 1;
+        descriptorWrites[0].pImageInfo = &srcInfo;
+        descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrites[1].dstSet = descriptorSets[dispatch];
+        descriptorWrites[1].dstBinding = 1;
+        descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        descriptorWrites[1].descriptorCount = MIPS_PER_DISPATCH;
+        descriptorWrites[1].pImageInfo = dstInfos.data();
+        vkUpdateDescriptorSets(vkDevice, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+
+        // The previous dispatch wrote the level this one starts from
+        if (dispatch > 0)
+        {
+            VkMemoryBarrier memoryBarrier{};
+            memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+            memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+            memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+            vkCmdPipelineBarrier(commandBuffer,
+                VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+                1, &memoryBarrier,
+                0, nullptr,
+                0, nullptr);
+        }
+
+        const uint32_t srcWidth = std::max(extent.width >> baseLevel, 1u);
+        const uint32_t srcHeight = std::max(extent.height >> baseLevel, 1u);
+        const PushConstants pushConstants{static_cast<int32_t>(srcWidth), static_cast<int32_t>(srcHeight), static_cast<int32_t>(mipCount), srgb ? 1 : 0};
+
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &descriptorSets[dispatch], 0, nullptr);
+        vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(pushConstants), &pushConstants);
+
+        // One workgroup per 16x16 texels of the first level written
+        const uint32_t firstWidth = std::max(srcWidth / 2, 1u);
+        const uint32_t firstHeight = std::max(srcHeight / 2, 1u);
+        vkCmdDispatch(commandBuffer, (firstWidth + GROUP_SIZE - 1) / GROUP_SIZE, (firstHeight + GROUP_SIZE - 1) / GROUP_SIZE, 1);
+    }
+
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+    vkCmdPipelineBarrier(commandBuffer,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
+        0, nullptr,
+        0, nullptr,
+        1, &barrier);
+
+    return dispatchCount;
+}
+
+void MipGenerator::ReleaseResources()
+{
+    for (const VkImageView view : views)
+    {
+        vkDestroyImageView(vkDevice, view, nullptr);
+    }
+    views.clear();
+
+    // Destroying a pool frees its sets
+    for (const VkDescriptorPool pool : descriptorPools)
+    {
+        vkDestroyDescriptorPool(vkDevice, pool, nullptr);
+    }
+    descriptorPools.clear();
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+class LayoutCache;
+class ShaderCompiler;
+
+// Builds mip chains with a compute shader (shaders/downsample.comp) instead of a chain of blits. One dispatch writes
+// up to MIPS_PER_DISPATCH levels through shared memory, so there is one barrier per dispatch rather than two per level,
+// and the format only needs storage image support, not linear blit filtering.
+// sRGB textures are created with their UNORM format and VK_IMAGE_CREATE_MUTABLE_FORMAT_BIT: the compute shader writes
+// through UNORM views (sRGB formats rarely support storage) and encodes by hand, and materials sample through an sRGB view
+// restricted to SAMPLED usage, which takes VK_KHR_maintenance2.
+class MipGenerator
+{
+public:
+    static constexpr uint32_t MIPS_PER_DISPATCH = 5;
+
+    // restrictViewUsage says whether views can restrict their usage, i.e. VK_KHR_maintenance2 is enabled
+    void Init(VkDevice device, VkPhysicalDevice physicalDevice, uint32_t queueFamily, bool restrictViewUsage, const ShaderCompiler& shaderCompiler,
+              LayoutCache& layoutCache);
+    void Cleanup();
+
+    // Whether textures of this format can get their mips from here. sRGB formats are checked through their UNORM alias,
+    // and need restrictViewUsage for their sampled view
+    [[nodiscard]] bool Supports(VkFormat format) const;
+    // The format to create the image with, and the flags it needs on top of the usual ones
+    [[nodiscard]] static VkFormat GetStorageFormat(VkFormat format);
+    [[nodiscard]] static VkImageCreateFlags GetImageCreateFlags(VkFormat format);
+
+    // Records the generation of levels 1 to mipLevels - 1 from level 0. The image must have been created with
+    // GetStorageFormat(format), GetImageCreateFlags(format) and STORAGE usage, every level in TRANSFER_DST_OPTIMAL.
+    // Every level ends up in SHADER_READ_ONLY_OPTIMAL. Returns the number of dispatches recorded
+    uint32_t Record(VkCommandBuffer commandBuffer, VkImage image, VkFormat format, VkExtent2D extent, uint32_t mipLevels);
+    // Frees the views and descriptor sets of every Record so far. Their command buffers must have completed
+    void ReleaseResources();
+
+private:
+    struct PushConstants
+    {
+        int32_t srcWidth;
+        int32_t srcHeight;
+        int32_t mipCount;
+        int32_t srgb;
+    };
+
+    VkDevice vkDevice = VK_NULL_HANDLE;
+    VkPhysicalDevice vkPhysicalDevice = VK_NULL_HANDLE;
+    bool computeQueue = false;
+    bool viewUsage = false;
+    VkDescriptorSetLayout descriptorSetLayout = VK_NULL_HANDLE;
+    // Owned by the layout cache
+    VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+    VkPipeline pipeline = VK_NULL_HANDLE;
+
+    // Per Record, until ReleaseResources
+    std::vector<VkImageView> views;
+    std::vector<VkDescriptorPool> descriptorPools;
+};
@@ -0,0 +1,428 @@
+#include "OcclusionCuller.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <glm/common.hpp>
+
+#include "DeletionQueue.h"
+#include "LayoutCache.h"
+#include "ShaderCompiler.h"
+#include "ShaderReflection.h"
+
+namespace
+{
+    // Workgroup sizes of hiz.comp and cull.comp
+    constexpr uint32_t HIZ_GROUP_SIZE = 8;
+    constexpr uint32_t CULL_GROUP_SIZE = 64;
+}
+
+void OcclusionCuller::Init(const VkDevice device, const VkPhysicalDevice physicalDevice, const uint32_t framesInFlight,
+                           const ShaderCompiler& shaderCompiler, LayoutCache& layoutCache)
+{
+    vkDevice = device;
+    deviceMemory.Init(device, physicalDevice);
+
+    // The sample count of the depth buffer follows the anti-aliasing tier, which can change at any time. Both
+    // variants bind a combined image sampler at binding 0, so they share the layouts
+    hiZPipeline = CreateComputePipeline(shaderCompiler, layoutCache, "shaders/hiz.comp", false, hiZSetLayout, hiZPipelineLayout);
+    hiZMultisampledPipeline = CreateComputePipeline(shaderCompiler, layoutCache, "shaders/hiz.comp", true, hiZSetLayout, hiZPipelineLayout);
+    cullPipeline = CreateComputePipeline(shaderCompiler, layoutCache, "shaders/cull.comp", false, cullSetLayout, cullPipelineLayout);
+
+    // Both shaders only ever texelFetch, the sampler is there because combined image samplers need one
+    VkSamplerCreateInfo samplerInfo{};
+    samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    samplerInfo.magFilter = VK_FILTER_NEAREST;
+    samplerInfo.minFilter = VK_FILTER_NEAREST;
+    samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
+
+    if (vkCreateSampler(vkDevice, &samplerInfo, nullptr, &sampler) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create Hi-Z sampler!");
+    }
+
+    drawBuffers.resize(framesInFlight);
+    drawBuffersMemory.resize(framesInFlight);
+    statsBuffers.resize(framesInFlight);
+    statsBuffersMemory.resize(framesInFlight);
+    statsBuffersMapped.resize(framesInFlight);
+}
+
+void OcclusionCuller::CreateClusters(const std::vector<glm::vec3>& positions, const std::vector<uint32_t>& indices, const std::vector<uint32_t>& batchEnds,
+                                     const uint32_t meshFirstIndex, const int32_t meshVertexOffset, const std::vector<VkBuffer>& frameUniformBuffers,
+                                     const VkDeviceSize frameUniformBufferSize)
+{
+    uniformBuffers = frameUniformBuffers;
+    uniformBufferSize = frameUniformBufferSize;
+
+    // OBJ files list the faces of a surface together, so consecutive triangles are usually close to each other
+    constexpr uint32_t indicesPerCluster = TRIANGLES_PER_CLUSTER * 3;
+    uint32_t batchFirst = 0;
+    for (const uint32_t batchEnd : batchEnds)
+    {
+        Batch batch;
+        batch.firstCluster = static_cast<uint32_t>(clusters.size());
+        for (uint32_t first = batchFirst; first < batchEnd; first += indicesPerCluster)
+        {
+            Cluster cluster{};
+            cluster.firstIndex = meshFirstIndex + first;
+            cluster.indexCount = std::min(indicesPerCluster, batchEnd - first);
+            cluster.vertexOffset = meshVertexOffset;
+
+            glm::vec3 boundsMin(std::numeric_limits<float>::max());
+            glm::vec3 boundsMax(std::numeric_limits<float>::lowest());
+            for (uint32_t i = first; i < first + cluster.indexCount; i++)
+            {
+                boundsMin = glm::min(boundsMin, positions[indices[i]]);
+                boundsMax = glm::max(boundsMax, positions[indices[i]]);
+            }
+            cluster.boundsMin = glm::vec4(boundsMin, 1.0f);
+            cluster.boundsMax = glm::vec4(boundsMax, 1.0f);
+            clusters.push_back(cluster);
+        }
+        batch.clusterCount = static_cast<uint32_t>(clusters.size()) - batch.firstCluster;
+        batches.push_back(batch);
+        batchFirst = batchEnd;
+    }
+
+    // Written once and read by one dispatch a frame, not worth a staging copy
+    const VkDeviceSize clusterBufferSize = sizeof(Cluster) * clusters.size();
+    deviceMemory.CreateBuffer(clusterBufferSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                              clusterBuffer, clusterBufferMemory, "culling buffer");
+
+    void* data;
+    vkMapMemory(vkDevice, clusterBufferMemory, 0, clusterBufferSize, 0, &data);
+    memcpy(data, clusters.data(), static_cast<size_t>(clusterBufferSize));
+    vkUnmapMemory(vkDevice, clusterBufferMemory);
+
+    const uint32_t framesInFlight = static_cast<uint32_t>(drawBuffers.size());
+    for (uint32_t frame = 0; frame < framesInFlight; frame++)
+    {
+        deviceMemory.CreateBuffer(sizeof(VkDrawIndexedIndirectCommand) * clusters.size(), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+                                  VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, drawBuffers[frame], drawBuffersMemory[frame], "culling buffer");
+        deviceMemory.CreateBuffer(sizeof(uint32_t) * 2, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                  VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, statsBuffers[frame], statsBuffersMemory[frame], "culling buffer");
+        vkMapMemory(vkDevice, statsBuffersMemory[frame], 0, sizeof(uint32_t) * 2, 0, &statsBuffersMapped[frame]);
+        memset(statsBuffersMapped[frame], 0, sizeof(uint32_t) * 2);
+    }
+
+    // The first graph is built before the clusters exist, so its cull sets are only filled in now
+    if (!cullDescriptorSets.empty())
+    {
+        WriteCullDescriptorSets();
+    }
+}
+
+void OcclusionCuller::Cleanup()
+{
+    // The pyramid views must have been retired already
+    for (size_t frame = 0; frame < drawBuffers.size(); frame++)
+    {
+        vkDestroyBuffer(vkDevice, drawBuffers[frame], nullptr);
+        vkFreeMemory(vkDevice, drawBuffersMemory[frame], nullptr);
+        vkDestroyBuffer(vkDevice, statsBuffers[frame], nullptr);
+        vkFreeMemory(vkDevice, statsBuffersMemory[frame], nullptr);
+    }
+    vkDestroyBuffer(vkDevice, clusterBuffer, nullptr);
+    vkFreeMemory(vkDevice, clusterBufferMemory, nullptr);
+
+    vkDestroySampler(vkDevice, sampler, nullptr);
+    vkDestroyPipeline(vkDevice, hiZPipeline, nullptr);
+    vkDestroyPipeline(vkDevice, hiZMultisampledPipeline, nullptr);
+    vkDestroyPipeline(vkDevice, cullPipeline, nullptr);
+}
+
+RenderGraph::ImageDesc OcclusionCuller::GetHiZDesc(const VkExtent2D extent)
+{
+    RenderGraph::ImageDesc desc;
+    desc.format = VK_FORMAT_R32_SFLOAT;
+    desc.extent = extent;
+    desc.mipLevels = static_cast<uint32_t>(std::floor(std::log2(std::max(extent.width, extent.height)))) + 1;
+    return desc;
+}
+
+void OcclusionCuller::SetTargets(const VkImageView depthView, const VkSampleCountFlagBits samples, const VkImage hiZImage, const VkExtent2D hiZExtent)
+{
+    depthSamples = samples;
+    extent = hiZExtent;
+    const uint32_t levelCount = GetHiZDesc(extent).mipLevels;
+
+    // Storage images address a single level, so each level gets its own view. The cull pass samples them all at once
+    VkImageViewCreateInfo viewInfo{};
+    viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    viewInfo.image = hiZImage;
+    viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    viewInfo.format = VK_FORMAT_R32_SFLOAT;
+    viewInfo.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, levelCount, 0, 1};
+
+    if (vkCreateImageView(vkDevice, &viewInfo, nullptr, &hiZView) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create Hi-Z view!");
+    }
+
+    levelViews.resize(levelCount);
+    for (uint32_t level = 0; level < levelCount; level++)
+    {
+        viewInfo.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, level, 1, 0, 1};
+        if (vkCreateImageView(vkDevice, &viewInfo, nullptr, &levelViews[level]) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create Hi-Z level view!");
+        }
+    }
+
+    // The cull sets sample the whole pyramid, so they come and go with it. Rewriting sets the frames in flight or the
+    // prerecorded command buffers still use would invalidate those, a new graph gets new ones instead
+    const uint32_t framesInFlight = static_cast<uint32_t>(drawBuffers.size());
+    const std::array<VkDescriptorPoolSize, 4> poolSizes =
+    {{
+        {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, levelCount + framesInFlight},
+        {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, levelCount * 2},
+        {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, framesInFlight},
+        {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, framesInFlight * 3},
+    }};
+
+    VkDescriptorPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+    poolInfo.pPoolSizes = poolSizes.data();
+    poolInfo.maxSets = levelCount + framesInFlight;
+
+    if (vkCreateDescriptorPool(vkDevice, &poolInfo, nullptr, &hiZDescriptorPool) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create descriptor pool!");
+    }
+
+    std::vector<VkDescriptorSetLayout> layouts(levelCount, hiZSetLayout);
+    VkDescriptorSetAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = hiZDescriptorPool;
+    allocInfo.descriptorSetCount = levelCount;
+    allocInfo.pSetLayouts = layouts.data();
+
+    hiZDescriptorSets.resize(levelCount);
+    if (vkAllocateDescriptorSets(vkDevice, &allocInfo, hiZDescriptorSets.data()) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to allocate descriptor sets!");
+    }
+
+    // Level 0 reads the depth image, and its unused source slot points at itself
+    for (uint32_t level = 0; level < levelCount; level++)
+    {
+        const VkDescriptorImageInfo depthInfo{sampler, depthView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+        const VkDescriptorImageInfo srcInfo{VK_NULL_HANDLE, levelViews[level > 0 ? level - 1 : 0], VK_IMAGE_LAYOUT_GENERAL};
+        const VkDescriptorImageInfo dstInfo{VK_NULL_HANDLE, levelViews[level], VK_IMAGE_LAYOUT_GENERAL};
+
+        std::array<VkWriteDescriptorSet, 3> descriptorWrites{};
+        for (uint32_t binding = 0; binding < descriptorWrites.size(); binding++)
+        {
+            descriptorWrites[binding].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            descriptorWrites[binding].dstSet = hiZDescriptorSets[level];
+            descriptorWrites[binding].dstBinding = binding;
+            descriptorWrites[binding].descriptorCount = 1;
+            descriptorWrites[binding].descriptorType = binding == 0 ? VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER : VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        }
+        descriptorWrites[0].pImageInfo = &depthInfo;
+        descriptorWrites[1].pImageInfo = &srcInfo;
+        descriptorWrites[2].pImageInfo = &dstInfo;
+        vkUpdateDescriptorSets(vkDevice, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+    }
+
+    layouts.assign(framesInFlight, cullSetLayout);
+    allocInfo.descriptorSetCount = framesInFlight;
+    allocInfo.pSetLayouts = layouts.data();
+
+    cullDescriptorSets.resize(framesInFlight);
+    if (vkAllocateDescriptorSets(vkDevice, &allocInfo, cullDescriptorSets.data()) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to allocate descriptor sets!");
+    }
+
+    if (clusterBuffer != VK_NULL_HANDLE)
+    {
+        WriteCullDescriptorSets();
+    }
+}
+
+void OcclusionCuller::Retire(DeletionQueue& deletionQueue, const uint64_t lastUsedFrame)
+{
+    deletionQueue.Push(lastUsedFrame, hiZView);
+    for (const VkImageView view : levelViews)
+    {
+        deletionQueue.Push(lastUsedFrame, view);
+    }
+
+    // Destroying the pool frees its sets
+    deletionQueue.Push(lastUsedFrame, [pool = hiZDescriptorPool](const VkDevice device)
+    {
+        vkDestroyDescriptorPool(device, pool, nullptr);
+    });
+
+    hiZView = VK_NULL_HANDLE;
+    levelViews.clear();
+    hiZDescriptorPool = VK_NULL_HANDLE;
+    hiZDescriptorSets.clear();
+    cullDescriptorSets.clear();
+}
+
+void OcclusionCuller::RecordHiZ(const VkCommandBuffer commandBuffer, const VkExtent2D renderExtent) const
+{
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, depthSamples != VK_SAMPLE_COUNT_1_BIT ? hiZMultisampledPipeline : hiZPipeline);
+
+    VkMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+    // Level 0 covers the whole pyramid but only reads the depth inside the rendered area
+    uint32_t srcWidth = renderExtent.width;
+    uint32_t srcHeight = renderExtent.height;
+    for (uint32_t level = 0; level < levelViews.size(); level++)
+    {
+        // Each level reads the one the previous dispatch wrote
+        if (level > 0)
+        {
+            vkCmdPipelineBarrier(commandBuffer,
+                VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+                1, &barrier,
+                0, nullptr,
+                0, nullptr);
+        }
+
+        const uint32_t dstWidth = level == 0 ? extent.width : std::max(srcWidth / 2, 1u);
+        const uint32_t dstHeight = level == 0 ? extent.height : std::max(srcHeight / 2, 1u);
+        const HiZPushConstants pushConstants{static_cast<int32_t>(srcWidth), static_cast<int32_t>(srcHeight), static_cast<int32_t>(dstWidth),
+                                             static_cast<int32_t>(dstHeight), static_cast<int32_t>(level), static_cast<int32_t>(depthSamples)};
+
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, hiZPipelineLayout, 0, 1, &hiZDescriptorSets[level], 0, nullptr);
+        vkCmdPushConstants(commandBuffer, hiZPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(pushConstants), &pushConstants);
+        vkCmdDispatch(commandBuffer, (dstWidth + HIZ_GROUP_SIZE - 1) / HIZ_GROUP_SIZE, (dstHeight + HIZ_GROUP_SIZE - 1) / HIZ_GROUP_SIZE, 1);
+
+        srcWidth = dstWidth;
+        srcHeight = dstHeight;
+    }
+}
+
+void OcclusionCuller::RecordCull(const VkCommandBuffer commandBuffer, const uint32_t frame, const VkExtent2D renderExtent) const
+{
+    // The counters start from zero every frame
+    vkCmdFillBuffer(commandBuffer, statsBuffers[frame], 0, VK_WHOLE_SIZE, 0);
+
+    VkMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+    vkCmdPipelineBarrier(commandBuffer,
+        VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+        1, &barrier,
+        0, nullptr,
+        0, nullptr);
+
+    const uint32_t clusterCount = GetClusterCount();
+    const CullPushConstants pushConstants{clusterCount, 0, static_cast<int32_t>(renderExtent.width), static_cast<int32_t>(renderExtent.height)};
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipeline);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipelineLayout, 0, 1, &cullDescriptorSets[frame], 0, nullptr);
+    vkCmdPushConstants(commandBuffer, cullPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(pushConstants), &pushConstants);
+    vkCmdDispatch(commandBuffer, (clusterCount + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+
+    // The render graph only tracks images, so the hand over of the buffers is ours: the draws to the forward pass,
+    // the counters to the host once the fence signals
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_HOST_READ_BIT;
+
+    vkCmdPipelineBarrier(commandBuffer,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_HOST_BIT, 0,
+        1, &barrier,
+        0, nullptr,
+        0, nullptr);
+}
+
+void OcclusionCuller::WriteCullDescriptorSets() const
+{
+    for (uint32_t frame = 0; frame < cullDescriptorSets.size(); frame++)
+    {
+        const VkDescriptorBufferInfo uniformInfo{uniformBuffers[frame], 0, uniformBufferSize};
+        const VkDescriptorImageInfo hiZInfo{sampler, hiZView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+        const VkDescriptorBufferInfo clusterInfo{clusterBuffer, 0, VK_WHOLE_SIZE};
+        const VkDescriptorBufferInfo drawInfo{drawBuffers[frame], 0, VK_WHOLE_SIZE};
+        const VkDescriptorBufferInfo statsInfo{statsBuffers[frame], 0, VK_WHOLE_SIZE};
+
+        std::array<VkWriteDescriptorSet, 5> descriptorWrites{};
+        for (uint32_t binding = 0; binding < descriptorWrites.size(); binding++)
+        {
+            descriptorWrites[binding].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            descriptorWrites[binding].dstSet = cullDescriptorSets[frame];
+            descriptorWrites[binding].dstBinding = binding;
+            descriptorWrites[binding].descriptorCount = 1;
+            descriptorWrites[binding].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        }
+        descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        descriptorWrites[0].pBufferInfo = &uniformInfo;
+        descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        descriptorWrites[1].pImageInfo = &hiZInfo;
+        descriptorWrites[2].pBufferInfo = &clusterInfo;
+        descriptorWrites[3].pBufferInfo = &drawInfo;
+        descriptorWrites[4].pBufferInfo = &statsInfo;
+        vkUpdateDescriptorSets(vkDevice, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+    }
+}
+
+OcclusionCuller::Stats OcclusionCuller::GetStats(const uint32_t frame) const
+{
+    uint32_t counts[2];
+    memcpy(counts, statsBuffersMapped[frame], sizeof(counts));
+    return {GetClusterCount(), counts[0], counts[1]};
+}
+
+VkPipeline OcclusionCuller::CreateComputePipeline(const ShaderCompiler& shaderCompiler, LayoutCache& layoutCache, const char* path, const bool multisampled,
+                                                  VkDescriptorSetLayout& setLayout, VkPipelineLayout& pipelineLayout) const
+{
+    std::vector<ShaderDefine> defines;
+    if (multisampled)
+    {
+        defines.push_back({"MULTISAMPLED", "1"});
+    }
+    const std::vector<uint32_t> code = shaderCompiler.Compile(path, shaderc_glsl_compute_shader, defines);
+
+    ShaderLayout shaderLayout;
+    ShaderReflection::Reflect(code, VK_SHADER_STAGE_COMPUTE_BIT, shaderLayout);
+    std::vector<VkDescriptorSetLayout> setLayouts;
+    pipelineLayout = layoutCache.GetPipelineLayout(shaderLayout, &setLayouts);
+    setLayout = setLayouts[0];
+
+    VkShaderModuleCreateInfo moduleInfo{};
+    moduleInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    moduleInfo.codeSize = code.size() * sizeof(uint32_t);
+    moduleInfo.pCode = code.data();
+
+    VkShaderModule shaderModule;
+    if (vkCreateShaderModule(vkDevice, &moduleInfo, nullptr, &shaderModule) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create shader module!");
+    }
+
+    VkComputePipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipelineInfo.stage.module = shaderModule;
+    pipelineInfo.stage.pName = "main";
+    pipelineInfo.layout = pipelineLayout;
+
+    VkPipeline pipeline;
+    const VkResult result = vkCreateComputePipelines(vkDevice, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &pipeline);
+    vkDestroyShaderModule(vkDevice, shaderModule, nullptr);
+
+    if (result != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create culling pipeline!");
+    }
+    return pipeline;
+}
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+#include <vulkan/vulkan.h>
+
+#include "DeviceMemory.h"
+#include "RenderGraph.h"
+
+class DeletionQueue;
+class LayoutCache;
+class ShaderCompiler;
+
+// GPU culling against the depth of the depth prepass. The model is split into clusters of a few hundred triangles, each
+// with a bounding box. Every frame the prepass depth is reduced into a hierarchical Z pyramid (shaders/hiz.comp), and
+// a compute pass (shaders/cull.comp) writes one indirect draw per cluster, with no instances for the clusters that are
+// outside the frustum or hidden behind the prepass depth. The forward pass then draws those commands.
+class OcclusionCuller
+{
+public:
+    // Matches the Cluster struct of cull.comp, std430
+    struct Cluster
+    {
+        glm::vec4 boundsMin;
+        glm::vec4 boundsMax;
+        uint32_t firstIndex;
+        uint32_t indexCount;
+        int32_t vertexOffset;
+        uint32_t padding;
+    };
+
+    struct Stats
+    {
+        uint32_t clusters = 0;
+        uint32_t frustumCulled = 0;
+        uint32_t occlusionCulled = 0;
+    };
+
+    // A run of clusters the caller draws together, e.g. with one material bound
+    struct Batch
+    {
+        uint32_t firstCluster = 0;
+        uint32_t clusterCount = 0;
+    };
+
+    static constexpr uint32_t TRIANGLES_PER_CLUSTER = 128;
+
+    void Init(VkDevice device, VkPhysicalDevice physicalDevice, uint32_t framesInFlight, const ShaderCompiler& shaderCompiler, LayoutCache& layoutCache);
+    // Splits the mesh's indices into clusters in the order the triangles come, and uploads their bounds. batchEnds
+    // lists where each batch of indices ends, in order, and no cluster crosses one. firstIndex and vertexOffset place
+    // the mesh in the geometry pool the draws read from. uniformBuffers holds the per frame UniformBufferObject the
+    // camera is read from
+    void CreateClusters(const std::vector<glm::vec3>& positions, const std::vector<uint32_t>& indices, const std::vector<uint32_t>& batchEnds,
+                        uint32_t firstIndex, int32_t vertexOffset, const std::vector<VkBuffer>& uniformBuffers, VkDeviceSize uniformBufferSize);
+    void Cleanup();
+
+    // The pyramid image to declare in the render graph, one level per halving down to 1x1
+    [[nodiscard]] static RenderGraph::ImageDesc GetHiZDesc(VkExtent2D extent);
+    // Once the graph is compiled: creates the views and descriptor sets the pyramid is built and read through.
+    // depthSamples picks the Hi-Z variant that resolves the depth image
+    void SetTargets(VkImageView depthView, VkSampleCountFlagBits depthSamples, VkImage hiZImage, VkExtent2D extent);
+    // Hands the pyramid's views and descriptor sets to the deletion queue, ready for the next SetTargets
+    void Retire(DeletionQueue& deletionQueue, uint64_t lastUsedFrame);
+
+    // Recorded in the "HiZ" pass: depth in SHADER_READ_ONLY_OPTIMAL, the pyramid in GENERAL. renderExtent is the top
+    // left part of the depth image the scene rendered into this frame, the rest counts as empty
+    void RecordHiZ(VkCommandBuffer commandBuffer, VkExtent2D renderExtent) const;
+    // Recorded in the "Cull" pass: the pyramid in SHADER_READ_ONLY_OPTIMAL. Leaves the draws ready for DRAW_INDIRECT
+    void RecordCull(VkCommandBuffer commandBuffer, uint32_t frame, VkExtent2D renderExtent) const;
+
+    [[nodiscard]] VkBuffer GetDrawBuffer(uint32_t frame) const { return drawBuffers[frame]; }
+    [[nodiscard]] uint32_t GetClusterCount() const { return static_cast<uint32_t>(clusters.size()); }
+    // The clusters of one of the batches given to CreateClusters, whose commands are consecutive in the draw buffer
+    [[nodiscard]] const Batch& GetBatch(uint32_t batch) const { return batches[batch]; }
+    // Counts of the last frame that used this frame in flight slot. Its fence must have signaled
+    [[nodiscard]] Stats GetStats(uint32_t frame) const;
+
+private:
+    struct CullPushConstants
+    {
+        uint32_t clusterCount;
+        uint32_t padding;
+        int32_t renderWidth;
+        int32_t renderHeight;
+    };
+
+    struct HiZPushConstants
+    {
+        int32_t srcWidth;
+        int32_t srcHeight;
+        int32_t dstWidth;
+        int32_t dstHeight;
+        int32_t level;
+        int32_t sampleCount;
+    };
+
+    VkDevice vkDevice = VK_NULL_HANDLE;
+    DeviceMemory deviceMemory;
+    VkSampleCountFlagBits depthSamples = VK_SAMPLE_COUNT_1_BIT;
+    VkSampler sampler = VK_NULL_HANDLE;
+
+    // Layouts owned by the layout cache
+    VkDescriptorSetLayout hiZSetLayout = VK_NULL_HANDLE;
+    VkPipelineLayout hiZPipelineLayout = VK_NULL_HANDLE;
+    VkPipeline hiZPipeline = VK_NULL_HANDLE;
+    VkPipeline hiZMultisampledPipeline = VK_NULL_HANDLE;
+    VkDescriptorSetLayout cullSetLayout = VK_NULL_HANDLE;
+    VkPipelineLayout cullPipelineLayout = VK_NULL_HANDLE;
+    VkPipeline cullPipeline = VK_NULL_HANDLE;
+
+    std::vector<Cluster> clusters;
+    std::vector<Batch> batches;
+    VkBuffer clusterBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory clusterBufferMemory = VK_NULL_HANDLE;
+
+    // One of each per frame in flight. Stats stay mapped and are read back once the frame's fence signals
+    std::vector<VkBuffer> uniformBuffers;
+    VkDeviceSize uniformBufferSize = 0;
+    std::vector<VkBuffer> drawBuffers;
+    std::vector<VkDeviceMemory> drawBuffersMemory;
+    std::vector<VkBuffer> statsBuffers;
+    std::vector<VkDeviceMemory> statsBuffersMemory;
+    std::vector<void*> statsBuffersMapped;
+
+    // Sized to the current swap chain, replaced by SetTargets
+    VkExtent2D extent = {};
+    VkImageView hiZView = VK_NULL_HANDLE;
+    std::vector<VkImageView> levelViews;
+    VkDescriptorPool hiZDescriptorPool = VK_NULL_HANDLE;
+    std::vector<VkDescriptorSet> hiZDescriptorSets;
+    // One per frame in flight, from the pyramid's pool
+    std::vector<VkDescriptorSet> cullDescriptorSets;
+
+    // Points every cull set at the current pyramid and the frame's buffers. Needs both SetTargets and CreateClusters
+    void WriteCullDescriptorSets() const;
+    VkPipeline CreateComputePipeline(const ShaderCompiler& shaderCompiler, LayoutCache& layoutCache, const char* path, bool multisampled,
+                                     VkDescriptorSetLayout& setLayout, VkPipelineLayout& pipelineLayout) const;
+};
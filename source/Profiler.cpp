@@ -0,0 +1,249 @@
+#include "Profiler.h"
+
+#if NYCSI_PROFILE
+
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+
+namespace
+{
+    // GPU zones go on their own track in the trace, below the CPU threads
+    constexpr uint32_t GPU_THREAD_ID = 1000;
+
+    void WriteJsonString(std::ofstream& file, const char* text)
+    {
+        file << '"';
+        for (const char* c = text; *c != '\0'; c++)
+        {
+            if (*c == '"' || *c == '\\')
+            {
+                file << '\\';
+            }
+            file << *c;
+        }
+        file << '"';
+    }
+}
+
+Profiler& Profiler::Get()
+{
+    static Profiler profiler;
+    return profiler;
+}
+
+void Profiler::InitGpu(const VkDevice device, const float period, const uint32_t timestampValidBits, const uint32_t framesInFlight)
+{
+    if (timestampValidBits == 0)
+    {
+        std::cerr << "The graphics queue does not support timestamps, the trace will only have CPU zones" << '\n';
+        return;
+    }
+
+    vkDevice = device;
+    timestampPeriod = period;
+    timestampMask = timestampValidBits >= 64 ? ~0ull : (1ull << timestampValidBits) - 1;
+
+    VkQueryPoolCreateInfo queryPoolInfo{};
+    queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    queryPoolInfo.queryCount = MAX_GPU_ZONES_PER_FRAME * 2;
+
+    gpuFrames.resize(framesInFlight);
+    for (GpuFrame& frame : gpuFrames)
+    {
+        if (vkCreateQueryPool(vkDevice, &queryPoolInfo, nullptr, &frame.queryPool) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create profiler query pool!");
+        }
+    }
+
+    queryPoolInfo.queryCount = 1;
+    if (vkCreateQueryPool(vkDevice, &queryPoolInfo, nullptr, &calibrationQueryPool) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create profiler query pool!");
+    }
+}
+
+void Profiler::CleanupGpu()
+{
+    for (const GpuFrame& frame : gpuFrames)
+    {
+        vkDestroyQueryPool(vkDevice, frame.queryPool, nullptr);
+    }
+    gpuFrames.clear();
+
+    vkDestroyQueryPool(vkDevice, calibrationQueryPool, nullptr);
+    calibrationQueryPool = VK_NULL_HANDLE;
+}
+
+void Profiler::RecordCalibration(const VkCommandBuffer commandBuffer) const
+{
+    if (calibrationQueryPool == VK_NULL_HANDLE)
+        return;
+
+    vkCmdResetQueryPool(commandBuffer, calibrationQueryPool, 0, 1);
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, calibrationQueryPool, 0);
+}
+
+void Profiler::FinishCalibration()
+{
+    if (calibrationQueryPool == VK_NULL_HANDLE)
+        return;
+
+    // The submission already completed, so the CPU time right now is the closest we get to the GPU's timestamp
+    vkGetQueryPoolResults(vkDevice, calibrationQueryPool, 0, 1, sizeof(calibrationTicks), &calibrationTicks, sizeof(uint64_t),
+                          VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT);
+    calibrationMicroseconds = MicrosecondsSinceStart(std::chrono::steady_clock::now());
+}
+
+void Profiler::BeginGpuFrame(const VkCommandBuffer commandBuffer, const uint32_t frame)
+{
+    recordingFrame = frame;
+    if (!enabled || gpuFrames.empty())
+        return;
+
+    GpuFrame& gpuFrame = gpuFrames[frame];
+    gpuFrame.zones.clear();
+    gpuFrame.queryCount = 0;
+    vkCmdResetQueryPool(commandBuffer, gpuFrame.queryPool, 0, MAX_GPU_ZONES_PER_FRAME * 2);
+}
+
+void Profiler::ResolveGpuFrame(const uint32_t frame)
+{
+    if (gpuFrames.empty())
+        return;
+
+    GpuFrame& gpuFrame = gpuFrames[frame];
+    if (gpuFrame.zones.empty())
+        return;
+
+    // No WAIT_BIT: the fence already signaled, and if the results are somehow not there we drop the frame
+    // rather than block on it
+    uint64_t timestamps[MAX_GPU_ZONES_PER_FRAME * 2];
+    const VkResult result = vkGetQueryPoolResults(vkDevice, gpuFrame.queryPool, 0, gpuFrame.queryCount, sizeof(timestamps), timestamps,
+                                                  sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+
+    if (result == VK_SUCCESS)
+    {
+        const double microsecondsPerTick = timestampPeriod / 1000.0;
+        for (const PendingGpuZone& zone : gpuFrame.zones)
+        {
+            const uint64_t begin = (timestamps[zone.beginQuery] - calibrationTicks) & timestampMask;
+            const uint64_t end = (timestamps[zone.endQuery] - calibrationTicks) & timestampMask;
+            const double start = calibrationMicroseconds + static_cast<double>(begin) * microsecondsPerTick;
+            const double duration = static_cast<double>(end - begin) * microsecondsPerTick;
+            AddEvent(zone.name, GPU_THREAD_ID, start, duration);
+        }
+    }
+
+    gpuFrame.zones.clear();
+    gpuFrame.queryCount = 0;
+}
+
+void Profiler::WriteChromeTrace(const std::string& path)
+{
+    std::ofstream file(path);
+    if (!file.is_open())
+    {
+        throw std::runtime_error("failed to write trace " + path + "!");
+    }
+
+    const std::lock_guard lock(eventsMutex);
+
+    file << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+
+    // Metadata events name the tracks
+    file << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << GPU_THREAD_ID << ", \"args\": {\"name\": \"GPU\"}}";
+    for (uint32_t thread = 0; thread < threadCount; thread++)
+    {
+        file << ",\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << thread << ", \"args\": {\"name\": \""
+             << (thread == 0 ? std::string("Main") : "Worker " + std::to_string(thread)) << "\"}}";
+    }
+
+    // Complete events. Chrome nests them by their time ranges, which gives us the hierarchy for free
+    for (const Event& event : events)
+    {
+        file << ",\n{\"name\": ";
+        WriteJsonString(file, event.name);
+        file << ", \"ph\": \"X\", \"pid\": 1, \"tid\": " << event.thread << ", \"ts\": " << event.start << ", \"dur\": " << event.duration << "}";
+    }
+
+    file << "\n]}\n";
+}
+
+double Profiler::MicrosecondsSinceStart(const std::chrono::steady_clock::time_point time) const
+{
+    return std::chrono::duration<double, std::micro>(time - startTime).count();
+}
+
+uint32_t Profiler::GetThreadId()
+{
+    thread_local uint32_t threadId = UINT32_MAX;
+    if (threadId == UINT32_MAX)
+    {
+        const std::lock_guard lock(eventsMutex);
+        threadId = threadCount++;
+    }
+    return threadId;
+}
+
+void Profiler::AddEvent(const char* name, const uint32_t thread, const double start, const double duration)
+{
+    const std::lock_guard lock(eventsMutex);
+    events.push_back({name, thread, start, duration});
+}
+
+int32_t Profiler::BeginGpuZone(const VkCommandBuffer commandBuffer, const char* name)
+{
+    if (!enabled || gpuFrames.empty())
+        return -1;
+
+    GpuFrame& gpuFrame = gpuFrames[recordingFrame];
+    if (gpuFrame.queryCount + 2 > MAX_GPU_ZONES_PER_FRAME * 2)
+        return -1;
+
+    const PendingGpuZone zone{name, gpuFrame.queryCount, gpuFrame.queryCount + 1};
+    gpuFrame.queryCount += 2;
+    gpuFrame.zones.push_back(zone);
+
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, gpuFrame.queryPool, zone.beginQuery);
+    return static_cast<int32_t>(gpuFrame.zones.size() - 1);
+}
+
+void Profiler::EndGpuZone(const VkCommandBuffer commandBuffer, const int32_t zone)
+{
+    if (zone < 0)
+        return;
+
+    const GpuFrame& gpuFrame = gpuFrames[recordingFrame];
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, gpuFrame.queryPool, gpuFrame.zones[zone].endQuery);
+}
+
+Profiler::CpuZone::CpuZone(const char* name)
+    : name(name), start(std::chrono::steady_clock::now())
+{
+}
+
+Profiler::CpuZone::~CpuZone()
+{
+    Profiler& profiler = Get();
+    if (!profiler.enabled)
+        return;
+
+    const auto end = std::chrono::steady_clock::now();
+    const double startMicroseconds = profiler.MicrosecondsSinceStart(start);
+    profiler.AddEvent(name, profiler.GetThreadId(), startMicroseconds, profiler.MicrosecondsSinceStart(end) - startMicroseconds);
+}
+
+Profiler::GpuZone::GpuZone(const VkCommandBuffer commandBuffer, const char* name)
+    : commandBuffer(commandBuffer), zone(Get().BeginGpuZone(commandBuffer, name))
+{
+}
+
+Profiler::GpuZone::~GpuZone()
+{
+    Get().EndGpuZone(commandBuffer, zone);
+}
+
+#endif
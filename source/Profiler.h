@@ -0,0 +1,142 @@
+#pragma once
+
+// The profiler is compiled in only when NYCSI_PROFILE is defined to 1 (add it to the project's preprocessor
+// definitions). Otherwise every PROFILE_* macro expands to nothing and the instrumented code pays nothing for it.
+#ifndef NYCSI_PROFILE
+#define NYCSI_PROFILE 0
+#endif
+
+#if NYCSI_PROFILE
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+// Records CPU zones (scoped timers on any thread) and GPU zones (pairs of timestamps written into the frame's command
+// buffer) and exports both as a Chrome trace, which chrome://tracing or https://ui.perfetto.dev can open.
+// Every frame in flight has its own query pool, which is only read back after that frame's fence has signaled, so
+// resolving GPU zones never stalls the CPU.
+class Profiler
+{
+public:
+    static Profiler& Get();
+
+    // Nothing is recorded until the profiler is enabled, so a profiling build can still run without producing a trace
+    void SetEnabled(bool enable) { enabled = enable; }
+    [[nodiscard]] bool IsEnabled() const { return enabled; }
+
+    void InitGpu(VkDevice device, float timestampPeriod, uint32_t timestampValidBits, uint32_t framesInFlight);
+    void CleanupGpu();
+
+    // GPU timestamps run on their own clock. Calibration writes one timestamp and pairs it with the CPU time at which
+    // the submission completed, which puts GPU zones on the same timeline as the CPU ones
+    void RecordCalibration(VkCommandBuffer commandBuffer) const;
+    void FinishCalibration();
+
+    // Starts recording the GPU zones of a frame in flight. Must be called outside of a render pass
+    void BeginGpuFrame(VkCommandBuffer commandBuffer, uint32_t frame);
+    // Reads back the zones recorded the last time this frame in flight was used. Its fence must have signaled
+    void ResolveGpuFrame(uint32_t frame);
+
+    void WriteChromeTrace(const std::string& path);
+
+    class CpuZone
+    {
+    public:
+        explicit CpuZone(const char* name);
+        ~CpuZone();
+        CpuZone(const CpuZone&) = delete;
+        CpuZone& operator=(const CpuZone&) = delete;
+
+    private:
+        const char* name;
+        std::chrono::steady_clock::time_point start;
+    };
+
+    class GpuZone
+    {
+    public:
+        GpuZone(VkCommandBuffer commandBuffer, const char* name);
+        ~GpuZone();
+        GpuZone(const GpuZone&) = delete;
+        GpuZone& operator=(const GpuZone&) = delete;
+
+    private:
+        VkCommandBuffer commandBuffer;
+        int32_t zone;
+    };
+
+private:
+    static constexpr uint32_t MAX_GPU_ZONES_PER_FRAME = 32;
+
+    struct Event
+    {
+        const char* name;
+        uint32_t thread;
+        // Microseconds since the profiler started
+        double start;
+        double duration;
+    };
+
+    struct PendingGpuZone
+    {
+        const char* name;
+        uint32_t beginQuery;
+        uint32_t endQuery;
+    };
+
+    struct GpuFrame
+    {
+        VkQueryPool queryPool = VK_NULL_HANDLE;
+        uint32_t queryCount = 0;
+        std::vector<PendingGpuZone> zones;
+    };
+
+    bool enabled = false;
+    std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+
+    std::mutex eventsMutex;
+    std::vector<Event> events;
+    uint32_t threadCount = 0;
+
+    VkDevice vkDevice = VK_NULL_HANDLE;
+    float timestampPeriod = 1.0f;
+    uint64_t timestampMask = ~0ull;
+    std::vector<GpuFrame> gpuFrames;
+    uint32_t recordingFrame = 0;
+    VkQueryPool calibrationQueryPool = VK_NULL_HANDLE;
+    uint64_t calibrationTicks = 0;
+    double calibrationMicroseconds = 0.0;
+
+    Profiler() = default;
+
+    [[nodiscard]] double MicrosecondsSinceStart(std::chrono::steady_clock::time_point time) const;
+    // Small, stable ids for the trace's "tid" field, one per thread that ever recorded a zone
+    uint32_t GetThreadId();
+    void AddEvent(const char* name, uint32_t thread, double start, double duration);
+
+    int32_t BeginGpuZone(VkCommandBuffer commandBuffer, const char* name);
+    void EndGpuZone(VkCommandBuffer commandBuffer, int32_t zone);
+};
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+
+// Times the rest of the enclosing scope on the CPU
+#define PROFILE_CPU_ZONE(name) const Profiler::CpuZone PROFILE_CONCAT(profileCpuZone, __LINE__)(name)
+// Times the commands recorded into commandBuffer for the rest of the enclosing scope
+#define PROFILE_GPU_ZONE(commandBuffer, name) const Profiler::GpuZone PROFILE_CONCAT(profileGpuZone, __LINE__)(commandBuffer, name)
+#define PROFILE_GPU_BEGIN_FRAME(commandBuffer, frame) Profiler::Get().BeginGpuFrame(commandBuffer, frame)
+#define PROFILE_GPU_RESOLVE_FRAME(frame) Profiler::Get().ResolveGpuFrame(frame)
+
+#else
+
+#define PROFILE_CPU_ZONE(name) ((void)0)
+#define PROFILE_GPU_ZONE(commandBuffer, name) ((void)0)
+#define PROFILE_GPU_BEGIN_FRAME(commandBuffer, frame) ((void)0)
+#define PROFILE_GPU_RESOLVE_FRAME(frame) ((void)0)
+
+#endif
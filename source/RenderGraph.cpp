@@ -0,0 +1,832 @@
+#include "RenderGraph.h"
+
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+
+#include "DeletionQueue.h"
+#include "Profiler.h"
+
+namespace
+{
+    struct AccessInfo
+    {
+        VkImageLayout layout;
+        VkPipelineStageFlags stages;
+        VkAccessFlags readAccess;
+        VkAccessFlags writeAccess;
+        VkImageUsageFlags usage;
+    };
+
+    AccessInfo GetAccessInfo(const RenderGraphAccess access)
+    {
+        constexpr VkPipelineStageFlags fragmentTests = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+
+        switch (access)
+        {
+        case RenderGraphAccess::ColorAttachment:
+        case RenderGraphAccess::ResolveAttachment:
+            return {VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                    VK_ACCESS_COLOR_ATTACHMENT_READ_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT};
+        case RenderGraphAccess::DepthAttachment:
+            return {VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, fragmentTests,
+                    VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT, VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT};
+        case RenderGraphAccess::DepthReadOnly:
+            return {VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL, fragmentTests,
+                    VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT, 0, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT};
+        case RenderGraphAccess::FragmentSampled:
+            return {VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                    VK_ACCESS_SHADER_READ_BIT, 0, VK_IMAGE_USAGE_SAMPLED_BIT};
+        case RenderGraphAccess::ComputeSampled:
+            return {VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                    VK_ACCESS_SHADER_READ_BIT, 0, VK_IMAGE_USAGE_SAMPLED_BIT};
+        case RenderGraphAccess::ComputeStorage:
+            return {VK_IMAGE_LAYOUT_GENERAL, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                    VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_SHADER_WRITE_BIT, VK_IMAGE_USAGE_STORAGE_BIT};
+        case RenderGraphAccess::TransferSrc:
+            return {VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                    VK_ACCESS_TRANSFER_READ_BIT, 0, VK_IMAGE_USAGE_TRANSFER_SRC_BIT};
+        case RenderGraphAccess::TransferDst:
+            return {VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                    0, VK_ACCESS_TRANSFER_WRITE_BIT, VK_IMAGE_USAGE_TRANSFER_DST_BIT};
+        }
+
+        throw std::runtime_error("unknown render graph access!");
+    }
+
+    bool IsDepthFormat(const VkFormat format)
+    {
+        return format == VK_FORMAT_D16_UNORM || format == VK_FORMAT_X8_D24_UNORM_PACK32 || format == VK_FORMAT_D32_SFLOAT ||
+               format == VK_FORMAT_D16_UNORM_S8_UINT || format == VK_FORMAT_D24_UNORM_S8_UINT || format == VK_FORMAT_D32_SFLOAT_S8_UINT;
+    }
+
+    bool HasStencil(const VkFormat format)
+    {
+        return format == VK_FORMAT_D16_UNORM_S8_UINT || format == VK_FORMAT_D24_UNORM_S8_UINT || format == VK_FORMAT_D32_SFLOAT_S8_UINT;
+    }
+}
+
+void RenderGraph::Init(const VkDevice device, const VkPhysicalDevice physicalDevice)
+{
+    vkDevice = device;
+    deviceMemory.Init(device, physicalDevice);
+}
+
+void RenderGraph::Cleanup()
+{
+    for (const auto& [key, renderPass] : renderPassCache)
+    {
+        vkDestroyRenderPass(vkDevice, renderPass, nullptr);
+    }
+    renderPassCache.clear();
+}
+
+RenderGraph::ResourceId RenderGraph::CreateImage(const char* name, const ImageDesc& desc)
+{
+    Resource resource{};
+    resource.name = name;
+    resource.desc = desc;
+    return AddResource(resource);
+}
+
+RenderGraph::ResourceId RenderGraph::ImportImage(const char* name, const ImageDesc& desc, const VkImageLayout initialLayout, const VkImageLayout finalLayout)
+{
+    Resource resource{};
+    resource.name = name;
+    resource.desc = desc;
+    resource.imported = true;
+    resource.initialLayout = initialLayout;
+    resource.finalLayout = finalLayout;
+    return AddResource(resource);
+}
+
+RenderGraph::ResourceId RenderGraph::AddResource(const Resource& resource)
+{
+    if (compiled)
+    {
+        throw std::runtime_error("render graph is already compiled!");
+    }
+
+    resources.push_back(resource);
+    return static_cast<ResourceId>(resources.size() - 1);
+}
+
+RenderGraph::PassId RenderGraph::AddGraphicsPass(const char* name, RecordFunction record)
+{
+    return DeclarePass(name, std::move(record), true);
+}
+
+RenderGraph::PassId RenderGraph::AddPass(const char* name, RecordFunction record)
+{
+    return DeclarePass(name, std::move(record), false);
+}
+
+RenderGraph::PassId RenderGraph::DeclarePass(const char* name, RecordFunction record, const bool graphics)
+{
+    if (compiled)
+    {
+        throw std::runtime_error("render graph is already compiled!");
+    }
+
+    Pass pass{};
+    pass.name = name;
+    pass.record = std::move(record);
+    pass.graphics = graphics;
+    passes.push_back(std::move(pass));
+    return static_cast<PassId>(passes.size() - 1);
+}
+
+void RenderGraph::AddUse(const PassId pass, const ResourceId image, const RenderGraphAccess access, const bool read, const bool write)
+{
+    // One layout per image and pass, so an image can't be e.g. an attachment and sampled in the same pass
+    for (const Use& use : passes[pass].uses)
+    {
+        if (use.resource == image)
+        {
+            throw std::runtime_error(std::string("render graph pass ") + passes[pass].name + " uses " + resources[image].name + " twice!");
+        }
+    }
+
+    passes[pass].uses.push_back({image, access, read, write});
+}
+
+void RenderGraph::AddColorAttachment(const PassId pass, const ResourceId image, const std::optional<VkClearColorValue> clear)
+{
+    passes[pass].colorAttachments.push_back({image, clear});
+    AddUse(pass, image, RenderGraphAccess::ColorAttachment, !clear.has_value(), true);
+}
+
+void RenderGraph::AddResolveAttachment(const PassId pass, const ResourceId image)
+{
+    if (passes[pass].colorAttachments.empty())
+    {
+        throw std::runtime_error("resolve attachment without a color attachment!");
+    }
+
+    passes[pass].colorAttachments.back().resolve = image;
+    AddUse(pass, image, RenderGraphAccess::ResolveAttachment, false, true);
+}
+
+void RenderGraph::SetDepthAttachment(const PassId pass, const ResourceId image, const std::optional<VkClearDepthStencilValue> clear, const bool write)
+{
+    passes[pass].depthAttachment = {image, clear, write};
+    if (write)
+    {
+        AddUse(pass, image, RenderGraphAccess::DepthAttachment, !clear.has_value(), true);
+    }
+    else
+    {
+        AddUse(pass, image, RenderGraphAccess::DepthReadOnly, true, false);
+    }
+}
+
+void RenderGraph::SetViewMask(const PassId pass, const uint32_t viewMask)
+{
+    passes[pass].viewMask = viewMask;
+}
+
+void RenderGraph::SetRenderArea(const PassId pass, const VkExtent2D extent)
+{
+    passes[pass].renderArea = extent;
+}
+
+void RenderGraph::Read(const PassId pass, const ResourceId image, const RenderGraphAccess access)
+{
+    AddUse(pass, image, access, true, false);
+}
+
+void RenderGraph::Write(const PassId pass, const ResourceId image, const RenderGraphAccess access)
+{
+    // Storage images are read-modify-write unless proven otherwise, everything else is overwritten
+    AddUse(pass, image, access, access == RenderGraphAccess::ComputeStorage, true);
+}
+
+void RenderGraph::SetSideEffect(const PassId pass)
+{
+    passes[pass].sideEffect = true;
+}
+
+void RenderGraph::Compile()
+{
+    CullPasses();
+    CreateTransientImages();
+    PlanBarriers();
+
+    for (Pass& pass : passes)
+    {
+        if (!pass.culled && pass.graphics)
+        {
+            CreateRenderPass(pass);
+        }
+    }
+
+    compiled = true;
+}
+
+void RenderGraph::CullPasses()
+{
+    // Walk back from the passes that have to run, keeping whoever produces what they read
+    std::vector<bool> needed(resources.size(), false);
+    culledPassCount = 0;
+
+    for (size_t i = passes.size(); i-- > 0;)
+    {
+        Pass& pass = passes[i];
+
+        bool keep = pass.sideEffect;
+        for (const Use& use : pass.uses)
+        {
+            if (use.write && (resources[use.resource].imported || needed[use.resource]))
+            {
+                keep = true;
+            }
+        }
+
+        pass.culled = !keep;
+        if (!keep)
+        {
+            culledPassCount++;
+            continue;
+        }
+
+        // What the pass overwrites doesn't need an earlier producer, what it reads does
+        for (const Use& use : pass.uses)
+        {
+            if (use.write && !use.read)
+            {
+                needed[use.resource] = false;
+            }
+        }
+        for (const Use& use : pass.uses)
+        {
+            if (use.read)
+            {
+                needed[use.resource] = true;
+            }
+        }
+    }
+}
+
+void RenderGraph::CreateTransientImages()
+{
+    // Lifetime (in pass order) and usage of every image a kept pass touches
+    for (uint32_t i = 0; i < passes.size(); i++)
+    {
+        if (passes[i].culled)
+            continue;
+
+        for (const Use& use : passes[i].uses)
+        {
+            Resource& resource = resources[use.resource];
+            resource.usage |= GetAccessInfo(use.access).usage;
+            resource.firstPass = std::min(resource.firstPass, i);
+            resource.lastPass = std::max(resource.lastPass, i);
+        }
+    }
+
+    std::vector<ResourceId> transients;
+    std::vector<VkMemoryRequirements> requirements(resources.size());
+    for (ResourceId id = 0; id < resources.size(); id++)
+    {
+        Resource& resource = resources[id];
+        if (resource.imported || resource.usage == 0)
+            continue;
+
+        // Images that are only ever attachments of a single pass can stay in tile memory on GPUs that have it. One
+        // carried from pass to pass (e.g. the depth of a depth prepass) has to be stored in between
+        VkImageUsageFlags usage = resource.usage;
+        if ((usage & ~(VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT)) == 0 && resource.firstPass == resource.lastPass)
+        {
+            usage |= VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+        }
+
+        VkImageCreateInfo imageInfo{};
+        imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        imageInfo.imageType = VK_IMAGE_TYPE_2D;
+        imageInfo.extent = {resource.desc.extent.width, resource.desc.extent.height, 1};
+        imageInfo.mipLevels = resource.desc.mipLevels;
+        imageInfo.arrayLayers = resource.desc.layers;
+        imageInfo.format = resource.desc.format;
+        imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+        imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        imageInfo.usage = usage;
+        imageInfo.samples = resource.desc.samples;
+        imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+        if (vkCreateImage(vkDevice, &imageInfo, nullptr, &resource.image) != VK_SUCCESS)
+        {
+            throw std::runtime_error(std::string("failed to create render graph image ") + resource.name + "!");
+        }
+
+        vkGetImageMemoryRequirements(vkDevice, resource.image, &requirements[id]);
+        transients.push_back(id);
+    }
+
+    // Biggest first, each one going into the first block it fits in whose images are all dead by the time it is
+    // needed (or born after it is done). Contents never survive a frame, so sharing memory is only about lifetimes
+    std::sort(transients.begin(), transients.end(), [&requirements](const ResourceId a, const ResourceId b)
+    {
+        return requirements[a].size > requirements[b].size;
+    });
+
+    transientMemory = 0;
+    unaliasedTransientMemory = 0;
+    for (const ResourceId id : transients)
+    {
+        Resource& resource = resources[id];
+        const VkMemoryRequirements& memRequirements = requirements[id];
+        unaliasedTransientMemory += memRequirements.size;
+
+        for (uint32_t blockIndex = 0; blockIndex < memoryBlocks.size() && resource.memoryBlock == UINT32_MAX; blockIndex++)
+        {
+            MemoryBlock& block = memoryBlocks[blockIndex];
+            const uint32_t memoryTypeBits = block.memoryTypeBits & memRequirements.memoryTypeBits;
+            if (memRequirements.size > block.size || !deviceMemory.TryFindMemoryType(memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT))
+                continue;
+
+            const bool overlaps = std::any_of(block.resources.begin(), block.resources.end(), [&](const ResourceId other)
+            {
+                return resource.firstPass <= resources[other].lastPass && resources[other].firstPass <= resource.lastPass;
+            });
+            if (overlaps)
+                continue;
+
+            block.memoryTypeBits = memoryTypeBits;
+            block.resources.push_back(id);
+            resource.memoryBlock = blockIndex;
+        }
+
+        if (resource.memoryBlock == UINT32_MAX)
+        {
+            MemoryBlock block;
+            block.size = memRequirements.size;
+            block.memoryTypeBits = memRequirements.memoryTypeBits;
+            block.resources.push_back(id);
+            memoryBlocks.push_back(block);
+            resource.memoryBlock = static_cast<uint32_t>(memoryBlocks.size() - 1);
+        }
+    }
+
+    for (MemoryBlock& block : memoryBlocks)
+    {
+        const std::optional<uint32_t> memoryType = deviceMemory.TryFindMemoryType(block.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        if (!memoryType)
+        {
+            throw std::runtime_error("failed to find suitable memory type!");
+        }
+
+        VkMemoryAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        allocInfo.allocationSize = block.size;
+        allocInfo.memoryTypeIndex = *memoryType;
+
+        if (vkAllocateMemory(vkDevice, &allocInfo, nullptr, &block.memory) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to allocate render graph memory!");
+        }
+        transientMemory += block.size;
+
+        for (const ResourceId id : block.resources)
+        {
+            Resource& resource = resources[id];
+            vkBindImageMemory(vkDevice, resource.image, block.memory, 0);
+
+            VkImageViewCreateInfo viewInfo{};
+            viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+            viewInfo.image = resource.image;
+            viewInfo.viewType = resource.desc.layers > 1 ? VK_IMAGE_VIEW_TYPE_2D_ARRAY : VK_IMAGE_VIEW_TYPE_2D;
+            viewInfo.format = resource.desc.format;
+            viewInfo.subresourceRange.aspectMask = IsDepthFormat(resource.desc.format) ? VK_IMAGE_ASPECT_DEPTH_BIT : VK_IMAGE_ASPECT_COLOR_BIT;
+            viewInfo.subresourceRange.baseMipLevel = 0;
+            viewInfo.subresourceRange.levelCount = resource.desc.mipLevels;
+            viewInfo.subresourceRange.baseArrayLayer = 0;
+            viewInfo.subresourceRange.layerCount = resource.desc.layers;
+
+            if (vkCreateImageView(vkDevice, &viewInfo, nullptr, &resource.view) != VK_SUCCESS)
+            {
+                throw std::runtime_error(std::string("failed to create render graph image view ") + resource.name + "!");
+            }
+        }
+    }
+
+    for (const Pass& pass : passes)
+    {
+        if (pass.culled)
+            continue;
+
+        for (const Use& use : pass.uses)
+        {
+            const Resource& resource = resources[use.resource];
+            if (resource.memoryBlock == UINT32_MAX)
+                continue;
+
+            const AccessInfo info = GetAccessInfo(use.access);
+            memoryBlocks[resource.memoryBlock].stages |= info.stages;
+            if (use.write)
+            {
+                memoryBlocks[resource.memoryBlock].writeAccess |= info.writeAccess;
+            }
+        }
+    }
+}
+
+void RenderGraph::PlanBarriers()
+{
+    // What the next use of an image has to wait for: the stages of the last write (or layout transition) and the
+    // reads since then, and which stages and accesses have already been made to see that write
+    struct State
+    {
+        VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+        VkPipelineStageFlags writeStages = 0;
+        VkAccessFlags writeAccess = 0;
+        VkPipelineStageFlags readStages = 0;
+        VkPipelineStageFlags visibleStages = 0;
+        VkAccessFlags visibleAccess = 0;
+    };
+
+    std::vector<State> states(resources.size());
+    for (ResourceId id = 0; id < resources.size(); id++)
+    {
+        const Resource& resource = resources[id];
+        if (resource.imported)
+        {
+            states[id].layout = resource.initialLayout;
+        }
+        else if (resource.memoryBlock != UINT32_MAX)
+        {
+            // Transient images share their memory with the other images in the block, both later in this frame
+            // and in the previous frame, so their first use waits on everything that touches the block
+            states[id].writeStages = memoryBlocks[resource.memoryBlock].stages;
+            states[id].writeAccess = memoryBlocks[resource.memoryBlock].writeAccess;
+        }
+    }
+
+    barrierCount = 0;
+    for (Pass& pass : passes)
+    {
+        pass.barriers = {};
+        if (pass.culled)
+            continue;
+
+        for (const Use& use : pass.uses)
+        {
+            const AccessInfo info = GetAccessInfo(use.access);
+            State& state = states[use.resource];
+
+            const VkAccessFlags readAccess = use.read ? info.readAccess : 0;
+            const VkAccessFlags writeAccess = use.write ? info.writeAccess : 0;
+
+            const bool layoutChange = state.layout != info.layout;
+            const bool readAfterWrite = use.read && state.writeStages != 0 &&
+                ((state.visibleStages & info.stages) != info.stages || (state.visibleAccess & readAccess) != readAccess);
+            const bool writeAfterAny = use.write && (state.writeStages != 0 || state.readStages != 0);
+
+            if (!layoutChange && !readAfterWrite && !writeAfterAny)
+            {
+                // Reading something this stage can already see, or the very first write to an imported image
+                if (use.write)
+                {
+                    state.writeStages = info.stages;
+                    state.writeAccess = writeAccess;
+                }
+                else
+                {
+                    state.readStages |= info.stages;
+                }
+                continue;
+            }
+
+            // Nothing touched an imported image yet, so the barrier just has to chain with the semaphore guarding it
+            const VkPipelineStageFlags srcStages = state.writeStages | state.readStages;
+            pass.barriers.srcStages |= srcStages != 0 ? srcStages : info.stages;
+            pass.barriers.dstStages |= info.stages;
+            // When the pass overwrites the image, transitioning from UNDEFINED lets the driver skip preserving it
+            pass.barriers.barriers.push_back({use.resource, use.read ? state.layout : VK_IMAGE_LAYOUT_UNDEFINED, info.layout,
+                                              state.writeAccess, readAccess | writeAccess});
+
+            // From here on this use is the only thing the next one has to wait for
+            state.layout = info.layout;
+            state.writeStages = info.stages;
+            state.writeAccess = writeAccess;
+            state.readStages = use.write ? 0 : info.stages;
+            state.visibleStages = use.write ? 0 : info.stages;
+            state.visibleAccess = readAccess;
+        }
+
+        barrierCount += static_cast<uint32_t>(pass.barriers.barriers.size());
+    }
+
+    finalBarriers = {};
+    for (ResourceId id = 0; id < resources.size(); id++)
+    {
+        const Resource& resource = resources[id];
+        const State& state = states[id];
+        if (!resource.imported || resource.finalLayout == VK_IMAGE_LAYOUT_UNDEFINED || state.layout == resource.finalLayout)
+            continue;
+
+        const VkPipelineStageFlags srcStages = state.writeStages | state.readStages;
+        finalBarriers.srcStages |= srcStages != 0 ? srcStages : static_cast<VkPipelineStageFlags>(VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT);
+        finalBarriers.dstStages |= VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+        finalBarriers.barriers.push_back({id, state.layout, resource.finalLayout, state.writeAccess, 0});
+    }
+    barrierCount += static_cast<uint32_t>(finalBarriers.barriers.size());
+}
+
+void RenderGraph::CreateRenderPass(Pass& pass)
+{
+    const uint32_t passIndex = static_cast<uint32_t>(&pass - passes.data());
+
+    std::vector<VkAttachmentDescription> descriptions;
+    pass.attachments.clear();
+    pass.clearValues.clear();
+
+    // The graph already put every attachment in its layout, so the render pass itself never transitions anything.
+    // Contents are only loaded if an earlier pass wrote them and only stored if a later pass (or the owner of an
+    // imported image) will look at them
+    const auto addAttachment = [&](const ResourceId id, const RenderGraphAccess access, const bool clear, const VkClearValue clearValue)
+    {
+        const Resource& resource = resources[id];
+        const bool hasContents = resource.firstPass < passIndex || (resource.imported && resource.initialLayout != VK_IMAGE_LAYOUT_UNDEFINED);
+        const bool contentsNeeded = resource.lastPass > passIndex || resource.imported;
+        const VkImageLayout layout = GetAccessInfo(access).layout;
+
+        VkAttachmentDescription description{};
+        description.format = resource.desc.format;
+        description.samples = resource.desc.samples;
+        description.loadOp = clear ? VK_ATTACHMENT_LOAD_OP_CLEAR : hasContents ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+        description.storeOp = contentsNeeded ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        description.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+        description.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        description.initialLayout = layout;
+        description.finalLayout = layout;
+        descriptions.push_back(description);
+
+        pass.attachments.push_back(id);
+        pass.clearValues.push_back(clearValue);
+        return VkAttachmentReference{static_cast<uint32_t>(descriptions.size() - 1), layout};
+    };
+
+    std::vector<VkAttachmentReference> colorRefs;
+    for (const ColorAttachment& attachment : pass.colorAttachments)
+    {
+        VkClearValue clearValue{};
+        clearValue.color = attachment.clear.value_or(VkClearColorValue{});
+        colorRefs.push_back(addAttachment(attachment.image, RenderGraphAccess::ColorAttachment, attachment.clear.has_value(), clearValue));
+    }
+
+    VkAttachmentReference depthRef{VK_ATTACHMENT_UNUSED, VK_IMAGE_LAYOUT_UNDEFINED};
+    if (pass.depthAttachment.image != NO_RESOURCE)
+    {
+        VkClearValue clearValue{};
+        clearValue.depthStencil = pass.depthAttachment.clear.value_or(VkClearDepthStencilValue{});
+        depthRef = addAttachment(pass.depthAttachment.image, pass.depthAttachment.write ? RenderGraphAccess::DepthAttachment : RenderGraphAccess::DepthReadOnly,
+                                 pass.depthAttachment.clear.has_value(), clearValue);
+    }
+
+    std::vector<VkAttachmentReference> resolveRefs;
+    for (const ColorAttachment& attachment : pass.colorAttachments)
+    {
+        if (attachment.resolve != NO_RESOURCE)
+        {
+            resolveRefs.resize(pass.colorAttachments.size(), {VK_ATTACHMENT_UNUSED, VK_IMAGE_LAYOUT_UNDEFINED});
+        }
+    }
+    for (size_t i = 0; i < resolveRefs.size(); i++)
+    {
+        if (pass.colorAttachments[i].resolve != NO_RESOURCE)
+        {
+            resolveRefs[i] = addAttachment(pass.colorAttachments[i].resolve, RenderGraphAccess::ResolveAttachment, false, {});
+        }
+    }
+
+    pass.extent = resources[pass.attachments.front()].desc.extent;
+
+    // Everything that makes two render passes different, so equal passes share one handle
+    std::vector<uint32_t> key = {pass.viewMask, static_cast<uint32_t>(colorRefs.size()), depthRef.attachment, static_cast<uint32_t>(resolveRefs.size())};
+    for (const VkAttachmentDescription& description : descriptions)
+    {
+        key.insert(key.end(), {static_cast<uint32_t>(description.format), static_cast<uint32_t>(description.samples),
+                               static_cast<uint32_t>(description.loadOp), static_cast<uint32_t>(description.storeOp),
+                               static_cast<uint32_t>(description.initialLayout)});
+    }
+    for (const VkAttachmentReference& reference : resolveRefs)
+    {
+        key.push_back(reference.attachment);
+    }
+
+    const auto it = renderPassCache.find(key);
+    if (it != renderPassCache.end())
+    {
+        pass.renderPass = it->second;
+        return;
+    }
+
+    VkSubpassDescription subpass{};
+    subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+    subpass.colorAttachmentCount = static_cast<uint32_t>(colorRefs.size());
+    subpass.pColorAttachments = colorRefs.data();
+    subpass.pResolveAttachments = resolveRefs.empty() ? nullptr : resolveRefs.data();
+    subpass.pDepthStencilAttachment = depthRef.attachment != VK_ATTACHMENT_UNUSED ? &depthRef : nullptr;
+
+    // No subpass dependencies: the barriers in front of the pass already order it after whatever came before
+    VkRenderPassCreateInfo renderPassInfo{};
+    renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+    renderPassInfo.attachmentCount = static_cast<uint32_t>(descriptions.size());
+    renderPassInfo.pAttachments = descriptions.data();
+    renderPassInfo.subpassCount = 1;
+    renderPassInfo.pSubpasses = &subpass;
+
+    // The views are correlated (they all look at the same scene), which lets implementations share work between them
+    VkRenderPassMultiviewCreateInfoKHR multiviewInfo{};
+    multiviewInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_MULTIVIEW_CREATE_INFO_KHR;
+    multiviewInfo.subpassCount = 1;
+    multiviewInfo.pViewMasks = &pass.viewMask;
+    multiviewInfo.correlationMaskCount = 1;
+    multiviewInfo.pCorrelationMasks = &pass.viewMask;
+    if (pass.viewMask != 0)
+    {
+        renderPassInfo.pNext = &multiviewInfo;
+    }
+
+    if (vkCreateRenderPass(vkDevice, &renderPassInfo, nullptr, &pass.renderPass) != VK_SUCCESS)
+    {
+        throw std::runtime_error(std::string("failed to create render pass ") + pass.name + "!");
+    }
+
+    renderPassCache.emplace(key, pass.renderPass);
+}
+
+VkFramebuffer RenderGraph::GetFramebuffer(Pass& pass)
+{
+    std::vector<VkImageView> views;
+    views.reserve(pass.attachments.size());
+    for (const ResourceId id : pass.attachments)
+    {
+        views.push_back(resources[id].view);
+    }
+
+    const auto it = pass.framebuffers.find(views);
+    if (it != pass.framebuffers.end())
+    {
+        return it->second;
+    }
+
+    VkFramebufferCreateInfo framebufferInfo{};
+    framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+    framebufferInfo.renderPass = pass.renderPass;
+    framebufferInfo.attachmentCount = static_cast<uint32_t>(views.size());
+    framebufferInfo.pAttachments = views.data();
+    framebufferInfo.width = pass.extent.width;
+    framebufferInfo.height = pass.extent.height;
+    framebufferInfo.layers = 1;
+
+    VkFramebuffer framebuffer;
+    if (vkCreateFramebuffer(vkDevice, &framebufferInfo, nullptr, &framebuffer) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create framebuffer!");
+    }
+
+    pass.framebuffers.emplace(std::move(views), framebuffer);
+    return framebuffer;
+}
+
+void RenderGraph::SetImportedImage(const ResourceId image, const VkImage handle, const VkImageView view)
+{
+    resources[image].image = handle;
+    resources[image].view = view;
+}
+
+void RenderGraph::Execute(const VkCommandBuffer commandBuffer)
+{
+    for (Pass& pass : passes)
+    {
+        if (pass.culled)
+            continue;
+
+        PROFILE_GPU_ZONE(commandBuffer, pass.name);
+
+        RecordBarriers(commandBuffer, pass.barriers);
+
+        if (!pass.graphics)
+        {
+            pass.record(commandBuffer);
+            continue;
+        }
+
+        VkRenderPassBeginInfo renderPassInfo{};
+        renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+        renderPassInfo.renderPass = pass.renderPass;
+        renderPassInfo.framebuffer = GetFramebuffer(pass);
+        renderPassInfo.renderArea.offset = {0, 0};
+        renderPassInfo.renderArea.extent = pass.extent;
+        if (pass.renderArea.width > 0 && pass.renderArea.height > 0)
+        {
+            renderPassInfo.renderArea.extent = {std::min(pass.renderArea.width, pass.extent.width), std::min(pass.renderArea.height, pass.extent.height)};
+        }
+        renderPassInfo.clearValueCount = static_cast<uint32_t>(pass.clearValues.size());
+        renderPassInfo.pClearValues = pass.clearValues.data();
+
+        vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+        pass.record(commandBuffer);
+        vkCmdEndRenderPass(commandBuffer);
+    }
+
+    RecordBarriers(commandBuffer, finalBarriers);
+}
+
+void RenderGraph::RecordBarriers(const VkCommandBuffer commandBuffer, const BarrierBatch& batch) const
+{
+    if (batch.barriers.empty())
+        return;
+
+    std::vector<VkImageMemoryBarrier> imageBarriers;
+    imageBarriers.reserve(batch.barriers.size());
+    for (const Barrier& barrier : batch.barriers)
+    {
+        const Resource& resource = resources[barrier.resource];
+
+        VkImageMemoryBarrier imageBarrier{};
+        imageBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        imageBarrier.srcAccessMask = barrier.srcAccess;
+        imageBarrier.dstAccessMask = barrier.dstAccess;
+        imageBarrier.oldLayout = barrier.oldLayout;
+        imageBarrier.newLayout = barrier.newLayout;
+        imageBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        imageBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        imageBarrier.image = resource.image;
+        imageBarrier.subresourceRange.aspectMask = !IsDepthFormat(resource.desc.format) ? VK_IMAGE_ASPECT_COLOR_BIT :
+            HasStencil(resource.desc.format) ? VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT : VK_IMAGE_ASPECT_DEPTH_BIT;
+        imageBarrier.subresourceRange.baseMipLevel = 0;
+        imageBarrier.subresourceRange.levelCount = resource.desc.mipLevels;
+        imageBarrier.subresourceRange.baseArrayLayer = 0;
+        imageBarrier.subresourceRange.layerCount = resource.desc.layers;
+        imageBarriers.push_back(imageBarrier);
+    }
+
+    vkCmdPipelineBarrier(commandBuffer,
+        batch.srcStages, batch.dstStages, 0,
+        0, nullptr,
+        0, nullptr,
+        static_cast<uint32_t>(imageBarriers.size()), imageBarriers.data());
+}
+
+VkRenderPass RenderGraph::GetRenderPass(const PassId pass) const
+{
+    return passes[pass].renderPass;
+}
+
+VkImage RenderGraph::GetImage(const ResourceId image) const
+{
+    return resources[image].image;
+}
+
+VkImageView RenderGraph::GetImageView(const ResourceId image) const
+{
+    return resources[image].view;
+}
+
+void RenderGraph::Retire(DeletionQueue& deletionQueue, const uint64_t lastUsedFrame)
+{
+    for (const Pass& pass : passes)
+    {
+        for (const auto& [views, framebuffer] : pass.framebuffers)
+        {
+            deletionQueue.Push(lastUsedFrame, framebuffer);
+        }
+    }
+
+    for (const Resource& resource : resources)
+    {
+        if (resource.imported)
+            continue;
+
+        deletionQueue.Push(lastUsedFrame, resource.view);
+        deletionQueue.Push(lastUsedFrame, resource.image);
+    }
+
+    for (const MemoryBlock& block : memoryBlocks)
+    {
+        deletionQueue.Push(lastUsedFrame, block.memory);
+    }
+
+    resources.clear();
+    passes.clear();
+    memoryBlocks.clear();
+    finalBarriers = {};
+    compiled = false;
+}
+
+void RenderGraph::PrintSummary() const
+{
+    size_t transientCount = 0;
+    for (const MemoryBlock& block : memoryBlocks)
+    {
+        transientCount += block.resources.size();
+    }
+
+    constexpr double megabyte = 1024.0 * 1024.0;
+    std::cout << "Render graph: " << passes.size() - culledPassCount << " passes (" << culledPassCount << " culled), "
+              << transientCount << " transient images in " << memoryBlocks.size() << " memory blocks, "
+              << static_cast<double>(transientMemory) / megabyte << " MB (" << static_cast<double>(unaliasedTransientMemory) / megabyte
+              << " MB without aliasing), " << barrierCount << " barriers per frame" << '\n';
+}
@@ -0,0 +1,227 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <optional>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+#include "DeviceMemory.h"
+
+class DeletionQueue;
+
+// How a pass uses an image. That is all the graph needs to place barriers: it maps every access to the layout the
+// image has to be in, the pipeline stages touching it and whether they read or write it
+enum class RenderGraphAccess
+{
+    ColorAttachment,
+    ResolveAttachment,
+    DepthAttachment,
+    // Depth tested but not written, e.g. the main pass after a depth prepass
+    DepthReadOnly,
+    FragmentSampled,
+    ComputeSampled,
+    ComputeStorage,
+    TransferSrc,
+    TransferDst,
+};
+
+// A frame graph. Passes declare which images they read and write, and once the graph is compiled it
+//  * culls the passes whose results nobody uses,
+//  * creates the transient images and lets the ones whose lifetimes don't overlap share memory,
+//  * derives the render passes, load/store ops and the minimal set of barriers between passes.
+// The graph is declared and compiled once, then executed every frame until the resources it was built for change
+// (e.g. a resize), at which point it is retired and declared again.
+class RenderGraph
+{
+public:
+    using ResourceId = uint32_t;
+    using PassId = uint32_t;
+    // Records the pass's commands. Graphics passes are called inside their render pass
+    using RecordFunction = std::function<void(VkCommandBuffer)>;
+
+    struct ImageDesc
+    {
+        VkFormat format = VK_FORMAT_UNDEFINED;
+        VkExtent2D extent = {};
+        uint32_t layers = 1;
+        VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT;
+        uint32_t mipLevels = 1;
+    };
+
+    void Init(VkDevice device, VkPhysicalDevice physicalDevice);
+    // Destroys the cached render passes. The graph must have been retired
+    void Cleanup();
+
+    // An image owned by the graph. It only exists while the graph runs, so its contents never survive a frame
+    ResourceId CreateImage(const char* name, const ImageDesc& desc);
+    // An image owned by someone else (swap chain, offscreen target), handed over every frame with SetImportedImage.
+    // An UNDEFINED initialLayout means its old contents don't matter, an UNDEFINED finalLayout leaves it in whatever
+    // layout its last pass needed. The first barrier on it waits at the stage of its first use, which is where a
+    // semaphore guarding it (e.g. image acquisition) should wait too
+    ResourceId ImportImage(const char* name, const ImageDesc& desc, VkImageLayout initialLayout, VkImageLayout finalLayout);
+
+    PassId AddGraphicsPass(const char* name, RecordFunction record);
+    // Compute or transfer work, recorded as is
+    PassId AddPass(const char* name, RecordFunction record);
+
+    // Attachments of a graphics pass, in attachment order. Without a clear value the previous contents are loaded
+    // if there are any
+    void AddColorAttachment(PassId pass, ResourceId image, std::optional<VkClearColorValue> clear = std::nullopt);
+    // Resolves the color attachment added last
+    void AddResolveAttachment(PassId pass, ResourceId image);
+    void SetDepthAttachment(PassId pass, ResourceId image, std::optional<VkClearDepthStencilValue> clear = std::nullopt, bool write = true);
+    // Multiview: the pass is broadcast to every view in the mask, each one rendering into its own layer
+    void SetViewMask(PassId pass, uint32_t viewMask);
+    // Limits a graphics pass to the top left corner of its attachments, e.g. to render below full resolution without
+    // creating smaller images. Can change every frame, an empty extent goes back to the whole attachment
+    void SetRenderArea(PassId pass, VkExtent2D extent);
+
+    // Any other use of an image
+    void Read(PassId pass, ResourceId image, RenderGraphAccess access);
+    void Write(PassId pass, ResourceId image, RenderGraphAccess access);
+    // A pass is culled unless it writes an imported image or something a kept pass reads. A side effect the graph
+    // can't see (e.g. a copy into a readback buffer) keeps it alive
+    void SetSideEffect(PassId pass);
+
+    void Compile();
+
+    void SetImportedImage(ResourceId image, VkImage handle, VkImageView view);
+    void Execute(VkCommandBuffer commandBuffer);
+
+    // Render passes are cached by their description, so the same pass keeps the same handle when the graph is
+    // declared again at another size, and the pipelines built against it stay valid
+    [[nodiscard]] VkRenderPass GetRenderPass(PassId pass) const;
+    [[nodiscard]] VkImage GetImage(ResourceId image) const;
+    [[nodiscard]] VkImageView GetImageView(ResourceId image) const;
+
+    // Hands every image, view, memory block and framebuffer to the deletion queue and forgets the declarations,
+    // ready to declare the graph again
+    void Retire(DeletionQueue& deletionQueue, uint64_t lastUsedFrame);
+
+    void PrintSummary() const;
+
+private:
+    static constexpr uint32_t NO_RESOURCE = UINT32_MAX;
+
+    struct Resource
+    {
+        const char* name;
+        ImageDesc desc;
+        bool imported = false;
+        VkImageLayout initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        VkImageLayout finalLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+        VkImage image = VK_NULL_HANDLE;
+        VkImageView view = VK_NULL_HANDLE;
+
+        // Filled by Compile
+        VkImageUsageFlags usage = 0;
+        uint32_t firstPass = UINT32_MAX;
+        uint32_t lastPass = 0;
+        uint32_t memoryBlock = UINT32_MAX;
+    };
+
+    struct Use
+    {
+        ResourceId resource;
+        RenderGraphAccess access;
+        bool read;
+        bool write;
+    };
+
+    struct ColorAttachment
+    {
+        ResourceId image;
+        std::optional<VkClearColorValue> clear;
+        ResourceId resolve = NO_RESOURCE;
+    };
+
+    struct DepthAttachment
+    {
+        ResourceId image = NO_RESOURCE;
+        std::optional<VkClearDepthStencilValue> clear;
+        bool write = true;
+    };
+
+    struct Barrier
+    {
+        ResourceId resource;
+        VkImageLayout oldLayout;
+        VkImageLayout newLayout;
+        VkAccessFlags srcAccess;
+        VkAccessFlags dstAccess;
+    };
+
+    // All the barriers in front of a pass go out in one vkCmdPipelineBarrier
+    struct BarrierBatch
+    {
+        VkPipelineStageFlags srcStages = 0;
+        VkPipelineStageFlags dstStages = 0;
+        std::vector<Barrier> barriers;
+    };
+
+    struct Pass
+    {
+        const char* name;
+        RecordFunction record;
+        bool graphics = false;
+        bool sideEffect = false;
+        std::vector<ColorAttachment> colorAttachments;
+        DepthAttachment depthAttachment;
+        uint32_t viewMask = 0;
+        VkExtent2D renderArea = {};
+        std::vector<Use> uses;
+
+        // Filled by Compile
+        bool culled = false;
+        BarrierBatch barriers;
+        VkRenderPass renderPass = VK_NULL_HANDLE;
+        std::vector<ResourceId> attachments;
+        std::vector<VkClearValue> clearValues;
+        VkExtent2D extent = {};
+        // Imported attachments change every frame, so framebuffers are made on demand for each set of views
+        std::map<std::vector<VkImageView>, VkFramebuffer> framebuffers;
+    };
+
+    struct MemoryBlock
+    {
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        VkDeviceSize size = 0;
+        uint32_t memoryTypeBits = ~0u;
+        std::vector<ResourceId> resources;
+        // Every stage and write touching any image in the block, which is what the first use of each of them waits on
+        VkPipelineStageFlags stages = 0;
+        VkAccessFlags writeAccess = 0;
+    };
+
+    VkDevice vkDevice = VK_NULL_HANDLE;
+    DeviceMemory deviceMemory;
+
+    std::vector<Resource> resources;
+    std::vector<Pass> passes;
+    std::vector<MemoryBlock> memoryBlocks;
+    // Transitions of imported images to their final layouts, after the last pass
+    BarrierBatch finalBarriers;
+    bool compiled = false;
+
+    std::map<std::vector<uint32_t>, VkRenderPass> renderPassCache;
+
+    // Statistics of the last Compile
+    uint32_t culledPassCount = 0;
+    uint32_t barrierCount = 0;
+    VkDeviceSize transientMemory = 0;
+    VkDeviceSize unaliasedTransientMemory = 0;
+
+    ResourceId AddResource(const Resource& resource);
+    PassId DeclarePass(const char* name, RecordFunction record, bool graphics);
+    void AddUse(PassId pass, ResourceId image, RenderGraphAccess access, bool read, bool write);
+
+    void CullPasses();
+    void CreateTransientImages();
+    void PlanBarriers();
+    void CreateRenderPass(Pass& pass);
+    VkFramebuffer GetFramebuffer(Pass& pass);
+    void RecordBarriers(VkCommandBuffer commandBuffer, const BarrierBatch& batch) const;
+};
@@ -0,0 +1,244 @@
+#include "ShaderCompiler.h"
+
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <glslang/Public/ShaderLang.h>
+#include <shaderc/shaderc.hpp>
+#include <spirv-tools/libspirv.h>
+#include <spirv-tools/optimizer.hpp>
+
+// Bump this whenever the compile options below change, so old cache entries are ignored. Toolchain upgrades and
+// optimizer pass changes are picked up by GetCompilerVersion on their own
+constexpr uint32_t SHADER_CACHE_VERSION = 1;
+constexpr uint32_t SPIRV_MAGIC_NUMBER = 0x07230203;
+
+namespace
+{
+    // 64-bit FNV-1a. Not cryptographic, but more than enough to tell shader variants apart
+    constexpr uint64_t FNV_OFFSET_BASIS = 14695981039346656037ull;
+    constexpr uint64_t FNV_PRIME = 1099511628211ull;
+
+    uint64_t Fnv1a(const void* data, const size_t size, uint64_t hash = FNV_OFFSET_BASIS)
+    {
+        const auto* bytes = static_cast<const unsigned char*>(data);
+        for (size_t i = 0; i < size; i++)
+        {
+            hash ^= bytes[i];
+            hash *= FNV_PRIME;
+        }
+        return hash;
+    }
+
+    uint64_t Fnv1a(const std::string& text, const uint64_t hash)
+    {
+        // Hash the length as well, so {"AB", "C"} and {"A", "BC"} do not collide
+        const uint64_t size = text.size();
+        return Fnv1a(text.data(), text.size(), Fnv1a(&size, sizeof(size), hash));
+    }
+
+    std::string ReadTextFile(const std::string& path)
+    {
+        std::ifstream file(path, std::ios::binary);
+        if (!file.is_open())
+        {
+            throw std::runtime_error("failed to open shader source " + path + "!");
+        }
+
+        std::stringstream buffer;
+        buffer << file.rdbuf();
+        return buffer.str();
+    }
+
+    void RegisterPasses(spvtools::Optimizer& optimizer)
+    {
+        // Same pass list as "spirv-opt -O"
+        optimizer.RegisterPerformancePasses();
+    }
+}
+
+ShaderCompiler::ShaderCompiler(std::string cacheDirectory) : cacheDirectory(std::move(cacheDirectory))
+{
+}
+
+std::vector<uint32_t> ShaderCompiler::Compile(const std::string& path, const shaderc_shader_kind kind, const std::vector<ShaderDefine>& defines) const
+{
+    const std::string source = ReadTextFile(path);
+
+    // The cache key only depends on what goes into the compiler, not on the file name or its timestamp
+    const std::string cachePath = GetCachePath(HashKey(source, kind, defines));
+
+    std::vector<uint32_t> spirv;
+    if (LoadFromCache(cachePath, spirv))
+    {
+        return spirv;
+    }
+
+    spirv = Optimize(CompileGlsl(source, path, kind, defines), path);
+    StoreInCache(cachePath, spirv);
+
+    return spirv;
+}
+
+std::string ShaderCompiler::GetCompilerVersion()
+{
+    // The same for the whole run, and asked for on every compile
+    static const std::string version = []()
+    {
+        // shaderc has no version of its own, it wraps the glslang and SPIRV-Tools it was built with. Every version is
+        // asked of the libraries we link, the headers in external/include may come from another SDK
+        const glslang::Version glslangVersion = glslang::GetVersion();
+        unsigned int spirvVersion = 0;
+        unsigned int spirvRevision = 0;
+        shaderc_get_spv_version(&spirvVersion, &spirvRevision);
+
+        std::ostringstream text;
+        text << "glslang-" << glslangVersion.major << "." << glslangVersion.minor << "." << glslangVersion.patch << glslangVersion.flavor
+             << "-spirv-" << spirvVersion << "." << spirvRevision << "-spirv-tools-" << spvSoftwareVersionDetailsString() << "-cache-"
+             << SHADER_CACHE_VERSION;
+
+        spvtools::Optimizer optimizer(SPV_ENV_VULKAN_1_0);
+        RegisterPasses(optimizer);
+        for (const char* pass : optimizer.GetPassNames())
+        {
+            text << "-" << pass;
+        }
+        return text.str();
+    }();
+    return version;
+}
+
+uint64_t ShaderCompiler::HashKey(const std::string& source, const shaderc_shader_kind kind, const std::vector<ShaderDefine>& defines)
+{
+    // The order in which defines are passed must not produce a different binary, so we sort them first
+    std::vector<ShaderDefine> sortedDefines = defines;
+    std::sort(sortedDefines.begin(), sortedDefines.end(), [](const ShaderDefine& a, const ShaderDefine& b)
+    {
+        return a.name < b.name;
+    });
+
+    uint64_t hash = Fnv1a(GetCompilerVersion(), FNV_OFFSET_BASIS);
+    hash = Fnv1a(&kind, sizeof(kind), hash);
+    hash = Fnv1a(source, hash);
+
+    for (const ShaderDefine& define : sortedDefines)
+    {
+        hash = Fnv1a(define.name, hash);
+        hash = Fnv1a(define.value, hash);
+    }
+
+    return hash;
+}
+
+std::string ShaderCompiler::GetCachePath(const uint64_t key) const
+{
+    std::ostringstream fileName;
+    fileName << std::hex << std::setw(16) << std::setfill('0') << key << ".spv";
+    return (std::filesystem::path(cacheDirectory) / fileName.str()).string();
+}
+
+bool ShaderCompiler::LoadFromCache(const std::string& cachePath, std::vector<uint32_t>& spirv) const
+{
+    std::ifstream file(cachePath, std::ios::ate | std::ios::binary);
+    if (!file.is_open())
+    {
+        return false;
+    }
+
+    const size_t fileSize = static_cast<size_t>(file.tellg());
+
+    // A truncated or foreign file is treated as a miss and simply gets overwritten
+    if (fileSize == 0 || fileSize % sizeof(uint32_t) != 0)
+    {
+        return false;
+    }
+
+    spirv.resize(fileSize / sizeof(uint32_t));
+    file.seekg(0);
+    file.read(reinterpret_cast<char*>(spirv.data()), static_cast<std::streamsize>(fileSize));
+
+    return file.good() && spirv[0] == SPIRV_MAGIC_NUMBER;
+}
+
+void ShaderCompiler::StoreInCache(const std::string& cachePath, const std::vector<uint32_t>& spirv) const
+{
+    std::error_code error;
+    std::filesystem::create_directories(cacheDirectory, error);
+
+    // We write into a temporary file and rename it, so a crash or a second instance never sees half a binary. Every
+    // write gets a file of its own, tagged with this process and a running count, so two writers of the same entry
+    // never write into each other's file
+    static const uint64_t processTag = (static_cast<uint64_t>(std::random_device()()) << 32) | std::random_device()();
+    static std::atomic<uint64_t> writeCount = 0;
+    std::ostringstream tempName;
+    tempName << "." << std::hex << processTag << "-" << writeCount++ << ".tmp";
+    const std::string tempPath = cachePath + tempName.str();
+    {
+        std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+        if (!file.is_open())
+        {
+            std::cout << "WARNING: failed to write shader cache " << cachePath << '\n';
+            return;
+        }
+        file.write(reinterpret_cast<const char*>(spirv.data()), static_cast<std::streamsize>(spirv.size() * sizeof(uint32_t)));
+    }
+
+    std::filesystem::rename(tempPath, cachePath, error);
+    if (error)
+    {
+        std::filesystem::remove(tempPath, error);
+    }
+}
+
+std::vector<uint32_t> ShaderCompiler::CompileGlsl(const std::string& source, const std::string& path, const shaderc_shader_kind kind, const std::vector<ShaderDefine>& defines)
+{
+    const shaderc::Compiler compiler;
+    shaderc::CompileOptions options;
+    options.SetTargetEnvironment(shaderc_target_env_vulkan, shaderc_env_version_vulkan_1_0);
+
+    // shaderc would run its own optimizer here, we leave that to spirv-tools so we control the passes
+    options.SetOptimizationLevel(shaderc_optimization_level_zero);
+
+    for (const ShaderDefine& define : defines)
+    {
+        options.AddMacroDefinition(define.name, define.value);
+    }
+
+    const shaderc::SpvCompilationResult result = compiler.CompileGlslToSpv(source, kind, path.c_str(), options);
+    if (result.GetCompilationStatus() != shaderc_compilation_status_success)
+    {
+        throw std::runtime_error("failed to compile shader " + path + ":\n" + result.GetErrorMessage());
+    }
+
+    return {result.cbegin(), result.cend()};
+}
+
+std::vector<uint32_t> ShaderCompiler::Optimize(const std::vector<uint32_t>& spirv, const std::string& path)
+{
+    spvtools::Optimizer optimizer(SPV_ENV_VULKAN_1_0);
+    optimizer.SetMessageConsumer([&path](spv_message_level_t level, const char*, const spv_position_t&, const char* message)
+    {
+        if (level <= SPV_MSG_ERROR)
+        {
+            std::cerr << "spirv-opt (" << path << "): " << message << '\n';
+        }
+    });
+
+    RegisterPasses(optimizer);
+
+    std::vector<uint32_t> optimized;
+    if (!optimizer.Run(spirv.data(), spirv.size(), &optimized))
+    {
+        // The unoptimized binary is still valid, so we carry on with it rather than failing the whole pipeline
+        std::cout << "WARNING: spirv-opt failed on " << path << ", using unoptimized SPIR-V" << '\n';
+        return spirv;
+    }
+
+    return optimized;
+}
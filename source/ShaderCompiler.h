@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <shaderc/shaderc.h>
+
+// A single #define passed to the preprocessor, e.g. {"USE_TEXTURE", "1"}
+struct ShaderDefine
+{
+    std::string name;
+    std::string value;
+};
+
+// Compiles GLSL into SPIR-V at runtime through shaderc, runs the spirv-tools performance passes on the result
+// and keeps the final binary in an on-disk cache. The cache is content addressed: the file name is a hash of the
+// source text, the stage, the defines and the compiler version, so an unchanged shader is never compiled twice
+// and an edited one can never pick up a stale binary.
+class ShaderCompiler
+{
+public:
+    explicit ShaderCompiler(std::string cacheDirectory = "shaders/cache");
+
+    [[nodiscard]] std::vector<uint32_t> Compile(const std::string& path, shaderc_shader_kind kind, const std::vector<ShaderDefine>& defines = {}) const;
+
+private:
+    std::string cacheDirectory;
+
+    // Identifies the toolchain that produced a cached binary. Anything that changes the generated code must change this
+    static std::string GetCompilerVersion();
+    static uint64_t HashKey(const std::string& source, shaderc_shader_kind kind, const std::vector<ShaderDefine>& defines);
+
+    [[nodiscard]] std::string GetCachePath(uint64_t key) const;
+    [[nodiscard]] bool LoadFromCache(const std::string& cachePath, std::vector<uint32_t>& spirv) const;
+    void StoreInCache(const std::string& cachePath, const std::vector<uint32_t>& spirv) const;
+
+    static std::vector<uint32_t> CompileGlsl(const std::string& source, const std::string& path, shaderc_shader_kind kind, const std::vector<ShaderDefine>& defines);
+    static std::vector<uint32_t> Optimize(const std::vector<uint32_t>& spirv, const std::string& path);
+};
@@ -0,0 +1,113 @@
+#include "ShaderReflection.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <spirv_cross/spirv_cross.hpp>
+
+void ShaderReflection::Reflect(const std::vector<uint32_t>& spirv, const VkShaderStageFlagBits stage, ShaderLayout& layout)
+{
+    const spirv_cross::Compiler compiler(spirv);
+    const spirv_cross::ShaderResources resources = compiler.get_shader_resources();
+
+    // Every kind of resource we care about maps to exactly one descriptor type
+    const auto addResources = [&](const spirv_cross::SmallVector<spirv_cross::Resource>& list, const VkDescriptorType type)
+    {
+        for (const spirv_cross::Resource& resource : list)
+        {
+            const uint32_t set = compiler.get_decoration(resource.id, spv::DecorationDescriptorSet);
+            const uint32_t binding = compiler.get_decoration(resource.id, spv::DecorationBinding);
+
+            // Arrays of descriptors (e.g. sampler2D textures[4]) take one binding with descriptorCount > 1
+            const spirv_cross::SPIRType& spirType = compiler.get_type(resource.type_id);
+            uint32_t count = 1;
+            for (const uint32_t dimension : spirType.array)
+            {
+                count *= dimension;
+            }
+
+            AddBinding(layout, set, binding, type, count, stage);
+        }
+    };
+
+    addResources(resources.uniform_buffers, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER);
+    addResources(resources.storage_buffers, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+    addResources(resources.sampled_images, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+    addResources(resources.separate_images, VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE);
+    addResources(resources.separate_samplers, VK_DESCRIPTOR_TYPE_SAMPLER);
+    addResources(resources.storage_images, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
+    addResources(resources.subpass_inputs, VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT);
+
+    // Push constants are not bound through descriptors, we only need the byte range each stage touches
+    for (const spirv_cross::Resource& resource : resources.push_constant_buffers)
+    {
+        const spirv_cross::SmallVector<spirv_cross::BufferRange> ranges = compiler.get_active_buffer_ranges(resource.id);
+        if (ranges.empty())
+        {
+            continue;
+        }
+
+        size_t begin = ranges[0].offset;
+        size_t end = 0;
+        for (const spirv_cross::BufferRange& range : ranges)
+        {
+            begin = std::min(begin, range.offset);
+            end = std::max(end, range.offset + range.range);
+        }
+
+        // If another stage already uses an overlapping block, we widen that range instead of adding a second one
+        const auto overlapping = std::find_if(layout.pushConstantRanges.begin(), layout.pushConstantRanges.end(), [&](const VkPushConstantRange& range)
+        {
+            return range.offset < end && begin < range.offset + range.size;
+        });
+
+        if (overlapping != layout.pushConstantRanges.end())
+        {
+            const uint32_t mergedBegin = std::min(overlapping->offset, static_cast<uint32_t>(begin));
+            const uint32_t mergedEnd = std::max(overlapping->offset + overlapping->size, static_cast<uint32_t>(end));
+            overlapping->offset = mergedBegin;
+            overlapping->size = mergedEnd - mergedBegin;
+            overlapping->stageFlags |= stage;
+        }
+        else
+        {
+            layout.pushConstantRanges.push_back({static_cast<VkShaderStageFlags>(stage), static_cast<uint32_t>(begin), static_cast<uint32_t>(end - begin)});
+        }
+    }
+}
+
+void ShaderReflection::AddBinding(ShaderLayout& layout, const uint32_t set, const uint32_t binding, const VkDescriptorType type, const uint32_t count, const VkShaderStageFlagBits stage)
+{
+    std::vector<VkDescriptorSetLayoutBinding>& bindings = layout.sets[set];
+
+    const auto existing = std::find_if(bindings.begin(), bindings.end(), [binding](const VkDescriptorSetLayoutBinding& b)
+    {
+        return b.binding == binding;
+    });
+
+    if (existing != bindings.end())
+    {
+        // The same binding seen from another stage must describe the same resource
+        if (existing->descriptorType != type || existing->descriptorCount != count)
+        {
+            throw std::runtime_error("shader stages disagree on set " + std::to_string(set) + " binding " + std::to_string(binding) + "!");
+        }
+
+        existing->stageFlags |= stage;
+        return;
+    }
+
+    VkDescriptorSetLayoutBinding layoutBinding{};
+    layoutBinding.binding = binding;
+    layoutBinding.descriptorType = type;
+    layoutBinding.descriptorCount = count;
+    layoutBinding.stageFlags = stage;
+    layoutBinding.pImmutableSamplers = nullptr;
+
+    // Keep them sorted, so equal layouts always produce byte-identical binding lists for the layout cache
+    const auto position = std::lower_bound(bindings.begin(), bindings.end(), binding, [](const VkDescriptorSetLayoutBinding& b, const uint32_t value)
+    {
+        return b.binding < value;
+    });
+    bindings.insert(position, layoutBinding);
+}
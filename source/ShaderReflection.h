@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+// Everything a pipeline layout needs, as declared by the shaders themselves
+struct ShaderLayout
+{
+    // Descriptor set index -> bindings of that set, sorted by binding number
+    std::map<uint32_t, std::vector<VkDescriptorSetLayoutBinding>> sets;
+    std::vector<VkPushConstantRange> pushConstantRanges;
+};
+
+// Reads descriptor bindings and push constant blocks straight out of SPIR-V with spirv_cross, so the C++ side never
+// has to hand-code bindings that must stay in sync with the GLSL
+class ShaderReflection
+{
+public:
+    // Merges one stage into the layout. A binding used by several stages ends up with all of their stage flags
+    static void Reflect(const std::vector<uint32_t>& spirv, VkShaderStageFlagBits stage, ShaderLayout& layout);
+
+private:
+    static void AddBinding(ShaderLayout& layout, uint32_t set, uint32_t binding, VkDescriptorType type, uint32_t count, VkShaderStageFlagBits stage);
+};
@@ -0,0 +1,224 @@
+#include "StartupTimer.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+namespace
+{
+    constexpr size_t CATEGORY_COUNT = 5;
+    constexpr double MEGABYTE = 1024.0 * 1024.0;
+
+    std::string EscapeJson(const std::string& text)
+    {
+        std::string escaped;
+        escaped.reserve(text.size());
+        for (const char c : text)
+        {
+            if (c == '"' || c == '\\')
+            {
+                escaped += '\\';
+            }
+            escaped += c;
+        }
+        return escaped;
+    }
+}
+
+void StartupTimer::Start(const bool trackMemory)
+{
+    startTime = Clock::now();
+    mainThread = std::this_thread::get_id();
+    this->trackMemory = trackMemory;
+}
+
+void StartupTimer::Step(const std::string& name)
+{
+    if (!currentStep.empty())
+    {
+        Add(currentStep, Category::Step, currentStepStart);
+    }
+    currentStep = name;
+    currentStepStart = Clock::now();
+}
+
+void StartupTimer::Add(const std::string& name, const Category category, const Clock::time_point start)
+{
+    const Clock::time_point end = Clock::now();
+
+    Event event;
+    event.name = name;
+    event.category = category;
+    event.mainThread = std::this_thread::get_id() == mainThread;
+    event.start = std::chrono::duration<double, std::milli>(start - startTime).count();
+    event.end = std::chrono::duration<double, std::milli>(end - startTime).count();
+    event.peakMemory = trackMemory ? GetPeakMemory() : 0;
+
+    const std::lock_guard lock(mutex);
+    if (!finished)
+    {
+        events.push_back(event);
+    }
+}
+
+void StartupTimer::Finish(const std::string& path)
+{
+    if (!currentStep.empty())
+    {
+        Add(currentStep, Category::Step, currentStepStart);
+        currentStep.clear();
+    }
+
+    std::vector<Event> sorted;
+    {
+        const std::lock_guard lock(mutex);
+        finished = true;
+        sorted = events;
+    }
+    std::stable_sort(sorted.begin(), sorted.end(), [](const Event& a, const Event& b) { return a.start < b.start; });
+
+    // Only the steps add up to the time to first frame. The other categories overlap them, and each other on workers
+    std::vector<double> totals(CATEGORY_COUNT, 0.0);
+    double timeToFirstFrame = 0.0;
+    for (const Event& event : sorted)
+    {
+        totals[static_cast<size_t>(event.category)] += event.end - event.start;
+        timeToFirstFrame = std::max(timeToFirstFrame, event.end);
+    }
+
+    // Formatted apart, so the fixed precision doesn't stick to std::cout
+    std::ostringstream table;
+    table << std::fixed << std::setprecision(1);
+    table << "Startup:" << '\n';
+    table << std::left << "  " << std::setw(44) << "Stage" << std::setw(10) << "Category" << std::setw(8) << "Thread" << std::right
+          << std::setw(10) << "Start ms" << std::setw(10) << "Time ms";
+    if (trackMemory)
+    {
+        table << std::setw(10) << "Peak MB";
+    }
+    table << '\n';
+    for (const Event& event : sorted)
+    {
+        table << std::left << "  " << std::setw(44) << event.name << std::setw(10) << GetCategoryName(event.category)
+              << std::setw(8) << (event.mainThread ? "main" : "worker") << std::right << std::setw(10) << event.start
+              << std::setw(10) << event.end - event.start;
+        if (trackMemory)
+        {
+            table << std::setw(10) << static_cast<double>(event.peakMemory) / MEGABYTE;
+        }
+        table << '\n';
+    }
+
+    table << "Startup totals:";
+    for (size_t category = 0; category < CATEGORY_COUNT; category++)
+    {
+        table << (category == 0 ? " " : ", ") << GetCategoryName(static_cast<Category>(category)) << ' ' << totals[category] << " ms";
+    }
+    table << '\n';
+    table << "Time to first frame: " << timeToFirstFrame << " ms";
+    if (trackMemory)
+    {
+        table << ", peak memory " << static_cast<double>(GetPeakMemory()) / MEGABYTE << " MB";
+    }
+    table << '\n';
+    std::cout << table.str();
+
+    if (path.empty())
+        return;
+
+    WriteJson(path, sorted, timeToFirstFrame, totals);
+    std::cout << "Startup report written to " << path << '\n';
+}
+
+void StartupTimer::WriteJson(const std::string& path, const std::vector<Event>& sorted, const double timeToFirstFrame,
+                             const std::vector<double>& totals) const
+{
+    std::ofstream file(path);
+    if (!file.is_open())
+    {
+        throw std::runtime_error("failed to write startup report " + path + "!");
+    }
+
+    // Times are in milliseconds since the start of the app, memory in bytes
+    file << "{\n";
+    file << "  \"timeToFirstFrame\": " << timeToFirstFrame << ",\n";
+    if (trackMemory)
+    {
+        file << "  \"peakMemory\": " << GetPeakMemory() << ",\n";
+    }
+
+    file << "  \"totals\": { ";
+    for (size_t category = 0; category < CATEGORY_COUNT; category++)
+    {
+        file << (category == 0 ? "" : ", ") << '"' << GetCategoryName(static_cast<Category>(category)) << "\": " << totals[category];
+    }
+    file << " },\n";
+
+    file << "  \"events\": [\n";
+    for (size_t i = 0; i < sorted.size(); i++)
+    {
+        const Event& event = sorted[i];
+        file << "    { \"name\": \"" << EscapeJson(event.name) << "\", "
+             << "\"category\": \"" << GetCategoryName(event.category) << "\", "
+             << "\"thread\": \"" << (event.mainThread ? "main" : "worker") << "\", "
+             << "\"start\": " << event.start << ", "
+             << "\"duration\": " << event.end - event.start;
+        if (trackMemory)
+        {
+            file << ", \"peakMemory\": " << event.peakMemory;
+        }
+        file << " }" << (i + 1 == sorted.size() ? "\n" : ",\n");
+    }
+    file << "  ]\n";
+    file << "}\n";
+}
+
+const char* StartupTimer::GetCategoryName(const Category category)
+{
+    switch (category)
+    {
+    case Category::Step:
+        return "step";
+    case Category::FileRead:
+        return "fileRead";
+    case Category::Decode:
+        return "decode";
+    case Category::Upload:
+        return "upload";
+    case Category::Pipeline:
+        return "pipeline";
+    }
+    return "unknown";
+}
+
+uint64_t StartupTimer::GetPeakMemory()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters{};
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+    {
+        return counters.PeakWorkingSetSize;
+    }
+    return 0;
+#else
+    rusage usage{};
+    if (getrusage(RUSAGE_SELF, &usage) == 0)
+    {
+        // In kilobytes on Linux
+        return static_cast<uint64_t>(usage.ru_maxrss) * 1024;
+    }
+    return 0;
+#endif
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Where the time goes between the start of the app and its first frame. The main thread's steps run back to back, each
+// Step ending the one before, so together they cover all of it. Work on other threads, or inside a step, like reading
+// a file, decoding it, uploading it or compiling a pipeline, is added as an event of its own category. Finish prints
+// every event as a table with the totals per category and writes the same as JSON, to follow time to first frame
+// across builds and asset changes.
+class StartupTimer
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    enum class Category
+    {
+        Step,
+        FileRead,
+        Decode,
+        Upload,
+        Pipeline,
+    };
+
+    // Starts the clock. The calling thread is the main thread. With trackMemory every event also records the peak
+    // memory use of the process when it ended
+    void Start(bool trackMemory);
+    // Ends the main thread's current step, if there is one, and begins the next
+    void Step(const std::string& name);
+    // Work that ran from start until now. Safe from any thread, and ignored once finished
+    void Add(const std::string& name, Category category, Clock::time_point start);
+    // Ends the current step, prints the table and writes the report to path
+    void Finish(const std::string& path);
+
+private:
+    struct Event
+    {
+        std::string name;
+        Category category = Category::Step;
+        bool mainThread = true;
+        // Milliseconds since Start
+        double start = 0.0;
+        double end = 0.0;
+        // Bytes, 0 without trackMemory
+        uint64_t peakMemory = 0;
+    };
+
+    Clock::time_point startTime;
+    std::thread::id mainThread;
+    bool trackMemory = false;
+    bool finished = false;
+
+    std::string currentStep;
+    Clock::time_point currentStepStart;
+
+    std::mutex mutex;
+    std::vector<Event> events;
+
+    void WriteJson(const std::string& path, const std::vector<Event>& sorted, double timeToFirstFrame, const std::vector<double>& totals) const;
+
+    static const char* GetCategoryName(Category category);
+    // Peak resident memory of the process so far, in bytes. 0 where the platform can't tell
+    static uint64_t GetPeakMemory();
+};
@@ -2,12 +2,17 @@
 
 #include <algorithm> // Necessary for std::clamp
 #include <chrono>
+#include <cmath>
 #include <cstdint> // Necessary for uint32_t
 #include <cstring>
+#include <filesystem>
 #include <fstream>
 #include <iostream>
 #include <limits> // Necessary for std::numeric_limits
+#include <random>
 #include <set>
+#include <sstream>
+#include <thread>
 #include <vector>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
@@ -27,19 +32,36 @@
 const std::vector VALIDATION_LAYERS = { "VK_LAYER_KHRONOS_validation" };
 const std::vector DEVICE_EXTENSIONS = { VK_KHR_SWAPCHAIN_EXTENSION_NAME };
 
+// Sized for the most views we ever render. shader.vert only declares as many view matrices as it was built for
 struct UniformBufferObject
 {
     alignas(16) glm::mat4 model;
-    alignas(16) glm::mat4 view;
     alignas(16) glm::mat4 proj;
+    alignas(16) glm::mat4 view[MAX_VIEWS];
 };
 
+// Depth range of the camera. Draws are sorted by where their center falls in it
+constexpr float CAMERA_NEAR = 0.1f;
+constexpr float CAMERA_FAR = 10.0f;
+
 #ifdef NDEBUG
     const bool enableValidationLayers = false;
 #else
     const bool enableValidationLayers = true;
 #endif
 
+// Samples per pixel of the color and depth images. FXAA renders single sampled and filters afterwards
+VkSampleCountFlagBits GetSampleCount(const AntiAliasing antiAliasing)
+{
+    switch (antiAliasing)
+    {
+    case AntiAliasing::Msaa2: return VK_SAMPLE_COUNT_2_BIT;
+    case AntiAliasing::Msaa4: return VK_SAMPLE_COUNT_4_BIT;
+    case AntiAliasing::Msaa8: return VK_SAMPLE_COUNT_8_BIT;
+    default: return VK_SAMPLE_COUNT_1_BIT;
+    }
+}
+
 // Calbacks
 VkResult CreateDebugUtilsMessengerExt(const VkInstance instance, const VkDebugUtilsMessengerCreateInfoEXT* pCreateInfo, const VkAllocationCallbacks* pAllocator, VkDebugUtilsMessengerEXT* pDebugMessenger)
 {
@@ -59,28 +81,131 @@ void DestroyDebugUtilsMessengerExt(VkInstance instance, VkDebugUtilsMessengerEXT
         func(instance, debugMessenger, pAllocator);
 }
 
+VulkanApp::VulkanApp(AppSettings settings) : settings(std::move(settings))
+{
+}
+
+void VulkanApp::SetReadbackCallback(ReadbackCallback callback)
+{
+    readbackCallback = std::move(callback);
+}
+
 void VulkanApp::Run()
 {
-    InitWindow();
+    startupTimer.Start(settings.startupMemory);
+    // A replay decides the model and settings, so it has to be loaded before anything is created from them
+    startupTimer.Step("Capture");
+    LoadReplay();
+    OpenCapture();
+
+    startupTimer.Step("Job system");
+    jobSystem.Init(settings.threadCount);
+    // The model and its textures need no window or device, so they load while those are created
+    StartAssetLoads();
+
+    // Headless runs never touch GLFW, so they work on machines without any display
+    if (!settings.headless)
+    {
+        startupTimer.Step("InitWindow");
+        InitWindow();
+    }
+
+    startupTimer.Step("LoadCameraPath");
+    LoadCameraPath();
     InitVulkan();
-    MainLoop();
+    if (captureReader.IsLoaded())
+    {
+        CheckReplayResources();
+    }
+
+    if (settings.mipBenchmark)
+    {
+        BenchmarkMipGeneration();
+    }
+    else if (settings.drawSortBenchmark)
+    {
+        BenchmarkDrawSort();
+    }
+    else if (settings.jobBenchmark)
+    {
+        BenchmarkJobs();
+    }
+    else if (settings.commandBufferBenchmark)
+    {
+        BenchmarkCommandBuffers();
+    }
+    else if (settings.benchmark)
+    {
+        BenchmarkLoop();
+    }
+    else if (settings.headless)
+    {
+        HeadlessLoop();
+    }
+    else
+    {
+        MainLoop();
+    }
+
+    WriteProfilerTrace();
+
+    if (captureWriter.IsOpen())
+    {
+        captureWriter.Close();
+        std::cout << "Capture of " << frameNumber << " frames written to " << settings.captureFile << '\n';
+    }
+
     Cleanup();
 }
 
 // Helpers
-std::vector<const char*> VulkanApp::GetRequiredExtensions()
+std::vector<const char*> VulkanApp::GetRequiredExtensions() const
 {
-    // We get the required extensions, based if validation layers are enabled or not
-    uint32_t glfwExtensionCount = 0;
-    const char** glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+    std::vector<const char*> extensions;
 
-    std::vector extensions(glfwExtensions, glfwExtensions + glfwExtensionCount);
+    // We get the required extensions, based if validation layers are enabled or not
+    // Without a window we do not need any of the surface extensions GLFW asks for
+    if (!settings.headless)
+    {
+        uint32_t glfwExtensionCount = 0;
+        const char** glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+        extensions.assign(glfwExtensions, glfwExtensions + glfwExtensionCount);
+    }
 
-    if (enableValidationLayers)
+    if (useValidationLayers)
     {
         extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
     }
 
+    // VK_KHR_multiview depends on it
+    if (settings.views > 1)
+    {
+        extensions.push_back(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
+    }
+
+    return extensions;
+}
+
+std::vector<const char*> VulkanApp::GetDeviceExtensions() const
+{
+    // The swap chain extension is only needed when we actually present
+    std::vector<const char*> extensions;
+    if (!settings.headless)
+    {
+        extensions = DEVICE_EXTENSIONS;
+    }
+
+    if (settings.views > 1)
+    {
+        extensions.push_back(VK_KHR_MULTIVIEW_EXTENSION_NAME);
+    }
+
+    // Optional, only known once the device is picked
+    if (maintenance2Supported)
+    {
+        extensions.push_back(VK_KHR_MAINTENANCE2_EXTENSION_NAME);
+    }
+
     return extensions;
 }
 
@@ -92,18 +217,16 @@ bool VulkanApp::IsDeviceSuitable(VkPhysicalDevice_T* device) const
     // Check if we support the extensions we need
     const bool extensionsSupported = CheckDeviceExtensionSupport(device);
 
-    // And then, if we have the correct swapChain support
-    bool swapChainAdequate = false;
-    if (extensionsSupported)
+    // And then, if we have the correct swapChain support. Headless rendering has no swap chain at all
+    bool swapChainAdequate = settings.headless;
+    if (extensionsSupported && !settings.headless)
     {
         const SwapChainSupportDetails swapChainSupport = QuerySwapChainSupport(device);
         swapChainAdequate = !swapChainSupport.formats.empty() && !swapChainSupport.presentModes.empty();
     }
 
-    VkPhysicalDeviceFeatures supportedFeatures;
-    vkGetPhysicalDeviceFeatures(device, &supportedFeatures);
-    
-    return indices.IsComplete() && extensionsSupported && swapChainAdequate && supportedFeatures.samplerAnisotropy;
+    // Anisotropic filtering is nice to have, but software implementations may not offer it, so it does not disqualify a device
+    return indices.IsComplete() && extensionsSupported && swapChainAdequate;
 }
 
 QueueFamilyIndices VulkanApp::FindQueueFamilies(const VkPhysicalDevice device) const
@@ -125,11 +248,18 @@ QueueFamilyIndices VulkanApp::FindQueueFamilies(const VkPhysicalDevice device) c
         if (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT)
         {
             indices.graphicsFamily = i;
+
+            // Without a surface there is nothing to present to, so the graphics queue does both jobs
+            if (settings.headless)
+            {
+                indices.presentFamily = i;
+            }
         }
 
         // And if we have present capabilities
         VkBool32 presentSupport = false;
-        vkGetPhysicalDeviceSurfaceSupportKHR(device, i, vkSurface, &presentSupport);
+        if (!settings.headless)
+            vkGetPhysicalDeviceSurfaceSupportKHR(device, i, vkSurface, &presentSupport);
         if (presentSupport)
         {
             indices.presentFamily = i;
@@ -144,7 +274,7 @@ QueueFamilyIndices VulkanApp::FindQueueFamilies(const VkPhysicalDevice device) c
     return indices;
 }
 
-bool VulkanApp::CheckDeviceExtensionSupport(VkPhysicalDevice_T* device)
+bool VulkanApp::CheckDeviceExtensionSupport(VkPhysicalDevice_T* device) const
 {
     // Get the available extensions for this device
     uint32_t extensionCount;
@@ -154,7 +284,8 @@ bool VulkanApp::CheckDeviceExtensionSupport(VkPhysicalDevice_T* device)
     vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, availableExtensions.data());
 
     // And we verify we have what we want
-    std::set<std::string> requiredExtensions(DEVICE_EXTENSIONS.begin(), DEVICE_EXTENSIONS.end());
+    const std::vector<const char*> deviceExtensions = GetDeviceExtensions();
+    std::set<std::string> requiredExtensions(deviceExtensions.begin(), deviceExtensions.end());
 
     for (const VkExtensionProperties& extension : availableExtensions)
     {
@@ -250,22 +381,6 @@ VkExtent2D VulkanApp::ChooseSwapExtent(const VkSurfaceCapabilitiesKHR& capabilit
     return actualExtent;
 }
 
-uint32_t VulkanApp::FindMemoryType(const uint32_t typeFilter, const VkMemoryPropertyFlags properties) const
-{
-    VkPhysicalDeviceMemoryProperties memProperties;
-    vkGetPhysicalDeviceMemoryProperties(vkPhysicalDevice, &memProperties);
-
-    for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++)
-    {
-        if ((typeFilter & (1 << i)) && (memProperties.memoryTypes[i].propertyFlags & properties) == properties)
-        {
-            return i;
-        }
-    }
-
-    throw std::runtime_error("failed to find suitable memory type!");
-}
-
 void VulkanApp::InitWindow()
 {
     // Initializes the GLFW library
@@ -274,68 +389,162 @@ void VulkanApp::InitWindow()
     // We tell them we don't want an OpenGL context
     glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
 
-    window = glfwCreateWindow(WIDTH, HEIGHT, "Vulkan", nullptr, nullptr);
+    window = glfwCreateWindow(static_cast<int>(settings.width), static_cast<int>(settings.height), "Vulkan", nullptr, nullptr);
     glfwSetWindowUserPointer(window, this);
     glfwSetFramebufferSizeCallback(window, FramebufferResizeCallback);
+    glfwSetKeyCallback(window, KeyCallback);
 }
 
 void VulkanApp::InitVulkan()
 {
+    startupTimer.Step("CreateInstance");
     CreateInstance();
+    startupTimer.Step("SetupDebugMessenger");
     SetupDebugMessenger();
 
     // Since Vulkan is a platform agnostic API, it can not interface directly with the window system on its own
     // The window surface needs to be created right after the instance creation, because it can actually
     // influence the physical device selection
-    CreateSurface();
+    if (!settings.headless)
+    {
+        startupTimer.Step("CreateSurface");
+        CreateSurface();
+    }
+    startupTimer.Step("SelectPhysicalDevice");
     SelectPhysicalDevice();
 
     // After selecting a physical device to use we need to set up a logical device to interface with i
+    startupTimer.Step("CreateLogicalDevice");
     CreateLogicalDevice();
 
-    // Now we create the Swap Chain
-    CreateSwapChain();
+    // Uploads need nothing more than a command pool, the mip generator and the sampler, so those come right after the
+    // device and any texture already decoded goes up now. Parsing and decoding usually take longer than the device, so
+    // the steps up to the pipelines look again for finished decodes in between. Those uploads show up as their own
+    // events within the step they ran in. Whatever is left waits until the pipelines are done
+    startupTimer.Step("CreateCommandPool");
+    CreateCommandPool();
+    startupTimer.Step("MipGenerator");
+    mipGenerator.Init(vkDevice, vkPhysicalDevice, FindQueueFamilies(vkPhysicalDevice).graphicsFamily.value(), maintenance2Supported, shaderCompiler, layoutCache);
+    startupTimer.Step("CreateTextureSampler");
+    CreateTextureSampler();
+    startupTimer.Step("UploadTextures (decoded so far)");
+    UploadTextures(false);
+
+    // Now we create the Swap Chain, or the images that stand in for it when there is no window
+    if (settings.headless)
+    {
+        startupTimer.Step("CreateOffscreenImages");
+        CreateOffscreenImages();
+    }
+    else
+    {
+        startupTimer.Step("CreateSwapChain");
+        CreateSwapChain();
+    }
     // An image view is quite literally a view into an image. It describes how to access the image and which
     // part of the image to access, for example if it should be treated as a 2D texture depth texture without any mipmapping levels
     
+    startupTimer.Step("CreateImageViews");
     CreateImageViews();
+    UploadTextures(false);
     // We need to tell Vulkan about the framebuffer attachments that will be used while rendering.
-    // We need to specify how many color and depth buffers there will be, how many samples to use
-    // for each of them and how their contents should be handled throughout the rendering operations
-    CreateRenderPass();
-    CreateDescriptorSetLayout();
-    CreateGraphicsPipeline();
-
-    CreateColorResources();
-    CreateDepthResources();
-    CreateFramebuffers();
-    CreateCommandPool();
-    CreateTextureImage();
-    CreateTextureImageView();
-    CreateTextureSampler();
-    CreateColorResources();
+    // The render graph works out how many color and depth buffers there are, how many samples they use
+    // and how their contents should be handled throughout the rendering operations
+    if (settings.occlusionCulling)
+    {
+        startupTimer.Step("InitOcclusionCulling");
+        InitOcclusionCulling();
+    }
+    startupTimer.Step("BuildRenderGraph");
+    antiAliasing = FindSupportedAntiAliasing(settings.antiAliasing);
+    msaaSamples = GetSampleCount(antiAliasing);
+    BuildRenderGraph();
+    renderGraph.PrintSummary();
+    UploadTextures(false);
+    startupTimer.Step("CreatePipelineLayout");
+    CreatePipelineLayout();
+    UploadTextures(false);
+    // The materials may still be parsing, but textured ones use the default permutation, so it is built right away.
+    // The rest follow once the materials are known
+    startupTimer.Step("Pipelines");
+    GetGraphicsPipeline(PipelineKey{});
+    UploadTextures(false);
+    if (settings.depthPrepass)
+    {
+        vkDepthPrepassPipeline = GetDepthPrepassPipeline();
+    }
+
+    startupTimer.Step("UploadTextures (rest)");
+    UploadTextures(true);
+    startupTimer.Step("Material pipelines");
+    UpdateForwardPipelines();
 
-    LoadModel();
-    CreateVertexBuffer();
-    CreateIndexBuffer();
+    startupTimer.Step("CreateGeometryPool");
+    CreateGeometryPool();
+    startupTimer.Step("CreateUniformBuffers");
     CreateUniformBuffers();
+    if (settings.occlusionCulling)
+    {
+        startupTimer.Step("CreateClusters");
+        std::vector<glm::vec3> positions(vertices.size());
+        std::transform(vertices.begin(), vertices.end(), positions.begin(), [](const Vertex& vertex) { return vertex.pos; });
+        std::vector<uint32_t> batchEnds;
+        for (const Submesh& submesh : submeshes)
+        {
+            batchEnds.push_back(submesh.firstIndex + submesh.indexCount);
+        }
+        const GeometryPool::Mesh& mesh = geometryPool.GetMesh(modelMesh);
+        occlusionCuller.CreateClusters(positions, indices, batchEnds, mesh.firstIndex, mesh.vertexOffset, vkUniformBuffers, sizeof(UniformBufferObject));
+    }
+    if (settings.lightCount > 0)
+    {
+        startupTimer.Step("ClusteredLighting");
+        clusteredLighting.Init(vkDevice, vkPhysicalDevice, MAX_FRAMES_IN_FLIGHT, settings.lightCount, shaderCompiler, layoutCache);
+    }
     
+    startupTimer.Step("CreateDescriptorPool");
     CreateDescriptorPool();
+    startupTimer.Step("CreateDescriptorSets");
     CreateDescriptorSets();
     
+    startupTimer.Step("CreateCommandBuffers");
     CreateCommandBuffers();
 
     // Synchronization
+    startupTimer.Step("CreateSyncObjects");
     CreateSyncObjects();
+
+    if (settings.readback)
+    {
+        startupTimer.Step("CreateReadbackBuffers");
+        CreateReadbackBuffers();
+    }
+
+    startupTimer.Step("CreateStatisticsQueries");
+    CreateStatisticsQueries();
+
+    // Dynamic resolution steers by the same GPU times the benchmark reports
+    if (settings.benchmark || settings.dynamicResolution)
+    {
+        startupTimer.Step("CreateTimestampQueries");
+        CreateTimestampQueries();
+    }
+
+    startupTimer.Step("InitProfiler");
+    InitProfiler();
+    // Ends at the first submit
+    startupTimer.Step("First frame");
 }
 
 void VulkanApp::CreateInstance()
 {
-    // If we want to enableValidationLayers, check if we have them
-    if (enableValidationLayers && !CheckValidationLayerSupport())
+    // If we want to enableValidationLayers, check if we have them. Build machines often do not have the SDK
+    // installed, so instead of giving up we carry on without validation
+    useValidationLayers = enableValidationLayers;
+    if (useValidationLayers && !CheckValidationLayerSupport())
     {
-        std::cout << "ERROR: Validation layers requested, but not available!" << '\n';
-        return;
+        std::cout << "WARNING: Validation layers requested, but not available!" << '\n';
+        useValidationLayers = false;
     }
     
     // Optional: We fill some info about our application.
@@ -359,7 +568,7 @@ void VulkanApp::CreateInstance()
 
     // Validation Layers
     VkDebugUtilsMessengerCreateInfoEXT debugCreateInfo{};
-    if (enableValidationLayers)
+    if (useValidationLayers)
     {
         createInfo.enabledLayerCount = static_cast<uint32_t>(VALIDATION_LAYERS.size());
         createInfo.ppEnabledLayerNames = VALIDATION_LAYERS.data();
@@ -403,7 +612,21 @@ void VulkanApp::SelectPhysicalDevice()
         if (IsDeviceSuitable(physicalDevice))
         {
             vkPhysicalDevice = physicalDevice;
-            msaaSamples = GetMaxUsableSampleCount();
+
+            VkPhysicalDeviceFeatures supportedFeatures;
+            vkGetPhysicalDeviceFeatures(physicalDevice, &supportedFeatures);
+            samplerAnisotropySupported = supportedFeatures.samplerAnisotropy == VK_TRUE;
+            pipelineStatisticsSupported = supportedFeatures.pipelineStatisticsQuery == VK_TRUE;
+            multiDrawIndirectSupported = supportedFeatures.multiDrawIndirect == VK_TRUE;
+
+            uint32_t extensionCount;
+            vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, nullptr);
+            std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+            vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, availableExtensions.data());
+            maintenance2Supported = std::any_of(availableExtensions.begin(), availableExtensions.end(), [](const VkExtensionProperties& extension)
+            {
+                return std::strcmp(extension.extensionName, VK_KHR_MAINTENANCE2_EXTENSION_NAME) == 0;
+            });
             return;
         }
     }
@@ -436,7 +659,9 @@ void VulkanApp::CreateLogicalDevice()
 
     // Specify device features we will be using
     VkPhysicalDeviceFeatures deviceFeatures{};
-    deviceFeatures.samplerAnisotropy = VK_TRUE;
+    deviceFeatures.samplerAnisotropy = samplerAnisotropySupported ? VK_TRUE : VK_FALSE;
+    deviceFeatures.pipelineStatisticsQuery = pipelineStatisticsSupported ? VK_TRUE : VK_FALSE;
+    deviceFeatures.multiDrawIndirect = multiDrawIndirectSupported ? VK_TRUE : VK_FALSE;
     
     // Now with all this data, we can create the vkDevice
     VkDeviceCreateInfo createInfo{};
@@ -445,14 +670,24 @@ void VulkanApp::CreateLogicalDevice()
     createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
     createInfo.pQueueCreateInfos = queueCreateInfos.data();
     createInfo.pEnabledFeatures = &deviceFeatures;
+
+    // The multiview feature is guaranteed wherever the extension is, so there is nothing to check before asking for it
+    VkPhysicalDeviceMultiviewFeaturesKHR multiviewFeatures{};
+    multiviewFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MULTIVIEW_FEATURES_KHR;
+    multiviewFeatures.multiview = VK_TRUE;
+    if (settings.views > 1)
+    {
+        createInfo.pNext = &multiviewFeatures;
+    }
     // Support for extensions in logical device
-    createInfo.enabledExtensionCount = static_cast<uint32_t>(DEVICE_EXTENSIONS.size());
-    createInfo.ppEnabledExtensionNames = DEVICE_EXTENSIONS.data();
+    const std::vector<const char*> deviceExtensions = GetDeviceExtensions();
+    createInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
+    createInfo.ppEnabledExtensionNames = deviceExtensions.data();
 
     // Previous implementations of Vulkan made a distinction between instance and device specific validation layers
     // That means that the enabledLayerCount and ppEnabledLayerNames fields of VkDeviceCreateInfo are ignored by
     // up-to-date implementations. However, we set them anyway
-    if (enableValidationLayers)
+    if (useValidationLayers)
     {
         createInfo.enabledLayerCount = static_cast<uint32_t>(VALIDATION_LAYERS.size());
         createInfo.ppEnabledLayerNames = VALIDATION_LAYERS.data();
@@ -468,6 +703,11 @@ void VulkanApp::CreateLogicalDevice()
         std::cout << "failed to create logical device!" << '\n';
     }
 
+    layoutCache.Init(vkDevice);
+    deletionQueue.Init(vkDevice);
+    deviceMemory.Init(vkDevice, vkPhysicalDevice);
+    renderGraph.Init(vkDevice, vkPhysicalDevice);
+
     // The queues are automatically created along with the logical device
     vkGetDeviceQueue(vkDevice, indices.graphicsFamily.value(), 0, &vkGraphicsQueue);
     vkGetDeviceQueue(vkDevice, indices.presentFamily.value(), 0, &vkPresentQueue);
@@ -489,6 +729,56 @@ VkSampleCountFlagBits VulkanApp::GetMaxUsableSampleCount() const
     return VK_SAMPLE_COUNT_1_BIT;
 }
 
+std::vector<AntiAliasing> VulkanApp::GetSupportedAntiAliasing() const
+{
+    std::vector<AntiAliasing> supported = {AntiAliasing::None};
+    if (settings.views == 1)
+    {
+        supported.push_back(AntiAliasing::Fxaa);
+    }
+    for (const AntiAliasing tier : {AntiAliasing::Msaa2, AntiAliasing::Msaa4, AntiAliasing::Msaa8})
+    {
+        if (GetSampleCount(tier) <= GetMaxUsableSampleCount())
+        {
+            supported.push_back(tier);
+        }
+    }
+    return supported;
+}
+
+AntiAliasing VulkanApp::FindSupportedAntiAliasing(AntiAliasing wanted) const
+{
+    const std::vector<AntiAliasing> supported = GetSupportedAntiAliasing();
+    // The tiers are ordered, and None is always there
+    while (std::find(supported.begin(), supported.end(), wanted) == supported.end())
+    {
+        wanted = static_cast<AntiAliasing>(static_cast<int>(wanted) - 1);
+    }
+    return wanted;
+}
+
+void VulkanApp::SetAntiAliasing(const AntiAliasing wanted)
+{
+    const AntiAliasing tier = FindSupportedAntiAliasing(wanted);
+    if (tier == antiAliasing)
+        return;
+
+    antiAliasing = tier;
+    msaaSamples = GetSampleCount(tier);
+
+    // The sample count changes the attachments and render passes, so the graph is declared again. Render passes and
+    // pipelines are cached per sample count, switching back to a tier used before creates nothing
+    RetireRenderGraph(frameNumber);
+    BuildRenderGraph();
+    UpdateForwardPipelines();
+    if (settings.depthPrepass)
+    {
+        vkDepthPrepassPipeline = GetDepthPrepassPipeline();
+    }
+
+    std::cout << "Anti-aliasing: " << GetAntiAliasingName(antiAliasing) << '\n';
+}
+
 void VulkanApp::CreateSurface()
 {
     if (glfwCreateWindowSurface(vkInstance, window, nullptr, &vkSurface) != VK_SUCCESS)
@@ -497,7 +787,7 @@ void VulkanApp::CreateSurface()
     }
 }
 
-void VulkanApp::CreateSwapChain()
+void VulkanApp::CreateSwapChain(const VkSwapchainKHR oldSwapChain)
 {
     const SwapChainSupportDetails swapChainSupport = QuerySwapChainSupport(vkPhysicalDevice);
 
@@ -531,6 +821,16 @@ void VulkanApp::CreateSwapChain()
     createInfo.imageArrayLayers = 1;
     createInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
 
+    // Reading frames back means copying out of the swap chain images
+    if (settings.readback)
+    {
+        if (!(swapChainSupport.capabilities.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_SRC_BIT))
+        {
+            throw std::runtime_error("swap chain images can not be copied from, readback is not available!");
+        }
+        createInfo.imageUsage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+    }
+
 
     const QueueFamilyIndices indices = FindQueueFamilies(vkPhysicalDevice);
     const uint32_t queueFamilyIndices[] = {indices.graphicsFamily.value(), indices.presentFamily.value()};
@@ -554,6 +854,9 @@ void VulkanApp::CreateSwapChain()
     createInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
     createInfo.presentMode = presentMode;
     createInfo.clipped = VK_TRUE;
+
+    // The old swap chain is retired by this call, but images it already handed out stay valid until we destroy it
+    createInfo.oldSwapchain = oldSwapChain;
     
     // And now we can create the Swap Chain
     if (vkCreateSwapchainKHR(vkDevice, &createInfo, nullptr, &vkSwapChain) != VK_SUCCESS)
@@ -571,8 +874,31 @@ void VulkanApp::CreateSwapChain()
     swapChainExtent = extent;
 }
 
+void VulkanApp::CreateOffscreenImages()
+{
+    // One image per frame in flight, so a frame never renders into an image the GPU may still be writing
+    constexpr VkFormat offscreenFormat = VK_FORMAT_R8G8B8A8_SRGB;
+
+    swapChainImages.resize(MAX_FRAMES_IN_FLIGHT);
+    offscreenImagesMemory.resize(MAX_FRAMES_IN_FLIGHT);
+
+    for (size_t i = 0; i < swapChainImages.size(); i++)
+    {
+        // They take the place of the swap chain images as resolve targets, and can be copied out for readback.
+        // With multiview, each view resolves into its own layer
+        CreateImage(settings.width, settings.height, 1, VK_SAMPLE_COUNT_1_BIT, offscreenFormat, VK_IMAGE_TILING_OPTIMAL,
+                    VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                    swapChainImages[i], offscreenImagesMemory[i], settings.views);
+    }
+
+    swapChainImageFormat = offscreenFormat;
+    swapChainExtent = {settings.width, settings.height};
+}
+
 void VulkanApp::ReCreateSwapChain()
 {
+    PROFILE_CPU_ZONE("ReCreateSwapChain");
+
     // Handle Minimize
     int width = 0, height = 0;
     glfwGetFramebufferSize(window, &width, &height);
@@ -581,28 +907,59 @@ void VulkanApp::ReCreateSwapChain()
         glfwGetFramebufferSize(window, &width, &height);
         glfwWaitEvents();
     }
-    
-    // We need to wait as we can't use devices still in use
-    vkDeviceWaitIdle(vkDevice);
 
-    CleanupSwapChain();
-    
-    CreateSwapChain();
+    const auto recreateStart = std::chrono::steady_clock::now();
+    if (!resizeStartTime)
+    {
+        resizeStartTime = recreateStart;
+    }
+
+    // Readback buffers are sized to the frame and their pending copies still have to be delivered at the old size,
+    // so with readback enabled we still drain the GPU here, and the buffers go before the old extent does. Everything
+    // else keeps running
+    if (settings.readback)
+    {
+        vkDeviceWaitIdle(vkDevice);
+        FlushReadbacks();
+        CleanupReadback();
+    }
+
+    // No vkDeviceWaitIdle: the frames in flight keep using the old resources, and the deletion queue destroys them
+    // once those frames are done
+    const VkSwapchainKHR oldSwapChain = RetireSwapChainResources(frameNumber);
+
+    CreateSwapChain(oldSwapChain);
     CreateImageViews();
-    CreateColorResources();
-    CreateDepthResources();
-    CreateFramebuffers();
+    BuildRenderGraph();
+    // The render pass is cached, so unless the surface format changed this finds the pipelines we already have
+    UpdateForwardPipelines();
+
+    if (settings.readback)
+    {
+        CreateReadbackBuffers();
+    }
+
+    swapChainRecreateTimes.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - recreateStart).count());
 }
 
-VkImageView VulkanApp::CreateImageView(const VkImage image, const VkFormat format, const VkImageAspectFlags aspectFlags, const uint32_t mipLevels) const
+VkImageView VulkanApp::CreateImageView(const VkImage image, const VkFormat format, const VkImageAspectFlags aspectFlags, const uint32_t mipLevels, const uint32_t layerCount,
+                                       const VkImageUsageFlags usage) const
 {
     VkImageViewCreateInfo viewInfo{};
     viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
     viewInfo.image = image;
+
+    VkImageViewUsageCreateInfoKHR usageInfo{};
+    usageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_USAGE_CREATE_INFO_KHR;
+    usageInfo.usage = usage;
+    if (usage != 0)
+    {
+        viewInfo.pNext = &usageInfo;
+    }
     
     // The viewType and format fields specify how the image data should be interpreted.
     // The viewType parameter allows you to treat images as 1D textures, 2D textures, 3D textures and cube maps
-    viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    viewInfo.viewType = layerCount > 1 ? VK_IMAGE_VIEW_TYPE_2D_ARRAY : VK_IMAGE_VIEW_TYPE_2D;
     viewInfo.format = format;
     
     // The subresourceRange field describes what the image’s purpose is and which part of the image should be accessed.
@@ -610,7 +967,7 @@ VkImageView VulkanApp::CreateImageView(const VkImage image, const VkFormat forma
     viewInfo.subresourceRange.baseMipLevel = 0;
     viewInfo.subresourceRange.levelCount = mipLevels;
     viewInfo.subresourceRange.baseArrayLayer = 0;
-    viewInfo.subresourceRange.layerCount = 1;
+    viewInfo.subresourceRange.layerCount = layerCount;
 
     VkImageView imageView;
     if (vkCreateImageView(vkDevice, &viewInfo, nullptr, &imageView) != VK_SUCCESS)
@@ -627,43 +984,82 @@ void VulkanApp::CreateImageViews()
 
     for (size_t i = 0; i < swapChainImages.size(); i++)
     {
-        swapChainImageViews[i] = CreateImageView(swapChainImages[i], swapChainImageFormat, VK_IMAGE_ASPECT_COLOR_BIT, 1);
+        swapChainImageViews[i] = CreateImageView(swapChainImages[i], swapChainImageFormat, VK_IMAGE_ASPECT_COLOR_BIT, 1, settings.views);
+    }
+}
+
+std::vector<ShaderDefine> VulkanApp::GetVertexShaderDefines() const
+{
+    if (settings.views == 1)
+    {
+        return {};
     }
+
+    return {{"MULTIVIEW", "1"}, {"VIEW_COUNT", std::to_string(settings.views)}};
 }
 
-void VulkanApp::CreateDescriptorSetLayout()
+std::vector<ShaderDefine> VulkanApp::GetFragmentShaderDefines() const
 {
-    VkDescriptorSetLayoutBinding uboLayoutBinding{};
-    uboLayoutBinding.binding = 0;
-    uboLayoutBinding.descriptorCount = 1;
-    uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    uboLayoutBinding.pImmutableSamplers = nullptr; // Optional
-    uboLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    // Lighting adds the cluster buffers to the forward set, without it they don't exist at all
+    if (settings.lightCount == 0)
+    {
+        return {};
+    }
 
-    VkDescriptorSetLayoutBinding samplerLayoutBinding{};
-    samplerLayoutBinding.binding = 1;
-    samplerLayoutBinding.descriptorCount = 1;
-    samplerLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-    samplerLayoutBinding.pImmutableSamplers = nullptr;
-    samplerLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
-    
-    // We need to specify the descriptor set layout during pipeline creation to tell Vulkan which descriptors the shaders will be using
-    std::array<VkDescriptorSetLayoutBinding, 2> bindings = {uboLayoutBinding, samplerLayoutBinding};
-    VkDescriptorSetLayoutCreateInfo layoutInfo{};
-    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-    layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
-    layoutInfo.pBindings = bindings.data();
+    return {{"CLUSTERED_LIGHTING", "1"}};
+}
 
-    if (vkCreateDescriptorSetLayout(vkDevice, &layoutInfo, nullptr, &vkDescriptorSetLayout) != VK_SUCCESS)
+void VulkanApp::CreatePipelineLayout()
+{
+    // We need to specify the descriptor set layout during pipeline creation to tell Vulkan which descriptors the shaders will be using.
+    // Instead of hand-coding the bindings, we read them out of the compiled shaders, so they can never drift apart
+    forwardShaderLayout = {};
+    ShaderReflection::Reflect(shaderCompiler.Compile("shaders/shader.vert", shaderc_glsl_vertex_shader, GetVertexShaderDefines()), VK_SHADER_STAGE_VERTEX_BIT, forwardShaderLayout);
+    ShaderReflection::Reflect(shaderCompiler.Compile("shaders/shader.frag", shaderc_glsl_fragment_shader, GetFragmentShaderDefines()), VK_SHADER_STAGE_FRAGMENT_BIT, forwardShaderLayout);
+
+    // Every permutation shares it, and any other pipeline declaring the same bindings gets the very same handles back
+    std::vector<VkDescriptorSetLayout> setLayouts;
+    vkPipelineLayout = layoutCache.GetPipelineLayout(forwardShaderLayout, &setLayouts);
+
+    if (setLayouts.empty())
+    {
+        throw std::runtime_error("forward shaders do not declare any descriptor set!");
+    }
+    vkDescriptorSetLayout = setLayouts[0];
+}
+
+VkPipeline VulkanApp::GetGraphicsPipeline(const PipelineKey& key)
+{
+    // Two materials asking for the same permutation against the same render pass share one pipeline
+    const PipelineCacheKey cacheKey{key, vkRenderPass, msaaSamples};
+
+    const auto it = graphicsPipelines.find(cacheKey);
+    if (it != graphicsPipelines.end())
+    {
+        return it->second;
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    const VkPipeline pipeline = CreateGraphicsPipeline(key);
+    startupTimer.Add("Graphics pipeline", StartupTimer::Category::Pipeline, start);
+    graphicsPipelines.emplace(cacheKey, pipeline);
+    return pipeline;
+}
+
+void VulkanApp::UpdateForwardPipelines()
+{
+    forwardPipelines.resize(pipelineKeys.size());
+    for (size_t pipeline = 0; pipeline < pipelineKeys.size(); pipeline++)
     {
-        throw std::runtime_error("failed to create descriptor set layout!");
+        forwardPipelines[pipeline] = GetGraphicsPipeline(pipelineKeys[pipeline]);
     }
 }
 
-void VulkanApp::CreateGraphicsPipeline()
+VkPipeline VulkanApp::CreateGraphicsPipeline(const PipelineKey& key) const
 {
-    const std::vector<char> vertShaderCode = ReadFile("shaders/vert.spv");
-    const std::vector<char> fragShaderCode = ReadFile("shaders/frag.spv");
+    // Shaders are compiled from GLSL on first use and served from the SPIR-V cache afterwards
+    const std::vector<uint32_t> vertShaderCode = shaderCompiler.Compile("shaders/shader.vert", shaderc_glsl_vertex_shader, GetVertexShaderDefines());
+    const std::vector<uint32_t> fragShaderCode = shaderCompiler.Compile("shaders/shader.frag", shaderc_glsl_fragment_shader, GetFragmentShaderDefines());
 
     VkShaderModule vertShaderModule = CreateShaderModule(vertShaderCode);
     VkShaderModule fragShaderModule = CreateShaderModule(fragShaderCode);
@@ -682,6 +1078,39 @@ void VulkanApp::CreateGraphicsPipeline()
     fragShaderStageInfo.module = fragShaderModule;
     fragShaderStageInfo.pName = "main";
 
+    // The permutation is baked in through specialization constants. The values are known when the driver compiles
+    // the pipeline, so the branches on them in shader.frag are folded away as if they were #defines
+    struct SpecializationData
+    {
+        VkBool32 useTexture;
+        VkBool32 useVertexColor;
+        VkBool32 alphaTest;
+        float alphaCutoff;
+    };
+    const SpecializationData specializationData
+    {
+        key.useTexture ? VK_TRUE : VK_FALSE,
+        key.useVertexColor ? VK_TRUE : VK_FALSE,
+        key.alphaTest ? VK_TRUE : VK_FALSE,
+        key.alphaCutoff
+    };
+
+    // Each entry maps a constant_id in the shader to a range inside specializationData
+    const std::array<VkSpecializationMapEntry, 4> specializationEntries =
+    {{
+        {0, offsetof(SpecializationData, useTexture), sizeof(VkBool32)},
+        {1, offsetof(SpecializationData, useVertexColor), sizeof(VkBool32)},
+        {2, offsetof(SpecializationData, alphaTest), sizeof(VkBool32)},
+        {3, offsetof(SpecializationData, alphaCutoff), sizeof(float)},
+    }};
+
+    VkSpecializationInfo specializationInfo{};
+    specializationInfo.mapEntryCount = static_cast<uint32_t>(specializationEntries.size());
+    specializationInfo.pMapEntries = specializationEntries.data();
+    specializationInfo.dataSize = sizeof(SpecializationData);
+    specializationInfo.pData = &specializationData;
+    fragShaderStageInfo.pSpecializationInfo = &specializationInfo;
+
     // And here we have the programmable part of the Pipeline
     VkPipelineShaderStageCreateInfo shaderStages[] = {vertShaderStageInfo, fragShaderStageInfo};
 
@@ -736,9 +1165,11 @@ void VulkanApp::CreateGraphicsPipeline()
     // The depth attachment is ready to be used now, but depth testing still needs to be enabled in the graphics pipeline
     VkPipelineDepthStencilStateCreateInfo depthStencil{};
     depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+    // After a depth prepass the depth buffer already holds the closest surface: only the fragments on it pass, and
+    // there is nothing left to write
     depthStencil.depthTestEnable = VK_TRUE;
-    depthStencil.depthWriteEnable = VK_TRUE;
-    depthStencil.depthCompareOp = VK_COMPARE_OP_LESS;
+    depthStencil.depthWriteEnable = settings.depthPrepass ? VK_FALSE : VK_TRUE;
+    depthStencil.depthCompareOp = settings.depthPrepass ? VK_COMPARE_OP_EQUAL : VK_COMPARE_OP_LESS;
     depthStencil.depthBoundsTestEnable = VK_FALSE;
     depthStencil.stencilTestEnable = VK_FALSE;
     
@@ -766,17 +1197,6 @@ void VulkanApp::CreateGraphicsPipeline()
     dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
     dynamicState.dynamicStateCount = static_cast<uint32_t>(dynamicStates.size());
     dynamicState.pDynamicStates = dynamicStates.data();
-    
-    // We need to specify the descriptor set layout during pipeline creation to tell Vulkan which descriptors the shaders will be using
-    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
-    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-    pipelineLayoutInfo.setLayoutCount = 1;
-    pipelineLayoutInfo.pSetLayouts = &vkDescriptorSetLayout;
-    
-    if (vkCreatePipelineLayout(vkDevice, &pipelineLayoutInfo, nullptr, &vkPipelineLayout) != VK_SUCCESS)
-    {
-        std::cout << "Failed to create pipeline layout!" << '\n';
-    }
 
     // We can now combine everything to create the PIPELINE
 
@@ -806,10 +1226,9 @@ void VulkanApp::CreateGraphicsPipeline()
     pipelineInfo.basePipelineHandle = VK_NULL_HANDLE; // Optional
     pipelineInfo.pDepthStencilState = &depthStencil;
 
-    CreateDescriptorSetLayout();
-    
     // FINALLY
-    if (vkCreateGraphicsPipelines(vkDevice, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &vkGraphicsPipeline) != VK_SUCCESS)
+    VkPipeline pipeline = VK_NULL_HANDLE;
+    if (vkCreateGraphicsPipelines(vkDevice, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &pipeline) != VK_SUCCESS)
     {
         std::cout << "Failed to create graphics pipeline!" << '\n';
     }
@@ -817,144 +1236,321 @@ void VulkanApp::CreateGraphicsPipeline()
     // Cleanup
     vkDestroyShaderModule(vkDevice, fragShaderModule, nullptr);
     vkDestroyShaderModule(vkDevice, vertShaderModule, nullptr);
+
+    return pipeline;
 }
 
-// Take a buffer with the bytecode as parameter and create a VkShaderModule
-VkShaderModule VulkanApp::CreateShaderModule(const std::vector<char>& code) const
+VkPipeline VulkanApp::GetDepthPrepassPipeline()
 {
-    VkShaderModuleCreateInfo createInfo{};
-    createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-    createInfo.codeSize = code.size();
-    createInfo.pCode = reinterpret_cast<const uint32_t*>(code.data());
-
-    VkShaderModule shaderModule;
-    if (vkCreateShaderModule(vkDevice, &createInfo, nullptr, &shaderModule) != VK_SUCCESS)
+    const auto it = depthPrepassPipelines.find(msaaSamples);
+    if (it != depthPrepassPipelines.end())
     {
-        std::cout << "failed to create shader module!" << '\n';
+        return it->second;
     }
 
-    return shaderModule;
+    const auto start = std::chrono::steady_clock::now();
+    const VkPipeline pipeline = CreateDepthPrepassPipeline();
+    startupTimer.Add("Depth prepass pipeline", StartupTimer::Category::Pipeline, start);
+    depthPrepassPipelines.emplace(msaaSamples, pipeline);
+    return pipeline;
 }
 
-void VulkanApp::CreateRenderPass()
-{
-    // Now we are using multisampling
-    VkAttachmentDescription colorAttachment{};
-    colorAttachment.format = swapChainImageFormat;
-    colorAttachment.samples = msaaSamples;
-
-    // The format of the color attachment should match the format of the swap chain images,
-    // and we’re not doing anything with multisampling yet, so we’ll stick to 1 sample
-    colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-    colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-
-    // Our application won’t do anything with the stencil buffer, so the results of loading and storing are irrelevant.
-    colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-    colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-
-    // The layout of the pixels in memory can change based on what you’re trying to do with an image.
-    colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    colorAttachment.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL; // because multisampled images cannot be presented directly
-
-    // Depth
-    VkAttachmentDescription depthAttachment{};
-    depthAttachment.format = FindDepthFormat();
-    depthAttachment.samples = msaaSamples;
-    depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-    depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-    depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-    depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-    depthAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
-
-    VkAttachmentDescription colorAttachmentResolve{};
-    colorAttachmentResolve.format = swapChainImageFormat;
-    colorAttachmentResolve.samples = VK_SAMPLE_COUNT_1_BIT;
-    colorAttachmentResolve.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-    colorAttachmentResolve.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-    colorAttachmentResolve.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-    colorAttachmentResolve.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-    colorAttachmentResolve.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    colorAttachmentResolve.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
-    
-    VkAttachmentReference colorAttachmentRef{};
-    colorAttachmentRef.attachment = 0;
-    colorAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+VkPipeline VulkanApp::CreateDepthPrepassPipeline() const
+{
+    const VkShaderModule vertShaderModule = CreateShaderModule(shaderCompiler.Compile("shaders/depth.vert", shaderc_glsl_vertex_shader, GetVertexShaderDefines()));
 
-    VkAttachmentReference depthAttachmentRef{};
-    depthAttachmentRef.attachment = 1;
-    depthAttachmentRef.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+    // No fragment stage at all: depth comes out of the rasterizer, and nothing else is written
+    VkPipelineShaderStageCreateInfo vertShaderStageInfo{};
+    vertShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    vertShaderStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
+    vertShaderStageInfo.module = vertShaderModule;
+    vertShaderStageInfo.pName = "main";
 
-    VkAttachmentReference colorAttachmentResolveRef{};
-    colorAttachmentResolveRef.attachment = 2;
-    colorAttachmentResolveRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-    
-    // Subpassses
-    VkSubpassDescription subpass{};
-    subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
-    subpass.colorAttachmentCount = 1;
-    subpass.pColorAttachments = &colorAttachmentRef;
-    subpass.pDepthStencilAttachment = &depthAttachmentRef;
-    subpass.pResolveAttachments = &colorAttachmentResolveRef;
-    
-    // Subpass dependencies
-    VkSubpassDependency dependency{};
-    dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
-    dependency.dstSubpass = 0;
-    dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
-    dependency.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
-    dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
-    dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
-    
-    // We can finally create the render pass
-    std::array<VkAttachmentDescription, 3> attachments = {colorAttachment, depthAttachment, colorAttachmentResolve};
-    VkRenderPassCreateInfo renderPassInfo{};
-    renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-    renderPassInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
-    renderPassInfo.pAttachments = attachments.data();
-    renderPassInfo.subpassCount = 1;
-    renderPassInfo.pSubpasses = &subpass;
-    renderPassInfo.dependencyCount = 1;
-    renderPassInfo.pDependencies = &dependency;
+    // The position stream, tightly packed
+    const VkVertexInputBindingDescription bindingDescription{0, sizeof(glm::vec3), VK_VERTEX_INPUT_RATE_VERTEX};
+    const VkVertexInputAttributeDescription attributeDescription{0, 0, VK_FORMAT_R32G32B32_SFLOAT, 0};
 
-    if (vkCreateRenderPass(vkDevice, &renderPassInfo, nullptr, &vkRenderPass) != VK_SUCCESS)
-    {
-        std::cout << "Failed to create render pass!" << '\n';
-    }
-}
+    VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
+    vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+    vertexInputInfo.vertexBindingDescriptionCount = 1;
+    vertexInputInfo.pVertexBindingDescriptions = &bindingDescription;
+    vertexInputInfo.vertexAttributeDescriptionCount = 1;
+    vertexInputInfo.pVertexAttributeDescriptions = &attributeDescription;
 
-void VulkanApp::CreateFramebuffers()
-{
-    swapChainFramebuffers.resize(swapChainImageViews.size());
+    VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
+    inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+    inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
 
-    // We’ll then iterate through the image views and create framebuffers from them:
-    for (size_t i = 0; i < swapChainImageViews.size(); i++)
-    {
-        std::array<VkImageView, 3> attachments = {
-            vkColorImageView,
-            vkDepthImageView,
-            swapChainImageViews[i],
-        };
+    VkPipelineViewportStateCreateInfo viewportState{};
+    viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+    viewportState.viewportCount = 1;
+    viewportState.scissorCount = 1;
 
-        VkFramebufferCreateInfo framebufferInfo{};
-        framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-        framebufferInfo.renderPass = vkRenderPass;
-        framebufferInfo.attachmentCount = static_cast<uint32_t>(attachments.size());;
-        framebufferInfo.pAttachments = attachments.data();
-        framebufferInfo.width = swapChainExtent.width;
-        framebufferInfo.height = swapChainExtent.height;
-        framebufferInfo.layers = 1;
+    // Same rasterization as the forward pipeline, so both passes cover exactly the same pixels
+    VkPipelineRasterizationStateCreateInfo rasterizer{};
+    rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+    rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
+    rasterizer.lineWidth = 1.0f;
+    rasterizer.cullMode = VK_CULL_MODE_BACK_BIT;
+    rasterizer.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
 
-        if (vkCreateFramebuffer(vkDevice, &framebufferInfo, nullptr, &swapChainFramebuffers[i]) != VK_SUCCESS)
-        {
-            std::cout << "failed to create framebuffer!" << '\n';
-        }
-    }
-}
+    VkPipelineMultisampleStateCreateInfo multisampling{};
+    multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+    multisampling.rasterizationSamples = msaaSamples;
 
-void VulkanApp::CreateCommandPool()
-{
-    const QueueFamilyIndices queueFamilyIndices = FindQueueFamilies(vkPhysicalDevice);
+    VkPipelineDepthStencilStateCreateInfo depthStencil{};
+    depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+    depthStencil.depthTestEnable = VK_TRUE;
+    depthStencil.depthWriteEnable = VK_TRUE;
+    depthStencil.depthCompareOp = VK_COMPARE_OP_LESS;
+
+    // The render pass has no color attachment
+    VkPipelineColorBlendStateCreateInfo colorBlending{};
+    colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+
+    const std::array<VkDynamicState, 2> dynamicStates = {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
+    VkPipelineDynamicStateCreateInfo dynamicState{};
+    dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+    dynamicState.dynamicStateCount = static_cast<uint32_t>(dynamicStates.size());
+    dynamicState.pDynamicStates = dynamicStates.data();
+
+    // The forward layout is a superset of what depth.vert uses, so the forward descriptor sets bind as they are
+    VkGraphicsPipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    pipelineInfo.stageCount = 1;
+    pipelineInfo.pStages = &vertShaderStageInfo;
+    pipelineInfo.pVertexInputState = &vertexInputInfo;
+    pipelineInfo.pInputAssemblyState = &inputAssembly;
+    pipelineInfo.pViewportState = &viewportState;
+    pipelineInfo.pRasterizationState = &rasterizer;
+    pipelineInfo.pMultisampleState = &multisampling;
+    pipelineInfo.pDepthStencilState = &depthStencil;
+    pipelineInfo.pColorBlendState = &colorBlending;
+    pipelineInfo.pDynamicState = &dynamicState;
+    pipelineInfo.layout = vkPipelineLayout;
+    pipelineInfo.renderPass = renderGraph.GetRenderPass(depthPrepass);
+    pipelineInfo.subpass = 0;
+
+    VkPipeline pipeline = VK_NULL_HANDLE;
+    if (vkCreateGraphicsPipelines(vkDevice, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &pipeline) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create depth prepass pipeline!");
+    }
+
+    vkDestroyShaderModule(vkDevice, vertShaderModule, nullptr);
+    return pipeline;
+}
+
+// Take a buffer with the bytecode as parameter and create a VkShaderModule
+VkShaderModule VulkanApp::CreateShaderModule(const std::vector<uint32_t>& code) const
+{
+    VkShaderModuleCreateInfo createInfo{};
+    createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    createInfo.codeSize = code.size() * sizeof(uint32_t);
+    createInfo.pCode = code.data();
+
+    VkShaderModule shaderModule;
+    if (vkCreateShaderModule(vkDevice, &createInfo, nullptr, &shaderModule) != VK_SUCCESS)
+    {
+        std::cout << "failed to create shader module!" << '\n';
+    }
+
+    return shaderModule;
+}
+
+void VulkanApp::BuildRenderGraph()
+{
+    const RenderGraph::ImageDesc frameDesc{swapChainImageFormat, swapChainExtent, settings.views};
+
+    // We clear over the swap chain image every frame, so whatever it held before doesn't matter. Offscreen images
+    // are never presented and simply stay in the layout of their last use
+    backbufferImage = renderGraph.ImportImage("Backbuffer", frameDesc, VK_IMAGE_LAYOUT_UNDEFINED,
+                                              settings.headless ? VK_IMAGE_LAYOUT_UNDEFINED : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+
+    RenderGraph::ImageDesc depthDesc = frameDesc;
+    depthDesc.format = FindDepthFormat();
+    depthDesc.samples = msaaSamples;
+    const RenderGraph::ResourceId depthImage = renderGraph.CreateImage("Depth", depthDesc);
+
+    RenderGraph::ResourceId hiZImage = 0;
+    if (settings.depthPrepass)
+    {
+        depthPrepass = renderGraph.AddGraphicsPass("DepthPrepass", [this](const VkCommandBuffer commandBuffer)
+        {
+            RecordDepthPrepass(commandBuffer);
+        });
+        renderGraph.SetDepthAttachment(depthPrepass, depthImage, VkClearDepthStencilValue{1.0f, 0});
+
+        if (settings.views > 1)
+        {
+            renderGraph.SetViewMask(depthPrepass, (1u << settings.views) - 1);
+        }
+
+        // The prepass depth is reduced into a Hi-Z pyramid, which the cull pass tests every cluster against
+        if (settings.occlusionCulling)
+        {
+            hiZImage = renderGraph.CreateImage("HiZ", OcclusionCuller::GetHiZDesc(swapChainExtent));
+
+            const RenderGraph::PassId hiZPass = renderGraph.AddPass("HiZ", [this](const VkCommandBuffer commandBuffer)
+            {
+                occlusionCuller.RecordHiZ(commandBuffer, renderExtent);
+            });
+            renderGraph.Read(hiZPass, depthImage, RenderGraphAccess::ComputeSampled);
+            renderGraph.Write(hiZPass, hiZImage, RenderGraphAccess::ComputeStorage);
+
+            const RenderGraph::PassId cullPass = renderGraph.AddPass("Cull", [this](const VkCommandBuffer commandBuffer)
+            {
+                occlusionCuller.RecordCull(commandBuffer, currentFrame, renderExtent);
+            });
+            renderGraph.Read(cullPass, hiZImage, RenderGraphAccess::ComputeSampled);
+            // Its output is the forward pass's indirect draws, a buffer the graph knows nothing about
+            renderGraph.SetSideEffect(cullPass);
+        }
+    }
+
+    // The lights are assigned to the clusters of this frame's camera before anything is shaded
+    if (settings.lightCount > 0)
+    {
+        const RenderGraph::PassId lightCullingPass = renderGraph.AddPass("LightCulling", [this](const VkCommandBuffer commandBuffer)
+        {
+            clusteredLighting.Record(commandBuffer, currentFrame);
+        });
+        // It only writes buffers the forward pass reads, which the graph doesn't see
+        renderGraph.SetSideEffect(lightCullingPass);
+    }
+
+    forwardPass = renderGraph.AddGraphicsPass("Forward", [this](const VkCommandBuffer commandBuffer)
+    {
+        RecordForwardPass(commandBuffer);
+    });
+
+    // With dynamic resolution the scene goes into the top left corner of an image the size of the backbuffer, and
+    // the upscale pass stretches it over the backbuffer. The scale only moves the render area, the images stay
+    RenderGraph::ResourceId sceneImage = backbufferImage;
+    if (settings.dynamicResolution)
+    {
+        sceneColorImage = renderGraph.CreateImage("SceneColor", frameDesc);
+        sceneImage = sceneColorImage;
+    }
+
+    // FXAA filters the forward pass's output into the scene image, before any upscale, so it works on the pixels
+    // that were actually rendered
+    RenderGraph::ResourceId forwardImage = sceneImage;
+    if (antiAliasing == AntiAliasing::Fxaa)
+    {
+        fxaaSourceImage = renderGraph.CreateImage("FxaaSource", frameDesc);
+        forwardImage = fxaaSourceImage;
+    }
+
+    // Multisampled images cannot be presented directly, so we render into a multisampled color image and resolve it
+    // into the backbuffer at the end of the pass
+    constexpr VkClearColorValue clearColor = {{0.0f, 0.0f, 0.0f, 1.0f}};
+    if (msaaSamples != VK_SAMPLE_COUNT_1_BIT)
+    {
+        RenderGraph::ImageDesc colorDesc = frameDesc;
+        colorDesc.samples = msaaSamples;
+        const RenderGraph::ResourceId colorImage = renderGraph.CreateImage("Color", colorDesc);
+
+        renderGraph.AddColorAttachment(forwardPass, colorImage, clearColor);
+        renderGraph.AddResolveAttachment(forwardPass, forwardImage);
+    }
+    else
+    {
+        renderGraph.AddColorAttachment(forwardPass, forwardImage, clearColor);
+    }
+    if (settings.depthPrepass)
+    {
+        renderGraph.SetDepthAttachment(forwardPass, depthImage, std::nullopt, false);
+    }
+    else
+    {
+        renderGraph.SetDepthAttachment(forwardPass, depthImage, VkClearDepthStencilValue{1.0f, 0});
+    }
+
+    if (settings.views > 1)
+    {
+        renderGraph.SetViewMask(forwardPass, (1u << settings.views) - 1);
+    }
+
+    if (antiAliasing == AntiAliasing::Fxaa)
+    {
+        fxaaPass = renderGraph.AddGraphicsPass("Fxaa", [this](const VkCommandBuffer commandBuffer)
+        {
+            RecordFxaa(commandBuffer);
+        });
+        renderGraph.Read(fxaaPass, fxaaSourceImage, RenderGraphAccess::FragmentSampled);
+        renderGraph.AddColorAttachment(fxaaPass, sceneImage);
+    }
+
+    if (settings.dynamicResolution)
+    {
+        upscalePass = renderGraph.AddGraphicsPass("Upscale", [this](const VkCommandBuffer commandBuffer)
+        {
+            dynamicResolution.RecordUpscale(commandBuffer, swapChainExtent, renderExtent);
+        });
+        renderGraph.Read(upscalePass, sceneColorImage, RenderGraphAccess::FragmentSampled);
+        // Every pixel gets written, so what was there before doesn't matter
+        renderGraph.AddColorAttachment(upscalePass, backbufferImage);
+    }
+
+    if (settings.readback)
+    {
+        const RenderGraph::PassId readbackPass = renderGraph.AddPass("Readback", [this](const VkCommandBuffer commandBuffer)
+        {
+            RecordReadback(commandBuffer, renderGraph.GetImage(backbufferImage));
+        });
+        renderGraph.Read(readbackPass, backbufferImage, RenderGraphAccess::TransferSrc);
+        // The copy lands in a buffer the graph knows nothing about
+        renderGraph.SetSideEffect(readbackPass);
+    }
+
+    renderGraph.Compile();
+    vkRenderPass = renderGraph.GetRenderPass(forwardPass);
+
+    if (settings.occlusionCulling)
+    {
+        occlusionCuller.SetTargets(renderGraph.GetImageView(depthImage), msaaSamples, renderGraph.GetImage(hiZImage), swapChainExtent);
+    }
+
+    // The post-processing passes need their render passes, so they are created with the first graph that has them
+    if (settings.dynamicResolution)
+    {
+        if (!dynamicResolution.IsInitialized())
+        {
+            dynamicResolution.Init(vkDevice, renderGraph.GetRenderPass(upscalePass), settings.targetFrameTime, shaderCompiler, layoutCache);
+        }
+        dynamicResolution.SetSceneView(renderGraph.GetImageView(sceneColorImage));
+    }
+    if (antiAliasing == AntiAliasing::Fxaa)
+    {
+        if (!fxaa.IsInitialized())
+        {
+            fxaa.Init(vkDevice, renderGraph.GetRenderPass(fxaaPass), "shaders/fxaa.frag", VK_FILTER_LINEAR, shaderCompiler, layoutCache);
+        }
+        fxaa.SetSource(renderGraph.GetImageView(fxaaSourceImage));
+    }
+
+    InvalidateCommandBuffers();
+}
+
+void VulkanApp::InitOcclusionCulling()
+{
+    // The Hi-Z pyramid is built by sampling the depth buffer, which not every depth format allows
+    VkFormatProperties formatProperties;
+    vkGetPhysicalDeviceFormatProperties(vkPhysicalDevice, FindDepthFormat(), &formatProperties);
+    if (!(formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT))
+    {
+        std::cerr << "The depth format can't be sampled, occlusion culling is disabled" << '\n';
+        settings.occlusionCulling = false;
+        return;
+    }
+
+    occlusionCuller.Init(vkDevice, vkPhysicalDevice, MAX_FRAMES_IN_FLIGHT, shaderCompiler, layoutCache);
+}
+
+void VulkanApp::CreateCommandPool()
+{
+    const QueueFamilyIndices queueFamilyIndices = FindQueueFamilies(vkPhysicalDevice);
 
     VkCommandPoolCreateInfo poolInfo{};
     poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
@@ -967,127 +1563,174 @@ void VulkanApp::CreateCommandPool()
     }
 }
 
-void VulkanApp::CreateTextureImage()
+void VulkanApp::UploadTextures(const bool wait)
 {
-    int texWidth, texHeight, texChannels;
-    
-    // We force it to load with alpha
-    stbi_uc* pixels = stbi_load(TEXTURE_PATH.c_str(), &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
-    VkDeviceSize imageSize = texWidth * texHeight * 4;
+    // Until the model is parsed there are no textures to speak of
+    if (!wait && !modelParsed.IsDone())
+        return;
 
-    // Calculates the number of levels in the mip chain
-    vkMipLevels = static_cast<uint32_t>(std::floor(std::log2(std::max(texWidth, texHeight)))) + 1;
+    jobSystem.Wait(modelParsed);
+    if (modelError)
+    {
+        std::rethrow_exception(modelError);
+    }
+
+    textures.resize(decodedImages.size());
+    for (uint32_t id = 0; id < decodedImages.size(); id++)
+    {
+        DecodedImage& image = *decodedImages[id];
+        if (textures[id].image != VK_NULL_HANDLE || (!wait && !image.decoded.IsDone()))
+            continue;
+
+        jobSystem.Wait(image.decoded);
+        if (image.error)
+        {
+            std::rethrow_exception(image.error);
+        }
+        UploadTexture(id);
+    }
 
-    if (!pixels)
+    // Every decode has been waited for, so their counters can go
+    if (wait)
     {
-        throw std::runtime_error("failed to load texture image!");
+        decodedImages.clear();
     }
+}
+
+void VulkanApp::UploadTexture(const uint32_t id)
+{
+    const auto start = std::chrono::steady_clock::now();
+    DecodedImage& image = *decodedImages[id];
+    const int texWidth = image.width;
+    const int texHeight = image.height;
+    VkDeviceSize imageSize = texWidth * texHeight * 4;
+
+    // Calculates the number of levels in the mip chain
+    Texture& texture = textures[id];
+    texture.mipLevels = static_cast<uint32_t>(std::floor(std::log2(std::max(texWidth, texHeight)))) + 1;
 
     VkBuffer stagingBuffer;
     VkDeviceMemory stagingBufferMemory;
 
     // We’re now going to create a buffer in host visible memory so that we can use vkMapMemory and copy the pixels to it
-    CreateBuffer(imageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
+    deviceMemory.CreateBuffer(imageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
 
     // We can then directly copy the pixel values that we got from the image loading library to the buffer
     void* data;
     vkMapMemory(vkDevice, stagingBufferMemory, 0, imageSize, 0, &data);
-    memcpy(data, pixels, static_cast<size_t>(imageSize));
+    memcpy(data, image.pixels, static_cast<size_t>(imageSize));
     vkUnmapMemory(vkDevice, stagingBufferMemory);
 
-    stbi_image_free(pixels);
+    stbi_image_free(image.pixels);
+    image.pixels = nullptr;
     
-    CreateImage(texWidth, texHeight, vkMipLevels, VK_SAMPLE_COUNT_1_BIT, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, vkTextureImage, vkTextureImageMemory);
+    // The compute downsampler does the whole chain in a few dispatches and doesn't need blit support, so it is the
+    // default. The blit chain is the fallback, and can be forced with --blit-mipmaps
+    const bool computeMipmaps = !settings.blitMipmaps && mipGenerator.Supports(VK_FORMAT_R8G8B8A8_SRGB);
+    if (computeMipmaps)
+    {
+        CreateImage(texWidth, texHeight, texture.mipLevels, VK_SAMPLE_COUNT_1_BIT, MipGenerator::GetStorageFormat(VK_FORMAT_R8G8B8A8_SRGB), VK_IMAGE_TILING_OPTIMAL,
+                    VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                    texture.image, texture.memory, 1, MipGenerator::GetImageCreateFlags(VK_FORMAT_R8G8B8A8_SRGB));
+    }
+    else
+    {
+        if (!SupportsLinearBlit(VK_FORMAT_R8G8B8A8_SRGB))
+        {
+            throw std::runtime_error("texture image format does not support linear blitting!");
+        }
+
+        CreateImage(texWidth, texHeight, texture.mipLevels, VK_SAMPLE_COUNT_1_BIT, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, texture.image, texture.memory);
+    }
 
-    TransitionImageLayout(vkTextureImage, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, vkMipLevels);
-    CopyBufferToImage(stagingBuffer, vkTextureImage, static_cast<uint32_t>(texWidth), static_cast<uint32_t>(texHeight));
+    TransitionImageLayout(texture.image, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, texture.mipLevels);
+    CopyBufferToImage(stagingBuffer, texture.image, static_cast<uint32_t>(texWidth), static_cast<uint32_t>(texHeight));
     //transitioned to VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL while generating mipmaps
 
     vkDestroyBuffer(vkDevice, stagingBuffer, nullptr);
     vkFreeMemory(vkDevice, stagingBufferMemory, nullptr);
 
-    GenerateMipmaps(vkTextureImage, VK_FORMAT_R8G8B8A8_SRGB, texWidth, texHeight, vkMipLevels);
+    const VkCommandBuffer commandBuffer = BeginSingleTimeCommands();
+    if (computeMipmaps)
+    {
+        mipGenerator.Record(commandBuffer, texture.image, VK_FORMAT_R8G8B8A8_SRGB, {static_cast<uint32_t>(texWidth), static_cast<uint32_t>(texHeight)}, texture.mipLevels);
+    }
+    else
+    {
+        GenerateMipmaps(commandBuffer, texture.image, texWidth, texHeight, texture.mipLevels);
+    }
+    EndSingleTimeCommands(commandBuffer);
+
+    // EndSingleTimeCommands waited for the queue, so the views and descriptor sets are done with
+    mipGenerator.ReleaseResources();
+
+    // Only sampled, the STORAGE usage of the image is for the UNORM views the downsampler writes through
+    texture.view = CreateImageView(texture.image, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_ASPECT_COLOR_BIT, texture.mipLevels, 1,
+                                   computeMipmaps ? VK_IMAGE_USAGE_SAMPLED_BIT : 0);
+    AddCapturedResource("texture " + std::filesystem::path(image.path).filename().string() + " " + std::to_string(texWidth) + "x" +
+                        std::to_string(texHeight) + ", " + std::to_string(texture.mipLevels) + " mips");
+    startupTimer.Add("Upload " + std::filesystem::path(image.path).filename().string(), StartupTimer::Category::Upload, start);
 }
 
-void VulkanApp::GenerateMipmaps(const VkImage image, const VkFormat imageFormat, const int32_t texWidth,
-                                const int32_t texHeight, const uint32_t mipLevels) const
+bool VulkanApp::SupportsLinearBlit(const VkFormat format) const
 {
-        // Check if image format supports linear blitting
-        VkFormatProperties formatProperties;
-        vkGetPhysicalDeviceFormatProperties(vkPhysicalDevice, imageFormat, &formatProperties);
+    VkFormatProperties formatProperties;
+    vkGetPhysicalDeviceFormatProperties(vkPhysicalDevice, format, &formatProperties);
+    return (formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT) != 0;
+}
 
-        if (!(formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT))
-        {
-            throw std::runtime_error("texture image format does not support linear blitting!");
-        }
+void VulkanApp::GenerateMipmaps(const VkCommandBuffer commandBuffer, const VkImage image, const int32_t texWidth,
+                                const int32_t texHeight, const uint32_t mipLevels) const
+{
+    VkImageMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.image = image;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    barrier.subresourceRange.baseArrayLayer = 0;
+    barrier.subresourceRange.layerCount = 1;
+    barrier.subresourceRange.levelCount = 1;
 
-        VkCommandBuffer commandBuffer = BeginSingleTimeCommands();
-
-        VkImageMemoryBarrier barrier{};
-        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-        barrier.image = image;
-        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-        barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-        barrier.subresourceRange.baseArrayLayer = 0;
-        barrier.subresourceRange.layerCount = 1;
-        barrier.subresourceRange.levelCount = 1;
-
-        int32_t mipWidth = texWidth;
-        int32_t mipHeight = texHeight;
-
-        for (uint32_t i = 1; i < mipLevels; i++) {
-            barrier.subresourceRange.baseMipLevel = i - 1;
-            barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-            barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
-            barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-            barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-
-            vkCmdPipelineBarrier(commandBuffer,
-                VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
-                0, nullptr,
-                0, nullptr,
-                1, &barrier);
-
-            VkImageBlit blit{};
-            blit.srcOffsets[0] = {0, 0, 0};
-            blit.srcOffsets[1] = {mipWidth, mipHeight, 1};
-            blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-            blit.srcSubresource.mipLevel = i - 1;
-            blit.srcSubresource.baseArrayLayer = 0;
-            blit.srcSubresource.layerCount = 1;
-            blit.dstOffsets[0] = {0, 0, 0};
-            blit.dstOffsets[1] = { mipWidth > 1 ? mipWidth / 2 : 1, mipHeight > 1 ? mipHeight / 2 : 1, 1 };
-            blit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-            blit.dstSubresource.mipLevel = i;
-            blit.dstSubresource.baseArrayLayer = 0;
-            blit.dstSubresource.layerCount = 1;
-
-            vkCmdBlitImage(commandBuffer,
-                image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-                image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-                1, &blit,
-                VK_FILTER_LINEAR);
-
-            barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
-            barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-            barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-            barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-
-            vkCmdPipelineBarrier(commandBuffer,
-                VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
-                0, nullptr,
-                0, nullptr,
-                1, &barrier);
-
-            if (mipWidth > 1) mipWidth /= 2;
-            if (mipHeight > 1) mipHeight /= 2;
-        }
+    int32_t mipWidth = texWidth;
+    int32_t mipHeight = texHeight;
 
-        barrier.subresourceRange.baseMipLevel = mipLevels - 1;
+    for (uint32_t i = 1; i < mipLevels; i++) {
+        barrier.subresourceRange.baseMipLevel = i - 1;
         barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-        barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
         barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+        vkCmdPipelineBarrier(commandBuffer,
+            VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+            0, nullptr,
+            0, nullptr,
+            1, &barrier);
+
+        VkImageBlit blit{};
+        blit.srcOffsets[0] = {0, 0, 0};
+        blit.srcOffsets[1] = {mipWidth, mipHeight, 1};
+        blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        blit.srcSubresource.mipLevel = i - 1;
+        blit.srcSubresource.baseArrayLayer = 0;
+        blit.srcSubresource.layerCount = 1;
+        blit.dstOffsets[0] = {0, 0, 0};
+        blit.dstOffsets[1] = { mipWidth > 1 ? mipWidth / 2 : 1, mipHeight > 1 ? mipHeight / 2 : 1, 1 };
+        blit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        blit.dstSubresource.mipLevel = i;
+        blit.dstSubresource.baseArrayLayer = 0;
+        blit.dstSubresource.layerCount = 1;
+
+        vkCmdBlitImage(commandBuffer,
+            image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+            image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            1, &blit,
+            VK_FILTER_LINEAR);
+
+        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
         barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
 
         vkCmdPipelineBarrier(commandBuffer,
@@ -1096,12 +1739,21 @@ void VulkanApp::GenerateMipmaps(const VkImage image, const VkFormat imageFormat,
             0, nullptr,
             1, &barrier);
 
-        EndSingleTimeCommands(commandBuffer);
+        if (mipWidth > 1) mipWidth /= 2;
+        if (mipHeight > 1) mipHeight /= 2;
     }
 
-void VulkanApp::CreateTextureImageView()
-{
-    vkTextureImageView = CreateImageView(vkTextureImage, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_ASPECT_COLOR_BIT, vkMipLevels); 
+    barrier.subresourceRange.baseMipLevel = mipLevels - 1;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+    vkCmdPipelineBarrier(commandBuffer,
+        VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
+        0, nullptr,
+        0, nullptr,
+        1, &barrier);
 }
 
 void VulkanApp::CreateTextureSampler()
@@ -1116,13 +1768,13 @@ void VulkanApp::CreateTextureSampler()
     samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
     samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
     samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
-    samplerInfo.anisotropyEnable = VK_TRUE;
+    samplerInfo.anisotropyEnable = samplerAnisotropySupported ? VK_TRUE : VK_FALSE;
 
     //  The maxAnisotropy field limits the amount of texel samples that can be used to calculate the final color
     //  We need to query it from physical device
     VkPhysicalDeviceProperties properties{};
     vkGetPhysicalDeviceProperties(vkPhysicalDevice, &properties);
-    samplerInfo.maxAnisotropy = properties.limits.maxSamplerAnisotropy;
+    samplerInfo.maxAnisotropy = samplerAnisotropySupported ? properties.limits.maxSamplerAnisotropy : 1.0f;
 
     samplerInfo.borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK;
     samplerInfo.unnormalizedCoordinates = VK_FALSE;
@@ -1145,16 +1797,17 @@ void VulkanApp::CreateTextureSampler()
 
 void VulkanApp::CreateImage(const uint32_t width, const uint32_t height, const uint32_t mipLevels, VkSampleCountFlagBits numSamples,
                             const VkFormat format, const VkImageTiling tiling, const VkImageUsageFlags usage,
-                            const VkMemoryPropertyFlags properties, VkImage& image, VkDeviceMemory& imageMemory) const
+                            const VkMemoryPropertyFlags properties, VkImage& image, VkDeviceMemory& imageMemory, const uint32_t arrayLayers, const VkImageCreateFlags flags) const
 {
     VkImageCreateInfo imageInfo{};
     imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageInfo.flags = flags;
     imageInfo.imageType = VK_IMAGE_TYPE_2D;
     imageInfo.extent.width = width;
     imageInfo.extent.height = height;
     imageInfo.extent.depth = 1;
     imageInfo.mipLevels = mipLevels;
-    imageInfo.arrayLayers = 1;
+    imageInfo.arrayLayers = arrayLayers;
     imageInfo.format = format;
     imageInfo.tiling = tiling;
     imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
@@ -1173,7 +1826,7 @@ void VulkanApp::CreateImage(const uint32_t width, const uint32_t height, const u
     VkMemoryAllocateInfo allocInfo{};
     allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
     allocInfo.allocationSize = memRequirements.size;
-    allocInfo.memoryTypeIndex = FindMemoryType(memRequirements.memoryTypeBits, properties);
+    allocInfo.memoryTypeIndex = deviceMemory.FindMemoryType(memRequirements.memoryTypeBits, properties);
 
     if (vkAllocateMemory(vkDevice, &allocInfo, nullptr, &imageMemory) != VK_SUCCESS)
     {
@@ -1222,24 +1875,62 @@ void VulkanApp::EndSingleTimeCommands(const VkCommandBuffer commandBuffer) const
     vkFreeCommandBuffers(vkDevice, vkCommandPool, 1, &commandBuffer);
 }
 
-void VulkanApp::LoadModel()
+void VulkanApp::StartAssetLoads()
+{
+    jobSystem.Run([this]()
+    {
+        // Rethrown on the main thread by UploadTextures, an exception leaving a job would end the process
+        try
+        {
+            ParseModel();
+        }
+        catch (...)
+        {
+            modelError = std::current_exception();
+        }
+    }, &modelParsed);
+}
+
+void VulkanApp::ParseModel()
 {
+    PROFILE_CPU_ZONE("ParseModel");
+
     tinyobj::attrib_t attrib;
     std::vector<tinyobj::shape_t> shapes;
-    std::vector<tinyobj::material_t> materials;
+    std::vector<tinyobj::material_t> objMaterials;
     std::string warn, err;
 
-    if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, MODEL_PATH.c_str()))
+    // Read in one go first, so the startup report tells the disk apart from the parser
+    const std::string modelName = std::filesystem::path(settings.modelPath).filename().string();
+    const auto readStart = std::chrono::steady_clock::now();
+    const std::vector<char> modelFile = ReadFile(settings.modelPath);
+    startupTimer.Add("Read " + modelName, StartupTimer::Category::FileRead, readStart);
+
+    // The material library and the textures it names are relative to the model
+    const auto parseStart = std::chrono::steady_clock::now();
+    const std::filesystem::path modelDirectory = std::filesystem::path(settings.modelPath).parent_path();
+    std::istringstream modelStream(std::string(modelFile.begin(), modelFile.end()));
+    tinyobj::MaterialFileReader materialReader((modelDirectory / "").string());
+    if (!tinyobj::LoadObj(&attrib, &shapes, &objMaterials, &warn, &err, &modelStream, &materialReader))
     {
         throw std::runtime_error(warn + err);
     }
 
     std::unordered_map<Vertex, uint32_t> uniqueVertices{};
+    // Indices per OBJ material, plus one last list for the faces without a material. Vertices are shared by all of
+    // them, so one draw per material covers every shape using it
+    std::vector<std::vector<uint32_t>> materialIndices(objMaterials.size() + 1);
 
     // The triangulation feature has already made sure that there are three vertices per face,
     for (const tinyobj::shape_t& shape : shapes)
     {
-        for (const auto& index : shape.mesh.indices) {
+        for (size_t i = 0; i < shape.mesh.indices.size(); i++) {
+            const tinyobj::index_t& index = shape.mesh.indices[i];
+            const int materialId = shape.mesh.material_ids[i / 3];
+            // Materials without a diffuse map are drawn in their diffuse color, which travels as the vertex color
+            const bool untextured = materialId >= 0 && objMaterials[materialId].diffuse_texname.empty();
+            std::vector<uint32_t>& faceIndices = materialIndices[materialId >= 0 ? materialId : objMaterials.size()];
+
             Vertex vertex{};
 
             vertex.pos =
@@ -1249,62 +1940,131 @@ void VulkanApp::LoadModel()
                 attrib.vertices[3 * index.vertex_index + 2]
             };
 
-            vertex.texCoord =
+            // Untextured models may leave the coordinates out, and nothing samples with them then
+            if (index.texcoord_index >= 0)
             {
-                attrib.texcoords[2 * index.texcoord_index + 0],
-                1.0f - attrib.texcoords[2 * index.texcoord_index + 1]
-            };
+                vertex.texCoord =
+                {
+                    attrib.texcoords[2 * index.texcoord_index + 0],
+                    1.0f - attrib.texcoords[2 * index.texcoord_index + 1]
+                };
+            }
 
             vertex.color = {1.0f, 1.0f, 1.0f};
-            
+            if (untextured)
+            {
+                const tinyobj::real_t* diffuse = objMaterials[materialId].diffuse;
+                vertex.color = {diffuse[0], diffuse[1], diffuse[2]};
+            }
+
             if (!uniqueVertices.contains(vertex))
             {
                 uniqueVertices[vertex] = static_cast<uint32_t>(vertices.size());
                 vertices.push_back(vertex);
             }
 
-            indices.push_back(uniqueVertices[vertex]);
+            faceIndices.push_back(uniqueVertices[vertex]);
         }
     }
-}
-
-void VulkanApp::CopyBuffer(const VkBuffer srcBuffer, const VkBuffer dstBuffer, const VkDeviceSize size) const
-{
-    const VkCommandBuffer commandBuffer = BeginSingleTimeCommands();
-
-    // Contents of buffers are transferred using the vkCmdCopyBuffer command
-    VkBufferCopy copyRegion{};
-    copyRegion.size = size;
-    vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
-
-    EndSingleTimeCommands(commandBuffer);
-}
 
-void VulkanApp::CreateBuffer(const VkDeviceSize size, const VkBufferUsageFlags usage, const VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& bufferMemory) const
-{
-    VkBufferCreateInfo bufferInfo{};
-    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-    bufferInfo.size = size;
-    bufferInfo.usage = usage;
-    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    // Only materials some face uses become materials of the model, and their textures only load once each
+    for (size_t objMaterial = 0; objMaterial < materialIndices.size(); objMaterial++)
+    {
+        const std::vector<uint32_t>& materialRange = materialIndices[objMaterial];
+        if (materialRange.empty())
+            continue;
+
+        Material material;
+        PipelineKey key;
+        std::string texturePath = TEXTURE_PATH;
+        if (objMaterial < objMaterials.size())
+        {
+            material.name = objMaterials[objMaterial].name;
+            if (!objMaterials[objMaterial].diffuse_texname.empty())
+            {
+                texturePath = (modelDirectory / objMaterials[objMaterial].diffuse_texname).generic_string();
+            }
+            else
+            {
+                texturePath = WHITE_TEXTURE;
+                key.useTexture = false;
+                key.useVertexColor = true;
+            }
+        }
+        else
+        {
+            material.name = "default";
+        }
+        const auto [texture, added] = textureIds.emplace(texturePath, static_cast<uint32_t>(decodedImages.size()));
+        if (added)
+        {
+            decodedImages.push_back(std::make_unique<DecodedImage>());
+            decodedImages.back()->path = texturePath;
+        }
+        material.texture = texture->second;
 
-    if (vkCreateBuffer(vkDevice, &bufferInfo, nullptr, &buffer) != VK_SUCCESS) {
-        throw std::runtime_error("failed to create buffer!");
+        // Materials asking for the same permutation share a pipeline id, so their draws sort next to each other
+        const auto keyIt = std::find(pipelineKeys.begin(), pipelineKeys.end(), key);
+        material.pipeline = static_cast<uint32_t>(keyIt - pipelineKeys.begin());
+        if (keyIt == pipelineKeys.end())
+        {
+            pipelineKeys.push_back(key);
+        }
+        materials.push_back(material);
+
+        Submesh submesh;
+        submesh.material = static_cast<uint32_t>(materials.size() - 1);
+        submesh.firstIndex = static_cast<uint32_t>(indices.size());
+        submesh.indexCount = static_cast<uint32_t>(materialRange.size());
+        submeshes.push_back(submesh);
+        indices.insert(indices.end(), materialRange.begin(), materialRange.end());
     }
 
-    VkMemoryRequirements memRequirements;
-    vkGetBufferMemoryRequirements(vkDevice, buffer, &memRequirements);
+    startupTimer.Add("Parse " + modelName, StartupTimer::Category::Decode, parseStart);
 
-    VkMemoryAllocateInfo allocInfo{};
-    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    allocInfo.allocationSize = memRequirements.size;
-    allocInfo.memoryTypeIndex = FindMemoryType(memRequirements.memoryTypeBits, properties);
+    std::cout << "Model " << settings.modelPath << ": " << vertices.size() << " vertices, " << indices.size() / 3 << " triangles, "
+              << materials.size() << " materials, " << decodedImages.size() << " textures" << '\n';
 
-    if (vkAllocateMemory(vkDevice, &allocInfo, nullptr, &bufferMemory) != VK_SUCCESS) {
-        throw std::runtime_error("failed to allocate buffer memory!");
+    // Each texture decodes on its own worker, and is uploaded by the main thread once it is done
+    for (const std::unique_ptr<DecodedImage>& decodedImage : decodedImages)
+    {
+        jobSystem.Run([this, image = decodedImage.get()]()
+        {
+            PROFILE_CPU_ZONE("DecodeTexture");
+            const std::string name = std::filesystem::path(image->path).filename().string();
+            try
+            {
+                if (image->path == WHITE_TEXTURE)
+                {
+                    // Allocated like stb_image does, so it is freed like every decoded image
+                    image->width = 1;
+                    image->height = 1;
+                    image->pixels = static_cast<unsigned char*>(STBI_MALLOC(4));
+                    std::fill_n(image->pixels, 4, static_cast<unsigned char>(255));
+                    return;
+                }
+
+                const auto readStart = std::chrono::steady_clock::now();
+                const std::vector<char> file = ReadFile(image->path);
+                startupTimer.Add("Read " + name, StartupTimer::Category::FileRead, readStart);
+
+                const auto decodeStart = std::chrono::steady_clock::now();
+                int channels;
+                // We force it to load with alpha
+                image->pixels = stbi_load_from_memory(reinterpret_cast<const stbi_uc*>(file.data()), static_cast<int>(file.size()),
+                                                      &image->width, &image->height, &channels, STBI_rgb_alpha);
+                if (!image->pixels)
+                {
+                    throw std::runtime_error("failed to load texture image " + image->path + "!");
+                }
+                startupTimer.Add("Decode " + name, StartupTimer::Category::Decode, decodeStart);
+            }
+            catch (...)
+            {
+                image->error = std::current_exception();
+            }
+        }, &decodedImage->decoded);
     }
-
-    vkBindBufferMemory(vkDevice, buffer, bufferMemory, 0);
 }
 
 void VulkanApp::TransitionImageLayout(VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout, uint32_t mipLevels)
@@ -1395,76 +2155,50 @@ void VulkanApp::CopyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width
     EndSingleTimeCommands(commandBuffer);
 }
 
-// Create a multisampled color buffer
-void VulkanApp::CreateColorResources()
+void VulkanApp::CreateUniformBuffers()
 {
-    VkFormat colorFormat = swapChainImageFormat;
+    VkDeviceSize bufferSize = sizeof(UniformBufferObject);
+
+    vkUniformBuffers.resize(MAX_FRAMES_IN_FLIGHT);
+    vkUniformBuffersMemory.resize(MAX_FRAMES_IN_FLIGHT);
+    vkUniformBuffersMapped.resize(MAX_FRAMES_IN_FLIGHT);
+
+    for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+        deviceMemory.CreateBuffer(bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, vkUniformBuffers[i], vkUniformBuffersMemory[i]);
 
-    CreateImage(swapChainExtent.width, swapChainExtent.height, 1, msaaSamples, colorFormat, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, vkColorImage, vkColorImageMemory);
-    vkColorImageView = CreateImageView(vkColorImage, colorFormat, VK_IMAGE_ASPECT_COLOR_BIT, 1);
+        // We map the buffer right after creation using vkMapMemory to get a pointer to which we can write the data later on
+        vkMapMemory(vkDevice, vkUniformBuffersMemory[i], 0, bufferSize, 0, &vkUniformBuffersMapped[i]);
+    }
 }
 
-void VulkanApp::CreateIndexBuffer()
+void VulkanApp::CreateDescriptorPool()
 {
-    VkDeviceSize bufferSize = sizeof(indices[0]) * indices.size();
-
-    // The same as before, first the staging buffer
-    VkBuffer stagingBuffer;
-    VkDeviceMemory stagingBufferMemory;
-    CreateBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
+    // We first need to describe which descriptor types our descriptor sets are going to contain and how many of them.
+    // That is whatever the shaders declared in set 0, once per material and frame in flight
+    const uint32_t setCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT * materials.size());
+    std::vector<VkDescriptorPoolSize> poolSizes;
+    for (const VkDescriptorSetLayoutBinding& binding : forwardShaderLayout.sets.at(0))
+    {
+        const auto it = std::find_if(poolSizes.begin(), poolSizes.end(), [&binding](const VkDescriptorPoolSize& size)
+        {
+            return size.type == binding.descriptorType;
+        });
 
-    // And copy our indices there
-    void* data;
-    vkMapMemory(vkDevice, stagingBufferMemory, 0, bufferSize, 0, &data);
-    memcpy(data, indices.data(), (size_t) bufferSize);
-    vkUnmapMemory(vkDevice, stagingBufferMemory);
-
-    // And now the buffer in device space
-    CreateBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, vkIndexBuffer, vkIndexBufferMemory);
-
-    // And we copy the staging buffer into our device space
-    CopyBuffer(stagingBuffer, vkIndexBuffer, bufferSize);
-
-    // Free the staging
-    vkDestroyBuffer(vkDevice, stagingBuffer, nullptr);
-    vkFreeMemory(vkDevice, stagingBufferMemory, nullptr);
-}
-
-void VulkanApp::CreateUniformBuffers()
-{
-    VkDeviceSize bufferSize = sizeof(UniformBufferObject);
-
-    vkUniformBuffers.resize(MAX_FRAMES_IN_FLIGHT);
-    vkUniformBuffersMemory.resize(MAX_FRAMES_IN_FLIGHT);
-    vkUniformBuffersMapped.resize(MAX_FRAMES_IN_FLIGHT);
-
-    for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-        CreateBuffer(bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, vkUniformBuffers[i], vkUniformBuffersMemory[i]);
-
-        // We map the buffer right after creation using vkMapMemory to get a pointer to which we can write the data later on
-        vkMapMemory(vkDevice, vkUniformBuffersMemory[i], 0, bufferSize, 0, &vkUniformBuffersMapped[i]);
+        if (it != poolSizes.end())
+            it->descriptorCount += binding.descriptorCount * setCount;
+        else
+            poolSizes.push_back({binding.descriptorType, binding.descriptorCount * setCount});
     }
-}
-
-void VulkanApp::CreateDescriptorPool()
-{
-    // We first need to describe which descriptor types our descriptor sets are going to contain and how many of them
-    std::array<VkDescriptorPoolSize, 2> poolSizes{};
-    poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    poolSizes[0].descriptorCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
-    poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-    poolSizes[1].descriptorCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
     
-    // We will allocate one of these descriptors for every frame
+    // We will allocate one of these descriptors for every material and frame
     VkDescriptorPoolCreateInfo poolInfo{};
     poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
     poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
     poolInfo.pPoolSizes = poolSizes.data();
-    poolInfo.maxSets = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
 
     // Aside from the maximum number of individual descriptors that are available,
     // we also need to specify the maximum number of descriptor sets that may be allocated:
-    poolInfo.maxSets = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
+    poolInfo.maxSets = setCount;
 
     if (vkCreateDescriptorPool(vkDevice, &poolInfo, nullptr, &vkDescriptorPool) != VK_SUCCESS) {
         throw std::runtime_error("failed to create descriptor pool!");
@@ -1483,70 +2217,99 @@ void VulkanApp::CreateDescriptorSets()
 
     // In our case we will create one descriptor set for each frame in flight, all with the same layout.
     // Unfortunately we do need all the copies of the layout because the next function expects an array matching the number of sets.
-    vkDescriptorSets.resize(MAX_FRAMES_IN_FLIGHT);
-    if (vkAllocateDescriptorSets(vkDevice, &allocInfo, vkDescriptorSets.data()) != VK_SUCCESS)
+    for (Material& material : materials)
     {
-        throw std::runtime_error("failed to allocate descriptor sets!");
+        material.descriptorSets.resize(MAX_FRAMES_IN_FLIGHT);
+        if (vkAllocateDescriptorSets(vkDevice, &allocInfo, material.descriptorSets.data()) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to allocate descriptor sets!");
+        }
     }
 
-    // The descriptor sets have been allocated now, but the descriptors within still need to be configured. 
-    for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-        VkDescriptorBufferInfo bufferInfo{};
-        bufferInfo.buffer = vkUniformBuffers[i];
-        bufferInfo.offset = 0;
-        bufferInfo.range = sizeof(UniformBufferObject);
+    // The descriptor sets have been allocated now, but the descriptors within still need to be configured. Materials
+    // only differ in their texture, the uniform buffer and the light lists are the frame's
+    for (const Material& material : materials)
+    {
+        for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+        {
+            VkDescriptorBufferInfo bufferInfo{};
+            bufferInfo.buffer = vkUniformBuffers[i];
+            bufferInfo.offset = 0;
+            bufferInfo.range = sizeof(UniformBufferObject);
 
-        VkDescriptorImageInfo imageInfo{};
-        imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-        imageInfo.imageView = vkTextureImageView;
-        imageInfo.sampler = vkTextureSampler;
+            VkDescriptorImageInfo imageInfo{};
+            imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+            imageInfo.imageView = textures[material.texture].view;
+            imageInfo.sampler = vkTextureSampler;
 
-        std::array<VkWriteDescriptorSet, 2> descriptorWrites{};
+            std::array<VkWriteDescriptorSet, 2> descriptorWrites{};
         
-        descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        descriptorWrites[0].dstSet = vkDescriptorSets[i];
-        descriptorWrites[0].dstBinding = 0;
-        descriptorWrites[0].dstArrayElement = 0;
-        descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-        descriptorWrites[0].descriptorCount = 1;
-        descriptorWrites[0].pBufferInfo = &bufferInfo;
-
-        descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        descriptorWrites[1].dstSet = vkDescriptorSets[i];
-        descriptorWrites[1].dstBinding = 1;
-        descriptorWrites[1].dstArrayElement = 0;
-        descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-        descriptorWrites[1].descriptorCount = 1;
-        descriptorWrites[1].pImageInfo = &imageInfo;
-
-        vkUpdateDescriptorSets(vkDevice, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+            descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            descriptorWrites[0].dstSet = material.descriptorSets[i];
+            descriptorWrites[0].dstBinding = 0;
+            descriptorWrites[0].dstArrayElement = 0;
+            descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+            descriptorWrites[0].descriptorCount = 1;
+            descriptorWrites[0].pBufferInfo = &bufferInfo;
+
+            descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            descriptorWrites[1].dstSet = material.descriptorSets[i];
+            descriptorWrites[1].dstBinding = 1;
+            descriptorWrites[1].dstArrayElement = 0;
+            descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+            descriptorWrites[1].descriptorCount = 1;
+            descriptorWrites[1].pImageInfo = &imageInfo;
+
+            vkUpdateDescriptorSets(vkDevice, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+
+            // The light, grid and index lists of shader.frag's clustered lighting, bindings 2 to 4
+            if (settings.lightCount > 0)
+            {
+                const std::array<VkDescriptorBufferInfo, 3> lightInfos = clusteredLighting.GetFragmentBuffers(static_cast<uint32_t>(i));
+
+                std::array<VkWriteDescriptorSet, 3> lightWrites{};
+                for (uint32_t j = 0; j < lightWrites.size(); j++)
+                {
+                    lightWrites[j].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+                    lightWrites[j].dstSet = material.descriptorSets[i];
+                    lightWrites[j].dstBinding = 2 + j;
+                    lightWrites[j].dstArrayElement = 0;
+                    lightWrites[j].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+                    lightWrites[j].descriptorCount = 1;
+                    lightWrites[j].pBufferInfo = &lightInfos[j];
+                }
+
+                vkUpdateDescriptorSets(vkDevice, static_cast<uint32_t>(lightWrites.size()), lightWrites.data(), 0, nullptr);
+            }
+        }
     }
 }
 
-void VulkanApp::CreateVertexBuffer()
+void VulkanApp::CreateGeometryPool()
 {
-    VkDeviceSize bufferSize = sizeof(vertices[0]) * vertices.size();
-
-    // Create the stating buffer where we can write from the CPU
-    VkBuffer stagingBuffer;
-    VkDeviceMemory stagingBufferMemory;
-    CreateBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
-
-    // And we copy our vertices into the staging buffer
-    void* data;
-    vkMapMemory(vkDevice, stagingBufferMemory, 0, bufferSize, 0, &data);
-    memcpy(data, vertices.data(), (size_t) bufferSize);
-    vkUnmapMemory(vkDevice, stagingBufferMemory);
-
-    // Now we create a buffer in Device Space
-    CreateBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, vkVertexBuffer, vkVertexBufferMemory);
+    // Room for far more than the model, so meshes can come and go without growing the buffers
+    constexpr uint32_t VERTEX_CAPACITY = 1u << 20;
+    constexpr uint32_t INDEX_CAPACITY = 1u << 22;
+
+    const uint32_t vertexCount = static_cast<uint32_t>(vertices.size());
+    const uint32_t indexCount = static_cast<uint32_t>(indices.size());
+    geometryPool.Init(vkDevice, vkPhysicalDevice, sizeof(Vertex), std::max(VERTEX_CAPACITY, vertexCount), std::max(INDEX_CAPACITY, indexCount),
+                      settings.depthPrepass);
+
+    // The depth prepass only reads positions, so it gets them tightly packed instead of striding over whole vertices
+    std::vector<glm::vec3> positions;
+    if (settings.depthPrepass)
+    {
+        positions.resize(vertices.size());
+        std::transform(vertices.begin(), vertices.end(), positions.begin(), [](const Vertex& vertex) { return vertex.pos; });
+    }
 
-    // Copy the stating buffer into the vertex buffer
-    CopyBuffer(stagingBuffer, vkVertexBuffer, bufferSize);
+    const VkCommandBuffer commandBuffer = BeginSingleTimeCommands();
+    modelMesh = geometryPool.AddMesh(commandBuffer, vertices.data(), positions.data(), vertexCount, indices.data(), indexCount);
+    EndSingleTimeCommands(commandBuffer);
+    geometryPool.ReleaseStaging();
 
-    // And destroy the temporary staging buffer
-    vkDestroyBuffer(vkDevice, stagingBuffer, nullptr);
-    vkFreeMemory(vkDevice, stagingBufferMemory, nullptr);
+    AddCapturedResource("mesh " + std::to_string(modelMesh) + " " + std::to_string(vertexCount) + " vertices, " + std::to_string(indexCount) + " indices");
 }
 
 void VulkanApp::CreateCommandBuffers()
@@ -1565,8 +2328,62 @@ void VulkanApp::CreateCommandBuffers()
     }
 }
 
+VkCommandBuffer VulkanApp::GetRecordedCommandBuffer(const uint32_t imageIndex)
+{
+    // The swap chain may have come back with more images
+    const size_t needed = swapChainImages.size() * MAX_FRAMES_IN_FLIGHT;
+    if (recordedCommandBuffers.size() < needed)
+    {
+        const size_t first = recordedCommandBuffers.size();
+        recordedCommandBuffers.resize(needed);
+
+        std::vector<VkCommandBuffer> commandBuffers(needed - first);
+        VkCommandBufferAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.commandPool = vkCommandPool;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocInfo.commandBufferCount = static_cast<uint32_t>(commandBuffers.size());
+
+        if (vkAllocateCommandBuffers(vkDevice, &allocInfo, commandBuffers.data()) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to allocate command buffers!");
+        }
+        for (size_t i = first; i < needed; i++)
+        {
+            recordedCommandBuffers[i].commandBuffer = commandBuffers[i - first];
+        }
+    }
+
+    RecordedCommandBuffer& recorded = recordedCommandBuffers[imageIndex * MAX_FRAMES_IN_FLIGHT + currentFrame];
+    FrameCounters& counters = counterSlots[currentFrame].counters;
+    if (recorded.valid && recorded.renderExtent.width == renderExtent.width && recorded.renderExtent.height == renderExtent.height)
+    {
+        counters = recorded.counters;
+        counters.frameNumber = frameNumber;
+        return recorded.commandBuffer;
+    }
+
+    vkResetCommandBuffer(recorded.commandBuffer, 0);
+    RecordCommandBuffer(recorded.commandBuffer, imageIndex);
+    recorded.valid = true;
+    recorded.renderExtent = renderExtent;
+    recorded.counters = counters;
+    return recorded.commandBuffer;
+}
+
+void VulkanApp::InvalidateCommandBuffers()
+{
+    // Some of them may still be executing, they are only recorded again once their frame slot comes around
+    for (RecordedCommandBuffer& recorded : recordedCommandBuffers)
+    {
+        recorded.valid = false;
+    }
+}
+
 void VulkanApp::RecordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex)
 {
+    PROFILE_CPU_ZONE("RecordCommandBuffer");
+
     // Function that writes the commands we want to execute into a command buffer.
 
     // We always begin recording a command buffer by calling vkBeginCommandBuffer with a small VkCommandBufferBeginInfo
@@ -1580,49 +2397,66 @@ void VulkanApp::RecordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imag
     {
         throw std::runtime_error("failed to begin recording command buffer!");
     }
+
+    PROFILE_GPU_BEGIN_FRAME(commandBuffer, currentFrame);
+
+    FrameCounters& counters = counterSlots[currentFrame].counters;
+    counters = {};
+    counters.frameNumber = frameNumber;
+
+    // Both the prepass and the forward pass draw from it. A reused command buffer keeps the order it was recorded
+    // with, which only costs some overdraw once the camera has moved
+    BuildDrawList();
+
+    // Queries must be reset before they are written again, and that can't happen inside a render pass
+    if (timestampQueryPool != VK_NULL_HANDLE)
+    {
+        vkCmdResetQueryPool(commandBuffer, timestampQueryPool, currentFrame * 2, 2);
+        vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, timestampQueryPool, currentFrame * 2);
+    }
+
+    if (statisticsQueryPool != VK_NULL_HANDLE)
+    {
+        vkCmdResetQueryPool(commandBuffer, statisticsQueryPool, currentFrame, 1);
+    }
     
-    // Drawing starts by beginning the render pass with vkCmdBeginRenderPass
-    VkRenderPassBeginInfo renderPassInfo{};
-    renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-    renderPassInfo.renderPass = vkRenderPass;
-    renderPassInfo.framebuffer = swapChainFramebuffers[imageIndex];
-    renderPassInfo.renderArea.offset = {0, 0};
-    renderPassInfo.renderArea.extent = swapChainExtent;
-
-    // Clear depth and color
-    std::array<VkClearValue, 2> clearValues{};
-    clearValues[0].color = {{0.0f, 0.0f, 0.0f, 1.0f}};
-    clearValues[1].depthStencil = {1.0f, 0};
-    renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
-    renderPassInfo.pClearValues = clearValues.data();
-    
-    vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
-
-        // We can now bind the graphics pipeline
-        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, vkGraphicsPipeline);
-        VkViewport viewport{};
-        viewport.x = 0.0f;
-        viewport.y = 0.0f;
-        viewport.width = static_cast<float>(swapChainExtent.width);
-        viewport.height = static_cast<float>(swapChainExtent.height);
-        viewport.minDepth = 0.0f;
-        viewport.maxDepth = 1.0f;
-        vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
-
-        VkRect2D scissor{};
-        scissor.offset = {0, 0};
-        scissor.extent = swapChainExtent;
-        vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
-
-        VkBuffer vertexBuffers[] = {vkVertexBuffer};
-        VkDeviceSize offsets[] = {0};
-        vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
-        vkCmdBindIndexBuffer(commandBuffer, vkIndexBuffer, 0, VK_INDEX_TYPE_UINT32);
-        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, vkPipelineLayout, 0, 1, &vkDescriptorSets[currentFrame], 0, nullptr);
-    
-        vkCmdDrawIndexed(commandBuffer, static_cast<uint32_t>(indices.size()), 1, 0, 0, 0);
+    // The backbuffer is the only image that changes from frame to frame
+    renderGraph.SetImportedImage(backbufferImage, swapChainImages[imageIndex], swapChainImageViews[imageIndex]);
 
-    vkCmdEndRenderPass(commandBuffer);
+    // And the area the scene covers, which only the passes before the upscale care about
+    if (settings.dynamicResolution)
+    {
+        if (settings.depthPrepass)
+        {
+            renderGraph.SetRenderArea(depthPrepass, renderExtent);
+        }
+        renderGraph.SetRenderArea(forwardPass, renderExtent);
+        if (antiAliasing == AntiAliasing::Fxaa)
+        {
+            renderGraph.SetRenderArea(fxaaPass, renderExtent);
+        }
+        counters.hasRenderScale = true;
+        counters.renderScale = dynamicResolution.GetScale();
+    }
+
+    // The statistics query spans every pass of the graph. Only graphics work counts towards it
+    if (statisticsQueryPool != VK_NULL_HANDLE)
+    {
+        vkCmdBeginQuery(commandBuffer, statisticsQueryPool, currentFrame, 0);
+    }
+
+    // Barriers, render passes and the passes' own commands
+    renderGraph.Execute(commandBuffer);
+
+    if (statisticsQueryPool != VK_NULL_HANDLE)
+    {
+        vkCmdEndQuery(commandBuffer, statisticsQueryPool, currentFrame);
+    }
+
+    if (timestampQueryPool != VK_NULL_HANDLE)
+    {
+        vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, timestampQueryPool, currentFrame * 2 + 1);
+    }
 
     if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
     {
@@ -1630,6 +2464,234 @@ void VulkanApp::RecordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imag
     }
 }
 
+void VulkanApp::RecordForwardPass(const VkCommandBuffer commandBuffer)
+{
+    FrameCounters& counters = counterSlots[currentFrame].counters;
+
+    VkViewport viewport{};
+    viewport.x = 0.0f;
+    viewport.y = 0.0f;
+    viewport.width = static_cast<float>(renderExtent.width);
+    viewport.height = static_cast<float>(renderExtent.height);
+    viewport.minDepth = 0.0f;
+    viewport.maxDepth = 1.0f;
+    vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+    VkRect2D scissor{};
+    scissor.offset = {0, 0};
+    scissor.extent = renderExtent;
+    vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+    if (settings.occlusionCulling)
+    {
+        geometryPool.Bind(commandBuffer, false);
+        counters.vertexBufferBinds++;
+
+        // The cull pass wrote one command per cluster, the hidden ones with no instances. Clusters never span two
+        // submeshes, so each material's clusters are one run of commands
+        const VkBuffer drawBuffer = occlusionCuller.GetDrawBuffer(currentFrame);
+        uint32_t boundPipeline = UINT32_MAX;
+        for (uint32_t submesh = 0; submesh < submeshes.size(); submesh++)
+        {
+            const Material& material = materials[submeshes[submesh].material];
+            if (material.pipeline != boundPipeline)
+            {
+                vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, forwardPipelines[material.pipeline]);
+                counters.pipelineBinds++;
+                boundPipeline = material.pipeline;
+            }
+
+            vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, vkPipelineLayout, 0, 1,
+                                    &material.descriptorSets[currentFrame], 0, nullptr);
+            counters.descriptorSetBinds++;
+
+            const OcclusionCuller::Batch& batch = occlusionCuller.GetBatch(submesh);
+            if (multiDrawIndirectSupported)
+            {
+                vkCmdDrawIndexedIndirect(commandBuffer, drawBuffer, batch.firstCluster * sizeof(VkDrawIndexedIndirectCommand), batch.clusterCount,
+                                         sizeof(VkDrawIndexedIndirectCommand));
+                counters.draws++;
+            }
+            else
+            {
+                for (uint32_t i = batch.firstCluster; i < batch.firstCluster + batch.clusterCount; i++)
+                {
+                    vkCmdDrawIndexedIndirect(commandBuffer, drawBuffer, i * sizeof(VkDrawIndexedIndirectCommand), 1, sizeof(VkDrawIndexedIndirectCommand));
+                }
+                counters.draws += batch.clusterCount;
+            }
+        }
+        // With culling this is what was recorded, the clusters the GPU skipped are in the culling counters
+        counters.submittedTriangles += indices.size() / 3;
+    }
+    else
+    {
+        RecordDrawList(commandBuffer, false, counters);
+    }
+}
+
+void VulkanApp::UpdateModelRanges()
+{
+    if (modelRangesDrawCount == settings.drawCount)
+        return;
+
+    const uint32_t triangleCount = static_cast<uint32_t>(indices.size() / 3);
+    const uint32_t trianglesPerDraw = std::max(triangleCount / settings.drawCount, 1u);
+    modelRangesDrawCount = settings.drawCount;
+    modelRanges.clear();
+    for (const Submesh& submesh : submeshes)
+    {
+        // A range never spans two materials, so the default single draw becomes one draw per material
+        const uint32_t submeshTriangles = submesh.indexCount / 3;
+        const uint32_t rangeCount = std::max(submeshTriangles / trianglesPerDraw, 1u);
+        for (uint32_t range = 0; range < rangeCount; range++)
+        {
+            // The last range takes the triangles the division left over
+            const uint32_t firstTriangle = range * trianglesPerDraw;
+            const uint32_t drawTriangles = range + 1 == rangeCount ? submeshTriangles - firstTriangle : trianglesPerDraw;
+
+            ModelRange modelRange;
+            modelRange.material = submesh.material;
+            modelRange.firstIndex = submesh.firstIndex + firstTriangle * 3;
+            modelRange.indexCount = drawTriangles * 3;
+            modelRanges.push_back(modelRange);
+        }
+    }
+
+    // Every index of the model is read once here, which is worth spreading out at high draw counts
+    jobSystem.ParallelFor(static_cast<uint32_t>(modelRanges.size()), 256, [this](const uint32_t begin, const uint32_t end)
+    {
+        for (uint32_t range = begin; range < end; range++)
+        {
+            ModelRange& modelRange = modelRanges[range];
+            for (uint32_t i = modelRange.firstIndex; i < modelRange.firstIndex + modelRange.indexCount; i++)
+            {
+                modelRange.center += vertices[indices[i]].pos;
+            }
+            modelRange.center /= static_cast<float>(modelRange.indexCount);
+        }
+    });
+}
+
+void VulkanApp::BuildDrawList()
+{
+    PROFILE_CPU_ZONE("BuildDrawList");
+
+    // A replay draws exactly what the capture did, already sorted
+    if (captureReader.IsLoaded())
+    {
+        const std::vector<DrawItem>& captured = captureReader.GetDrawList(GetReplayFrame().drawList);
+        drawList.Clear();
+        std::copy(captured.begin(), captured.end(), drawList.Append(captured.size()));
+        return;
+    }
+
+    UpdateModelRanges();
+
+    // The model is a single mesh, so the sort groups the draws by their material's pipeline, then by material, and
+    // orders each material's draws front to back. Past one draw per range the draws start over at the first range
+    const GeometryPool::Mesh& mesh = geometryPool.GetMesh(modelMesh);
+    const uint32_t drawCount = std::max(settings.drawCount, static_cast<uint32_t>(modelRanges.size()));
+    drawList.Clear();
+    DrawItem* draws = drawList.Append(drawCount);
+    jobSystem.ParallelFor(drawCount, 4096, [this, &mesh, draws](const uint32_t begin, const uint32_t end)
+    {
+        for (uint32_t i = begin; i < end; i++)
+        {
+            const ModelRange& range = modelRanges[i % modelRanges.size()];
+            // View space looks down -Z
+            const float viewDepth = -(modelView * glm::vec4(range.center, 1.0f)).z;
+
+            DrawItem& draw = draws[i];
+            draw.pipeline = materials[range.material].pipeline;
+            draw.material = range.material;
+            draw.mesh = modelMesh;
+            draw.firstIndex = mesh.firstIndex + range.firstIndex;
+            draw.indexCount = range.indexCount;
+            draw.vertexOffset = mesh.vertexOffset;
+            draw.sortKey = DrawList::MakeSortKey(draw.pipeline, draw.material, draw.mesh, (viewDepth - CAMERA_NEAR) / (CAMERA_FAR - CAMERA_NEAR));
+        }
+    });
+    drawList.Sort();
+}
+
+void VulkanApp::RecordDrawList(const VkCommandBuffer commandBuffer, const bool depthPrepass, FrameCounters& counters) const
+{
+    // Nothing is bound at the start of a pass. Pipeline ids index forwardPipelines, material ids index materials
+    constexpr uint32_t NONE = UINT32_MAX;
+    uint32_t boundPipeline = NONE;
+    uint32_t boundMaterial = NONE;
+
+    // Every mesh lives in the geometry pool, so switching meshes is only a different firstIndex and vertexOffset
+    geometryPool.Bind(commandBuffer, depthPrepass);
+    counters.vertexBufferBinds++;
+    uint64_t binds = 1;
+
+    for (const DrawItem& draw : drawList.GetItems())
+    {
+        // The prepass draws everything with the same position only pipeline, and only reads the transforms, which
+        // every material's set holds
+        if (boundPipeline == NONE || (!depthPrepass && draw.pipeline != boundPipeline))
+        {
+            vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, depthPrepass ? vkDepthPrepassPipeline : forwardPipelines[draw.pipeline]);
+            counters.pipelineBinds++;
+            binds++;
+            boundPipeline = draw.pipeline;
+        }
+        if (boundMaterial == NONE || (!depthPrepass && draw.material != boundMaterial))
+        {
+            vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, vkPipelineLayout, 0, 1,
+                                    &materials[draw.material].descriptorSets[currentFrame], 0, nullptr);
+            counters.descriptorSetBinds++;
+            binds++;
+            boundMaterial = draw.material;
+        }
+
+        vkCmdDrawIndexed(commandBuffer, draw.indexCount, 1, draw.firstIndex, draw.vertexOffset, 0);
+        counters.submittedTriangles += draw.indexCount / 3;
+    }
+
+    // An empty list still binds the geometry, and skipped nothing
+    const uint64_t drawCount = drawList.GetItems().size();
+    counters.draws += drawCount;
+    if (drawCount > 0)
+    {
+        counters.skippedBinds += 3 * drawCount - binds;
+    }
+}
+
+void VulkanApp::RecordFxaa(const VkCommandBuffer commandBuffer)
+{
+    // Matches the push constants of fxaa.frag
+    struct FxaaPushConstants
+    {
+        float texelSizeX;
+        float texelSizeY;
+        float uvMaxX;
+        float uvMaxY;
+    };
+
+    const float width = static_cast<float>(swapChainExtent.width);
+    const float height = static_cast<float>(swapChainExtent.height);
+    const FxaaPushConstants pushConstants{1.0f / width, 1.0f / height, (static_cast<float>(renderExtent.width) - 0.5f) / width,
+                                          (static_cast<float>(renderExtent.height) - 0.5f) / height};
+
+    fxaa.Record(commandBuffer, renderExtent, &pushConstants, sizeof(pushConstants));
+}
+
+void VulkanApp::RecordDepthPrepass(const VkCommandBuffer commandBuffer)
+{
+    FrameCounters& counters = counterSlots[currentFrame].counters;
+
+    const VkViewport viewport{0.0f, 0.0f, static_cast<float>(renderExtent.width), static_cast<float>(renderExtent.height), 0.0f, 1.0f};
+    vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+    const VkRect2D scissor{{0, 0}, renderExtent};
+    vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+    // Every cluster goes in, the prepass depth is what the others are culled against
+    RecordDrawList(commandBuffer, true, counters);
+}
+
 void VulkanApp::CreateSyncObjects()
 {
     imageAvailableSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
@@ -1655,218 +2717,1502 @@ void VulkanApp::CreateSyncObjects()
     
 }
 
-std::vector<char> VulkanApp::ReadFile(const std::string& filename)
+void VulkanApp::CreateReadbackBuffers()
 {
-    std::ifstream file(filename, std::ios::ate | std::ios::binary);
+    // Every frame is copied tightly packed, 4 bytes per pixel, one view after the other
+    readbackFrameSize = static_cast<VkDeviceSize>(swapChainExtent.width) * swapChainExtent.height * 4 * settings.views;
+    readbackSlots.resize(MAX_FRAMES_IN_FLIGHT);
 
-    if (!file.is_open())
+    for (ReadbackSlot& slot : readbackSlots)
     {
-        throw std::runtime_error("failed to open file!");
-    }
+        VkBufferCreateInfo bufferInfo{};
+        bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferInfo.size = readbackFrameSize;
+        bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+        bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 
-    size_t fileSize = (size_t) file.tellg();
-    std::vector<char> buffer(fileSize);
+        if (vkCreateBuffer(vkDevice, &bufferInfo, nullptr, &slot.buffer) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create readback buffer!");
+        }
 
-    // Read all the file, and return a buffer. Simple enough
-    file.seekg(0);
-    file.read(buffer.data(), fileSize);
+        VkMemoryRequirements memRequirements;
+        vkGetBufferMemoryRequirements(vkDevice, slot.buffer, &memRequirements);
 
-    file.close();
-    return buffer;
-}
+        // The CPU reads every byte of these, and uncached memory makes that painfully slow. HOST_CACHED is usually
+        // not coherent, which just means we invalidate the range before reading it
+        std::optional<uint32_t> memoryType = deviceMemory.TryFindMemoryType(memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT);
+        if (!memoryType)
+        {
+            memoryType = deviceMemory.FindMemoryType(memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+        }
 
-void VulkanApp::UpdateUniformBuffer(const uint32_t currentImage) const
-{
-    // Some logic to calculate the time in seconds since rendering has started with floating point accuracy
-    static auto startTime = std::chrono::high_resolution_clock::now();
+        slot.coherent = (deviceMemory.GetPropertyFlags(*memoryType) & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
 
-    const auto currentTime = std::chrono::high_resolution_clock::now();
-    const float time = std::chrono::duration<float>(currentTime - startTime).count();
+        VkMemoryAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        allocInfo.allocationSize = memRequirements.size;
+        allocInfo.memoryTypeIndex = *memoryType;
 
-    // We will now define the model, view and projection transformations in the uniform buffer object
-    UniformBufferObject ubo;
-    ubo.model = rotate(glm::mat4(1.0f), time * glm::radians(90.0f), glm::vec3(0.0f, 0.0f, 1.0f));
-    ubo.view = lookAt(glm::vec3(2.0f, 2.0f, 2.0f), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
-    ubo.proj = glm::perspective(glm::radians(45.0f), swapChainExtent.width / static_cast<float>(swapChainExtent.height), 0.1f, 10.0f);
+        if (vkAllocateMemory(vkDevice, &allocInfo, nullptr, &slot.memory) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to allocate readback memory!");
+        }
 
-    // GLM was originally designed for OpenGL, where the Y coordinate of the clip coordinates is inverted.
-    // The easiest way to compensate for that is to flip the sign on the scaling factor of the Y axis in the projection matrix.
-    // If you don’t do this, then the image will be rendered upside down
-    ubo.proj[1][1] *= -1;
+        vkBindBufferMemory(vkDevice, slot.buffer, slot.memory, 0);
 
-    // All of the transformations are defined now, so we can copy the data in the uniform buffer object to the current uniform buffer
-    memcpy(vkUniformBuffersMapped[currentImage], &ubo, sizeof(ubo));
-}
+        // Persistently mapped, just like the uniform buffers
+        vkMapMemory(vkDevice, slot.memory, 0, VK_WHOLE_SIZE, 0, &slot.mapped);
+        slot.pending = false;
+    }
 
-bool VulkanApp::HasStencilComponent(const VkFormat format)
-{
-    return format == VK_FORMAT_D32_SFLOAT_S8_UINT || format == VK_FORMAT_D24_UNORM_S8_UINT;
+    // Without a consumer we still read the frames, which is what the throughput numbers measure
+    if (!readbackCallback && !settings.readbackDumpDirectory.empty())
+    {
+        std::filesystem::create_directories(settings.readbackDumpDirectory);
+        readbackCallback = [directory = settings.readbackDumpDirectory](const ReadbackFrame& frame)
+        {
+            WriteFrameToPpm(frame, directory);
+        };
+    }
 }
 
-VkFormat VulkanApp::FindDepthFormat() const
+void VulkanApp::RecordReadback(const VkCommandBuffer commandBuffer, const VkImage image) const
 {
-    return FindSupportedFormat(
-       {VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT},
-       VK_IMAGE_TILING_OPTIMAL,
-       VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT
-   );
+    const ReadbackSlot& slot = readbackSlots[currentFrame];
+
+    // The render graph already waited for the resolve and moved the image to TRANSFER_SRC_OPTIMAL
+    VkBufferImageCopy region{};
+    region.bufferOffset = 0;
+    region.bufferRowLength = 0; // Tightly packed
+    region.bufferImageHeight = 0;
+    region.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, settings.views};
+    region.imageOffset = {0, 0, 0};
+    region.imageExtent = {swapChainExtent.width, swapChainExtent.height, 1};
+
+    vkCmdCopyImageToBuffer(commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, slot.buffer, 1, &region);
+
+    // Make the copy visible to the host once the frame's fence signals
+    VkBufferMemoryBarrier bufferBarrier{};
+    bufferBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    bufferBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    bufferBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    bufferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    bufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    bufferBarrier.buffer = slot.buffer;
+    bufferBarrier.offset = 0;
+    bufferBarrier.size = VK_WHOLE_SIZE;
+
+    vkCmdPipelineBarrier(commandBuffer,
+        VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0,
+        0, nullptr,
+        1, &bufferBarrier,
+        0, nullptr);
 }
 
-VkFormat VulkanApp::FindSupportedFormat(const std::vector<VkFormat>& candidates, const VkImageTiling tiling, const VkFormatFeatureFlags features) const
+void VulkanApp::DeliverReadback(ReadbackSlot& slot)
 {
-    for (const VkFormat format : candidates)
+    if (!slot.pending)
+        return;
+
+    // Cached memory is not coherent: drop whatever stale lines the CPU still holds for this range
+    if (!slot.coherent)
     {
-        VkFormatProperties props;
-        vkGetPhysicalDeviceFormatProperties(vkPhysicalDevice, format, &props);
+        VkMappedMemoryRange range{};
+        range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+        range.memory = slot.memory;
+        range.offset = 0;
+        range.size = VK_WHOLE_SIZE;
+        vkInvalidateMappedMemoryRanges(vkDevice, 1, &range);
+    }
 
-        if (tiling == VK_IMAGE_TILING_LINEAR && (props.linearTilingFeatures & features) == features)
-            return format;
+    if (readbackFramesDelivered == 0)
+    {
+        readbackStartTime = std::chrono::steady_clock::now();
+    }
 
-        if (tiling == VK_IMAGE_TILING_OPTIMAL && (props.optimalTilingFeatures & features) == features)
-            return format;
+    const ReadbackFrame frame{slot.frameNumber, swapChainExtent.width, swapChainExtent.height, settings.views, swapChainImageFormat,
+                              static_cast<const uint8_t*>(slot.mapped), static_cast<size_t>(readbackFrameSize)};
+
+    if (readbackCallback)
+    {
+        readbackCallback(frame);
     }
 
-    throw std::runtime_error("failed to find supported format!");
+    readbackFramesDelivered++;
+    readbackBytesDelivered += readbackFrameSize;
+    slot.pending = false;
 }
 
-void VulkanApp::CreateDepthResources()
+void VulkanApp::FlushReadbacks()
 {
-    const VkFormat depthFormat = FindDepthFormat();
-    CreateImage(swapChainExtent.width, swapChainExtent.height, 1, msaaSamples, depthFormat, VK_IMAGE_TILING_OPTIMAL,
-                VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, vkDepthImage,
-                vkDepthImageMemory);
-    vkDepthImageView = CreateImageView(vkDepthImage, depthFormat, VK_IMAGE_ASPECT_DEPTH_BIT, 1);
-}
+    // Oldest first, so the consumer always sees frames in order
+    std::vector<ReadbackSlot*> pending;
+    for (ReadbackSlot& slot : readbackSlots)
+    {
+        if (slot.pending)
+            pending.push_back(&slot);
+    }
 
-void VulkanApp::DrawFrame()
-{
-    // At a high level, rendering a frame in Vulkan consists of a common set of steps:
-    //  1. Wait for the previous frame to finish
-    vkWaitForFences(vkDevice, 1, &inFlightFences[currentFrame], VK_TRUE, UINT64_MAX);
-    
-    //  2. Acquire an image from the swakop chain
-    uint32_t imageIndex;
-    const VkResult result = vkAcquireNextImageKHR(vkDevice, vkSwapChain, UINT64_MAX, imageAvailableSemaphores[currentFrame], VK_NULL_HANDLE, &imageIndex);
+    std::sort(pending.begin(), pending.end(), [](const ReadbackSlot* a, const ReadbackSlot* b)
+    {
+        return a->frameNumber < b->frameNumber;
+    });
 
-    if (result == VK_ERROR_OUT_OF_DATE_KHR)
+    for (ReadbackSlot* slot : pending)
     {
-        ReCreateSwapChain();
-        return;
+        DeliverReadback(*slot);
     }
+}
 
-    if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR)
+void VulkanApp::CleanupReadback()
+{
+    for (const ReadbackSlot& slot : readbackSlots)
     {
-        throw std::runtime_error("failed to acquire swap chain image!");
+        vkDestroyBuffer(vkDevice, slot.buffer, nullptr);
+        vkFreeMemory(vkDevice, slot.memory, nullptr);
     }
+    readbackSlots.clear();
+}
 
-    UpdateUniformBuffer(currentFrame);
-    
-    // We only reset the fence if we can do work
-    // After waiting, we need to manually reset the fence to the unsignaled state with the vkResetFences
-    vkResetFences(vkDevice, 1, &inFlightFences[currentFrame]);
-    
-    //  3. Record a command buffer which draws the scene onto that image
-    vkResetCommandBuffer(vkCommandBuffers[currentFrame], 0);
-    RecordCommandBuffer(vkCommandBuffers[currentFrame], imageIndex);
-    
-    //  4. Submit the recorded command buffer
-    VkSubmitInfo submitInfo{};
+void VulkanApp::PrintReadbackStats() const
+{
+    if (readbackFramesDelivered == 0)
+        return;
+
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - readbackStartTime).count();
+    const double megabytes = static_cast<double>(readbackBytesDelivered) / (1024.0 * 1024.0);
+
+    std::cout << "Readback: " << readbackFramesDelivered << " frames at " << swapChainExtent.width << "x" << swapChainExtent.height
+              << ", " << (seconds > 0.0 ? megabytes / seconds : 0.0) << " MB/s, "
+              << (seconds > 0.0 ? readbackFramesDelivered / seconds : 0.0) << " frames/s" << '\n';
+}
+
+void VulkanApp::WriteFrameToPpm(const ReadbackFrame& frame, const std::string& directory)
+{
+    // PPM wants RGB, the swap chain usually hands us BGRA
+    const bool bgra = frame.format == VK_FORMAT_B8G8R8A8_SRGB || frame.format == VK_FORMAT_B8G8R8A8_UNORM;
+    const size_t layerSize = static_cast<size_t>(frame.width) * frame.height * 4;
+    std::vector<uint8_t> row(static_cast<size_t>(frame.width) * 3);
+
+    // One image per view
+    for (uint32_t layer = 0; layer < frame.layers; layer++)
+    {
+        std::string name = "frame_" + std::to_string(frame.frameNumber);
+        if (frame.layers > 1)
+        {
+            name += "_view" + std::to_string(layer);
+        }
+        const std::string path = (std::filesystem::path(directory) / (name + ".ppm")).string();
+
+        std::ofstream file(path, std::ios::binary);
+        if (!file.is_open())
+        {
+            throw std::runtime_error("failed to write " + path + "!");
+        }
+
+        file << "P6\n" << frame.width << " " << frame.height << "\n255\n";
+
+        const uint8_t* pixels = frame.pixels + layer * layerSize;
+        for (uint32_t y = 0; y < frame.height; y++)
+        {
+            const uint8_t* src = pixels + static_cast<size_t>(y) * frame.width * 4;
+            for (uint32_t x = 0; x < frame.width; x++)
+            {
+                row[x * 3 + 0] = src[x * 4 + (bgra ? 2 : 0)];
+                row[x * 3 + 1] = src[x * 4 + 1];
+                row[x * 3 + 2] = src[x * 4 + (bgra ? 0 : 2)];
+            }
+            file.write(reinterpret_cast<const char*>(row.data()), static_cast<std::streamsize>(row.size()));
+        }
+    }
+}
+
+std::vector<char> VulkanApp::ReadFile(const std::string& filename)
+{
+    std::ifstream file(filename, std::ios::ate | std::ios::binary);
+
+    if (!file.is_open())
+    {
+        throw std::runtime_error("failed to open file " + filename + "!");
+    }
+
+    size_t fileSize = (size_t) file.tellg();
+    std::vector<char> buffer(fileSize);
+
+    // Read all the file, and return a buffer. Simple enough
+    file.seekg(0);
+    file.read(buffer.data(), fileSize);
+
+    file.close();
+    return buffer;
+}
+
+float VulkanApp::GetAnimationTime() const
+{
+    if (captureReader.IsLoaded())
+    {
+        return GetReplayFrame().animationTime;
+    }
+
+    // Headless runs and benchmarks must render the same images every time, no matter how fast the machine is
+    if (settings.headless || settings.benchmark)
+    {
+        return static_cast<float>(frameNumber) / 60.0f;
+    }
+
+    // Some logic to calculate the time in seconds since rendering has started with floating point accuracy
+    static auto startTime = std::chrono::high_resolution_clock::now();
+
+    const auto currentTime = std::chrono::high_resolution_clock::now();
+    return std::chrono::duration<float>(currentTime - startTime).count();
+}
+
+void VulkanApp::LoadCameraPath()
+{
+    if (settings.cameraPath.empty())
+        return;
+
+    std::ifstream file(settings.cameraPath);
+    if (!file.is_open())
+    {
+        throw std::runtime_error("failed to open camera path " + settings.cameraPath + "!");
+    }
+
+    CameraKeyframe keyframe{};
+    while (file >> keyframe.eye.x >> keyframe.eye.y >> keyframe.eye.z >> keyframe.target.x >> keyframe.target.y >> keyframe.target.z)
+    {
+        cameraPath.push_back(keyframe);
+    }
+
+    if (cameraPath.empty())
+    {
+        throw std::runtime_error("camera path " + settings.cameraPath + " has no cameras!");
+    }
+}
+
+void VulkanApp::LoadReplay()
+{
+    if (settings.replayFile.empty())
+        return;
+
+    captureReader.Load(settings.replayFile);
+    const CaptureSettings& captured = captureReader.GetSettings();
+    settings.modelPath = captured.modelPath;
+    settings.views = captured.views;
+    settings.drawCount = captured.drawCount;
+    settings.lightCount = captured.lightCount;
+    settings.depthPrepass = captured.depthPrepass;
+    settings.occlusionCulling = captured.occlusionCulling;
+    settings.dynamicResolution = captured.dynamicResolution;
+    settings.targetFrameTime = captured.targetFrameTime;
+    settings.reuseCommandBuffers = captured.reuseCommandBuffers;
+    settings.blitMipmaps = captured.blitMipmaps;
+
+    // The capture has the cameras, and its frames always render offscreen at the size the first one had
+    const std::vector<CapturedFrame>& frames = captureReader.GetFrames();
+    // The tier the capture actually rendered with. The requested one may have fallen back to a lower tier there
+    settings.antiAliasing = frames[0].antiAliasing;
+    settings.cameraPath.clear();
+    settings.headless = true;
+    settings.width = frames[0].width;
+    settings.height = frames[0].height;
+    if (settings.frameCount == 0)
+    {
+        settings.frameCount = static_cast<uint32_t>(frames.size());
+    }
+
+    std::cout << "Replaying " << frames.size() << " frames of " << settings.modelPath << " at " << settings.width << "x" << settings.height
+              << " from " << settings.replayFile << '\n';
+    const bool resized = std::any_of(frames.begin(), frames.end(), [&frames](const CapturedFrame& frame)
+    {
+        return frame.width != frames[0].width || frame.height != frames[0].height;
+    });
+    if (resized)
+    {
+        std::cout << "The window was resized during the capture, every frame is replayed at the size of the first" << '\n';
+    }
+}
+
+void VulkanApp::OpenCapture()
+{
+    if (settings.captureFile.empty())
+        return;
+
+    CaptureSettings captured;
+    captured.modelPath = settings.modelPath;
+    captured.views = settings.views;
+    captured.drawCount = settings.drawCount;
+    captured.lightCount = settings.lightCount;
+    captured.antiAliasing = settings.antiAliasing;
+    captured.depthPrepass = settings.depthPrepass;
+    captured.occlusionCulling = settings.occlusionCulling;
+    captured.dynamicResolution = settings.dynamicResolution;
+    captured.targetFrameTime = settings.targetFrameTime;
+    captured.reuseCommandBuffers = settings.reuseCommandBuffers;
+    captured.blitMipmaps = settings.blitMipmaps;
+    captureWriter.Open(settings.captureFile, captured);
+}
+
+void VulkanApp::AddCapturedResource(const std::string& description)
+{
+    if (captureWriter.IsOpen())
+    {
+        captureWriter.AddResource(description);
+    }
+    else if (captureReader.IsLoaded())
+    {
+        createdResources.push_back(description);
+    }
+}
+
+void VulkanApp::CheckReplayResources() const
+{
+    // Textures upload in whatever order their decodes finish, so only the sets have to match
+    std::vector<std::string> captured = captureReader.GetResources();
+    std::vector<std::string> created = createdResources;
+    std::sort(captured.begin(), captured.end());
+    std::sort(created.begin(), created.end());
+    if (captured != created)
+    {
+        std::cout << "Warning: the replay created other resources than the capture did, the assets may have changed" << '\n';
+    }
+
+    // Draws past the model, or naming a pipeline or material it doesn't have, would read out of bounds, so those are
+    // refused outright
+    // Frames sharing their draws have neighbouring lists, so each list is checked once
+    const GeometryPool::Mesh& mesh = geometryPool.GetMesh(modelMesh);
+    const std::vector<CapturedFrame>& frames = captureReader.GetFrames();
+    for (uint32_t drawList = 0; drawList <= frames.back().drawList; drawList++)
+    {
+        for (const DrawItem& draw : captureReader.GetDrawList(drawList))
+        {
+            // In 64 bits, so a huge count can't wrap back into range
+            if (draw.pipeline >= forwardPipelines.size() || draw.material >= materials.size() || draw.mesh != modelMesh || draw.vertexOffset != mesh.vertexOffset || draw.firstIndex < mesh.firstIndex ||
+                static_cast<uint64_t>(draw.firstIndex) + draw.indexCount > static_cast<uint64_t>(mesh.firstIndex) + mesh.indexCount)
+            {
+                throw std::runtime_error("capture " + settings.replayFile + " draws geometry the model doesn't have!");
+            }
+        }
+    }
+}
+
+const CapturedFrame& VulkanApp::GetReplayFrame() const
+{
+    const std::vector<CapturedFrame>& frames = captureReader.GetFrames();
+    return frames[frameNumber % frames.size()];
+}
+
+void VulkanApp::UpdateUniformBuffer(const uint32_t currentImage)
+{
+    PROFILE_CPU_ZONE("UpdateUniformBuffer");
+
+    // We will now define the model, view and projection transformations in the uniform buffer object
+    UniformBufferObject ubo{};
+    const float time = GetAnimationTime();
+    const glm::vec3 up(0.0f, 0.0f, 1.0f);
+    glm::vec3 eye(2.0f, 2.0f, 2.0f);
+    glm::vec3 target(0.0f, 0.0f, 0.0f);
+    if (!cameraPath.empty())
+    {
+        // A camera path replaces the turntable animation: the model stays put and the camera moves
+        const CameraKeyframe& camera = cameraPath[frameNumber % cameraPath.size()];
+        ubo.model = glm::mat4(1.0f);
+        eye = camera.eye;
+        target = camera.target;
+    }
+    else
+    {
+        ubo.model = rotate(glm::mat4(1.0f), time * glm::radians(90.0f), up);
+    }
+
+    // View 0 is the camera above. Any further views orbit the target at the same distance and height, evenly spaced
+    for (uint32_t view = 0; view < settings.views; view++)
+    {
+        const glm::mat4 orbit = rotate(glm::mat4(1.0f), glm::radians(360.0f) * static_cast<float>(view) / static_cast<float>(settings.views), up);
+        const glm::vec3 viewEye = target + glm::vec3(orbit * glm::vec4(eye - target, 0.0f));
+        ubo.view[view] = lookAt(viewEye, target, up);
+    }
+    ubo.proj = glm::perspective(glm::radians(45.0f), swapChainExtent.width / static_cast<float>(swapChainExtent.height), CAMERA_NEAR, CAMERA_FAR);
+
+    // GLM was originally designed for OpenGL, where the Y coordinate of the clip coordinates is inverted.
+    // The easiest way to compensate for that is to flip the sign on the scaling factor of the Y axis in the projection matrix.
+    // If you don’t do this, then the image will be rendered upside down
+    ubo.proj[1][1] *= -1;
+
+    // The captured matrices already carry the flip
+    if (captureReader.IsLoaded())
+    {
+        const CapturedFrame& frame = GetReplayFrame();
+        ubo.model = frame.model;
+        for (uint32_t view = 0; view < std::min(settings.views, static_cast<uint32_t>(frame.views.size())); view++)
+        {
+            ubo.view[view] = frame.views[view];
+        }
+        ubo.proj = frame.proj;
+    }
+    else if (captureWriter.IsOpen())
+    {
+        capturedFrame.animationTime = time;
+        capturedFrame.model = ubo.model;
+        capturedFrame.views.assign(ubo.view, ubo.view + settings.views);
+        capturedFrame.proj = ubo.proj;
+    }
+
+    // All of the transformations are defined now, so we can copy the data in the uniform buffer object to the current uniform buffer
+    memcpy(vkUniformBuffersMapped[currentImage], &ubo, sizeof(ubo));
+    modelView = ubo.view[0] * ubo.model;
+
+    if (settings.lightCount > 0)
+    {
+        clusteredLighting.Update(currentImage, ubo.view[0], ubo.proj, renderExtent, time);
+    }
+}
+
+bool VulkanApp::HasStencilComponent(const VkFormat format)
+{
+    return format == VK_FORMAT_D32_SFLOAT_S8_UINT || format == VK_FORMAT_D24_UNORM_S8_UINT;
+}
+
+VkFormat VulkanApp::FindDepthFormat() const
+{
+    return FindSupportedFormat(
+       {VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT},
+       VK_IMAGE_TILING_OPTIMAL,
+       VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT
+   );
+}
+
+VkFormat VulkanApp::FindSupportedFormat(const std::vector<VkFormat>& candidates, const VkImageTiling tiling, const VkFormatFeatureFlags features) const
+{
+    for (const VkFormat format : candidates)
+    {
+        VkFormatProperties props;
+        vkGetPhysicalDeviceFormatProperties(vkPhysicalDevice, format, &props);
+
+        if (tiling == VK_IMAGE_TILING_LINEAR && (props.linearTilingFeatures & features) == features)
+            return format;
+
+        if (tiling == VK_IMAGE_TILING_OPTIMAL && (props.optimalTilingFeatures & features) == features)
+            return format;
+    }
+
+    throw std::runtime_error("failed to find supported format!");
+}
+
+void VulkanApp::DrawFrame()
+{
+    PROFILE_CPU_ZONE("DrawFrame");
+
+    // A replay switches tiers on the same frames the capture did. A sweep picks its own tiers
+    if (captureReader.IsLoaded() && !settings.antiAliasingSweep && frameNumber > 0)
+    {
+        const std::vector<CapturedFrame>& frames = captureReader.GetFrames();
+        const AntiAliasing previous = frames[(frameNumber - 1) % frames.size()].antiAliasing;
+        const AntiAliasing current = GetReplayFrame().antiAliasing;
+        if (current != previous)
+        {
+            requestedAntiAliasing = current;
+        }
+    }
+
+    // A tier switch rebuilds the graph between two frames, the same way a resize does
+    if (requestedAntiAliasing)
+    {
+        SetAntiAliasing(*requestedAntiAliasing);
+        requestedAntiAliasing.reset();
+    }
+
+    // At a high level, rendering a frame in Vulkan consists of a common set of steps:
+    //  1. Wait for the previous frame to finish
+    const auto fenceWaitStart = std::chrono::steady_clock::now();
+    {
+        PROFILE_CPU_ZONE("Wait for fence");
+        vkWaitForFences(vkDevice, 1, &inFlightFences[currentFrame], VK_TRUE, UINT64_MAX);
+    }
+    frameTiming.fenceWaitTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - fenceWaitStart).count();
+
+    // Every frame up to the one that last used this slot has finished, so anything they retired can go now
+    if (frameNumber >= static_cast<uint64_t>(MAX_FRAMES_IN_FLIGHT))
+    {
+        deletionQueue.Collect(frameNumber - MAX_FRAMES_IN_FLIGHT);
+    }
+
+    // That fence also covers the copy recorded MAX_FRAMES_IN_FLIGHT frames ago, so its pixels are ready to hand out
+    if (settings.readback)
+    {
+        DeliverReadback(readbackSlots[currentFrame]);
+    }
+
+    // Same for the timestamps of that frame
+    if (timestampQueryPool != VK_NULL_HANDLE)
+    {
+        CollectGpuTime(currentFrame);
+    }
+    CollectFrameCounters(currentFrame);
+    PROFILE_GPU_RESOLVE_FRAME(currentFrame);
+    
+    //  2. Acquire an image from the swakop chain
+    // Headless there is nothing to acquire: each frame in flight owns its offscreen image, and the fence we just
+    // waited on guarantees the GPU is done with it
+    uint32_t imageIndex = currentFrame;
+    VkResult result = VK_SUCCESS;
+    frameTiming.acquireWaitTime = 0.0;
+    if (!settings.headless)
+    {
+        const auto acquireStart = std::chrono::steady_clock::now();
+        {
+            PROFILE_CPU_ZONE("Acquire");
+            result = vkAcquireNextImageKHR(vkDevice, vkSwapChain, UINT64_MAX, imageAvailableSemaphores[currentFrame], VK_NULL_HANDLE, &imageIndex);
+        }
+        frameTiming.acquireWaitTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - acquireStart).count();
+
+        if (result == VK_ERROR_OUT_OF_DATE_KHR)
+        {
+            ReCreateSwapChain();
+            return;
+        }
+
+        if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR)
+        {
+            throw std::runtime_error("failed to acquire swap chain image!");
+        }
+    }
+
+    // The scale follows the GPU times of the frames completed so far
+    renderExtent = settings.dynamicResolution ? dynamicResolution.GetRenderExtent(swapChainExtent) : swapChainExtent;
+    // A replay renders at the resolutions the capture's GPU picked, not the ones this GPU would
+    if (captureReader.IsLoaded() && settings.dynamicResolution)
+    {
+        const CapturedFrame& frame = GetReplayFrame();
+        renderExtent = {std::min(frame.renderWidth, swapChainExtent.width), std::min(frame.renderHeight, swapChainExtent.height)};
+    }
+    UpdateUniformBuffer(currentFrame);
+    
+    // We only reset the fence if we can do work
+    // After waiting, we need to manually reset the fence to the unsignaled state with the vkResetFences
+    vkResetFences(vkDevice, 1, &inFlightFences[currentFrame]);
+    
+    //  3. Record a command buffer which draws the scene onto that image, or reuse the one recorded for it
+    const auto recordStart = std::chrono::steady_clock::now();
+    VkCommandBuffer commandBuffer = vkCommandBuffers[currentFrame];
+    if (settings.reuseCommandBuffers)
+    {
+        commandBuffer = GetRecordedCommandBuffer(imageIndex);
+    }
+    else
+    {
+        vkResetCommandBuffer(commandBuffer, 0);
+        RecordCommandBuffer(commandBuffer, imageIndex);
+    }
+    frameTiming.recordTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - recordStart).count();
+
+    if (settings.readback)
+    {
+        readbackSlots[currentFrame].pending = true;
+        readbackSlots[currentFrame].frameNumber = frameNumber;
+    }
+
+    if (timestampQueryPool != VK_NULL_HANDLE)
+    {
+        timestampSlots[currentFrame].pending = true;
+        timestampSlots[currentFrame].measured = benchmarkMeasuring;
+        timestampSlots[currentFrame].renderScale = settings.dynamicResolution ? dynamicResolution.GetScale() : 1.0f;
+        timestampSlots[currentFrame].antiAliasing = antiAliasing;
+    }
+    counterSlots[currentFrame].pending = true;
+    counterSlots[currentFrame].measured = benchmarkMeasuring;
+    
+    //  4. Submit the recorded command buffer
+    VkSubmitInfo submitInfo{};
     submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
 
-    // Specify which semaphores to wait on before execution begins and in which stage(s) of the pipeline to wait
-    VkSemaphore waitSemaphores[] = {imageAvailableSemaphores[currentFrame]};
-    VkPipelineStageFlags waitStages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
-    submitInfo.waitSemaphoreCount = 1;
-    submitInfo.pWaitSemaphores = waitSemaphores;
-    submitInfo.pWaitDstStageMask = waitStages;
+    // Specify which semaphores to wait on before execution begins and in which stage(s) of the pipeline to wait
+    VkSemaphore waitSemaphores[] = {imageAvailableSemaphores[currentFrame]};
+    VkPipelineStageFlags waitStages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
+    submitInfo.waitSemaphoreCount = settings.headless ? 0 : 1;
+    submitInfo.pWaitSemaphores = waitSemaphores;
+    submitInfo.pWaitDstStageMask = waitStages;
+
+    // Specify which command buffers to actually submit for execution
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &commandBuffer;
+
+    // Specify which semaphores to signal once the command buffer(s) have finished execution
+    VkSemaphore signalSemaphores[] = {renderFinishedSemaphores[currentFrame]};
+    submitInfo.signalSemaphoreCount = settings.headless ? 0 : 1;
+    submitInfo.pSignalSemaphores = signalSemaphores;
+
+    // Submit the command buffer to the graphics queue 
+    if (vkQueueSubmit(vkGraphicsQueue, 1, &submitInfo, inFlightFences[currentFrame]) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to submit draw command buffer!");
+    }
+
+    if (frameNumber == 0)
+    {
+        startupTimer.Finish(settings.startupReport);
+    }
+
+    if (captureWriter.IsOpen())
+    {
+        capturedFrame.width = swapChainExtent.width;
+        capturedFrame.height = swapChainExtent.height;
+        capturedFrame.renderWidth = renderExtent.width;
+        capturedFrame.renderHeight = renderExtent.height;
+        capturedFrame.antiAliasing = antiAliasing;
+        captureWriter.AddFrame(capturedFrame, drawList.GetItems());
+    }
+
+    // Offscreen images are done once the fence signals, there is no presentation step
+    if (settings.headless)
+    {
+        currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+        frameNumber++;
+        return;
+    }
+
+    //  5. Present the swap chain image
+
+    // Specify which semaphores to wait on before presentation can happen
+    VkPresentInfoKHR presentInfo{};
+    presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+    presentInfo.waitSemaphoreCount = 1;
+    presentInfo.pWaitSemaphores = signalSemaphores;
+
+    // Specify the swap chains to present images to and the index of the image for each swap chain
+    VkSwapchainKHR swapChains[] = { vkSwapChain };
+    presentInfo.swapchainCount = 1;
+    presentInfo.pSwapchains = swapChains;
+    presentInfo.pImageIndices = &imageIndex;
+    presentInfo.pResults = nullptr; // Optional
+
+    // Submits the request to present an image to the swap chain
+    {
+        PROFILE_CPU_ZONE("Present");
+        result = vkQueuePresentKHR(vkPresentQueue, &presentInfo);
+    }
+
+    // The first frame at the new size is on its way to the screen
+    if (resizeStartTime && result == VK_SUCCESS && !framebufferResized)
+    {
+        resizeLatencies.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - *resizeStartTime).count());
+        resizeStartTime.reset();
+    }
+
+    if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || framebufferResized)
+    {
+        framebufferResized = false;
+        ReCreateSwapChain();
+    }
+    else if (result != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to present swap chain image!");
+    }
+    
+    currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+    frameNumber++;
+}
+
+void VulkanApp::MainLoop()
+{
+    // --frames ends a windowed run early too, without it the window decides
+    while (!glfwWindowShouldClose(window) && (settings.frameCount == 0 || frameNumber < settings.frameCount))
+    {
+        glfwPollEvents();
+        DrawFrame();
+    }
+
+    vkDeviceWaitIdle(vkDevice);
+
+    if (settings.readback)
+    {
+        FlushReadbacks();
+        PrintReadbackStats();
+    }
+
+    PrintSwapChainStats();
+}
+
+void VulkanApp::HeadlessLoop()
+{
+    // A camera path defines its own length, otherwise we fall back to a fixed number of frames
+    uint32_t frameCount = settings.frameCount;
+    if (frameCount == 0)
+    {
+        frameCount = cameraPath.empty() ? 1000 : static_cast<uint32_t>(cameraPath.size());
+    }
+
+    const auto startTime = std::chrono::steady_clock::now();
+
+    for (uint32_t i = 0; i < frameCount; i++)
+    {
+        DrawFrame();
+    }
+
+    // The last frames are still in flight, they only count once the GPU has finished them
+    vkDeviceWaitIdle(vkDevice);
+
+    if (settings.readback)
+    {
+        FlushReadbacks();
+    }
+
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+    std::cout << "Rendered " << frameCount << " frames of " << settings.views << " view(s) at " << swapChainExtent.width << "x" << swapChainExtent.height
+              << " in " << seconds << " s (" << (seconds > 0.0 ? frameCount / seconds : 0.0) << " frames/s)" << '\n';
+
+    if (settings.readback)
+    {
+        PrintReadbackStats();
+    }
+
+    // The overdraw the depth prepass and culling are there to remove shows up in the fragment shader invocations
+    if (lastFrameCounters.hasPipelineStatistics)
+    {
+        std::cout << "Last completed frame: " << lastFrameCounters.fragmentShaderInvocations << " fragment shader invocations" << '\n';
+    }
+    if (lastFrameCounters.hasCulling)
+    {
+        std::cout << "Last completed frame: " << lastFrameCounters.frustumCulledClusters + lastFrameCounters.occlusionCulledClusters << " of "
+                  << lastFrameCounters.clusters << " clusters culled (" << lastFrameCounters.frustumCulledClusters << " outside the frustum, "
+                  << lastFrameCounters.occlusionCulledClusters << " occluded)" << '\n';
+    }
+    if (lastFrameCounters.hasRenderScale)
+    {
+        std::cout << "Last completed frame: rendered at " << lastFrameCounters.renderScale * 100.0 << "% of the resolution" << '\n';
+    }
+}
+
+void VulkanApp::InitProfiler()
+{
+    if (settings.traceFile.empty())
+        return;
+
+#if NYCSI_PROFILE
+    Profiler& profiler = Profiler::Get();
+
+    uint32_t queueFamilyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(vkPhysicalDevice, &queueFamilyCount, nullptr);
+    std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(vkPhysicalDevice, &queueFamilyCount, queueFamilies.data());
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(vkPhysicalDevice, &properties);
+
+    profiler.InitGpu(vkDevice, properties.limits.timestampPeriod,
+                     queueFamilies[FindQueueFamilies(vkPhysicalDevice).graphicsFamily.value()].timestampValidBits, MAX_FRAMES_IN_FLIGHT);
+
+    const VkCommandBuffer commandBuffer = BeginSingleTimeCommands();
+    profiler.RecordCalibration(commandBuffer);
+    EndSingleTimeCommands(commandBuffer);
+    profiler.FinishCalibration();
+
+    profiler.SetEnabled(true);
+
+    // GPU zones are collected while recording, so reused command buffers would leave most frames without any
+    if (settings.reuseCommandBuffers)
+    {
+        std::cerr << "Command buffers are recorded every frame while tracing" << '\n';
+        settings.reuseCommandBuffers = false;
+    }
+#else
+    std::cerr << "--trace needs a build with NYCSI_PROFILE=1, no trace will be written" << '\n';
+#endif
+}
+
+void VulkanApp::WriteProfilerTrace() const
+{
+#if NYCSI_PROFILE
+    Profiler& profiler = Profiler::Get();
+    if (!profiler.IsEnabled())
+        return;
+
+    // Every loop waits for the device before returning, so the last frames can be resolved too
+    profiler.SetEnabled(false);
+    for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+    {
+        profiler.ResolveGpuFrame(i);
+    }
+
+    profiler.WriteChromeTrace(settings.traceFile);
+    std::cout << "Trace written to " << settings.traceFile << '\n';
+#endif
+}
+
+void VulkanApp::BenchmarkLoop()
+{
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(vkPhysicalDevice, &properties);
+    frameStats.SetInfo("device", properties.deviceName);
+    frameStats.SetInfo("resolution", std::to_string(swapChainExtent.width) + "x" + std::to_string(swapChainExtent.height));
+    frameStats.SetInfo("mode", settings.headless ? "headless" : "windowed");
+    frameStats.SetInfo("model", settings.modelPath);
+    frameStats.SetInfo("materials", std::to_string(materials.size()));
+    frameStats.SetInfo("antiAliasing", settings.antiAliasingSweep ? "sweep" : GetAntiAliasingName(antiAliasing));
+    frameStats.SetInfo("views", std::to_string(settings.views));
+    frameStats.SetInfo("depthPrepass", settings.depthPrepass ? "true" : "false");
+    frameStats.SetInfo("occlusionCulling", settings.occlusionCulling ? "true" : "false");
+    frameStats.SetInfo("lights", std::to_string(settings.lightCount));
+    frameStats.SetInfo("draws", std::to_string(settings.drawCount));
+    frameStats.SetInfo("reuseCommandBuffers", settings.reuseCommandBuffers ? "true" : "false");
+    frameStats.SetInfo("targetFrameTime", settings.dynamicResolution ? std::to_string(settings.targetFrameTime) : "none");
+    frameStats.SetInfo("replay", captureReader.IsLoaded() ? settings.replayFile : "none");
+
+    const auto shouldStop = [this]()
+    {
+        return !settings.headless && glfwWindowShouldClose(window);
+    };
+
+    uint32_t frameCount = settings.frameCount;
+    if (frameCount == 0)
+    {
+        frameCount = cameraPath.empty() ? 1000 : static_cast<uint32_t>(cameraPath.size());
+    }
 
-    // Specify which command buffers to actually submit for execution
-    submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &vkCommandBuffers[currentFrame];
+    // A sweep measures every supported tier for the full frame count or duration, one after the other. The GPU times
+    // are filed under the tier each frame was rendered with
+    const std::vector<AntiAliasing> tiers = settings.antiAliasingSweep ? GetSupportedAntiAliasing() : std::vector<AntiAliasing>{antiAliasing};
+    double seconds = 0.0;
+    for (const AntiAliasing tier : tiers)
+    {
+        SetAntiAliasing(tier);
 
-    // Specify which semaphores to signal once the command buffer(s) have finished execution
-    VkSemaphore signalSemaphores[] = {renderFinishedSemaphores[currentFrame]};
-    submitInfo.signalSemaphoreCount = 1;
-    submitInfo.pSignalSemaphores = signalSemaphores;
+        // Warm-up: the first frames pay for pipeline creation, driver shader compiles and cold caches. Every tier
+        // brings its own render passes and pipelines, so each one gets its own warm-up
+        for (uint32_t i = 0; i < settings.warmupFrames && !shouldStop(); i++)
+        {
+            if (!settings.headless)
+                glfwPollEvents();
+            DrawFrame();
+        }
 
-    // Submit the command buffer to the graphics queue 
-    if (vkQueueSubmit(vkGraphicsQueue, 1, &submitInfo, inFlightFences[currentFrame]) != VK_SUCCESS)
+        benchmarkMeasuring = true;
+        const auto startTime = std::chrono::steady_clock::now();
+        const auto elapsedSeconds = [&startTime]()
+        {
+            return std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+        };
+
+        for (uint32_t i = 0; !shouldStop(); i++)
+        {
+            if (settings.benchmarkDuration > 0.0f ? elapsedSeconds() >= settings.benchmarkDuration : i >= frameCount)
+                break;
+
+            const auto frameStart = std::chrono::steady_clock::now();
+            if (!settings.headless)
+                glfwPollEvents();
+            DrawFrame();
+            frameTiming.cpuFrameTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - frameStart).count();
+            frameStats.AddFrame(frameTiming);
+        }
+        seconds += elapsedSeconds();
+        benchmarkMeasuring = false;
+    }
+
+    // The frames still in flight count too, including their GPU times
+    vkDeviceWaitIdle(vkDevice);
+
+    if (timestampQueryPool != VK_NULL_HANDLE)
     {
-        throw std::runtime_error("failed to submit draw command buffer!");
+        for (uint32_t i = 0; i < timestampSlots.size(); i++)
+        {
+            CollectGpuTime(i);
+        }
     }
 
-    //  5. Present the swap chain image
+    for (uint32_t i = 0; i < counterSlots.size(); i++)
+    {
+        CollectFrameCounters(i);
+    }
 
-    // Specify which semaphores to wait on before presentation can happen
-    VkPresentInfoKHR presentInfo{};
-    presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
-    presentInfo.waitSemaphoreCount = 1;
-    presentInfo.pWaitSemaphores = signalSemaphores;
+    if (settings.readback)
+    {
+        FlushReadbacks();
+        PrintReadbackStats();
+    }
 
-    // Specify the swap chains to present images to and the index of the image for each swap chain
-    VkSwapchainKHR swapChains[] = { vkSwapChain };
-    presentInfo.swapchainCount = 1;
-    presentInfo.pSwapchains = swapChains;
-    presentInfo.pImageIndices = &imageIndex;
-    presentInfo.pResults = nullptr; // Optional
+    frameStats.Print(seconds);
+    PrintSwapChainStats();
+    frameStats.WriteJson(settings.benchmarkReport, seconds);
+    std::cout << "Benchmark report written to " << settings.benchmarkReport << '\n';
+}
 
-    // Submits the request to present an image to the swap chain
-    vkQueuePresentKHR(vkPresentQueue, &presentInfo);
-    if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || framebufferResized)
+void VulkanApp::BenchmarkMipGeneration()
+{
+    constexpr VkFormat FORMAT = VK_FORMAT_R8G8B8A8_SRGB;
+    constexpr std::array<uint32_t, 2> SIZES = {4096, 8192};
+    // Plus one untimed run first, so neither path pays for first-use costs
+    constexpr uint32_t ITERATIONS = 10;
+
+    uint32_t queueFamilyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(vkPhysicalDevice, &queueFamilyCount, nullptr);
+    std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(vkPhysicalDevice, &queueFamilyCount, queueFamilies.data());
+
+    const uint32_t validBits = queueFamilies[FindQueueFamilies(vkPhysicalDevice).graphicsFamily.value()].timestampValidBits;
+    if (validBits == 0)
     {
-        framebufferResized = false;
-        ReCreateSwapChain();
+        std::cerr << "The graphics queue does not support timestamps, mip generation can't be benchmarked" << '\n';
+        return;
     }
-    else if (result != VK_SUCCESS)
+    const uint64_t mask = validBits >= 64 ? ~0ull : (1ull << validBits) - 1;
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(vkPhysicalDevice, &properties);
+
+    VkQueryPoolCreateInfo queryPoolInfo{};
+    queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    queryPoolInfo.queryCount = 2;
+
+    VkQueryPool queryPool;
+    if (vkCreateQueryPool(vkDevice, &queryPoolInfo, nullptr, &queryPool) != VK_SUCCESS)
     {
-        throw std::runtime_error("failed to present swap chain image!");
+        throw std::runtime_error("failed to create timestamp query pool!");
     }
-    
-    currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+
+    for (const uint32_t size : SIZES)
+    {
+        const uint32_t mipLevels = static_cast<uint32_t>(std::floor(std::log2(size))) + 1;
+
+        for (const bool compute : {false, true})
+        {
+            const char* name = compute ? "compute" : "blit";
+            if (compute ? !mipGenerator.Supports(FORMAT) : !SupportsLinearBlit(FORMAT))
+            {
+                std::cout << "Mip generation " << size << "x" << size << " " << name << ": not supported on this device" << '\n';
+                continue;
+            }
+
+            // Created the same way CreateTextureImage would for this path
+            VkImage image;
+            VkDeviceMemory imageMemory;
+            if (compute)
+            {
+                CreateImage(size, size, mipLevels, VK_SAMPLE_COUNT_1_BIT, MipGenerator::GetStorageFormat(FORMAT), VK_IMAGE_TILING_OPTIMAL,
+                            VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                            image, imageMemory, 1, MipGenerator::GetImageCreateFlags(FORMAT));
+            }
+            else
+            {
+                CreateImage(size, size, mipLevels, VK_SAMPLE_COUNT_1_BIT, FORMAT, VK_IMAGE_TILING_OPTIMAL,
+                            VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                            image, imageMemory);
+            }
+
+            std::vector<double> times;
+            uint32_t dispatches = 0;
+            for (uint32_t i = 0; i <= ITERATIONS; i++)
+            {
+                const VkCommandBuffer commandBuffer = BeginSingleTimeCommands();
+                vkCmdResetQueryPool(commandBuffer, queryPool, 0, 2);
+
+                // Level 0 holds garbage, which costs the same to filter as a real texture
+                VkImageMemoryBarrier barrier{};
+                barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+                barrier.srcAccessMask = 0;
+                barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+                barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+                barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+                barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+                barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+                barrier.image = image;
+                barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, mipLevels, 0, 1};
+
+                vkCmdPipelineBarrier(commandBuffer,
+                    VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+                    0, nullptr,
+                    0, nullptr,
+                    1, &barrier);
+
+                // The first timestamp is written once the transition is done, the second once the whole chain is
+                vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, queryPool, 0);
+                if (compute)
+                {
+                    dispatches = mipGenerator.Record(commandBuffer, image, FORMAT, {size, size}, mipLevels);
+                }
+                else
+                {
+                    GenerateMipmaps(commandBuffer, image, static_cast<int32_t>(size), static_cast<int32_t>(size), mipLevels);
+                }
+                vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, 1);
+
+                EndSingleTimeCommands(commandBuffer);
+                mipGenerator.ReleaseResources();
+
+                std::array<uint64_t, 2> timestamps{};
+                vkGetQueryPoolResults(vkDevice, queryPool, 0, 2, sizeof(timestamps), timestamps.data(), sizeof(uint64_t),
+                                      VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT);
+
+                if (i > 0)
+                {
+                    times.push_back(static_cast<double>((timestamps[1] - timestamps[0]) & mask) * properties.limits.timestampPeriod / 1000000.0);
+                }
+            }
+
+            vkDestroyImage(vkDevice, image, nullptr);
+            vkFreeMemory(vkDevice, imageMemory, nullptr);
+
+            // Blits take two barriers per level and one more for the last, compute one per dispatch and one at each end
+            const uint32_t barriers = compute ? dispatches + 1 : 2 * (mipLevels - 1) + 1;
+            const FrameStats::Summary summary = FrameStats::Summarize(times);
+            std::cout << "Mip generation " << size << "x" << size << " " << name << ": mean " << summary.mean << " ms, median " << summary.p50
+                      << " ms, max " << summary.max << " ms (" << mipLevels << " levels, "
+                      << (compute ? dispatches : mipLevels - 1) << (compute ? " dispatches, " : " blits, ") << barriers << " barriers)" << '\n';
+        }
+    }
+
+    vkDestroyQueryPool(vkDevice, queryPool, nullptr);
 }
 
-void VulkanApp::MainLoop()
+void VulkanApp::BenchmarkCommandBuffers()
 {
-    while (!glfwWindowShouldClose(window))
+    constexpr std::array<uint32_t, 3> DRAW_COUNTS = {1000, 10000, 100000};
+    constexpr uint32_t FRAMES = 200;
+
+    const auto shouldStop = [this]()
     {
-        glfwPollEvents();
-        DrawFrame();
+        return !settings.headless && glfwWindowShouldClose(window);
+    };
+
+    if (settings.occlusionCulling)
+    {
+        std::cout << "Occlusion culling draws the forward pass per cluster, only the depth prepass is split into draws" << '\n';
+    }
+
+    for (const uint32_t drawCount : DRAW_COUNTS)
+    {
+        for (const bool reuse : {false, true})
+        {
+            settings.drawCount = drawCount;
+            settings.reuseCommandBuffers = reuse;
+            InvalidateCommandBuffers();
+
+            // With reuse the first frames record a command buffer for every image and frame slot, which isn't what
+            // we are measuring
+            for (uint32_t i = 0; i < settings.warmupFrames && !shouldStop(); i++)
+            {
+                if (!settings.headless)
+                    glfwPollEvents();
+                DrawFrame();
+            }
+
+            std::vector<double> recordTimes;
+            std::vector<double> frameTimes;
+            for (uint32_t i = 0; i < FRAMES && !shouldStop(); i++)
+            {
+                const auto frameStart = std::chrono::steady_clock::now();
+                if (!settings.headless)
+                    glfwPollEvents();
+                DrawFrame();
+                frameTimes.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - frameStart).count());
+                recordTimes.push_back(frameTiming.recordTime);
+            }
+
+            const FrameStats::Summary record = FrameStats::Summarize(recordTimes);
+            const FrameStats::Summary frame = FrameStats::Summarize(frameTimes);
+            std::cout << "Command buffers " << drawCount << " draws " << (reuse ? "reused" : "re-recorded") << ": record mean " << record.mean
+                      << " ms, p95 " << record.p95 << " ms, CPU frame mean " << frame.mean << " ms, p95 " << frame.p95 << " ms" << '\n';
+        }
     }
 
     vkDeviceWaitIdle(vkDevice);
 }
 
-void VulkanApp::CleanupSwapChain() const
+void VulkanApp::BenchmarkDrawSort()
 {
-    vkDestroyImageView(vkDevice, vkColorImageView, nullptr);
-    vkDestroyImage(vkDevice, vkColorImage, nullptr);
-    vkFreeMemory(vkDevice, vkColorImageMemory, nullptr);
-    
-    for (const VkFramebuffer framebuffer : swapChainFramebuffers)
+    constexpr uint32_t DRAW_COUNT = 100000;
+    // A scene that size has a handful of pipelines, some hundreds of materials and some thousands of meshes
+    constexpr uint32_t PIPELINES = 8;
+    constexpr uint32_t MATERIALS = 256;
+    constexpr uint32_t MESHES = 4096;
+    // Plus one untimed run first, so the scratch buffer is already allocated like it is after the first frame
+    constexpr uint32_t ITERATIONS = 50;
+
+    // Fixed seed, so every run sorts the same draws
+    std::mt19937 random(1234);
+    std::uniform_int_distribution<uint32_t> pipeline(0, PIPELINES - 1);
+    std::uniform_int_distribution<uint32_t> material(0, MATERIALS - 1);
+    std::uniform_int_distribution<uint32_t> mesh(0, MESHES - 1);
+    std::uniform_real_distribution<float> depth(0.0f, 1.0f);
+
+    std::vector<DrawItem> draws(DRAW_COUNT);
+    for (DrawItem& draw : draws)
+    {
+        draw.pipeline = pipeline(random);
+        draw.material = material(random);
+        draw.mesh = mesh(random);
+        draw.sortKey = DrawList::MakeSortKey(draw.pipeline, draw.material, draw.mesh, depth(random));
+    }
+
+    DrawList drawList;
+    DrawList::BindCounts unsortedBinds;
+    std::vector<double> radixTimes;
+    std::vector<double> comparisonTimes;
+    for (uint32_t i = 0; i <= ITERATIONS; i++)
+    {
+        drawList.Clear();
+        for (const DrawItem& draw : draws)
+        {
+            drawList.Add(draw);
+        }
+        unsortedBinds = drawList.CountBinds();
+
+        const auto radixStart = std::chrono::steady_clock::now();
+        drawList.Sort();
+        const double radixTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - radixStart).count();
+
+        // The same order through a comparison sort, for reference
+        std::vector<DrawItem> sorted = draws;
+        const auto comparisonStart = std::chrono::steady_clock::now();
+        std::stable_sort(sorted.begin(), sorted.end(), [](const DrawItem& a, const DrawItem& b)
+        {
+            return a.sortKey < b.sortKey;
+        });
+        const double comparisonTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - comparisonStart).count();
+
+        // Both sorts are stable, so they have to agree draw for draw
+        if (drawList.GetItems() != sorted)
+        {
+            throw std::runtime_error("radix sort of the draw list differs from std::stable_sort!");
+        }
+
+        if (i > 0)
+        {
+            radixTimes.push_back(radixTime);
+            comparisonTimes.push_back(comparisonTime);
+        }
+    }
+
+    const DrawList::BindCounts sortedBinds = drawList.CountBinds();
+    const uint64_t unsortedTotal = unsortedBinds.pipelines + unsortedBinds.materials + unsortedBinds.meshes;
+    const uint64_t sortedTotal = sortedBinds.pipelines + sortedBinds.materials + sortedBinds.meshes;
+
+    const FrameStats::Summary radix = FrameStats::Summarize(radixTimes);
+    const FrameStats::Summary comparison = FrameStats::Summarize(comparisonTimes);
+    std::cout << "Draw sort " << DRAW_COUNT << " draws: radix mean " << radix.mean << " ms, median " << radix.p50 << " ms, std::stable_sort mean "
+              << comparison.mean << " ms, median " << comparison.p50 << " ms" << '\n';
+    std::cout << "Draw sort binds: " << unsortedTotal << " unsorted (" << unsortedBinds.pipelines << " pipelines, " << unsortedBinds.materials
+              << " materials, " << unsortedBinds.meshes << " meshes), " << sortedTotal << " sorted (" << sortedBinds.pipelines << " pipelines, "
+              << sortedBinds.materials << " materials, " << sortedBinds.meshes << " meshes), " << unsortedTotal - sortedTotal << " saved" << '\n';
+}
+
+void VulkanApp::BenchmarkJobs()
+{
+    // Empty jobs, so all that is timed is queueing, taking and finishing them
+    constexpr uint32_t SPAWN_COUNT = 100000;
+    // Batches of equal cost, enough of them that 64 threads still get dozens each
+    constexpr uint32_t WORK_ITEMS = 1u << 22;
+    constexpr uint32_t WORK_BATCH = 1024;
+    // Plus one untimed run first, which starts the workers and grows the deques
+    constexpr uint32_t ITERATIONS = 10;
+    constexpr std::array<uint32_t, 7> THREAD_COUNTS = {1, 2, 4, 8, 16, 32, 64};
+
+    std::cout << "Job benchmark on " << std::thread::hardware_concurrency() << " hardware threads" << '\n';
+
+    std::vector<float> output(WORK_ITEMS);
+    double singleThreadTime = 0.0;
+    for (const uint32_t threadCount : THREAD_COUNTS)
     {
-        vkDestroyFramebuffer(vkDevice, framebuffer, nullptr);
+        JobSystem jobs;
+        jobs.Init(threadCount);
+
+        std::vector<double> spawnTimes;
+        std::vector<double> mainTimes;
+        std::vector<double> nestedTimes;
+        std::vector<double> workTimes;
+        for (uint32_t i = 0; i <= ITERATIONS; i++)
+        {
+            // Spawning on its own, then everything up to the last job done. The workers already take jobs while the
+            // loop runs, so the first also counts some contention on the main thread's deque
+            const auto spawnStart = std::chrono::steady_clock::now();
+            JobSystem::Counter counter;
+            for (uint32_t job = 0; job < SPAWN_COUNT; job++)
+            {
+                jobs.Run([]() {}, &counter);
+            }
+            const double spawnTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - spawnStart).count();
+            jobs.Wait(counter);
+            const double mainTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - spawnStart).count();
+
+            // One job per thread that spawns the rest from wherever it runs, into that thread's own deque. That is
+            // how jobs spawning jobs behave, and what the stealing is for: a thread whose job was stolen late steals back
+            const uint32_t jobsPerRoot = SPAWN_COUNT / threadCount;
+            const auto nestedStart = std::chrono::steady_clock::now();
+            JobSystem::Counter nestedCounter;
+            for (uint32_t root = 0; root < threadCount; root++)
+            {
+                jobs.Run([&jobs, &nestedCounter, jobsPerRoot]()
+                {
+                    for (uint32_t job = 0; job < jobsPerRoot; job++)
+                    {
+                        jobs.Run([]() {}, &nestedCounter);
+                    }
+                }, &nestedCounter);
+            }
+            jobs.Wait(nestedCounter);
+            const double nestedTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - nestedStart).count();
+
+            const auto workStart = std::chrono::steady_clock::now();
+            jobs.ParallelFor(WORK_ITEMS, WORK_BATCH, [&output](const uint32_t begin, const uint32_t end)
+            {
+                for (uint32_t item = begin; item < end; item++)
+                {
+                    float value = static_cast<float>(item);
+                    for (uint32_t step = 0; step < 16; step++)
+                    {
+                        value = std::sqrt(value * value + 1.0f);
+                    }
+                    output[item] = value;
+                }
+            });
+            const double workTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - workStart).count();
+
+            if (i > 0)
+            {
+                spawnTimes.push_back(spawnTime);
+                mainTimes.push_back(mainTime);
+                nestedTimes.push_back(nestedTime);
+                workTimes.push_back(workTime);
+            }
+        }
+
+        const FrameStats::Summary spawn = FrameStats::Summarize(spawnTimes);
+        const FrameStats::Summary main = FrameStats::Summarize(mainTimes);
+        const FrameStats::Summary nested = FrameStats::Summarize(nestedTimes);
+        const FrameStats::Summary work = FrameStats::Summarize(workTimes);
+        if (threadCount == 1)
+        {
+            singleThreadTime = work.p50;
+        }
+        // Medians in ns per job: spawning alone, then spawning and running every job from the main thread or from jobs
+        const uint32_t nestedCount = threadCount * (SPAWN_COUNT / threadCount + 1);
+        std::cout << "Jobs " << threadCount << " threads: spawn " << spawn.p50 * 1e6 / SPAWN_COUNT << " ns per job, spawn and run from main "
+                  << main.p50 * 1e6 / SPAWN_COUNT << " ns, from jobs " << nested.p50 * 1e6 / nestedCount << " ns, workload median "
+                  << work.p50 << " ms, p95 " << work.p95 << " ms, speedup " << singleThreadTime / work.p50 << "x" << '\n';
+    }
+}
+
+void VulkanApp::CreateStatisticsQueries()
+{
+    counterSlots.resize(MAX_FRAMES_IN_FLIGHT);
+
+    // Without the feature we still count draws and binds on the CPU
+    if (!pipelineStatisticsSupported)
+        return;
+
+    // Results come back in bit order, which is the order of the fields in FrameCounters
+    VkQueryPoolCreateInfo queryPoolInfo{};
+    queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    queryPoolInfo.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+    queryPoolInfo.queryCount = MAX_FRAMES_IN_FLIGHT;
+    queryPoolInfo.pipelineStatistics =
+        VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_VERTICES_BIT |
+        VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_PRIMITIVES_BIT |
+        VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT |
+        VK_QUERY_PIPELINE_STATISTIC_CLIPPING_INVOCATIONS_BIT |
+        VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT |
+        VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT;
+
+    if (vkCreateQueryPool(vkDevice, &queryPoolInfo, nullptr, &statisticsQueryPool) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create pipeline statistics query pool!");
+    }
+}
+
+void VulkanApp::CollectFrameCounters(const uint32_t frame)
+{
+    CounterSlot& slot = counterSlots[frame];
+    if (!slot.pending)
+        return;
+
+    slot.pending = false;
+    FrameCounters& counters = slot.counters;
+
+    if (statisticsQueryPool != VK_NULL_HANDLE)
+    {
+        uint64_t statistics[6];
+        counters.hasPipelineStatistics = vkGetQueryPoolResults(vkDevice, statisticsQueryPool, frame, 1, sizeof(statistics), statistics,
+                                                               sizeof(statistics), VK_QUERY_RESULT_64_BIT) == VK_SUCCESS;
+        if (counters.hasPipelineStatistics)
+        {
+            counters.inputAssemblyVertices = statistics[0];
+            counters.inputAssemblyPrimitives = statistics[1];
+            counters.vertexShaderInvocations = statistics[2];
+            counters.clippingInvocations = statistics[3];
+            counters.clippingPrimitives = statistics[4];
+            counters.fragmentShaderInvocations = statistics[5];
+        }
+    }
+
+    if (settings.occlusionCulling)
+    {
+        const OcclusionCuller::Stats stats = occlusionCuller.GetStats(frame);
+        counters.hasCulling = true;
+        counters.clusters = stats.clusters;
+        counters.frustumCulledClusters = stats.frustumCulled;
+        counters.occlusionCulledClusters = stats.occlusionCulled;
+    }
+
+    lastFrameCounters = counters;
+
+    if (slot.measured)
+    {
+        frameStats.AddCounters(counters);
+    }
+}
+
+void VulkanApp::CreateTimestampQueries()
+{
+    // Not every queue can write timestamps, in which case we simply report no GPU times
+    uint32_t queueFamilyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(vkPhysicalDevice, &queueFamilyCount, nullptr);
+    std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(vkPhysicalDevice, &queueFamilyCount, queueFamilies.data());
+
+    const uint32_t validBits = queueFamilies[FindQueueFamilies(vkPhysicalDevice).graphicsFamily.value()].timestampValidBits;
+    if (validBits == 0)
+    {
+        std::cerr << "The graphics queue does not support timestamps, GPU times will not be reported" << '\n';
+        return;
+    }
+
+    // Timestamps only count up in their valid bits and wrap around, so differences are taken modulo that
+    timestampMask = validBits >= 64 ? ~0ull : (1ull << validBits) - 1;
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(vkPhysicalDevice, &properties);
+    timestampPeriod = properties.limits.timestampPeriod;
+
+    VkQueryPoolCreateInfo queryPoolInfo{};
+    queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    queryPoolInfo.queryCount = MAX_FRAMES_IN_FLIGHT * 2;
+
+    if (vkCreateQueryPool(vkDevice, &queryPoolInfo, nullptr, &timestampQueryPool) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create timestamp query pool!");
+    }
+
+    timestampSlots.resize(MAX_FRAMES_IN_FLIGHT);
+}
+
+void VulkanApp::CollectGpuTime(const uint32_t frame)
+{
+    TimestampSlot& slot = timestampSlots[frame];
+    if (!slot.pending)
+        return;
+
+    slot.pending = false;
+
+    // The fence already signaled, so the results are available and we don't ask the driver to wait for them
+    uint64_t timestamps[2];
+    if (vkGetQueryPoolResults(vkDevice, timestampQueryPool, frame * 2, 2, sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) != VK_SUCCESS)
+        return;
+
+    // timestampPeriod is in nanoseconds per tick
+    const uint64_t ticks = (timestamps[1] - timestamps[0]) & timestampMask;
+    const double gpuTime = static_cast<double>(ticks) * timestampPeriod / 1000000.0;
+
+    if (settings.dynamicResolution)
+    {
+        dynamicResolution.AddGpuTime(gpuTime, slot.renderScale);
+    }
+
+    if (!slot.measured)
+        return;
+
+    frameStats.AddGpuTime(gpuTime, GetAntiAliasingName(slot.antiAliasing));
+}
+
+void VulkanApp::RetireRenderGraph(const uint64_t lastUsedFrame)
+{
+    // Framebuffers and the multisampled color and depth images
+    renderGraph.Retire(deletionQueue, lastUsedFrame);
+    if (settings.occlusionCulling)
+    {
+        occlusionCuller.Retire(deletionQueue, lastUsedFrame);
+    }
+    if (settings.dynamicResolution)
+    {
+        dynamicResolution.Retire(deletionQueue, lastUsedFrame);
     }
+    if (fxaa.IsInitialized())
+    {
+        fxaa.Retire(deletionQueue, lastUsedFrame);
+    }
+}
+
+VkSwapchainKHR VulkanApp::RetireSwapChainResources(const uint64_t lastUsedFrame)
+{
+    RetireRenderGraph(lastUsedFrame);
 
     for (const VkImageView imageView : swapChainImageViews)
     {
-        vkDestroyImageView(vkDevice, imageView, nullptr);
+        deletionQueue.Push(lastUsedFrame, imageView);
+    }
+
+    // Offscreen images are ours to destroy, swap chain images belong to the swap chain
+    const VkSwapchainKHR swapChain = vkSwapChain;
+    if (settings.headless)
+    {
+        for (size_t i = 0; i < swapChainImages.size(); i++)
+        {
+            deletionQueue.Push(lastUsedFrame, swapChainImages[i]);
+            deletionQueue.Push(lastUsedFrame, offscreenImagesMemory[i]);
+        }
+        offscreenImagesMemory.clear();
+    }
+    else
+    {
+        deletionQueue.Push(lastUsedFrame, swapChain);
     }
 
-    vkDestroySwapchainKHR(vkDevice, vkSwapChain, nullptr);
+    swapChainImageViews.clear();
+    swapChainImages.clear();
+    vkSwapChain = VK_NULL_HANDLE;
+
+    return swapChain;
+}
+
+void VulkanApp::PrintSwapChainStats() const
+{
+    if (swapChainRecreateTimes.empty())
+        return;
+
+    const FrameStats::Summary recreate = FrameStats::Summarize(swapChainRecreateTimes);
+    const FrameStats::Summary latency = FrameStats::Summarize(resizeLatencies);
+    std::cout << "Swap chain recreated " << recreate.count << " times: recreation mean " << recreate.mean << " ms, max " << recreate.max
+              << " ms; resize to next present mean " << latency.mean << " ms, max " << latency.max << " ms" << '\n';
+}
+
+void VulkanApp::CleanupSwapChain()
+{
+    // Only called once the device is idle, so nothing has to wait for a frame
+    RetireSwapChainResources(frameNumber);
+    deletionQueue.Flush();
 }
 
-void VulkanApp::Cleanup() const
+void VulkanApp::Cleanup()
 {
+    jobSystem.Shutdown();
     CleanupSwapChain();
+    CleanupReadback();
+    vkDestroyQueryPool(vkDevice, timestampQueryPool, nullptr);
+    vkDestroyQueryPool(vkDevice, statisticsQueryPool, nullptr);
+#if NYCSI_PROFILE
+    Profiler::Get().CleanupGpu();
+#endif
 
     // Cleanup Textures
     vkDestroySampler(vkDevice, vkTextureSampler, nullptr);
-    vkDestroyImageView(vkDevice, vkTextureImageView, nullptr);
-    vkDestroyImage(vkDevice, vkTextureImage, nullptr);
-    
-    vkFreeMemory(vkDevice, vkTextureImageMemory, nullptr);
-    
-    vkDestroyDescriptorSetLayout(vkDevice, vkDescriptorSetLayout, nullptr);
+    for (const Texture& texture : textures)
+    {
+        vkDestroyImageView(vkDevice, texture.view, nullptr);
+        vkDestroyImage(vkDevice, texture.image, nullptr);
+        vkFreeMemory(vkDevice, texture.memory, nullptr);
+    }
 
     for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
     {
@@ -1875,14 +4221,8 @@ void VulkanApp::Cleanup() const
     }
 
     vkDestroyDescriptorPool(vkDevice, vkDescriptorPool, nullptr);
-
-    vkDestroyDescriptorSetLayout(vkDevice, vkDescriptorSetLayout, nullptr);
     
-    vkDestroyBuffer(vkDevice, vkIndexBuffer, nullptr);
-    vkFreeMemory(vkDevice, vkIndexBufferMemory, nullptr);
-    
-    vkDestroyBuffer(vkDevice, vkVertexBuffer, nullptr);
-    vkFreeMemory(vkDevice, vkVertexBufferMemory, nullptr);
+    geometryPool.Cleanup();
     
     // Clean all Sync Objects
     for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
@@ -1893,22 +4233,51 @@ void VulkanApp::Cleanup() const
     }
     
     vkDestroyCommandPool(vkDevice, vkCommandPool, nullptr);
-    vkDestroyPipeline(vkDevice, vkGraphicsPipeline, nullptr);
-    vkDestroyPipelineLayout(vkDevice, vkPipelineLayout, nullptr);
-    vkDestroyRenderPass(vkDevice, vkRenderPass, nullptr);
+    for (const auto& [cacheKey, pipeline] : graphicsPipelines)
+    {
+        vkDestroyPipeline(vkDevice, pipeline, nullptr);
+    }
+    for (const auto& [samples, pipeline] : depthPrepassPipelines)
+    {
+        vkDestroyPipeline(vkDevice, pipeline, nullptr);
+    }
+    if (settings.occlusionCulling)
+    {
+        occlusionCuller.Cleanup();
+    }
+    if (settings.lightCount > 0)
+    {
+        clusteredLighting.Cleanup();
+    }
+    if (settings.dynamicResolution)
+    {
+        dynamicResolution.Cleanup();
+    }
+    if (fxaa.IsInitialized())
+    {
+        fxaa.Cleanup();
+    }
+    mipGenerator.Cleanup();
+    layoutCache.Cleanup();
+    renderGraph.Cleanup();
     vkDestroyDevice(vkDevice, nullptr);
 
-    if (enableValidationLayers)
+    if (useValidationLayers)
     {
         DestroyDebugUtilsMessengerExt(vkInstance, debugMessenger, nullptr);
     }
 
-    vkDestroySurfaceKHR(vkInstance, vkSurface, nullptr);
+    if (!settings.headless)
+    {
+        vkDestroySurfaceKHR(vkInstance, vkSurface, nullptr);
+    }
     vkDestroyInstance(vkInstance, nullptr);
 
-    glfwDestroyWindow(window);
-
-    glfwTerminate();
+    if (!settings.headless)
+    {
+        glfwDestroyWindow(window);
+        glfwTerminate();
+    }
 }
 
 void VulkanApp::PopulateDebugMessengerCreateInfo(VkDebugUtilsMessengerCreateInfoEXT& createInfo)
@@ -1925,7 +4294,7 @@ void VulkanApp::PopulateDebugMessengerCreateInfo(VkDebugUtilsMessengerCreateInfo
 
 void VulkanApp::SetupDebugMessenger()
 {
-    if constexpr (!enableValidationLayers) return;
+    if (!useValidationLayers) return;
 
     VkDebugUtilsMessengerCreateInfoEXT createInfo;
     PopulateDebugMessengerCreateInfo(createInfo);
@@ -1942,6 +4311,15 @@ void VulkanApp::FramebufferResizeCallback(GLFWwindow* window, int width, int hei
     app->framebufferResized = true;
 }
 
+void VulkanApp::KeyCallback(GLFWwindow* window, int key, int /*scancode*/, int action, int /*mods*/)
+{
+    if (action != GLFW_PRESS || key < GLFW_KEY_1 || key > GLFW_KEY_5)
+        return;
+
+    VulkanApp* app = reinterpret_cast<VulkanApp*>(glfwGetWindowUserPointer(window));
+    app->requestedAntiAliasing = static_cast<AntiAliasing>(key - GLFW_KEY_1);
+}
+
 bool VulkanApp::CheckValidationLayerSupport()
 {
     // We get the layerCount
@@ -2,23 +2,48 @@
 
 #define GLFW_INCLUDE_VULKAN
 #include <array>
+#include <chrono>
+#include <exception>
+#include <functional>
+#include <memory>
 #include <optional>
+#include <unordered_map>
 #include <vector>
 #include <xstring>
 #include <GLFW/glfw3.h>
 #include <vulkan/vulkan.h>
 
+#include "glm/mat4x4.hpp"
 #include "glm/vec2.hpp"
 #include "glm/vec3.hpp"
 
 #define GLM_ENABLE_EXPERIMENTAL
 #include <glm/gtx/hash.hpp>
 
-constexpr uint32_t WIDTH = 800;
-constexpr uint32_t HEIGHT = 600;
-
-const std::string MODEL_PATH = "models/viking_room.obj";
+#include "AppSettings.h"
+#include "ClusteredLighting.h"
+#include "DeletionQueue.h"
+#include "DeviceMemory.h"
+#include "DrawList.h"
+#include "DynamicResolution.h"
+#include "FrameCapture.h"
+#include "FrameStats.h"
+#include "FullscreenPass.h"
+#include "GeometryPool.h"
+#include "JobSystem.h"
+#include "Profiler.h"
+#include "StartupTimer.h"
+#include "LayoutCache.h"
+#include "MipGenerator.h"
+#include "OcclusionCuller.h"
+#include "RenderGraph.h"
+#include "ShaderCompiler.h"
+#include "ShaderReflection.h"
+
+// Used by faces without a material
 const std::string TEXTURE_PATH = "textures/viking_room.png";
+// Not a file, a single white texel bound by materials without a diffuse map. Their shaders never sample it
+const std::string WHITE_TEXTURE = "<white>";
 
 // It’s actually possible that the queue families supporting drawing commands
 // and the ones supporting presentation do not overlap.
@@ -83,6 +108,28 @@ struct Vertex
     }
 };
 
+// Selects a variant of the forward shaders. Each field maps to a specialization constant in shader.frag, so the
+// driver compiles the disabled paths away instead of branching on them for every fragment
+struct PipelineKey
+{
+    bool useTexture = true;
+    bool useVertexColor = false;
+    bool alphaTest = false;
+    float alphaCutoff = 0.5f;
+
+    bool operator==(const PipelineKey& other) const = default;
+};
+
+// A pipeline is only reusable if the permutation and the state it was baked against both match
+struct PipelineCacheKey
+{
+    PipelineKey permutation;
+    VkRenderPass renderPass = VK_NULL_HANDLE;
+    VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT;
+
+    bool operator==(const PipelineCacheKey& other) const = default;
+};
+
 namespace std {
     template<> struct hash<Vertex> {
         size_t operator()(Vertex const& vertex) const {
@@ -91,25 +138,85 @@ namespace std {
                    (hash<glm::vec2>()(vertex.texCoord) << 1);
         }
     };
+
+    template<> struct hash<PipelineKey> {
+        size_t operator()(PipelineKey const& key) const {
+            const size_t flags = (key.useTexture ? 1u : 0u) | (key.useVertexColor ? 2u : 0u) | (key.alphaTest ? 4u : 0u);
+            return hash<size_t>()(flags) ^ (hash<float>()(key.alphaCutoff) << 1);
+        }
+    };
+
+    template<> struct hash<PipelineCacheKey> {
+        size_t operator()(PipelineCacheKey const& key) const {
+            return ((hash<PipelineKey>()(key.permutation) ^
+                   (hash<VkRenderPass>()(key.renderPass) << 1)) >> 1) ^
+                   (hash<uint32_t>()(key.samples) << 1);
+        }
+    };
 }
 
 
+// A rendered frame copied back to host memory. The pixels are tightly packed, 4 bytes per pixel in the given
+// format, one layer (view) after the other, and only valid for the duration of the ReadbackCallback
+struct ReadbackFrame
+{
+    uint64_t frameNumber;
+    uint32_t width;
+    uint32_t height;
+    uint32_t layers;
+    VkFormat format;
+    const uint8_t* pixels;
+    size_t size;
+};
+
+using ReadbackCallback = std::function<void(const ReadbackFrame&)>;
+
+// One camera of a --camera-path file
+struct CameraKeyframe
+{
+    glm::vec3 eye;
+    glm::vec3 target;
+};
+
 class VulkanApp
 {
 public:
+    explicit VulkanApp(AppSettings settings = {});
     void Run();
 
+    // Receives every frame when readback is enabled, a few frames after it was rendered. Set it before Run()
+    void SetReadbackCallback(ReadbackCallback callback);
+
+    // Work done by the most recent frame the GPU has finished. Lags a couple of frames behind the one being recorded
+    [[nodiscard]] const FrameCounters& GetLastFrameCounters() const { return lastFrameCounters; }
+
 private:
+    AppSettings settings;
+
+    // Validation layers are requested in debug builds, but we keep going without them if they are not installed
+    bool useValidationLayers = false;
+
     // Model
     std::vector<Vertex> vertices;
     std::vector<uint32_t> indices;
-    VkBuffer vertexBuffer;
-    VkDeviceMemory vertexBufferMemory;
+    // indices is grouped by material, so each material is one contiguous range whatever shapes its faces came from
+    struct Submesh
+    {
+        uint32_t material = 0;
+        uint32_t firstIndex = 0;
+        uint32_t indexCount = 0;
+    };
+    std::vector<Submesh> submeshes;
+    // The model's id in geometryPool
+    uint32_t modelMesh = 0;
 
     // Render Specific
     const int MAX_FRAMES_IN_FLIGHT = 2;
     uint32_t currentFrame = 0;
+    // Frames submitted since startup. Drives the animation in headless mode so runs are reproducible
+    uint64_t frameNumber = 0;
     bool framebufferResized = false;
+    std::vector<CameraKeyframe> cameraPath;
     
     GLFWwindow* window = nullptr;
 
@@ -129,58 +236,236 @@ private:
     VkFormat swapChainImageFormat = VK_FORMAT_UNDEFINED;
     VkExtent2D swapChainExtent = {};
     std::vector<VkImageView> swapChainImageViews;
+    // The part of the swap chain sized targets the scene renders into this frame. Smaller than swapChainExtent only
+    // with dynamic resolution
+    VkExtent2D renderExtent = {};
+    // In headless mode swapChainImages are plain images we own, backed by this memory
+    std::vector<VkDeviceMemory> offscreenImagesMemory;
+
+    // Objects replaced while frames in flight may still use them, e.g. everything sized to an old swap chain
+    DeletionQueue deletionQueue;
+    // Memory types of vkPhysicalDevice, and the buffers of the app itself
+    DeviceMemory deviceMemory;
+    // Set when a resize is noticed, cleared when the first frame at the new size is presented
+    std::optional<std::chrono::steady_clock::time_point> resizeStartTime;
+    std::vector<double> swapChainRecreateTimes;
+    std::vector<double> resizeLatencies;
     
     VkSurfaceKHR vkSurface = VK_NULL_HANDLE;
+    // Every pass of the frame, with the images and barriers between them
+    RenderGraph renderGraph;
+    RenderGraph::ResourceId backbufferImage = 0;
+    RenderGraph::PassId forwardPass = 0;
+    RenderGraph::PassId depthPrepass = 0;
+    // With dynamic resolution the scene renders into sceneColorImage, which the upscale pass stretches over the backbuffer
+    RenderGraph::ResourceId sceneColorImage = 0;
+    RenderGraph::PassId upscalePass = 0;
+    // With FXAA the forward pass renders into fxaaSourceImage, which the FXAA pass filters into the scene image
+    RenderGraph::ResourceId fxaaSourceImage = 0;
+    RenderGraph::PassId fxaaPass = 0;
+    // The forward pass's render pass, which the pipelines are built against. Owned by renderGraph
     VkRenderPass vkRenderPass = VK_NULL_HANDLE;
-    VkDescriptorSetLayout vkDescriptorSetLayout = VK_NULL_HANDLE; 
+    // Both are derived from the shaders in CreatePipelineLayout and owned by layoutCache, which destroys them in
+    // Cleanup. Nothing else creates a forward set layout, so there is nothing of ours to destroy
+    VkDescriptorSetLayout vkDescriptorSetLayout = VK_NULL_HANDLE;
     VkPipelineLayout vkPipelineLayout = VK_NULL_HANDLE;
-    VkPipeline vkGraphicsPipeline = VK_NULL_HANDLE;
-    std::vector<VkFramebuffer> swapChainFramebuffers;
+    LayoutCache layoutCache;
+    ShaderLayout forwardShaderLayout;
+    // Every permutation some material asks for, once each, in the order they were first asked for
+    std::vector<PipelineKey> pipelineKeys;
+    // pipelineKeys resolved against the current render pass and sample count. Every variant lives in graphicsPipelines
+    std::vector<VkPipeline> forwardPipelines;
+    std::unordered_map<PipelineCacheKey, VkPipeline> graphicsPipelines;
+    // Position only, no fragment shader. Built against the prepass's render pass, which the graph's cache keeps stable
+    // for a given sample count, so there is one pipeline per sample count used so far
+    VkPipeline vkDepthPrepassPipeline = VK_NULL_HANDLE;
+    std::unordered_map<VkSampleCountFlagBits, VkPipeline> depthPrepassPipelines;
+    // Hi-Z pyramid and cluster culling between the depth prepass and the forward pass
+    OcclusionCuller occlusionCuller;
+    // Assigns the point lights to clusters before the forward pass shades with them
+    ClusteredLighting clusteredLighting;
+    // Picks the render scale from the GPU frame times, and owns the upscale pass
+    DynamicResolution dynamicResolution;
+    // Created the first time the FXAA tier is selected
+    FullscreenPass fxaa;
+    ShaderCompiler shaderCompiler;
+    // Builds texture mip chains in compute. Textures it can't handle, or every texture with --blit-mipmaps, use blits
+    MipGenerator mipGenerator;
     
     VkCommandPool vkCommandPool = VK_NULL_HANDLE;
 
     // We need to have multiple to handle multiple frames in flight
     std::vector<VkCommandBuffer> vkCommandBuffers;
+    // With --reuse-command-buffers, one per swap chain image and frame in flight, indexed by
+    // imageIndex * MAX_FRAMES_IN_FLIGHT + frame. Only ever submitted from their own frame slot, so once that slot's
+    // fence signals they can be recorded again
+    struct RecordedCommandBuffer
+    {
+        VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+        bool valid = false;
+        // Baked into the viewports, render areas and cull constants
+        VkExtent2D renderExtent = {};
+        // What recording counted, handed out again with every submit
+        FrameCounters counters;
+    };
+    std::vector<RecordedCommandBuffer> recordedCommandBuffers;
+    // The submeshes split into about settings.drawCount triangle ranges, at least one per submesh. Built again when
+    // the draw count changes
+    struct ModelRange
+    {
+        uint32_t material = 0;
+        uint32_t firstIndex = 0;
+        uint32_t indexCount = 0;
+        // Average position of the range's vertices, which its draws are sorted by
+        glm::vec3 center = glm::vec3(0.0f);
+    };
+    std::vector<ModelRange> modelRanges;
+    uint32_t modelRangesDrawCount = 0;
+    // The draws of the frame being recorded, sorted by state and depth
+    DrawList drawList;
+    // View 0 times the model matrix of the frame, from UpdateUniformBuffer
+    glm::mat4 modelView = glm::mat4(1.0f);
     std::vector<VkSemaphore> imageAvailableSemaphores;
     std::vector<VkSemaphore> renderFinishedSemaphores;
     std::vector<VkFence> inFlightFences;
 
     // Buffers
-    VkBuffer vkVertexBuffer = VK_NULL_HANDLE;
-    VkDeviceMemory vkVertexBufferMemory = VK_NULL_HANDLE;
-    VkBuffer vkIndexBuffer = VK_NULL_HANDLE;
-    VkDeviceMemory vkIndexBufferMemory = VK_NULL_HANDLE;
+    // Vertices and indices of every mesh, plus their positions alone for the depth prepass
+    GeometryPool geometryPool;
 
     // Uniform buffers. We need as many as frames in flight
     std::vector<VkBuffer> vkUniformBuffers;
     std::vector<VkDeviceMemory> vkUniformBuffersMemory;
     std::vector<void*> vkUniformBuffersMapped;
     VkDescriptorPool vkDescriptorPool = VK_NULL_HANDLE;
-    std::vector<VkDescriptorSet> vkDescriptorSets;
 
     // Texture
-    uint32_t vkMipLevels = 1;
-    VkImage vkTextureImage;
-    VkDeviceMemory vkTextureImageMemory;
-    VkImageView vkTextureImageView;
+    struct Texture
+    {
+        VkImage image = VK_NULL_HANDLE;
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        VkImageView view = VK_NULL_HANDLE;
+        uint32_t mipLevels = 1;
+    };
+    // Loaded once per path, however many materials share them. The ids are handed out while the model is parsed, and
+    // a texture's image stays null until its upload
+    std::vector<Texture> textures;
+    std::unordered_map<std::string, uint32_t> textureIds;
+    // A texture file decoded on a worker, indexed like textures. Gone once every texture is uploaded
+    struct DecodedImage
+    {
+        std::string path;
+        int width = 0;
+        int height = 0;
+        // From stbi_load, freed by the upload
+        unsigned char* pixels = nullptr;
+        std::exception_ptr error;
+        JobSystem::Counter decoded;
+    };
+    std::vector<std::unique_ptr<DecodedImage>> decodedImages;
     VkSampler vkTextureSampler;
 
-    // Depth Buffer
-    VkImage vkDepthImage;
-    VkDeviceMemory vkDepthImageMemory;
-    VkImageView vkDepthImageView;
-    VkSampleCountFlagBits msaaSamples = VK_SAMPLE_COUNT_1_BIT;
+    // The model's materials that some face uses. Their ids are what the draw list sorts and binds by
+    struct Material
+    {
+        std::string name;
+        uint32_t texture = 0;
+        // Index into pipelineKeys and forwardPipelines, and the pipeline id its draws sort and bind by
+        uint32_t pipeline = 0;
+        // Set 0 of the forward shaders with this material's texture, one per frame in flight
+        std::vector<VkDescriptorSet> descriptorSets;
+    };
+    std::vector<Material> materials;
 
-    // Multisampling
-    VkImage vkColorImage;
-    VkDeviceMemory vkColorImageMemory;
-    VkImageView vkColorImageView;
+    // Readback. One host buffer per frame in flight: the copy of a frame is recorded into its command buffer, and we
+    // only look at the buffer again once that frame's fence has signaled, so neither side ever waits on the other
+    struct ReadbackSlot
+    {
+        VkBuffer buffer = VK_NULL_HANDLE;
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        void* mapped = nullptr;
+        bool coherent = false;
+        bool pending = false;
+        uint64_t frameNumber = 0;
+    };
+    std::vector<ReadbackSlot> readbackSlots;
+    VkDeviceSize readbackFrameSize = 0;
+    ReadbackCallback readbackCallback;
+    uint64_t readbackFramesDelivered = 0;
+    uint64_t readbackBytesDelivered = 0;
+    std::chrono::steady_clock::time_point readbackStartTime;
+
+    // Benchmark and dynamic resolution. Two GPU timestamps per frame in flight, bracketing everything the frame's command buffer does
+    struct TimestampSlot
+    {
+        bool pending = false;
+        bool measured = false;
+        float renderScale = 1.0f;
+        AntiAliasing antiAliasing = AntiAliasing::None;
+    };
+    VkQueryPool timestampQueryPool = VK_NULL_HANDLE;
+    std::vector<TimestampSlot> timestampSlots;
+    float timestampPeriod = 1.0f;
+    uint64_t timestampMask = ~0ull;
+    // Blocking times of the last DrawFrame
+    FrameTiming frameTiming;
+    FrameStats frameStats;
+    // Frames submitted while this is off are warm-up and are left out of the statistics
+    bool benchmarkMeasuring = false;
+
+    // Frame counters. Filled while recording a frame, completed with its pipeline statistics once its fence signals
+    struct CounterSlot
+    {
+        bool pending = false;
+        bool measured = false;
+        FrameCounters counters;
+    };
+    bool pipelineStatisticsSupported = false;
+    VkQueryPool statisticsQueryPool = VK_NULL_HANDLE;
+    std::vector<CounterSlot> counterSlots;
+    FrameCounters lastFrameCounters;
+
+    // Not every implementation (e.g. some software rasterizers) supports anisotropic filtering
+    bool samplerAnisotropySupported = false;
+    // Without it the culled clusters are drawn with one indirect draw each
+    bool multiDrawIndirectSupported = false;
+    // VK_KHR_maintenance2, enabled when there. Without it the sRGB view of a texture would inherit the STORAGE usage
+    // the compute downsampler needs, which sRGB formats rarely support, so mips fall back to blits
+    bool maintenance2Supported = false;
+
+    // Anti-aliasing. The multisampled color and depth images are transient images of the render graph
+    AntiAliasing antiAliasing = AntiAliasing::None;
+    VkSampleCountFlagBits msaaSamples = VK_SAMPLE_COUNT_1_BIT;
+    // Set by the number keys, applied at the start of the next frame
+    std::optional<AntiAliasing> requestedAntiAliasing;
+
+    // Startup. The model is parsed on a worker from the start of Run, and queues the decode of every texture it names,
+    // while the main thread creates the device, swap chain and pipelines. Each texture is uploaded as soon as both the
+    // device and its pixels are there
+    JobSystem::Counter modelParsed;
+    std::exception_ptr modelError;
+    // Every step from the start of Run to the first frame, reported once the first frame is submitted
+    StartupTimer startupTimer;
+
+    // Capture and replay. A capture records what every frame took from outside the renderer, and a replay feeds it
+    // back in, so runs of two builds render exactly the same frames
+    CaptureWriter captureWriter;
+    CaptureReader captureReader;
+    // The inputs of the frame being recorded, written once it is submitted
+    CapturedFrame capturedFrame;
+    // What this run created, compared against the capture's when replaying
+    std::vector<std::string> createdResources;
+
+    // Spreads startup loading and per-frame CPU work, like filling drawList, over every core. Last, so the workers
+    // are stopped before anything a job might touch is destroyed
+    JobSystem jobSystem;
 
     // Helpers
-    static std::vector<const char*> GetRequiredExtensions();
+    std::vector<const char*> GetRequiredExtensions() const;
+    std::vector<const char*> GetDeviceExtensions() const;
     bool IsDeviceSuitable(VkPhysicalDevice_T* device) const;
     QueueFamilyIndices FindQueueFamilies(VkPhysicalDevice device) const;
-    static bool CheckDeviceExtensionSupport(VkPhysicalDevice_T* device);
+    bool CheckDeviceExtensionSupport(VkPhysicalDevice_T* device) const;
 
     // Checking if a swap chain is available is not sufficient, because it may not actually be compatible with our window surface.
     // We need to know
@@ -194,7 +479,6 @@ private:
     static VkPresentModeKHR ChooseSwapPresentMode(const std::vector<VkPresentModeKHR>& availablePresentModes);
     // The swap extent is the resolution of the swap chain images
     VkExtent2D ChooseSwapExtent(const VkSurfaceCapabilitiesKHR& capabilities) const;
-    uint32_t FindMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) const;
 
     // Creation Methods
     void InitWindow();
@@ -203,67 +487,166 @@ private:
     void SelectPhysicalDevice();
     void CreateLogicalDevice();
     VkSampleCountFlagBits GetMaxUsableSampleCount() const;
+    // The tiers this device and view count allow, from cheapest to best
+    [[nodiscard]] std::vector<AntiAliasing> GetSupportedAntiAliasing() const;
+    // wanted if supported, the best supported tier below it otherwise
+    [[nodiscard]] AntiAliasing FindSupportedAntiAliasing(AntiAliasing wanted) const;
+    // Rebuilds the graph and picks the pipelines for the new tier without waiting for the GPU. The frames in flight
+    // finish with the old attachments, which go through the deletion queue like on a resize
+    void SetAntiAliasing(AntiAliasing wanted);
     
     void CreateSurface();
-    void CreateSwapChain();
+    // Passing the current swap chain as oldSwapChain lets the presentation engine hand its resources over
+    void CreateSwapChain(VkSwapchainKHR oldSwapChain = VK_NULL_HANDLE);
+    // Headless replacement for the swap chain: images of the requested size that we render into and never present
+    void CreateOffscreenImages();
     void ReCreateSwapChain();
-    VkImageView CreateImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags, uint32_t mipLevels) const;
+    // More than one layer gives a 2D array view, which is what a multiview render pass renders into
+    // usage 0 keeps every usage of the image, anything else restricts the view to it, which needs VK_KHR_maintenance2
+    VkImageView CreateImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags, uint32_t mipLevels, uint32_t layerCount = 1,
+                                VkImageUsageFlags usage = 0) const;
     void CreateImageViews();
-    void CreateDescriptorSetLayout();
-    void CreateGraphicsPipeline();
-    [[nodiscard]] VkShaderModule CreateShaderModule(const std::vector<char>& code) const;
-    void CreateRenderPass();
+    // Multiview builds of shader.vert index the camera with gl_ViewIndex
+    [[nodiscard]] std::vector<ShaderDefine> GetVertexShaderDefines() const;
+    // With --lights, shader.frag is built with clustered lighting and its light buffers
+    [[nodiscard]] std::vector<ShaderDefine> GetFragmentShaderDefines() const;
+    void CreatePipelineLayout();
+    // Returns the pipeline for this permutation, creating it the first time it is requested
+    VkPipeline GetGraphicsPipeline(const PipelineKey& key);
+    // Looks up, or creates, forwardPipelines for the current render pass. Needs the model parsed
+    void UpdateForwardPipelines();
+    [[nodiscard]] VkPipeline CreateGraphicsPipeline(const PipelineKey& key) const;
+    // Returns the prepass pipeline for the current sample count, creating it the first time it is requested
+    VkPipeline GetDepthPrepassPipeline();
+    [[nodiscard]] VkPipeline CreateDepthPrepassPipeline() const;
+    [[nodiscard]] VkShaderModule CreateShaderModule(const std::vector<uint32_t>& code) const;
+    // Declares the frame's passes for the current swap chain and compiles the graph
+    void BuildRenderGraph();
+    // Turns occlusion culling off if the depth buffer can't be sampled
+    void InitOcclusionCulling();
 
     // Drawing
-    void CreateFramebuffers();
     void CreateCommandPool();
 
     // Textures
-    void CreateTextureImage();
-    void GenerateMipmaps(VkImage image, VkFormat imageFormat, int32_t texWidth, int32_t texHeight, uint32_t mipLevels) const;
-    void CreateTextureImageView();
+    // Uploads every decoded texture that isn't yet. With wait, first waits for the model and the decodes still running
+    void UploadTextures(bool wait);
+    // Creates textures[id] from its decoded pixels and builds its mip chain
+    void UploadTexture(uint32_t id);
+    // The blit fallback of mipGenerator. Expects every level in TRANSFER_DST_OPTIMAL and leaves them in SHADER_READ_ONLY_OPTIMAL
+    void GenerateMipmaps(VkCommandBuffer commandBuffer, VkImage image, int32_t texWidth, int32_t texHeight, uint32_t mipLevels) const;
+    [[nodiscard]] bool SupportsLinearBlit(VkFormat format) const;
     void CreateTextureSampler();
     void CreateImage(uint32_t width, uint32_t height, uint32_t mipLevels, VkSampleCountFlagBits numSamples, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage,
-                     VkMemoryPropertyFlags properties, VkImage& image, VkDeviceMemory& imageMemory) const;
+                     VkMemoryPropertyFlags properties, VkImage& image, VkDeviceMemory& imageMemory, uint32_t arrayLayers = 1, VkImageCreateFlags flags = 0) const;
     void TransitionImageLayout(VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout, uint32_t mipLevels);
     void CopyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height) const;
     
-    void CreateColorResources();
-    
     // Buffers
-    void CopyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size) const;
-    void CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& bufferMemory) const;
     VkCommandBuffer BeginSingleTimeCommands() const;
     void EndSingleTimeCommands(VkCommandBuffer commandBuffer) const;
 
-    void LoadModel();
-    void CreateVertexBuffer();
-    void CreateIndexBuffer();
+    // Takes the settings a capture decides from settings.replayFile
+    void LoadReplay();
+    void OpenCapture();
+    // Notes a resource for the capture, or for comparing against it when replaying
+    void AddCapturedResource(const std::string& description);
+    // Warns when the replay created other resources than the capture did, and throws when the captured draws don't
+    // fit the model
+    void CheckReplayResources() const;
+    // The captured frame that drives the frame being recorded
+    [[nodiscard]] const CapturedFrame& GetReplayFrame() const;
+
+    // Queues ParseModel on the job system, before any Vulkan object exists
+    void StartAssetLoads();
+    // Runs on a worker. Loads settings.modelPath into vertices, indices, submeshes and materials, hands out the ids of
+    // their textures and queues a decode for each
+    void ParseModel();
+    // Uploads the model into the geometry pool
+    void CreateGeometryPool();
     void CreateUniformBuffers();
     void CreateDescriptorPool();
     void CreateDescriptorSets();
     
     void CreateCommandBuffers();
     void RecordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex);
+    void RecordDepthPrepass(VkCommandBuffer commandBuffer);
+    void RecordForwardPass(VkCommandBuffer commandBuffer);
+    void UpdateModelRanges();
+    // Fills drawList with one draw per model range, or settings.drawCount draws wrapping around the ranges if that
+    // is more, and sorts it
+    void BuildDrawList();
+    // Records drawList, binding pipelines, materials and meshes only where they change from the previous draw. The
+    // depth prepass binds its own pipeline and the position buffer instead
+    void RecordDrawList(VkCommandBuffer commandBuffer, bool depthPrepass, FrameCounters& counters) const;
+    // The frame's recorded command buffer for this image, recorded again first if it is out of date
+    VkCommandBuffer GetRecordedCommandBuffer(uint32_t imageIndex);
+    // Everything recorded so far is out of date. Called whenever the graph, a pipeline or the draws change
+    void InvalidateCommandBuffers();
+    void RecordFxaa(VkCommandBuffer commandBuffer);
     void CreateSyncObjects();
+
+    // Readback
+    void CreateReadbackBuffers();
+    void RecordReadback(VkCommandBuffer commandBuffer, VkImage image) const;
+    void DeliverReadback(ReadbackSlot& slot);
+    // Hands out every copy still pending. Only call it once the device is idle
+    void FlushReadbacks();
+    void CleanupReadback();
+    void PrintReadbackStats() const;
+    static void WriteFrameToPpm(const ReadbackFrame& frame, const std::string& directory);
     static std::vector<char> ReadFile(const std::string& filename);
-    void UpdateUniformBuffer(uint32_t currentImage) const;
+    void UpdateUniformBuffer(uint32_t currentImage);
+    // Seconds of animation for the current frame. Wall clock in a window, a fixed 60Hz step per frame when headless or benchmarking, the captured time when replaying
+    float GetAnimationTime() const;
+    void LoadCameraPath();
     
     // Depth Buffer
     static bool HasStencilComponent(VkFormat format);
     VkFormat FindDepthFormat() const;
     VkFormat FindSupportedFormat(const std::vector<VkFormat>& candidates, VkImageTiling tiling, VkFormatFeatureFlags features) const;
-    void CreateDepthResources();
+    
+    // Profiler. Both do nothing unless the build has NYCSI_PROFILE=1 and a --trace file was given
+    void InitProfiler();
+    void WriteProfilerTrace() const;
+
+    // Counters
+    void CreateStatisticsQueries();
+    // Finishes the counters of the frame that last used this frame in flight slot. Its fence must have signaled
+    void CollectFrameCounters(uint32_t frame);
+
+    // Benchmark
+    void CreateTimestampQueries();
+    // Reads the GPU time of the frame that last used this frame in flight slot. Its fence must have signaled
+    void CollectGpuTime(uint32_t frame);
     
     void DrawFrame();
     void MainLoop();
-
-    void CleanupSwapChain() const;
-    void Cleanup() const;
+    void HeadlessLoop();
+    void BenchmarkLoop();
+    // Times the blit and compute mip chains of 4K and 8K textures on the GPU
+    void BenchmarkMipGeneration();
+    // Times recording every frame against reusing recorded command buffers, on the CPU
+    void BenchmarkCommandBuffers();
+    // Times sorting 100k draws by their state keys, and counts the binds the sorted order saves
+    static void BenchmarkDrawSort();
+    // Times spawning empty jobs, and a fixed workload over 1 to 64 threads
+    static void BenchmarkJobs();
+
+    // Hands every swap chain sized resource to the deletion queue, leaving the members empty for the next swap chain.
+    // Returns the swap chain itself, which is still needed as oldSwapchain
+    VkSwapchainKHR RetireSwapChainResources(uint64_t lastUsedFrame);
+    // Hands the graph's images and everything created for them to the deletion queue, ready for BuildRenderGraph
+    void RetireRenderGraph(uint64_t lastUsedFrame);
+    void PrintSwapChainStats() const;
+    void CleanupSwapChain();
+    void Cleanup();
     static void PopulateDebugMessengerCreateInfo(VkDebugUtilsMessengerCreateInfoEXT& createInfo);
     void SetupDebugMessenger();
 
     static void FramebufferResizeCallback(GLFWwindow* window, int width, int height);
+    // Keys 1 to 5 pick the anti-aliasing tier, in the order of AntiAliasing
+    static void KeyCallback(GLFWwindow* window, int key, int scancode, int action, int mods);
     
     static bool CheckValidationLayerSupport();
     static VkBool32 DebugCallback(